@@ -0,0 +1,299 @@
+/*
+ * Copyright (C) 2021 Ole André Vadla Ravnås <oleavr@nowsecure.com>
+ *
+ * Licence: wxWindows Library Licence, Version 3.1
+ */
+
+#include "gummessagebatcher.h"
+
+#include <string.h>
+
+#define GUM_MESSAGE_BATCH_NO_DATA G_MAXUINT32
+
+typedef struct _GumMessageFrame GumMessageFrame;
+
+/*
+ * Messages are coalesced into a single frame, delivered as one message of
+ * type "batch" whose data is the frame. Each record in the frame is laid out
+ * as:
+ *
+ *   guint32 message_size (little-endian)
+ *   guint32 data_size    (little-endian, G_MAXUINT32 if there is no data)
+ *   gchar   message[message_size]
+ *   guint8  data[data_size]
+ *
+ * A frame is flushed once it reaches max_size bytes, or max_delay ms after
+ * its first record was added, whichever comes first.
+ *
+ * Full frames are queued with the mutex held and delivered after dropping it,
+ * so a slow consumer never stalls threads that are adding messages. Only one
+ * thread drains the queue at a time, which keeps frames in order. Messages
+ * added after free() are passed through on their own, as an emitter may
+ * still hold a reference to a batcher that was just swapped out. The pending
+ * timer keeps its own reference, as it may already be dispatching when free()
+ * destroys it.
+ */
+struct _GumMessageBatcher
+{
+  gint ref_count;
+  GMutex mutex;
+  gboolean closed;
+
+  GByteArray * frame;
+  guint count;
+  GSource * timer;
+
+  GQueue ready;
+  gboolean draining;
+
+  gsize max_size;
+  guint max_delay;
+  GMainContext * main_context;
+  GumMessageBatchFunc func;
+  gpointer user_data;
+};
+
+struct _GumMessageFrame
+{
+  GByteArray * data;
+  guint count;
+};
+
+static void gum_message_batcher_enqueue_frame (GumMessageBatcher * self);
+static void gum_message_batcher_drain (GumMessageBatcher * self);
+static void gum_message_batcher_cancel_timer (GumMessageBatcher * self);
+static void gum_message_frame_free (GumMessageFrame * frame);
+static gboolean gum_message_batcher_on_timeout (GumMessageBatcher * self);
+
+GumMessageBatcher *
+gum_message_batcher_new (gsize max_size,
+                         guint max_delay,
+                         GMainContext * main_context,
+                         GumMessageBatchFunc func,
+                         gpointer user_data)
+{
+  GumMessageBatcher * batcher;
+
+  batcher = g_slice_new0 (GumMessageBatcher);
+  batcher->ref_count = 1;
+
+  g_mutex_init (&batcher->mutex);
+
+  g_queue_init (&batcher->ready);
+
+  batcher->max_size = max_size;
+  batcher->max_delay = max_delay;
+  batcher->main_context = g_main_context_ref (main_context);
+  batcher->func = func;
+  batcher->user_data = user_data;
+
+  return batcher;
+}
+
+void
+gum_message_batcher_free (GumMessageBatcher * self)
+{
+  g_mutex_lock (&self->mutex);
+  gum_message_batcher_cancel_timer (self);
+  g_clear_pointer (&self->frame, g_byte_array_unref);
+  self->count = 0;
+  self->closed = TRUE;
+  g_mutex_unlock (&self->mutex);
+
+  gum_message_batcher_unref (self);
+}
+
+GumMessageBatcher *
+gum_message_batcher_ref (GumMessageBatcher * self)
+{
+  g_atomic_int_inc (&self->ref_count);
+
+  return self;
+}
+
+void
+gum_message_batcher_unref (GumMessageBatcher * self)
+{
+  if (!g_atomic_int_dec_and_test (&self->ref_count))
+    return;
+
+  g_queue_clear_full (&self->ready, (GDestroyNotify) gum_message_frame_free);
+
+  g_main_context_unref (self->main_context);
+
+  g_mutex_clear (&self->mutex);
+
+  g_slice_free (GumMessageBatcher, self);
+}
+
+void
+gum_message_batcher_add (GumMessageBatcher * self,
+                         const gchar * message,
+                         GBytes * data)
+{
+  guint32 message_size, data_size, header[2];
+  gconstpointer data_bytes;
+  gsize size;
+  gboolean frame_ready = FALSE;
+
+  message_size = strlen (message);
+  if (data != NULL)
+  {
+    data_bytes = g_bytes_get_data (data, &size);
+    data_size = size;
+  }
+  else
+  {
+    data_bytes = NULL;
+    data_size = GUM_MESSAGE_BATCH_NO_DATA;
+  }
+
+  header[0] = GUINT32_TO_LE (message_size);
+  header[1] = GUINT32_TO_LE (data_size);
+
+  g_mutex_lock (&self->mutex);
+
+  if (self->closed)
+    goto closed;
+
+  if (self->frame == NULL)
+    self->frame = g_byte_array_sized_new (self->max_size);
+
+  g_byte_array_append (self->frame, (const guint8 *) header, sizeof (header));
+  g_byte_array_append (self->frame, (const guint8 *) message, message_size);
+  if (data_bytes != NULL)
+    g_byte_array_append (self->frame, data_bytes, data_size);
+  self->count++;
+
+  if (self->frame->len >= self->max_size)
+  {
+    gum_message_batcher_enqueue_frame (self);
+    frame_ready = TRUE;
+  }
+  else if (self->timer == NULL)
+  {
+    GSource * timer;
+
+    timer = g_timeout_source_new (self->max_delay);
+    g_source_set_callback (timer,
+        (GSourceFunc) gum_message_batcher_on_timeout,
+        gum_message_batcher_ref (self),
+        (GDestroyNotify) gum_message_batcher_unref);
+    g_source_attach (timer, self->main_context);
+
+    self->timer = timer;
+  }
+
+  g_mutex_unlock (&self->mutex);
+
+  if (frame_ready)
+    gum_message_batcher_drain (self);
+
+  return;
+
+closed:
+  {
+    g_mutex_unlock (&self->mutex);
+
+    self->func (message, data, self->user_data);
+
+    return;
+  }
+}
+
+void
+gum_message_batcher_flush (GumMessageBatcher * self)
+{
+  g_mutex_lock (&self->mutex);
+  if (!self->closed)
+    gum_message_batcher_enqueue_frame (self);
+  g_mutex_unlock (&self->mutex);
+
+  gum_message_batcher_drain (self);
+}
+
+static void
+gum_message_batcher_enqueue_frame (GumMessageBatcher * self)
+{
+  GumMessageFrame * frame;
+
+  gum_message_batcher_cancel_timer (self);
+
+  if (self->frame == NULL)
+    return;
+
+  frame = g_slice_new (GumMessageFrame);
+  frame->data = self->frame;
+  frame->count = self->count;
+  g_queue_push_tail (&self->ready, frame);
+
+  self->frame = NULL;
+  self->count = 0;
+}
+
+static void
+gum_message_batcher_drain (GumMessageBatcher * self)
+{
+  GumMessageFrame * frame;
+
+  g_mutex_lock (&self->mutex);
+
+  if (self->draining)
+  {
+    /* The thread already draining will get to our frames too. */
+    g_mutex_unlock (&self->mutex);
+    return;
+  }
+  self->draining = TRUE;
+
+  while ((frame = g_queue_pop_head (&self->ready)) != NULL)
+  {
+    gchar * message;
+    GBytes * data;
+
+    g_mutex_unlock (&self->mutex);
+
+    message = g_strdup_printf ("{\"type\":\"batch\",\"count\":%u}",
+        frame->count);
+    data = g_byte_array_free_to_bytes (frame->data);
+    g_slice_free (GumMessageFrame, frame);
+
+    self->func (message, data, self->user_data);
+
+    g_bytes_unref (data);
+    g_free (message);
+
+    g_mutex_lock (&self->mutex);
+  }
+
+  self->draining = FALSE;
+
+  g_mutex_unlock (&self->mutex);
+}
+
+static void
+gum_message_batcher_cancel_timer (GumMessageBatcher * self)
+{
+  if (self->timer == NULL)
+    return;
+
+  g_source_destroy (self->timer);
+  g_source_unref (self->timer);
+  self->timer = NULL;
+}
+
+static void
+gum_message_frame_free (GumMessageFrame * frame)
+{
+  g_byte_array_unref (frame->data);
+
+  g_slice_free (GumMessageFrame, frame);
+}
+
+static gboolean
+gum_message_batcher_on_timeout (GumMessageBatcher * self)
+{
+  gum_message_batcher_flush (self);
+
+  return G_SOURCE_REMOVE;
+}
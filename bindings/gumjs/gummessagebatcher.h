@@ -0,0 +1,33 @@
+/*
+ * Copyright (C) 2021 Ole André Vadla Ravnås <oleavr@nowsecure.com>
+ *
+ * Licence: wxWindows Library Licence, Version 3.1
+ */
+
+#ifndef __GUM_MESSAGE_BATCHER_H__
+#define __GUM_MESSAGE_BATCHER_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _GumMessageBatcher GumMessageBatcher;
+
+typedef void (* GumMessageBatchFunc) (const gchar * message, GBytes * data,
+    gpointer user_data);
+
+G_GNUC_INTERNAL GumMessageBatcher * gum_message_batcher_new (gsize max_size,
+    guint max_delay, GMainContext * main_context, GumMessageBatchFunc func,
+    gpointer user_data);
+G_GNUC_INTERNAL void gum_message_batcher_free (GumMessageBatcher * self);
+G_GNUC_INTERNAL GumMessageBatcher * gum_message_batcher_ref (
+    GumMessageBatcher * self);
+G_GNUC_INTERNAL void gum_message_batcher_unref (GumMessageBatcher * self);
+
+G_GNUC_INTERNAL void gum_message_batcher_add (GumMessageBatcher * self,
+    const gchar * message, GBytes * data);
+G_GNUC_INTERNAL void gum_message_batcher_flush (GumMessageBatcher * self);
+
+G_END_DECLS
+
+#endif
@@ -14,6 +14,8 @@
     (gum_quick_js_call_listener_get_type ())
 #define GUM_QUICK_TYPE_JS_PROBE_LISTENER \
     (gum_quick_js_probe_listener_get_type ())
+#define GUM_QUICK_TYPE_JS_ISOLATED_LISTENER \
+    (gum_quick_js_isolated_listener_get_type ())
 #define GUM_QUICK_TYPE_C_CALL_LISTENER \
     (gum_quick_c_call_listener_get_type ())
 #define GUM_QUICK_TYPE_C_PROBE_LISTENER \
@@ -28,6 +30,9 @@
 #define GUM_QUICK_JS_PROBE_LISTENER(obj) \
     G_TYPE_CHECK_INSTANCE_CAST (obj, GUM_QUICK_TYPE_JS_PROBE_LISTENER, \
         GumQuickJSProbeListener)
+#define GUM_QUICK_JS_ISOLATED_LISTENER(obj) \
+    G_TYPE_CHECK_INSTANCE_CAST (obj, GUM_QUICK_TYPE_JS_ISOLATED_LISTENER, \
+        GumQuickJSIsolatedListener)
 #define GUM_QUICK_C_CALL_LISTENER(obj) \
     G_TYPE_CHECK_INSTANCE_CAST (obj, GUM_QUICK_TYPE_C_CALL_LISTENER, \
         GumQuickCCallListener)
@@ -41,6 +46,8 @@
     ((GumQuickJSCallListener *) (obj))
 #define GUM_QUICK_JS_PROBE_LISTENER_CAST(obj) \
     ((GumQuickJSProbeListener *) (obj))
+#define GUM_QUICK_JS_ISOLATED_LISTENER_CAST(obj) \
+    ((GumQuickJSIsolatedListener *) (obj))
 #define GUM_QUICK_C_CALL_LISTENER_CAST(obj) \
     ((GumQuickCCallListener *) (obj))
 #define GUM_QUICK_C_PROBE_LISTENER_CAST(obj) \
@@ -52,12 +59,18 @@ typedef struct _GumQuickJSCallListener GumQuickJSCallListener;
 typedef struct _GumQuickJSCallListenerClass GumQuickJSCallListenerClass;
 typedef struct _GumQuickJSProbeListener GumQuickJSProbeListener;
 typedef struct _GumQuickJSProbeListenerClass GumQuickJSProbeListenerClass;
+typedef struct _GumQuickJSIsolatedListener GumQuickJSIsolatedListener;
+typedef struct _GumQuickJSIsolatedListenerClass
+    GumQuickJSIsolatedListenerClass;
 typedef struct _GumQuickCCallListener GumQuickCCallListener;
 typedef struct _GumQuickCCallListenerClass GumQuickCCallListenerClass;
 typedef struct _GumQuickCProbeListener GumQuickCProbeListener;
 typedef struct _GumQuickCProbeListenerClass GumQuickCProbeListenerClass;
 typedef struct _GumQuickInvocationState GumQuickInvocationState;
+typedef struct _GumQuickIsolatedCallbacks GumQuickIsolatedCallbacks;
+typedef struct _GumQuickIsolatedForgetJob GumQuickIsolatedForgetJob;
 typedef struct _GumQuickReplaceEntry GumQuickReplaceEntry;
+typedef struct _GumQuickStatsCollectContext GumQuickStatsCollectContext;
 
 typedef void (* GumQuickCHook) (GumInvocationContext * ic);
 
@@ -100,6 +113,20 @@ struct _GumQuickJSProbeListenerClass
   GumQuickInvocationListenerClass listener_class;
 };
 
+struct _GumQuickJSIsolatedListener
+{
+  GumQuickInvocationListener listener;
+
+  guint id;
+  GBytes * on_enter;
+  GBytes * on_leave;
+};
+
+struct _GumQuickJSIsolatedListenerClass
+{
+  GumQuickInvocationListenerClass listener_class;
+};
+
 struct _GumQuickCCallListener
 {
   GumQuickInvocationListener listener;
@@ -130,6 +157,20 @@ struct _GumQuickInvocationState
   GumQuickInvocationContext * jic;
 };
 
+struct _GumQuickIsolatedCallbacks
+{
+  JSValue on_enter;
+  JSValue on_leave;
+
+  JSContext * ctx;
+};
+
+struct _GumQuickIsolatedForgetJob
+{
+  GumQuickScript * script;
+  guint id;
+};
+
 struct _GumQuickInvocationArgs
 {
   JSValue wrapper;
@@ -154,10 +195,27 @@ struct _GumQuickReplaceEntry
   JSContext * ctx;
 };
 
+struct _GumQuickStatsCollectContext
+{
+  JSValue result;
+  guint index;
+
+  JSContext * ctx;
+  GumQuickCore * core;
+};
+
 static gboolean gum_quick_interceptor_on_flush_timer_tick (
     GumQuickInterceptor * self);
 
 GUMJS_DECLARE_FUNCTION (gumjs_interceptor_attach)
+static gboolean gum_quick_interceptor_targets_get (JSContext * ctx,
+    JSValueConst val, GumQuickCore * core, GArray ** targets);
+static gboolean gum_quick_callbacks_are_isolated (JSContext * ctx,
+    JSValue callbacks);
+static gboolean gum_quick_isolated_code_compile (JSContext * ctx,
+    JSValue func, const gchar * name, GBytes ** code);
+static JSValue gum_quick_isolated_code_instantiate (GBytes * code,
+    GumQuickScope * scope);
 static void gum_quick_invocation_listener_destroy (
     GumQuickInvocationListener * listener);
 static void gum_quick_interceptor_detach (GumQuickInterceptor * self,
@@ -169,6 +227,11 @@ static void gum_quick_replace_entry_revert_and_free (
     GumQuickReplaceEntry * entry);
 GUMJS_DECLARE_FUNCTION (gumjs_interceptor_revert)
 GUMJS_DECLARE_FUNCTION (gumjs_interceptor_flush)
+GUMJS_DECLARE_FUNCTION (gumjs_interceptor_set_stats_enabled)
+GUMJS_DECLARE_FUNCTION (gumjs_interceptor_enumerate_stats)
+static gboolean gum_quick_interceptor_collect_stats (const GumHookStats * stats,
+    GumQuickStatsCollectContext * sc);
+GUMJS_DECLARE_FUNCTION (gumjs_interceptor_reset_stats)
 
 GUMJS_DECLARE_FUNCTION (gumjs_invocation_listener_detach)
 static void gum_quick_invocation_listener_dispose (GObject * object);
@@ -187,6 +250,12 @@ static void gum_quick_js_call_listener_on_enter (
     GumInvocationListener * listener, GumInvocationContext * ic);
 static void gum_quick_js_call_listener_on_leave (
     GumInvocationListener * listener, GumInvocationContext * ic);
+static void gum_quick_interceptor_invoke_on_enter (GumQuickInterceptor * self,
+    GumQuickScope * scope, JSValue on_enter, gboolean has_on_leave,
+    GumInvocationContext * ic, GumQuickInvocationState * state);
+static void gum_quick_interceptor_invoke_on_leave (GumQuickInterceptor * self,
+    GumQuickScope * scope, JSValue on_leave, gboolean has_on_enter,
+    GumInvocationContext * ic, GumQuickInvocationState * state);
 G_DEFINE_TYPE_EXTENDED (GumQuickJSCallListener,
                         gum_quick_js_call_listener,
                         GUM_QUICK_TYPE_INVOCATION_LISTENER,
@@ -206,6 +275,27 @@ G_DEFINE_TYPE_EXTENDED (GumQuickJSProbeListener,
                         G_IMPLEMENT_INTERFACE (GUM_TYPE_INVOCATION_LISTENER,
                             gum_quick_js_probe_listener_iface_init))
 
+static void gum_quick_js_isolated_listener_iface_init (gpointer g_iface,
+    gpointer iface_data);
+static void gum_quick_js_isolated_listener_dispose (GObject * object);
+static void gum_quick_js_isolated_listener_finalize (GObject * object);
+static void gum_quick_isolated_forget_job_run (
+    GumQuickIsolatedForgetJob * job);
+static void gum_quick_isolated_forget_job_free (
+    GumQuickIsolatedForgetJob * job);
+static void gum_quick_isolated_callbacks_forget (GumQuickCore * core,
+    gpointer id);
+static void gum_quick_js_isolated_listener_on_enter (
+    GumInvocationListener * listener, GumInvocationContext * ic);
+static void gum_quick_js_isolated_listener_on_leave (
+    GumInvocationListener * listener, GumInvocationContext * ic);
+G_DEFINE_TYPE_EXTENDED (GumQuickJSIsolatedListener,
+                        gum_quick_js_isolated_listener,
+                        GUM_QUICK_TYPE_INVOCATION_LISTENER,
+                        0,
+                        G_IMPLEMENT_INTERFACE (GUM_TYPE_INVOCATION_LISTENER,
+                            gum_quick_js_isolated_listener_iface_init))
+
 static void gum_quick_c_call_listener_iface_init (gpointer g_iface,
     gpointer iface_data);
 static void gum_quick_c_call_listener_dispose (GObject * object);
@@ -278,6 +368,11 @@ static GumQuickInvocationRetval *
 gum_quick_interceptor_obtain_invocation_retval (GumQuickInterceptor * self);
 static void gum_quick_interceptor_release_invocation_retval (
     GumQuickInterceptor * self, GumQuickInvocationRetval * retval);
+static GumQuickIsolatedCallbacks *
+gum_quick_interceptor_obtain_isolated_callbacks (GumQuickInterceptor * self,
+    GumQuickJSIsolatedListener * listener, GumQuickScope * scope);
+static void gum_quick_isolated_callbacks_free (
+    GumQuickIsolatedCallbacks * callbacks);
 
 static const JSCFunctionListEntry gumjs_interceptor_entries[] =
 {
@@ -286,6 +381,9 @@ static const JSCFunctionListEntry gumjs_interceptor_entries[] =
   JS_CFUNC_DEF ("_replace", 0, gumjs_interceptor_replace),
   JS_CFUNC_DEF ("revert", 0, gumjs_interceptor_revert),
   JS_CFUNC_DEF ("flush", 0, gumjs_interceptor_flush),
+  JS_CFUNC_DEF ("_setStatsEnabled", 0, gumjs_interceptor_set_stats_enabled),
+  JS_CFUNC_DEF ("enumerateStats", 0, gumjs_interceptor_enumerate_stats),
+  JS_CFUNC_DEF ("resetStats", 0, gumjs_interceptor_reset_stats),
 };
 
 static const JSClassDef gumjs_invocation_listener_def =
@@ -356,7 +454,10 @@ _gum_quick_interceptor_init (GumQuickInterceptor * self,
       (GDestroyNotify) gum_quick_invocation_listener_destroy);
   self->replacement_by_address = g_hash_table_new_full (NULL, NULL, NULL,
       (GDestroyNotify) gum_quick_replace_entry_revert_and_free);
+  self->isolated_callbacks = g_hash_table_new_full (NULL, NULL, NULL,
+      (GDestroyNotify) gum_quick_isolated_callbacks_free);
   self->flush_timer = NULL;
+  self->stats_enabled = FALSE;
 
   _gum_quick_core_store_module_data (core, "interceptor", self);
 
@@ -406,6 +507,12 @@ _gum_quick_interceptor_flush (GumQuickInterceptor * self)
 
   _gum_quick_scope_suspend (&scope);
 
+  if (self->stats_enabled)
+  {
+    gum_interceptor_set_stats_enabled (self->interceptor, FALSE);
+    self->stats_enabled = FALSE;
+  }
+
   flushed = gum_interceptor_flush (self->interceptor);
 
   _gum_quick_scope_resume (&scope);
@@ -455,6 +562,8 @@ _gum_quick_interceptor_dispose (GumQuickInterceptor * self)
 {
   g_assert (self->flush_timer == NULL);
 
+  g_hash_table_remove_all (self->isolated_callbacks);
+
   gum_quick_invocation_context_release (self->cached_invocation_context);
   gum_quick_invocation_args_release (self->cached_invocation_args);
   gum_quick_invocation_retval_release (self->cached_invocation_retval);
@@ -465,6 +574,7 @@ _gum_quick_interceptor_finalize (GumQuickInterceptor * self)
 {
   g_clear_pointer (&self->invocation_listeners, g_hash_table_unref);
   g_clear_pointer (&self->replacement_by_address, g_hash_table_unref);
+  g_clear_pointer (&self->isolated_callbacks, g_hash_table_unref);
 
   g_clear_pointer (&self->interceptor, g_object_unref);
 }
@@ -482,19 +592,28 @@ GUMJS_DEFINE_FUNCTION (gumjs_interceptor_attach)
   JSValue data_val = args->elements[2];
   GumQuickInterceptor * self;
   gpointer target, cb_ptr;
+  GArray * targets = NULL;
   GumQuickInvocationListener * listener = NULL;
   gpointer listener_function_data;
   GumAttachReturn attach_ret;
 
   self = gumjs_get_parent_module (core);
 
+  if (JS_IsArray (ctx, target_val))
+  {
+    if (!gum_quick_interceptor_targets_get (ctx, target_val, core, &targets))
+      goto propagate_exception;
+    target = NULL;
+  }
+  else if (!_gum_quick_native_pointer_get (ctx, target_val, core, &target))
+  {
+    goto propagate_exception;
+  }
+
   if (JS_IsFunction (ctx, cb_val))
   {
     GumQuickJSProbeListener * l;
 
-    if (!_gum_quick_native_pointer_get (ctx, target_val, core, &target))
-      goto propagate_exception;
-
     l = g_object_new (GUM_QUICK_TYPE_JS_PROBE_LISTENER, NULL);
     l->on_hit = JS_DupValue (ctx, cb_val);
 
@@ -504,9 +623,6 @@ GUMJS_DEFINE_FUNCTION (gumjs_interceptor_attach)
   {
     GumQuickCProbeListener * l;
 
-    if (!_gum_quick_native_pointer_get (ctx, target_val, core, &target))
-      goto propagate_exception;
-
     l = g_object_new (GUM_QUICK_TYPE_C_PROBE_LISTENER, NULL);
     l->on_hit = GUM_POINTER_TO_FUNCPTR (GumQuickCHook, cb_ptr);
 
@@ -514,15 +630,40 @@ GUMJS_DEFINE_FUNCTION (gumjs_interceptor_attach)
   }
   else
   {
-    JSValue on_enter_js, on_leave_js;
+    JSValue target_js, on_enter_js, on_leave_js;
     GumQuickCHook on_enter_c, on_leave_c;
 
-    if (!_gum_quick_args_parse (args, "pF*{onEnter?,onLeave?}", &target,
+    if (!_gum_quick_args_parse (args, "VF*{onEnter?,onLeave?}", &target_js,
         &on_enter_js, &on_enter_c,
         &on_leave_js, &on_leave_c))
       goto propagate_exception;
 
-    if (!JS_IsNull (on_enter_js) || !JS_IsNull (on_leave_js))
+    if ((!JS_IsNull (on_enter_js) || !JS_IsNull (on_leave_js)) &&
+        gum_quick_callbacks_are_isolated (ctx, cb_val))
+    {
+      GumQuickJSIsolatedListener * l;
+      GBytes * on_enter_code, * on_leave_code;
+
+      if (!gum_quick_isolated_code_compile (ctx, on_enter_js, "onEnter",
+          &on_enter_code))
+        goto propagate_exception;
+
+      if (!gum_quick_isolated_code_compile (ctx, on_leave_js, "onLeave",
+          &on_leave_code))
+      {
+        g_clear_pointer (&on_enter_code, g_bytes_unref);
+        goto propagate_exception;
+      }
+
+      _gum_quick_script_create_isolates (core->script);
+
+      l = g_object_new (GUM_QUICK_TYPE_JS_ISOLATED_LISTENER, NULL);
+      l->on_enter = on_enter_code;
+      l->on_leave = on_leave_code;
+
+      listener = GUM_QUICK_INVOCATION_LISTENER (l);
+    }
+    else if (!JS_IsNull (on_enter_js) || !JS_IsNull (on_leave_js))
     {
       GumQuickJSCallListener * l;
 
@@ -561,8 +702,44 @@ GUMJS_DEFINE_FUNCTION (gumjs_interceptor_attach)
 
   listener->parent = self;
 
-  attach_ret = gum_interceptor_attach (self->interceptor, target,
-      GUM_INVOCATION_LISTENER (listener), listener_function_data);
+  if (targets != NULL)
+  {
+    GumAttachReturn * results;
+    guint i;
+
+    results = g_new (GumAttachReturn, targets->len);
+
+    gum_interceptor_attach_many (self->interceptor,
+        (const gpointer *) targets->data, targets->len,
+        GUM_INVOCATION_LISTENER (listener), listener_function_data, results);
+
+    attach_ret = GUM_ATTACH_OK;
+    for (i = 0; i != targets->len; i++)
+    {
+      if (results[i] != GUM_ATTACH_OK)
+      {
+        attach_ret = results[i];
+        target = g_array_index (targets, gpointer, i);
+        break;
+      }
+    }
+
+    g_free (results);
+
+    if (attach_ret != GUM_ATTACH_OK)
+    {
+      gum_interceptor_detach (self->interceptor,
+          GUM_INVOCATION_LISTENER (listener));
+    }
+
+    g_array_free (targets, TRUE);
+    targets = NULL;
+  }
+  else
+  {
+    attach_ret = gum_interceptor_attach (self->interceptor, target,
+        GUM_INVOCATION_LISTENER (listener), listener_function_data);
+  }
 
   if (attach_ret != GUM_ATTACH_OK)
     goto unable_to_attach;
@@ -592,6 +769,10 @@ unable_to_attach:
       case GUM_ATTACH_POLICY_VIOLATION:
         _gum_quick_throw_literal (ctx, "not permitted by code-signing policy");
         break;
+      case GUM_ATTACH_WRONG_TYPE:
+        _gum_quick_throw_literal (ctx, "function is replaced using the fast "
+            "path and cannot be attached to");
+        break;
       default:
         g_assert_not_reached ();
     }
@@ -606,11 +787,167 @@ expected_callback:
 propagate_exception:
   {
     g_clear_object (&listener);
+    if (targets != NULL)
+      g_array_free (targets, TRUE);
 
     return JS_EXCEPTION;
   }
 }
 
+static gboolean
+gum_quick_interceptor_targets_get (JSContext * ctx,
+                                   JSValueConst val,
+                                   GumQuickCore * core,
+                                   GArray ** targets)
+{
+  GArray * result;
+  JSValue element = JS_NULL;
+  guint n, i;
+
+  if (!_gum_quick_array_get_length (ctx, val, core, &n))
+    return FALSE;
+
+  result = g_array_sized_new (FALSE, FALSE, sizeof (gpointer), n);
+
+  for (i = 0; i != n; i++)
+  {
+    gpointer target;
+
+    element = JS_GetPropertyUint32 (ctx, val, i);
+    if (JS_IsException (element))
+      goto propagate_exception;
+
+    if (!_gum_quick_native_pointer_get (ctx, element, core, &target))
+      goto propagate_exception;
+
+    g_array_append_val (result, target);
+
+    JS_FreeValue (ctx, element);
+    element = JS_NULL;
+  }
+
+  *targets = result;
+  return TRUE;
+
+propagate_exception:
+  {
+    JS_FreeValue (ctx, element);
+    g_array_free (result, TRUE);
+
+    return FALSE;
+  }
+}
+
+static gboolean
+gum_quick_callbacks_are_isolated (JSContext * ctx,
+                                  JSValue callbacks)
+{
+  JSValue val;
+  gboolean isolated;
+
+  val = JS_GetPropertyStr (ctx, callbacks, "isolated");
+  isolated = JS_ToBool (ctx, val) == 1;
+  JS_FreeValue (ctx, val);
+
+  return isolated;
+}
+
+/*
+ * Isolated callbacks run in one of the script's isolates, which are separate
+ * runtimes, so they cannot share the function object itself. Instead we
+ * recompile its source into bytecode that each isolate instantiates on first
+ * use. This means such callbacks must be self-contained, i.e. not close over
+ * any state from the script that attached them.
+ */
+static gboolean
+gum_quick_isolated_code_compile (JSContext * ctx,
+                                 JSValue func,
+                                 const gchar * name,
+                                 GBytes ** code)
+{
+  const char * source;
+  gchar * program;
+  JSValue val;
+  uint8_t * bytecode;
+  size_t size;
+
+  *code = NULL;
+
+  if (JS_IsNull (func))
+    return TRUE;
+
+  source = JS_ToCString (ctx, func);
+  if (source == NULL)
+    return FALSE;
+
+  program = g_strconcat ("(", source, ")", NULL);
+  val = JS_Eval (ctx, program, strlen (program), "/_isolated.js",
+      JS_EVAL_TYPE_GLOBAL | JS_EVAL_FLAG_STRICT | JS_EVAL_FLAG_COMPILE_ONLY);
+  g_free (program);
+
+  if (JS_IsException (val))
+  {
+    JS_FreeValue (ctx, JS_GetException (ctx));
+
+    /* Method shorthand, e.g. `onEnter(args) { ... }`. */
+    program = g_strconcat ("({", source, "}).", name, NULL);
+    val = JS_Eval (ctx, program, strlen (program), "/_isolated.js",
+        JS_EVAL_TYPE_GLOBAL | JS_EVAL_FLAG_STRICT | JS_EVAL_FLAG_COMPILE_ONLY);
+    g_free (program);
+  }
+
+  JS_FreeCString (ctx, source);
+
+  if (JS_IsException (val))
+    return FALSE;
+
+  bytecode = JS_WriteObject (ctx, &size, val, JS_WRITE_OBJ_BYTECODE);
+  JS_FreeValue (ctx, val);
+
+  *code = g_bytes_new (bytecode, size);
+  js_free (ctx, bytecode);
+
+  return TRUE;
+}
+
+static JSValue
+gum_quick_isolated_code_instantiate (GBytes * code,
+                                     GumQuickScope * scope)
+{
+  JSContext * ctx = scope->core->ctx;
+  gconstpointer bytecode;
+  gsize size;
+  JSValue val, func;
+
+  if (code == NULL)
+    return JS_NULL;
+
+  bytecode = g_bytes_get_data (code, &size);
+
+  val = JS_ReadObject (ctx, bytecode, size, JS_READ_OBJ_BYTECODE);
+  if (JS_IsException (val))
+    goto propagate_exception;
+
+  func = JS_EvalFunction (ctx, val);
+  if (JS_IsException (func))
+    goto propagate_exception;
+
+  if (!JS_IsFunction (ctx, func))
+  {
+    JS_FreeValue (ctx, func);
+    return JS_NULL;
+  }
+
+  return func;
+
+propagate_exception:
+  {
+    _gum_quick_scope_catch_and_emit (scope);
+
+    return JS_NULL;
+  }
+}
+
 static void
 gum_quick_invocation_listener_destroy (GumQuickInvocationListener * listener)
 {
@@ -683,6 +1020,9 @@ unable_to_replace:
       case GUM_REPLACE_POLICY_VIOLATION:
         _gum_quick_throw_literal (ctx, "not permitted by code-signing policy");
         break;
+      case GUM_REPLACE_WRONG_TYPE:
+        _gum_quick_throw_literal (ctx, "already replaced this function");
+        break;
       default:
         g_assert_not_reached ();
     }
@@ -741,6 +1081,75 @@ GUMJS_DEFINE_FUNCTION (gumjs_interceptor_flush)
   return JS_UNDEFINED;
 }
 
+GUMJS_DEFINE_FUNCTION (gumjs_interceptor_set_stats_enabled)
+{
+  GumQuickInterceptor * self;
+  gboolean enabled;
+
+  self = gumjs_get_parent_module (core);
+
+  if (!_gum_quick_args_parse (args, "t", &enabled))
+    return JS_EXCEPTION;
+
+  gum_interceptor_set_stats_enabled (self->interceptor, enabled);
+  self->stats_enabled = enabled;
+
+  return JS_UNDEFINED;
+}
+
+GUMJS_DEFINE_FUNCTION (gumjs_interceptor_enumerate_stats)
+{
+  GumQuickInterceptor * self;
+  GumQuickStatsCollectContext sc;
+
+  self = gumjs_get_parent_module (core);
+
+  sc.result = JS_NewArray (ctx);
+  sc.index = 0;
+  sc.ctx = ctx;
+  sc.core = core;
+
+  gum_interceptor_enumerate_stats (self->interceptor,
+      (GumFoundHookStatsFunc) gum_quick_interceptor_collect_stats, &sc);
+
+  return sc.result;
+}
+
+static gboolean
+gum_quick_interceptor_collect_stats (const GumHookStats * stats,
+                                     GumQuickStatsCollectContext * sc)
+{
+  JSContext * ctx = sc->ctx;
+  JSValue s;
+
+  s = JS_NewObject (ctx);
+  JS_DefinePropertyValueStr (ctx, s, "target",
+      _gum_quick_native_pointer_new (ctx, stats->function_address, sc->core),
+      JS_PROP_C_W_E);
+  JS_DefinePropertyValueStr (ctx, s, "enters",
+      JS_NewInt64 (ctx, stats->enter_count), JS_PROP_C_W_E);
+  JS_DefinePropertyValueStr (ctx, s, "leaves",
+      JS_NewInt64 (ctx, stats->leave_count), JS_PROP_C_W_E);
+  JS_DefinePropertyValueStr (ctx, s, "bypasses",
+      JS_NewInt64 (ctx, stats->bypass_count), JS_PROP_C_W_E);
+  JS_DefinePropertyValueStr (ctx, s, "listenerTime",
+      JS_NewInt64 (ctx, stats->listener_time), JS_PROP_C_W_E);
+
+  JS_DefinePropertyValueUint32 (ctx, sc->result, sc->index++, s,
+      JS_PROP_C_W_E);
+
+  return TRUE;
+}
+
+GUMJS_DEFINE_FUNCTION (gumjs_interceptor_reset_stats)
+{
+  GumQuickInterceptor * self = gumjs_get_parent_module (core);
+
+  gum_interceptor_reset_stats (self->interceptor);
+
+  return JS_UNDEFINED;
+}
+
 GUMJS_DEFINE_FUNCTION (gumjs_invocation_listener_detach)
 {
   GumQuickInterceptor * parent;
@@ -860,37 +1269,13 @@ gum_quick_js_call_listener_on_enter (GumInvocationListener * listener,
   {
     GumQuickInterceptor * parent;
     GumQuickScope scope;
-    GumQuickInvocationContext * jic;
-    GumQuickInvocationArgs * args;
-    gboolean jic_is_dirty;
 
     parent = GUM_QUICK_INVOCATION_LISTENER_CAST (listener)->parent;
 
     _gum_quick_scope_enter (&scope, parent->core);
 
-    jic = _gum_quick_interceptor_obtain_invocation_context (parent);
-    _gum_quick_invocation_context_reset (jic, ic);
-
-    args = gum_quick_interceptor_obtain_invocation_args (parent);
-    gum_quick_invocation_args_reset (args, ic);
-
-    _gum_quick_scope_call_void (&scope, self->on_enter, jic->wrapper, 1,
-        &args->wrapper);
-
-    gum_quick_invocation_args_reset (args, NULL);
-    gum_quick_interceptor_release_invocation_args (parent, args);
-
-    _gum_quick_invocation_context_reset (jic, NULL);
-    gum_quick_interceptor_check_invocation_context (parent, jic, &jic_is_dirty);
-    if (!JS_IsNull (self->on_leave) || jic_is_dirty)
-    {
-      state->jic = jic;
-    }
-    else
-    {
-      _gum_quick_interceptor_release_invocation_context (parent, jic);
-      state->jic = NULL;
-    }
+    gum_quick_interceptor_invoke_on_enter (parent, &scope, self->on_enter,
+        !JS_IsNull (self->on_leave), ic, state);
 
     _gum_quick_scope_leave (&scope);
   }
@@ -915,30 +1300,11 @@ gum_quick_js_call_listener_on_leave (GumInvocationListener * listener,
   if (!JS_IsNull (self->on_leave))
   {
     GumQuickScope scope;
-    GumQuickInvocationContext * jic;
-    GumQuickInvocationRetval * retval;
 
     _gum_quick_scope_enter (&scope, parent->core);
 
-    jic = !JS_IsNull (self->on_enter) ? state->jic : NULL;
-    if (jic == NULL)
-    {
-      jic = _gum_quick_interceptor_obtain_invocation_context (parent);
-    }
-    _gum_quick_invocation_context_reset (jic, ic);
-
-    retval = gum_quick_interceptor_obtain_invocation_retval (parent);
-    gum_quick_invocation_retval_reset (retval, ic);
-
-    _gum_quick_scope_call_void (&scope, self->on_leave, jic->wrapper, 1,
-        &retval->wrapper);
-
-    gum_quick_invocation_retval_reset (retval, NULL);
-    gum_quick_interceptor_release_invocation_retval (parent, retval);
-
-    _gum_quick_invocation_context_reset (jic, NULL);
-    gum_quick_interceptor_check_invocation_context (parent, jic, NULL);
-    _gum_quick_interceptor_release_invocation_context (parent, jic);
+    gum_quick_interceptor_invoke_on_leave (parent, &scope, self->on_leave,
+        !JS_IsNull (self->on_enter), ic, state);
 
     _gum_quick_scope_leave (&scope);
   }
@@ -954,6 +1320,75 @@ gum_quick_js_call_listener_on_leave (GumInvocationListener * listener,
   }
 }
 
+static void
+gum_quick_interceptor_invoke_on_enter (GumQuickInterceptor * self,
+                                       GumQuickScope * scope,
+                                       JSValue on_enter,
+                                       gboolean has_on_leave,
+                                       GumInvocationContext * ic,
+                                       GumQuickInvocationState * state)
+{
+  GumQuickInvocationContext * jic;
+  GumQuickInvocationArgs * args;
+  gboolean jic_is_dirty;
+
+  jic = _gum_quick_interceptor_obtain_invocation_context (self);
+  _gum_quick_invocation_context_reset (jic, ic);
+
+  args = gum_quick_interceptor_obtain_invocation_args (self);
+  gum_quick_invocation_args_reset (args, ic);
+
+  _gum_quick_scope_call_void (scope, on_enter, jic->wrapper, 1,
+      &args->wrapper);
+
+  gum_quick_invocation_args_reset (args, NULL);
+  gum_quick_interceptor_release_invocation_args (self, args);
+
+  _gum_quick_invocation_context_reset (jic, NULL);
+  gum_quick_interceptor_check_invocation_context (self, jic, &jic_is_dirty);
+  if (has_on_leave || jic_is_dirty)
+  {
+    state->jic = jic;
+  }
+  else
+  {
+    _gum_quick_interceptor_release_invocation_context (self, jic);
+    state->jic = NULL;
+  }
+}
+
+static void
+gum_quick_interceptor_invoke_on_leave (GumQuickInterceptor * self,
+                                       GumQuickScope * scope,
+                                       JSValue on_leave,
+                                       gboolean has_on_enter,
+                                       GumInvocationContext * ic,
+                                       GumQuickInvocationState * state)
+{
+  GumQuickInvocationContext * jic;
+  GumQuickInvocationRetval * retval;
+
+  jic = has_on_enter ? state->jic : NULL;
+  if (jic == NULL)
+  {
+    jic = _gum_quick_interceptor_obtain_invocation_context (self);
+  }
+  _gum_quick_invocation_context_reset (jic, ic);
+
+  retval = gum_quick_interceptor_obtain_invocation_retval (self);
+  gum_quick_invocation_retval_reset (retval, ic);
+
+  _gum_quick_scope_call_void (scope, on_leave, jic->wrapper, 1,
+      &retval->wrapper);
+
+  gum_quick_invocation_retval_reset (retval, NULL);
+  gum_quick_interceptor_release_invocation_retval (self, retval);
+
+  _gum_quick_invocation_context_reset (jic, NULL);
+  gum_quick_interceptor_check_invocation_context (self, jic, NULL);
+  _gum_quick_interceptor_release_invocation_context (self, jic);
+}
+
 static void
 gum_quick_js_probe_listener_class_init (GumQuickJSProbeListenerClass * klass)
 {
@@ -1036,6 +1471,185 @@ gum_quick_js_probe_listener_on_enter (GumInvocationListener * listener,
   _gum_quick_scope_leave (&scope);
 }
 
+static void
+gum_quick_js_isolated_listener_class_init (
+    GumQuickJSIsolatedListenerClass * klass)
+{
+  GObjectClass * object_class = G_OBJECT_CLASS (klass);
+
+  object_class->dispose = gum_quick_js_isolated_listener_dispose;
+  object_class->finalize = gum_quick_js_isolated_listener_finalize;
+}
+
+static void
+gum_quick_js_isolated_listener_iface_init (gpointer g_iface,
+                                           gpointer iface_data)
+{
+  GumInvocationListenerInterface * iface = g_iface;
+
+  iface->on_enter = gum_quick_js_isolated_listener_on_enter;
+  iface->on_leave = gum_quick_js_isolated_listener_on_leave;
+}
+
+static void
+gum_quick_js_isolated_listener_init (GumQuickJSIsolatedListener * self)
+{
+  static volatile gint next_id = 1;
+
+  self->id = g_atomic_int_add (&next_id, 1);
+}
+
+static void
+gum_quick_js_isolated_listener_dispose (GObject * object)
+{
+  GumQuickJSIsolatedListener * self;
+  GumQuickInvocationListener * base_listener;
+  GumQuickCore * core;
+  GumQuickIsolatedForgetJob * job;
+  GumQuickScope scope;
+
+  self = GUM_QUICK_JS_ISOLATED_LISTENER (object);
+  base_listener = GUM_QUICK_INVOCATION_LISTENER (object);
+  core = base_listener->parent->core;
+
+  /*
+   * We are likely holding the script's scope here, and a thread inside one of
+   * the isolates may be about to enter it, e.g. by calling a function that the
+   * script itself hooks. So we leave it to the JS thread, which holds no locks
+   * of its own, to reclaim the callbacks from each isolate.
+   */
+  job = g_slice_new (GumQuickIsolatedForgetJob);
+  job->script = g_object_ref (core->script);
+  job->id = self->id;
+  gum_script_scheduler_push_job_on_js_thread (core->scheduler,
+      G_PRIORITY_DEFAULT, (GumScriptJobFunc) gum_quick_isolated_forget_job_run,
+      job, (GDestroyNotify) gum_quick_isolated_forget_job_free);
+
+  _gum_quick_scope_enter (&scope, core);
+
+  gum_quick_invocation_listener_release_wrapper (base_listener, core->ctx);
+
+  _gum_quick_scope_leave (&scope);
+
+  G_OBJECT_CLASS (gum_quick_js_isolated_listener_parent_class)->dispose (
+      object);
+}
+
+static void
+gum_quick_js_isolated_listener_finalize (GObject * object)
+{
+  GumQuickJSIsolatedListener * self = GUM_QUICK_JS_ISOLATED_LISTENER (object);
+
+  g_clear_pointer (&self->on_enter, g_bytes_unref);
+  g_clear_pointer (&self->on_leave, g_bytes_unref);
+
+  G_OBJECT_CLASS (gum_quick_js_isolated_listener_parent_class)->finalize (
+      object);
+}
+
+static void
+gum_quick_isolated_forget_job_run (GumQuickIsolatedForgetJob * job)
+{
+  _gum_quick_script_foreach_isolate (job->script,
+      (GFunc) gum_quick_isolated_callbacks_forget, GUINT_TO_POINTER (job->id));
+}
+
+static void
+gum_quick_isolated_forget_job_free (GumQuickIsolatedForgetJob * job)
+{
+  g_object_unref (job->script);
+
+  g_slice_free (GumQuickIsolatedForgetJob, job);
+}
+
+static void
+gum_quick_isolated_callbacks_forget (GumQuickCore * core,
+                                     gpointer id)
+{
+  GumQuickScope scope;
+
+  _gum_quick_scope_enter (&scope, core);
+
+  g_hash_table_remove (core->interceptor->isolated_callbacks, id);
+
+  _gum_quick_scope_leave (&scope);
+}
+
+static void
+gum_quick_js_isolated_listener_on_enter (GumInvocationListener * listener,
+                                         GumInvocationContext * ic)
+{
+  GumQuickJSIsolatedListener * self;
+  GumQuickInvocationState * state;
+  GumQuickCore * core;
+  GumQuickScope scope;
+  GumQuickIsolatedCallbacks * callbacks;
+
+  self = GUM_QUICK_JS_ISOLATED_LISTENER_CAST (listener);
+  state = GUM_IC_GET_INVOCATION_DATA (ic, GumQuickInvocationState);
+
+  state->jic = NULL;
+
+  if (self->on_enter == NULL)
+    return;
+
+  core = _gum_quick_script_obtain_isolate (
+      GUM_QUICK_INVOCATION_LISTENER_CAST (listener)->parent->core->script);
+  if (core == NULL)
+    return;
+
+  _gum_quick_scope_enter (&scope, core);
+
+  callbacks = gum_quick_interceptor_obtain_isolated_callbacks (
+      core->interceptor, self, &scope);
+  if (!JS_IsNull (callbacks->on_enter))
+  {
+    gum_quick_interceptor_invoke_on_enter (core->interceptor, &scope,
+        callbacks->on_enter, !JS_IsNull (callbacks->on_leave), ic, state);
+  }
+
+  _gum_quick_scope_leave (&scope);
+}
+
+static void
+gum_quick_js_isolated_listener_on_leave (GumInvocationListener * listener,
+                                         GumInvocationContext * ic)
+{
+  GumQuickJSIsolatedListener * self;
+  GumQuickInvocationState * state;
+  GumQuickCore * core;
+  GumQuickScope scope;
+  GumQuickIsolatedCallbacks * callbacks;
+
+  self = GUM_QUICK_JS_ISOLATED_LISTENER_CAST (listener);
+  state = GUM_IC_GET_INVOCATION_DATA (ic, GumQuickInvocationState);
+
+  if (self->on_leave == NULL && state->jic == NULL)
+    return;
+
+  core = _gum_quick_script_obtain_isolate (
+      GUM_QUICK_INVOCATION_LISTENER_CAST (listener)->parent->core->script);
+  if (core == NULL)
+    return;
+
+  _gum_quick_scope_enter (&scope, core);
+
+  callbacks = gum_quick_interceptor_obtain_isolated_callbacks (
+      core->interceptor, self, &scope);
+  if (!JS_IsNull (callbacks->on_leave))
+  {
+    gum_quick_interceptor_invoke_on_leave (core->interceptor, &scope,
+        callbacks->on_leave, self->on_enter != NULL, ic, state);
+  }
+  else if (state->jic != NULL)
+  {
+    _gum_quick_interceptor_release_invocation_context (core->interceptor,
+        state->jic);
+  }
+
+  _gum_quick_scope_leave (&scope);
+}
+
 static void
 gum_quick_c_call_listener_class_init (GumQuickCCallListenerClass * klass)
 {
@@ -1667,3 +2281,37 @@ gum_quick_interceptor_release_invocation_retval (
   else
     gum_quick_invocation_retval_release (retval);
 }
+
+static GumQuickIsolatedCallbacks *
+gum_quick_interceptor_obtain_isolated_callbacks (
+    GumQuickInterceptor * self,
+    GumQuickJSIsolatedListener * listener,
+    GumQuickScope * scope)
+{
+  GumQuickIsolatedCallbacks * callbacks;
+  gpointer key = GUINT_TO_POINTER (listener->id);
+
+  callbacks = g_hash_table_lookup (self->isolated_callbacks, key);
+  if (callbacks == NULL)
+  {
+    callbacks = g_slice_new (GumQuickIsolatedCallbacks);
+    callbacks->on_enter =
+        gum_quick_isolated_code_instantiate (listener->on_enter, scope);
+    callbacks->on_leave =
+        gum_quick_isolated_code_instantiate (listener->on_leave, scope);
+    callbacks->ctx = self->core->ctx;
+
+    g_hash_table_insert (self->isolated_callbacks, key, callbacks);
+  }
+
+  return callbacks;
+}
+
+static void
+gum_quick_isolated_callbacks_free (GumQuickIsolatedCallbacks * callbacks)
+{
+  JS_FreeValue (callbacks->ctx, callbacks->on_enter);
+  JS_FreeValue (callbacks->ctx, callbacks->on_leave);
+
+  g_slice_free (GumQuickIsolatedCallbacks, callbacks);
+}
@@ -25,7 +25,9 @@ struct _GumQuickInterceptor
 
   GHashTable * invocation_listeners;
   GHashTable * replacement_by_address;
+  GHashTable * isolated_callbacks;
   GSource * flush_timer;
+  gboolean stats_enabled;
 
   JSClassID invocation_listener_class;
   JSClassID invocation_context_class;
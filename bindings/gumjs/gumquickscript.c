@@ -16,6 +16,7 @@
 #include "gumquickinstruction.h"
 #include "gumquickinterceptor.h"
 #include "gumquickkernel.h"
+#include "gumquickmacros.h"
 #include "gumquickmemory.h"
 #include "gumquickmodule.h"
 #include "gumquickprocess.h"
@@ -28,6 +29,7 @@
 #include "gumquickstream.h"
 #include "gumquicksymbol.h"
 #include "gumquickthread.h"
+#include "gummessagebatcher.h"
 #include "gumscripttask.h"
 
 typedef guint GumScriptState;
@@ -36,6 +38,7 @@ typedef void (* GumUnloadNotifyFunc) (GumQuickScript * self,
     gpointer user_data);
 typedef struct _GumEmitData GumEmitData;
 typedef struct _GumPostData GumPostData;
+typedef struct _GumQuickIsolate GumQuickIsolate;
 
 struct _GumQuickScript
 {
@@ -71,9 +74,17 @@ struct _GumQuickScript
   GumQuickCodeRelocator code_relocator;
   GumQuickStalker stalker;
 
+  GMutex isolates_mutex;
+  GCond isolates_cond;
+  gboolean isolates_created;
+  GumQuickIsolate ** isolates;
+  guint num_isolates;
+
   GumScriptMessageHandler message_handler;
   gpointer message_handler_data;
   GDestroyNotify message_handler_data_destroy;
+  GMutex message_batcher_mutex;
+  GumMessageBatcher * message_batcher;
 };
 
 enum
@@ -114,6 +125,34 @@ struct _GumPostData
   GBytes * data;
 };
 
+struct _GumQuickIsolate
+{
+  GumQuickScript * script;
+
+  GRecMutex scope_mutex;
+
+  JSRuntime * rt;
+  JSContext * ctx;
+  GumQuickCore core;
+  GumQuickKernel kernel;
+  GumQuickMemory memory;
+  GumQuickModule module;
+  GumQuickProcess process;
+  GumQuickThread thread;
+  GumQuickFile file;
+  GumQuickStream stream;
+  GumQuickSocket socket;
+  GumQuickDatabase database;
+  GumQuickInterceptor interceptor;
+  GumQuickApiResolver api_resolver;
+  GumQuickSymbol symbol;
+  GumQuickCModule cmodule;
+  GumQuickInstruction instruction;
+  GumQuickCodeWriter code_writer;
+  GumQuickCodeRelocator code_relocator;
+  GumQuickStalker stalker;
+};
+
 static void gum_quick_script_iface_init (gpointer g_iface, gpointer iface_data);
 
 static void gum_quick_script_dispose (GObject * object);
@@ -123,6 +162,14 @@ static void gum_quick_script_get_property (GObject * object, guint property_id,
 static void gum_quick_script_set_property (GObject * object, guint property_id,
     const GValue * value, GParamSpec * pspec);
 static void gum_quick_script_destroy_context (GumQuickScript * self);
+static void gum_quick_script_do_create_isolates (GumQuickScript * self);
+static gboolean gum_quick_script_flush_isolates (GumQuickScript * self);
+static void gum_quick_script_destroy_isolates (GumQuickScript * self);
+
+static GumQuickIsolate * gum_quick_isolate_new (GumQuickScript * script);
+static gboolean gum_quick_isolate_flush (GumQuickIsolate * self);
+static void gum_quick_isolate_free (GumQuickIsolate * self);
+GUMJS_DECLARE_FUNCTION (gumjs_isolate_post)
 
 static void gum_quick_script_load (GumScript * script,
     GCancellable * cancellable, GAsyncReadyCallback callback,
@@ -153,6 +200,8 @@ static void gum_quick_script_once_unloaded (GumQuickScript * self,
 static void gum_quick_script_set_message_handler (GumScript * script,
     GumScriptMessageHandler handler, gpointer data,
     GDestroyNotify data_destroy);
+static void gum_quick_script_set_message_batching (GumScript * script,
+    gsize max_size, guint max_delay);
 static void gum_quick_script_post (GumScript * script, const gchar * message,
     GBytes * data);
 static void gum_quick_script_do_post (GumPostData * d);
@@ -162,9 +211,21 @@ static GumStalker * gum_quick_script_get_stalker (GumScript * script);
 
 static void gum_quick_script_emit (GumQuickScript * self,
     const gchar * message, GBytes * data);
+static GumMessageBatcher * gum_quick_script_ref_message_batcher (
+    GumQuickScript * self);
+static void gum_quick_script_flush_message_batcher (GumQuickScript * self);
+static void gum_quick_script_emit_batch (const gchar * message, GBytes * data,
+    GumQuickScript * self);
+static void gum_quick_script_schedule_emit (GumQuickScript * self,
+    const gchar * message, GBytes * data);
 static gboolean gum_quick_script_do_emit (GumEmitData * d);
 static void gum_quick_emit_data_free (GumEmitData * d);
 
+static const JSCFunctionListEntry gumjs_isolate_entries[] =
+{
+  JS_CFUNC_DEF ("post", 0, gumjs_isolate_post),
+};
+
 G_DEFINE_TYPE_EXTENDED (GumQuickScript,
                         gum_quick_script,
                         G_TYPE_OBJECT,
@@ -215,6 +276,7 @@ gum_quick_script_iface_init (gpointer g_iface,
   iface->unload_sync = gum_quick_script_unload_sync;
 
   iface->set_message_handler = gum_quick_script_set_message_handler;
+  iface->set_message_batching = gum_quick_script_set_message_batching;
   iface->post = gum_quick_script_post;
 
   iface->get_stalker = gum_quick_script_get_stalker;
@@ -227,6 +289,12 @@ gum_quick_script_init (GumQuickScript * self)
 
   self->state = GUM_SCRIPT_STATE_UNLOADED;
   self->on_unload = NULL;
+
+  g_mutex_init (&self->isolates_mutex);
+  g_mutex_init (&self->message_batcher_mutex);
+  g_cond_init (&self->isolates_cond);
+  self->num_isolates = g_get_num_processors ();
+  self->isolates = g_new0 (GumQuickIsolate *, self->num_isolates);
 }
 
 static void
@@ -247,6 +315,8 @@ gum_quick_script_dispose (GObject * object)
     if (self->state == GUM_SCRIPT_STATE_UNLOADED && self->ctx != NULL)
       gum_quick_script_destroy_context (self);
 
+    gum_quick_script_set_message_batching (script, 0, 0);
+
     g_clear_pointer (&self->main_context, g_main_context_unref);
     g_clear_pointer (&self->backend, g_object_unref);
   }
@@ -263,6 +333,11 @@ gum_quick_script_finalize (GObject * object)
   g_free (self->source);
   g_bytes_unref (self->bytecode);
 
+  g_free (self->isolates);
+  g_cond_clear (&self->isolates_cond);
+  g_mutex_clear (&self->isolates_mutex);
+  g_mutex_clear (&self->message_batcher_mutex);
+
   G_OBJECT_CLASS (gum_quick_script_parent_class)->finalize (object);
 }
 
@@ -423,6 +498,8 @@ gum_quick_script_destroy_context (GumQuickScript * self)
 
   g_assert (self->ctx != NULL);
 
+  gum_quick_script_destroy_isolates (self);
+
   {
     GumQuickScope scope;
 
@@ -487,6 +564,338 @@ gum_quick_script_destroy_context (GumQuickScript * self)
   _gum_quick_core_finalize (core);
 }
 
+/*
+ * Creates the script's isolates, all at once and on the JS thread, so that
+ * hooked threads never have to set up a runtime, or wait for one to be set
+ * up, from inside a hook. Must be called with the script's scope held, which
+ * is released while we wait for the JS thread.
+ */
+void
+_gum_quick_script_create_isolates (GumQuickScript * self)
+{
+  GumQuickScope scope = GUM_QUICK_SCOPE_INIT (&self->core);
+  GumScriptScheduler * scheduler;
+
+  if (g_atomic_int_get (&self->isolates_created))
+    return;
+
+  scheduler = gum_quick_script_backend_get_scheduler (self->backend);
+
+  if (g_main_context_is_owner (gum_script_scheduler_get_js_context (scheduler)))
+  {
+    gum_quick_script_do_create_isolates (self);
+    return;
+  }
+
+  _gum_quick_scope_suspend (&scope);
+
+  gum_script_scheduler_push_job_on_js_thread (scheduler, G_PRIORITY_DEFAULT,
+      (GumScriptJobFunc) gum_quick_script_do_create_isolates, self, NULL);
+
+  g_mutex_lock (&self->isolates_mutex);
+  while (!self->isolates_created)
+    g_cond_wait (&self->isolates_cond, &self->isolates_mutex);
+  g_mutex_unlock (&self->isolates_mutex);
+
+  _gum_quick_scope_resume (&scope);
+}
+
+static void
+gum_quick_script_do_create_isolates (GumQuickScript * self)
+{
+  guint i;
+
+  g_mutex_lock (&self->isolates_mutex);
+
+  if (!self->isolates_created)
+  {
+    for (i = 0; i != self->num_isolates; i++)
+      self->isolates[i] = gum_quick_isolate_new (self);
+
+    g_atomic_int_set (&self->isolates_created, TRUE);
+    g_cond_broadcast (&self->isolates_cond);
+  }
+
+  g_mutex_unlock (&self->isolates_mutex);
+}
+
+static gboolean
+gum_quick_script_flush_isolates (GumQuickScript * self)
+{
+  gboolean done = TRUE;
+  guint i;
+
+  g_mutex_lock (&self->isolates_mutex);
+
+  for (i = 0; i != self->num_isolates; i++)
+  {
+    GumQuickIsolate * isolate = self->isolates[i];
+
+    if (isolate != NULL && !gum_quick_isolate_flush (isolate))
+      done = FALSE;
+  }
+
+  g_mutex_unlock (&self->isolates_mutex);
+
+  return done;
+}
+
+static void
+gum_quick_script_destroy_isolates (GumQuickScript * self)
+{
+  guint i;
+
+  g_mutex_lock (&self->isolates_mutex);
+
+  for (i = 0; i != self->num_isolates; i++)
+    g_clear_pointer (&self->isolates[i], gum_quick_isolate_free);
+
+  g_atomic_int_set (&self->isolates_created, FALSE);
+
+  g_mutex_unlock (&self->isolates_mutex);
+}
+
+GumQuickCore *
+_gum_quick_script_obtain_isolate (GumQuickScript * self)
+{
+  guint index;
+  GumQuickIsolate * isolate;
+
+  /*
+   * Threads are mapped onto isolates by their ID, so a given thread always
+   * ends up in the same isolate. This keeps state set up in onEnter() around
+   * for the matching onLeave(), and means threads only contend when they
+   * happen to share an isolate.
+   */
+  index = gum_process_get_current_thread_id () % self->num_isolates;
+
+  isolate = g_atomic_pointer_get (&self->isolates[index]);
+  if (isolate == NULL)
+    return NULL;
+
+  return &isolate->core;
+}
+
+void
+_gum_quick_script_foreach_isolate (GumQuickScript * self,
+                                   GFunc func,
+                                   gpointer user_data)
+{
+  guint i;
+
+  g_mutex_lock (&self->isolates_mutex);
+
+  for (i = 0; i != self->num_isolates; i++)
+  {
+    GumQuickIsolate * isolate = self->isolates[i];
+
+    if (isolate != NULL)
+      func (&isolate->core, user_data);
+  }
+
+  g_mutex_unlock (&self->isolates_mutex);
+}
+
+static GumQuickIsolate *
+gum_quick_isolate_new (GumQuickScript * script)
+{
+  GumQuickIsolate * self;
+  GumQuickCore * core;
+  JSRuntime * rt;
+  JSContext * ctx;
+  JSValue global_obj, obj;
+  GumQuickScope scope;
+
+  self = g_slice_new0 (GumQuickIsolate);
+  self->script = script;
+  g_rec_mutex_init (&self->scope_mutex);
+
+  core = &self->core;
+
+  rt = gum_quick_script_backend_make_runtime (script->backend);
+  JS_SetRuntimeOpaque (rt, core);
+
+  ctx = JS_NewContext (rt);
+  JS_SetContextOpaque (ctx, core);
+
+  self->rt = rt;
+  self->ctx = ctx;
+
+  global_obj = JS_GetGlobalObject (ctx);
+
+  JS_DefinePropertyValueStr (ctx, global_obj, "global",
+      JS_DupValue (ctx, global_obj), JS_PROP_C_W_E);
+
+  _gum_quick_core_init (core, script, ctx, global_obj, &self->scope_mutex,
+      gumjs_frida_source_map, &self->interceptor, &self->stalker,
+      gum_quick_script_emit,
+      gum_quick_script_backend_get_scheduler (script->backend));
+
+  {
+    GumQuickScope init_scope = { core, NULL, };
+
+    core->current_scope = &init_scope;
+
+    _gum_quick_kernel_init (&self->kernel, global_obj, core);
+    _gum_quick_memory_init (&self->memory, global_obj, core);
+    _gum_quick_module_init (&self->module, global_obj, core);
+    _gum_quick_process_init (&self->process, global_obj, &self->module, core);
+    _gum_quick_thread_init (&self->thread, global_obj, core);
+    _gum_quick_file_init (&self->file, global_obj, core);
+    _gum_quick_stream_init (&self->stream, global_obj, core);
+    _gum_quick_socket_init (&self->socket, global_obj, &self->stream, core);
+    _gum_quick_database_init (&self->database, global_obj, core);
+    _gum_quick_interceptor_init (&self->interceptor, global_obj, core);
+    _gum_quick_api_resolver_init (&self->api_resolver, global_obj, core);
+    _gum_quick_symbol_init (&self->symbol, global_obj, core);
+    _gum_quick_cmodule_init (&self->cmodule, global_obj, core);
+    _gum_quick_instruction_init (&self->instruction, global_obj, core);
+    _gum_quick_code_writer_init (&self->code_writer, global_obj, core);
+    _gum_quick_code_relocator_init (&self->code_relocator, global_obj,
+        &self->code_writer, &self->instruction, core);
+    _gum_quick_stalker_init (&self->stalker, global_obj, &self->code_writer,
+        &self->instruction, core);
+
+    obj = JS_NewObject (ctx);
+    JS_SetPropertyFunctionList (ctx, obj, gumjs_isolate_entries,
+        G_N_ELEMENTS (gumjs_isolate_entries));
+    JS_DefinePropertyValueStr (ctx, global_obj, "Isolate", obj,
+        JS_PROP_C_W_E);
+
+    core->current_scope = NULL;
+  }
+
+  JS_FreeValue (ctx, global_obj);
+
+  _gum_quick_scope_enter (&scope, core);
+
+  gum_quick_bundle_load (gumjs_runtime_modules, ctx);
+
+  _gum_quick_scope_leave (&scope);
+
+  return self;
+}
+
+/*
+ * Flushes the isolate as part of unloading its script. If anything is still
+ * in flight, such as an Interceptor flush timer or a thread inside one of its
+ * callbacks, the script's unload is retried once the isolate is released.
+ */
+static gboolean
+gum_quick_isolate_flush (GumQuickIsolate * self)
+{
+  GumQuickCore * core = &self->core;
+  GumQuickScope scope;
+  gboolean done;
+
+  _gum_quick_scope_enter (&scope, core);
+
+  _gum_quick_stalker_flush (&self->stalker);
+  _gum_quick_interceptor_flush (&self->interceptor);
+  _gum_quick_socket_flush (&self->socket);
+  _gum_quick_stream_flush (&self->stream);
+  _gum_quick_process_flush (&self->process);
+  done = _gum_quick_core_flush (core, gum_quick_script_try_unload);
+
+  _gum_quick_scope_leave (&scope);
+
+  return done;
+}
+
+static void
+gum_quick_isolate_free (GumQuickIsolate * self)
+{
+  GumQuickCore * core = &self->core;
+
+  {
+    GumQuickScope scope;
+
+    _gum_quick_scope_enter (&scope, core);
+
+    _gum_quick_stalker_dispose (&self->stalker);
+    _gum_quick_code_relocator_dispose (&self->code_relocator);
+    _gum_quick_code_writer_dispose (&self->code_writer);
+    _gum_quick_instruction_dispose (&self->instruction);
+    _gum_quick_cmodule_dispose (&self->cmodule);
+    _gum_quick_symbol_dispose (&self->symbol);
+    _gum_quick_api_resolver_dispose (&self->api_resolver);
+    _gum_quick_interceptor_dispose (&self->interceptor);
+    _gum_quick_database_dispose (&self->database);
+    _gum_quick_socket_dispose (&self->socket);
+    _gum_quick_stream_dispose (&self->stream);
+    _gum_quick_file_dispose (&self->file);
+    _gum_quick_thread_dispose (&self->thread);
+    _gum_quick_process_dispose (&self->process);
+    _gum_quick_module_dispose (&self->module);
+    _gum_quick_memory_dispose (&self->memory);
+    _gum_quick_kernel_dispose (&self->kernel);
+    _gum_quick_core_dispose (core);
+
+    _gum_quick_scope_leave (&scope);
+  }
+
+  {
+    GumQuickScope scope = { core, NULL, };
+
+    core->current_scope = &scope;
+
+    JS_FreeContext (self->ctx);
+    self->ctx = NULL;
+
+    JS_FreeRuntime (self->rt);
+    self->rt = NULL;
+
+    core->current_scope = NULL;
+  }
+
+  _gum_quick_stalker_finalize (&self->stalker);
+  _gum_quick_code_relocator_finalize (&self->code_relocator);
+  _gum_quick_code_writer_finalize (&self->code_writer);
+  _gum_quick_instruction_finalize (&self->instruction);
+  _gum_quick_cmodule_finalize (&self->cmodule);
+  _gum_quick_symbol_finalize (&self->symbol);
+  _gum_quick_api_resolver_finalize (&self->api_resolver);
+  _gum_quick_interceptor_finalize (&self->interceptor);
+  _gum_quick_database_finalize (&self->database);
+  _gum_quick_socket_finalize (&self->socket);
+  _gum_quick_stream_finalize (&self->stream);
+  _gum_quick_file_finalize (&self->file);
+  _gum_quick_thread_finalize (&self->thread);
+  _gum_quick_process_finalize (&self->process);
+  _gum_quick_module_finalize (&self->module);
+  _gum_quick_memory_finalize (&self->memory);
+  _gum_quick_kernel_finalize (&self->kernel);
+  _gum_quick_core_finalize (core);
+
+  g_rec_mutex_clear (&self->scope_mutex);
+
+  g_slice_free (GumQuickIsolate, self);
+}
+
+GUMJS_DEFINE_FUNCTION (gumjs_isolate_post)
+{
+  JSValue message;
+  GBytes * data = NULL;
+  JSValue json_val;
+  const char * json;
+
+  if (!_gum_quick_args_parse (args, "V|B?", &message, &data))
+    return JS_EXCEPTION;
+
+  json_val = JS_JSONStringify (ctx, message, JS_UNDEFINED, JS_UNDEFINED);
+  if (JS_IsException (json_val))
+    return JS_EXCEPTION;
+
+  json = JS_ToCString (ctx, json_val);
+
+  gum_quick_script_post (GUM_SCRIPT (core->script), json, data);
+
+  JS_FreeCString (ctx, json);
+  JS_FreeValue (ctx, json_val);
+
+  return JS_UNDEFINED;
+}
+
 static void
 gum_quick_script_load (GumScript * script,
                        GCancellable * cancellable,
@@ -676,10 +1085,15 @@ gum_quick_script_try_unload (GumQuickScript * self)
 
   _gum_quick_scope_leave (&scope);
 
+  if (success)
+    success = gum_quick_script_flush_isolates (self);
+
   if (success)
   {
     gum_quick_script_destroy_context (self);
 
+    gum_quick_script_flush_message_batcher (self);
+
     self->state = GUM_SCRIPT_STATE_UNLOADED;
 
     while (self->on_unload != NULL)
@@ -728,6 +1142,33 @@ gum_quick_script_set_message_handler (GumScript * script,
   self->message_handler_data_destroy = data_destroy;
 }
 
+static void
+gum_quick_script_set_message_batching (GumScript * script,
+                                       gsize max_size,
+                                       guint max_delay)
+{
+  GumQuickScript * self = GUM_QUICK_SCRIPT (script);
+  GumMessageBatcher * old_batcher, * new_batcher = NULL;
+
+  if (max_size != 0)
+  {
+    new_batcher = gum_message_batcher_new (max_size, max_delay,
+        self->main_context, (GumMessageBatchFunc) gum_quick_script_emit_batch,
+        self);
+  }
+
+  g_mutex_lock (&self->message_batcher_mutex);
+  old_batcher = self->message_batcher;
+  g_atomic_pointer_set (&self->message_batcher, new_batcher);
+  g_mutex_unlock (&self->message_batcher_mutex);
+
+  if (old_batcher != NULL)
+  {
+    gum_message_batcher_flush (old_batcher);
+    gum_message_batcher_free (old_batcher);
+  }
+}
+
 static void
 gum_quick_script_post (GumScript * script,
                        const gchar * message,
@@ -776,10 +1217,73 @@ gum_quick_script_get_stalker (GumScript * script)
   return _gum_quick_stalker_get (&self->stalker);
 }
 
+/*
+ * Batching is usually off, so emitters only take the lock when there is a
+ * batcher, and just long enough to grab a reference to it. It may get swapped
+ * out right after, in which case the batcher passes the message through on
+ * its own.
+ */
 static void
 gum_quick_script_emit (GumQuickScript * self,
                        const gchar * message,
                        GBytes * data)
+{
+  GumMessageBatcher * batcher;
+
+  batcher = gum_quick_script_ref_message_batcher (self);
+  if (batcher != NULL)
+  {
+    gum_message_batcher_add (batcher, message, data);
+    gum_message_batcher_unref (batcher);
+  }
+  else
+  {
+    gum_quick_script_schedule_emit (self, message, data);
+  }
+}
+
+static GumMessageBatcher *
+gum_quick_script_ref_message_batcher (GumQuickScript * self)
+{
+  GumMessageBatcher * batcher;
+
+  if (g_atomic_pointer_get (&self->message_batcher) == NULL)
+    return NULL;
+
+  g_mutex_lock (&self->message_batcher_mutex);
+  batcher = self->message_batcher;
+  if (batcher != NULL)
+    gum_message_batcher_ref (batcher);
+  g_mutex_unlock (&self->message_batcher_mutex);
+
+  return batcher;
+}
+
+static void
+gum_quick_script_flush_message_batcher (GumQuickScript * self)
+{
+  GumMessageBatcher * batcher;
+
+  batcher = gum_quick_script_ref_message_batcher (self);
+  if (batcher == NULL)
+    return;
+
+  gum_message_batcher_flush (batcher);
+  gum_message_batcher_unref (batcher);
+}
+
+static void
+gum_quick_script_emit_batch (const gchar * message,
+                             GBytes * data,
+                             GumQuickScript * self)
+{
+  gum_quick_script_schedule_emit (self, message, data);
+}
+
+static void
+gum_quick_script_schedule_emit (GumQuickScript * self,
+                                const gchar * message,
+                                GBytes * data)
 {
   GumEmitData * d;
   GSource * source;
@@ -18,6 +18,12 @@ G_DECLARE_FINAL_TYPE (GumQuickScript, gum_quick_script, GUM_QUICK, SCRIPT,
 G_GNUC_INTERNAL gboolean gum_quick_script_create_context (GumQuickScript * self,
     GError ** error);
 
+G_GNUC_INTERNAL void _gum_quick_script_create_isolates (GumQuickScript * self);
+G_GNUC_INTERNAL struct _GumQuickCore * _gum_quick_script_obtain_isolate (
+    GumQuickScript * self);
+G_GNUC_INTERNAL void _gum_quick_script_foreach_isolate (GumQuickScript * self,
+    GFunc func, gpointer user_data);
+
 G_END_DECLS
 
 #endif
@@ -513,6 +513,8 @@ GUMJS_DEFINE_FUNCTION (gumjs_stalker_follow)
   GumStalkerTransformerCallback transformer_callback_c;
   GumQuickEventSinkOptions so;
   gpointer user_data;
+  gpointer coverage_bitmap;
+  gsize coverage_size;
   GumStalkerTransformer * transformer;
   GumEventSink * sink;
 
@@ -524,9 +526,10 @@ GUMJS_DEFINE_FUNCTION (gumjs_stalker_follow)
   so.queue_capacity = parent->queue_capacity;
   so.queue_drain_interval = parent->queue_drain_interval;
 
-  if (!_gum_quick_args_parse (args, "ZF*?uF?F?pp", &thread_id,
+  if (!_gum_quick_args_parse (args, "ZF*?uF?F?pppZ", &thread_id,
       &transformer_callback_js, &transformer_callback_c, &so.event_mask,
-      &so.on_receive, &so.on_call_summary, &so.on_event, &user_data))
+      &so.on_receive, &so.on_call_summary, &so.on_event, &user_data,
+      &coverage_bitmap, &coverage_size))
     return JS_EXCEPTION;
 
   so.user_data = user_data;
@@ -547,6 +550,11 @@ GUMJS_DEFINE_FUNCTION (gumjs_stalker_follow)
     transformer = gum_stalker_transformer_make_from_callback (
         transformer_callback_c, user_data, NULL);
   }
+  else if (coverage_bitmap != NULL)
+  {
+    transformer = gum_stalker_transformer_make_edge_coverage (coverage_bitmap,
+        coverage_size, NULL, NULL);
+  }
   else
   {
     transformer = NULL;
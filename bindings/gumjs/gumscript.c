@@ -69,6 +69,21 @@ gum_script_set_message_handler (GumScript * self,
       data_destroy);
 }
 
+/*
+ * Coalesces outgoing messages into frames of up to max_size bytes, flushed at
+ * the latest max_delay ms after the first message was queued. Each frame is
+ * delivered to the message handler as a single message of type "batch", with
+ * the frame as its data. A max_size of 0 turns batching off again.
+ */
+void
+gum_script_set_message_batching (GumScript * self,
+                                 gsize max_size,
+                                 guint max_delay)
+{
+  GUM_SCRIPT_GET_IFACE (self)->set_message_batching (self, max_size,
+      max_delay);
+}
+
 void
 gum_script_post (GumScript * self,
                  const gchar * message,
@@ -35,6 +35,8 @@ struct _GumScriptInterface
   void (* set_message_handler) (GumScript * self,
       GumScriptMessageHandler handler, gpointer data,
       GDestroyNotify data_destroy);
+  void (* set_message_batching) (GumScript * self, gsize max_size,
+      guint max_delay);
   void (* post) (GumScript * self, const gchar * message, GBytes * data);
 
   GumStalker * (* get_stalker) (GumScript * self);
@@ -54,6 +56,8 @@ GUM_API void gum_script_unload_sync (GumScript * self,
 GUM_API void gum_script_set_message_handler (GumScript * self,
     GumScriptMessageHandler handler, gpointer data,
     GDestroyNotify data_destroy);
+GUM_API void gum_script_set_message_batching (GumScript * self,
+    gsize max_size, guint max_delay);
 GUM_API void gum_script_post (GumScript * self, const gchar * message,
     GBytes * data);
 
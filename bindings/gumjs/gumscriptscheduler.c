@@ -6,6 +6,31 @@
 
 #include "gumscriptscheduler.h"
 
+typedef struct _GumScriptJobLane GumScriptJobLane;
+
+enum _GumScriptJobLaneId
+{
+  GUM_SCRIPT_JOB_LANE_HIGH,
+  GUM_SCRIPT_JOB_LANE_DEFAULT,
+  GUM_SCRIPT_JOB_LANE_LOW,
+
+  GUM_SCRIPT_JOB_LANE_COUNT
+};
+
+/*
+ * Jobs are pushed onto a lock-free stack, so producers never contend with
+ * each other or with GLib's context lock. The JS thread takes the whole
+ * stack in one go, restores FIFO order, and runs the batch from a single
+ * GSource. Producers only wake up the loop when the lane goes from empty to
+ * non-empty.
+ */
+struct _GumScriptJobLane
+{
+  GSource source;
+
+  GumScriptJob * head;
+};
+
 struct _GumScriptScheduler
 {
   GObject parent;
@@ -17,6 +42,7 @@ struct _GumScriptScheduler
   GMainLoop * js_loop;
   GMainContext * js_context;
   volatile gint start_request_seqno;
+  GumScriptJobLane * lanes[GUM_SCRIPT_JOB_LANE_COUNT];
 
   GThreadPool * thread_pool;
 };
@@ -28,17 +54,40 @@ struct _GumScriptJob
   GDestroyNotify data_destroy;
 
   GumScriptScheduler * scheduler;
+
+  GumScriptJob * next;
+  gboolean free_after_run;
 };
 
 static void gum_script_scheduler_dispose (GObject * obj);
 
-static gboolean gum_script_scheduler_perform_js_job (
-    GumScriptJob * job);
+static void gum_script_scheduler_enqueue_js_job (GumScriptScheduler * self,
+    gint priority, GumScriptJob * job);
 static void gum_script_scheduler_perform_pool_job (GumScriptJob * job,
     GumScriptScheduler * self);
 
 static gpointer gum_script_scheduler_run_js_loop (GumScriptScheduler * self);
 
+static GumScriptJobLane * gum_script_job_lane_new (GMainContext * context,
+    gint priority);
+static void gum_script_job_lane_destroy (GumScriptJobLane * lane);
+static gboolean gum_script_job_lane_push (GumScriptJobLane * lane,
+    GumScriptJob * job);
+static GumScriptJob * gum_script_job_lane_take_all (GumScriptJobLane * lane);
+static gboolean gum_script_job_lane_prepare (GSource * source, gint * timeout);
+static gboolean gum_script_job_lane_check (GSource * source);
+static gboolean gum_script_job_lane_dispatch (GSource * source,
+    GSourceFunc callback, gpointer user_data);
+static void gum_script_job_run (GumScriptJob * job);
+
+static GSourceFuncs gum_script_job_lane_funcs =
+{
+  gum_script_job_lane_prepare,
+  gum_script_job_lane_check,
+  gum_script_job_lane_dispatch,
+  NULL
+};
+
 G_DEFINE_TYPE (GumScriptScheduler, gum_script_scheduler, G_TYPE_OBJECT)
 
 static void
@@ -56,6 +105,13 @@ gum_script_scheduler_init (GumScriptScheduler * self)
 
   self->js_context = g_main_context_new ();
 
+  self->lanes[GUM_SCRIPT_JOB_LANE_HIGH] =
+      gum_script_job_lane_new (self->js_context, G_PRIORITY_HIGH);
+  self->lanes[GUM_SCRIPT_JOB_LANE_DEFAULT] =
+      gum_script_job_lane_new (self->js_context, G_PRIORITY_DEFAULT);
+  self->lanes[GUM_SCRIPT_JOB_LANE_LOW] =
+      gum_script_job_lane_new (self->js_context, G_PRIORITY_LOW);
+
   self->thread_pool = g_thread_pool_new (
       (GFunc) gum_script_scheduler_perform_pool_job,
       self,
@@ -71,6 +127,8 @@ gum_script_scheduler_dispose (GObject * obj)
 
   if (!self->disposed)
   {
+    guint i;
+
     self->disposed = TRUE;
 
     g_thread_pool_free (self->thread_pool, FALSE, TRUE);
@@ -78,6 +136,9 @@ gum_script_scheduler_dispose (GObject * obj)
 
     gum_script_scheduler_stop (self);
 
+    for (i = 0; i != GUM_SCRIPT_JOB_LANE_COUNT; i++)
+      g_clear_pointer (&self->lanes[i], gum_script_job_lane_destroy);
+
     g_main_context_unref (self->js_context);
     self->js_context = NULL;
   }
@@ -154,18 +215,29 @@ gum_script_scheduler_push_job_on_js_thread (GumScriptScheduler * self,
                                             GDestroyNotify data_destroy)
 {
   GumScriptJob * job;
-  GSource * source;
 
   job = gum_script_job_new (self, func, data, data_destroy);
+  job->free_after_run = TRUE;
 
-  source = g_idle_source_new ();
-  g_source_set_priority (source, priority);
-  g_source_set_callback (source,
-      (GSourceFunc) gum_script_scheduler_perform_js_job,
-      job,
-      (GDestroyNotify) gum_script_job_free);
-  g_source_attach (source, self->js_context);
-  g_source_unref (source);
+  gum_script_scheduler_enqueue_js_job (self, priority, job);
+}
+
+static void
+gum_script_scheduler_enqueue_js_job (GumScriptScheduler * self,
+                                     gint priority,
+                                     GumScriptJob * job)
+{
+  GumScriptJobLane * lane;
+
+  if (priority < G_PRIORITY_DEFAULT)
+    lane = self->lanes[GUM_SCRIPT_JOB_LANE_HIGH];
+  else if (priority < G_PRIORITY_LOW)
+    lane = self->lanes[GUM_SCRIPT_JOB_LANE_DEFAULT];
+  else
+    lane = self->lanes[GUM_SCRIPT_JOB_LANE_LOW];
+
+  if (gum_script_job_lane_push (lane, job))
+    g_main_context_wakeup (self->js_context);
 
   gum_script_scheduler_start (self);
 }
@@ -181,14 +253,6 @@ gum_script_scheduler_push_job_on_thread_pool (GumScriptScheduler * self,
       NULL);
 }
 
-static gboolean
-gum_script_scheduler_perform_js_job (GumScriptJob * job)
-{
-  job->func (job->data);
-
-  return FALSE;
-}
-
 static void
 gum_script_scheduler_perform_pool_job (GumScriptJob * job,
                                        GumScriptScheduler * self)
@@ -208,6 +272,137 @@ gum_script_scheduler_run_js_loop (GumScriptScheduler * self)
   return NULL;
 }
 
+static GumScriptJobLane *
+gum_script_job_lane_new (GMainContext * context,
+                         gint priority)
+{
+  GSource * source;
+  GumScriptJobLane * lane;
+
+  source = g_source_new (&gum_script_job_lane_funcs, sizeof (GumScriptJobLane));
+  g_source_set_priority (source, priority);
+  g_source_set_can_recurse (source, TRUE);
+
+  lane = (GumScriptJobLane *) source;
+  lane->head = NULL;
+
+  g_source_attach (source, context);
+
+  return lane;
+}
+
+static void
+gum_script_job_lane_destroy (GumScriptJobLane * lane)
+{
+  GSource * source = (GSource *) lane;
+  GumScriptJob * job, * next;
+
+  g_source_destroy (source);
+
+  for (job = gum_script_job_lane_take_all (lane); job != NULL; job = next)
+  {
+    next = job->next;
+
+    if (job->free_after_run)
+      gum_script_job_free (job);
+  }
+
+  g_source_unref (source);
+}
+
+static gboolean
+gum_script_job_lane_push (GumScriptJobLane * lane,
+                          GumScriptJob * job)
+{
+  GumScriptJob * head;
+
+  do
+  {
+    head = g_atomic_pointer_get (&lane->head);
+    job->next = head;
+  }
+  while (!g_atomic_pointer_compare_and_exchange (&lane->head, head, job));
+
+  return head == NULL;
+}
+
+static GumScriptJob *
+gum_script_job_lane_take_all (GumScriptJobLane * lane)
+{
+  GumScriptJob * head, * fifo;
+
+  do
+  {
+    head = g_atomic_pointer_get (&lane->head);
+  }
+  while (!g_atomic_pointer_compare_and_exchange (&lane->head, head, NULL));
+
+  fifo = NULL;
+  while (head != NULL)
+  {
+    GumScriptJob * next = head->next;
+
+    head->next = fifo;
+    fifo = head;
+
+    head = next;
+  }
+
+  return fifo;
+}
+
+static gboolean
+gum_script_job_lane_prepare (GSource * source,
+                             gint * timeout)
+{
+  GumScriptJobLane * lane = (GumScriptJobLane *) source;
+
+  *timeout = -1;
+
+  return g_atomic_pointer_get (&lane->head) != NULL;
+}
+
+static gboolean
+gum_script_job_lane_check (GSource * source)
+{
+  GumScriptJobLane * lane = (GumScriptJobLane *) source;
+
+  return g_atomic_pointer_get (&lane->head) != NULL;
+}
+
+static gboolean
+gum_script_job_lane_dispatch (GSource * source,
+                              GSourceFunc callback,
+                              gpointer user_data)
+{
+  GumScriptJobLane * lane = (GumScriptJobLane *) source;
+  GumScriptJob * job, * next;
+
+  /*
+   * Jobs pushed while we drain end up in the next batch, so a busy producer
+   * cannot starve the other sources on the loop.
+   */
+  for (job = gum_script_job_lane_take_all (lane); job != NULL; job = next)
+  {
+    next = job->next;
+
+    gum_script_job_run (job);
+  }
+
+  return G_SOURCE_CONTINUE;
+}
+
+static void
+gum_script_job_run (GumScriptJob * job)
+{
+  gboolean free_after_run = job->free_after_run;
+
+  job->func (job->data);
+
+  if (free_after_run)
+    gum_script_job_free (job);
+}
+
 GumScriptJob *
 gum_script_job_new (GumScriptScheduler * scheduler,
                     GumScriptJobFunc func,
@@ -223,6 +418,9 @@ gum_script_job_new (GumScriptScheduler * scheduler,
 
   job->scheduler = scheduler;
 
+  job->next = NULL;
+  job->free_after_run = FALSE;
+
   return job;
 }
 
@@ -246,17 +444,7 @@ gum_script_job_start_on_js_thread (GumScriptJob * job)
   }
   else
   {
-    GSource * source;
-
-    source = g_idle_source_new ();
-    g_source_set_priority (source, G_PRIORITY_DEFAULT);
-    g_source_set_callback (source,
-        (GSourceFunc) gum_script_scheduler_perform_js_job,
-        job,
-        NULL);
-    g_source_attach (source, js_context);
-    g_source_unref (source);
-
-    gum_script_scheduler_start (job->scheduler);
+    gum_script_scheduler_enqueue_js_job (job->scheduler, G_PRIORITY_DEFAULT,
+        job);
   }
 }
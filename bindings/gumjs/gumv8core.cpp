@@ -1250,8 +1250,11 @@ GUMJS_DEFINE_FUNCTION (gumjs_send)
    * This is very important for the RPC API.
    */
   auto interceptor = core->script->interceptor.interceptor;
-  gum_interceptor_end_transaction (interceptor);
-  gum_interceptor_begin_transaction (interceptor);
+  if (gum_interceptor_has_pending_changes (interceptor))
+  {
+    gum_interceptor_end_transaction (interceptor);
+    gum_interceptor_begin_transaction (interceptor);
+  }
 
   core->message_emitter (core->script, message, data);
 
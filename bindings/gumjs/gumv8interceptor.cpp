@@ -137,10 +137,20 @@ struct GumV8ReplaceEntry
   GumPersistent<Value>::type * replacement;
 };
 
+struct GumV8StatsCollectContext
+{
+  Local<Array> result;
+  uint32_t index;
+
+  GumV8Core * core;
+};
+
 static gboolean gum_v8_interceptor_on_flush_timer_tick (
     GumV8Interceptor * self);
 
 GUMJS_DECLARE_FUNCTION (gumjs_interceptor_attach)
+static GArray * gum_v8_interceptor_targets_get (Local<Array> values,
+    GumV8Core * core);
 static void gum_v8_invocation_listener_destroy (
     GumV8InvocationListener * listener);
 GUMJS_DECLARE_FUNCTION (gumjs_interceptor_detach_all)
@@ -148,6 +158,11 @@ GUMJS_DECLARE_FUNCTION (gumjs_interceptor_replace)
 static void gum_v8_replace_entry_free (GumV8ReplaceEntry * entry);
 GUMJS_DECLARE_FUNCTION (gumjs_interceptor_revert)
 GUMJS_DECLARE_FUNCTION (gumjs_interceptor_flush)
+GUMJS_DECLARE_FUNCTION (gumjs_interceptor_set_stats_enabled)
+GUMJS_DECLARE_FUNCTION (gumjs_interceptor_enumerate_stats)
+static gboolean gum_v8_interceptor_collect_stats (const GumHookStats * stats,
+    GumV8StatsCollectContext * sc);
+GUMJS_DECLARE_FUNCTION (gumjs_interceptor_reset_stats)
 
 GUMJS_DECLARE_FUNCTION (gumjs_invocation_listener_detach)
 static void gum_v8_invocation_listener_dispose (GObject * object);
@@ -269,6 +284,9 @@ static const GumV8Function gumjs_interceptor_functions[] =
   { "_replace", gumjs_interceptor_replace },
   { "revert", gumjs_interceptor_revert },
   { "flush", gumjs_interceptor_flush },
+  { "_setStatsEnabled", gumjs_interceptor_set_stats_enabled },
+  { "enumerateStats", gumjs_interceptor_enumerate_stats },
+  { "resetStats", gumjs_interceptor_reset_stats },
 
   { NULL, NULL }
 };
@@ -340,6 +358,7 @@ _gum_v8_interceptor_init (GumV8Interceptor * self,
   self->replacement_by_address = g_hash_table_new_full (NULL, NULL, NULL,
       (GDestroyNotify) gum_v8_replace_entry_free);
   self->flush_timer = NULL;
+  self->stats_enabled = FALSE;
 
   auto module = External::New (isolate, self);
 
@@ -441,6 +460,12 @@ _gum_v8_interceptor_flush (GumV8Interceptor * self)
   {
     ScriptUnlocker unlocker (core);
 
+    if (self->stats_enabled)
+    {
+      gum_interceptor_set_stats_enabled (self->interceptor, FALSE);
+      self->stats_enabled = FALSE;
+    }
+
     flushed = gum_interceptor_flush (self->interceptor);
   }
 
@@ -546,17 +571,27 @@ GUMJS_DEFINE_FUNCTION (gumjs_interceptor_attach)
     return;
   }
 
-  gpointer target;
+  gpointer target = NULL;
+  GArray * targets = NULL;
   GumV8InvocationListener * listener;
   auto target_val = info[0];
   auto callback_val = info[1];
   auto native_pointer = Local<FunctionTemplate>::New (isolate,
       *core->native_pointer);
-  if (callback_val->IsFunction ())
+
+  if (target_val->IsArray ())
   {
-    if (!_gum_v8_native_pointer_get (target_val, &target, core))
+    targets = gum_v8_interceptor_targets_get (target_val.As<Array> (), core);
+    if (targets == NULL)
       return;
+  }
+  else if (!_gum_v8_native_pointer_get (target_val, &target, core))
+  {
+    return;
+  }
 
+  if (callback_val->IsFunction ())
+  {
     auto l = GUM_V8_JS_PROBE_LISTENER (
         g_object_new (GUM_V8_TYPE_JS_PROBE_LISTENER, NULL));
     l->on_hit = new GumPersistent<Function>::type (isolate,
@@ -566,9 +601,6 @@ GUMJS_DEFINE_FUNCTION (gumjs_interceptor_attach)
   }
   else if (native_pointer->HasInstance (callback_val))
   {
-    if (!_gum_v8_native_pointer_get (target_val, &target, core))
-      return;
-
     auto l = GUM_V8_C_PROBE_LISTENER (
         g_object_new (GUM_V8_TYPE_C_PROBE_LISTENER, NULL));
     l->on_hit = GUM_POINTER_TO_FUNCPTR (GumV8CHook,
@@ -578,13 +610,15 @@ GUMJS_DEFINE_FUNCTION (gumjs_interceptor_attach)
   }
   else
   {
+    Local<Value> target_js;
     Local<Function> on_enter_js, on_leave_js;
     GumV8CHook on_enter_c, on_leave_c;
 
-    if (!_gum_v8_args_parse (args, "pF*{onEnter?,onLeave?}", &target,
+    if (!_gum_v8_args_parse (args, "VF*{onEnter?,onLeave?}", &target_js,
         &on_enter_js, &on_enter_c,
         &on_leave_js, &on_leave_c))
     {
+      g_clear_pointer (&targets, g_array_unref);
       return;
     }
 
@@ -610,6 +644,7 @@ GUMJS_DEFINE_FUNCTION (gumjs_interceptor_attach)
     }
     else
     {
+      g_clear_pointer (&targets, g_array_unref);
       _gum_v8_throw_ascii_literal (isolate, "expected at least one callback");
       return;
     }
@@ -625,6 +660,7 @@ GUMJS_DEFINE_FUNCTION (gumjs_interceptor_attach)
   {
     if (!_gum_v8_native_pointer_get (data_val, &listener_function_data, core))
     {
+      g_clear_pointer (&targets, g_array_unref);
       g_object_unref (listener);
       return;
     }
@@ -634,8 +670,41 @@ GUMJS_DEFINE_FUNCTION (gumjs_interceptor_attach)
     listener_function_data = NULL;
   }
 
-  auto attach_ret = gum_interceptor_attach (module->interceptor, target,
-      GUM_INVOCATION_LISTENER (listener), listener_function_data);
+  GumAttachReturn attach_ret;
+  if (targets != NULL)
+  {
+    auto results = g_new (GumAttachReturn, targets->len);
+
+    gum_interceptor_attach_many (module->interceptor,
+        (const gpointer *) targets->data, targets->len,
+        GUM_INVOCATION_LISTENER (listener), listener_function_data, results);
+
+    attach_ret = GUM_ATTACH_OK;
+    for (guint i = 0; i != targets->len; i++)
+    {
+      if (results[i] != GUM_ATTACH_OK)
+      {
+        attach_ret = results[i];
+        target = g_array_index (targets, gpointer, i);
+        break;
+      }
+    }
+
+    g_free (results);
+
+    if (attach_ret != GUM_ATTACH_OK)
+    {
+      gum_interceptor_detach (module->interceptor,
+          GUM_INVOCATION_LISTENER (listener));
+    }
+
+    g_array_unref (targets);
+  }
+  else
+  {
+    attach_ret = gum_interceptor_attach (module->interceptor, target,
+        GUM_INVOCATION_LISTENER (listener), listener_function_data);
+  }
 
   if (attach_ret == GUM_ATTACH_OK)
   {
@@ -671,11 +740,39 @@ GUMJS_DEFINE_FUNCTION (gumjs_interceptor_attach)
       _gum_v8_throw_ascii_literal (isolate,
           "not permitted by code-signing policy");
       break;
+    case GUM_ATTACH_WRONG_TYPE:
+      _gum_v8_throw_ascii_literal (isolate,
+          "function is replaced using the fast path and cannot be attached to");
+      break;
     default:
       g_assert_not_reached ();
   }
 }
 
+static GArray *
+gum_v8_interceptor_targets_get (Local<Array> values,
+                                GumV8Core * core)
+{
+  auto context = core->isolate->GetCurrentContext ();
+
+  uint32_t length = values->Length ();
+  auto targets = g_array_sized_new (FALSE, FALSE, sizeof (gpointer), length);
+  for (uint32_t i = 0; i != length; i++)
+  {
+    Local<Value> value;
+    gpointer target;
+    if (!values->Get (context, i).ToLocal (&value) ||
+        !_gum_v8_native_pointer_get (value, &target, core))
+    {
+      g_array_free (targets, TRUE);
+      return NULL;
+    }
+    g_array_append_val (targets, target);
+  }
+
+  return targets;
+}
+
 static void
 gum_v8_invocation_listener_destroy (GumV8InvocationListener * listener)
 {
@@ -740,6 +837,9 @@ GUMJS_DEFINE_FUNCTION (gumjs_interceptor_replace)
       _gum_v8_throw_ascii_literal (isolate,
           "not permitted by code-signing policy");
       break;
+    case GUM_REPLACE_WRONG_TYPE:
+      _gum_v8_throw_ascii_literal (isolate, "already replaced this function");
+      break;
     default:
       g_assert_not_reached ();
   }
@@ -772,6 +872,58 @@ GUMJS_DEFINE_FUNCTION (gumjs_interceptor_flush)
   gum_interceptor_begin_transaction (interceptor);
 }
 
+GUMJS_DEFINE_FUNCTION (gumjs_interceptor_set_stats_enabled)
+{
+  gboolean enabled;
+  if (!_gum_v8_args_parse (args, "t", &enabled))
+    return;
+
+  gum_interceptor_set_stats_enabled (module->interceptor, enabled);
+  module->stats_enabled = enabled;
+}
+
+GUMJS_DEFINE_FUNCTION (gumjs_interceptor_enumerate_stats)
+{
+  GumV8StatsCollectContext sc;
+  sc.result = Array::New (isolate);
+  sc.index = 0;
+  sc.core = core;
+
+  gum_interceptor_enumerate_stats (module->interceptor,
+      (GumFoundHookStatsFunc) gum_v8_interceptor_collect_stats, &sc);
+
+  info.GetReturnValue ().Set (sc.result);
+}
+
+static gboolean
+gum_v8_interceptor_collect_stats (const GumHookStats * stats,
+                                  GumV8StatsCollectContext * sc)
+{
+  auto core = sc->core;
+  auto isolate = core->isolate;
+  auto context = isolate->GetCurrentContext ();
+
+  auto s = Object::New (isolate);
+  _gum_v8_object_set_pointer (s, "target", stats->function_address, core);
+  _gum_v8_object_set (s, "enters",
+      Number::New (isolate, (double) stats->enter_count), core);
+  _gum_v8_object_set (s, "leaves",
+      Number::New (isolate, (double) stats->leave_count), core);
+  _gum_v8_object_set (s, "bypasses",
+      Number::New (isolate, (double) stats->bypass_count), core);
+  _gum_v8_object_set (s, "listenerTime",
+      Number::New (isolate, (double) stats->listener_time), core);
+
+  sc->result->Set (context, sc->index++, s).Check ();
+
+  return TRUE;
+}
+
+GUMJS_DEFINE_FUNCTION (gumjs_interceptor_reset_stats)
+{
+  gum_interceptor_reset_stats (module->interceptor);
+}
+
 GUMJS_DEFINE_CLASS_METHOD (gumjs_invocation_listener_detach,
                            GumV8InvocationListener)
 {
@@ -27,6 +27,7 @@ struct GumV8Interceptor
   GHashTable * invocation_return_values;
   GHashTable * replacement_by_address;
   GSource * flush_timer;
+  gboolean stats_enabled;
 
   GumPersistent<v8::FunctionTemplate>::type * invocation_listener;
   GumPersistent<v8::FunctionTemplate>::type * invocation_context;
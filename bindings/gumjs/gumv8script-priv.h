@@ -29,6 +29,7 @@
 #include "gumv8stream.h"
 #include "gumv8symbol.h"
 #include "gumv8thread.h"
+#include "gummessagebatcher.h"
 
 typedef guint GumScriptState;
 
@@ -38,6 +39,7 @@ struct _GumV8Script
 
   gchar * name;
   gchar * source;
+  GBytes * code_cache;
   GMainContext * main_context;
   GumV8ScriptBackend * backend;
 
@@ -68,6 +70,8 @@ struct _GumV8Script
   GumScriptMessageHandler message_handler;
   gpointer message_handler_data;
   GDestroyNotify message_handler_data_destroy;
+  GMutex message_batcher_mutex;
+  GumMessageBatcher * message_batcher;
 };
 
 #endif
@@ -27,6 +27,7 @@ enum
   PROP_0,
   PROP_NAME,
   PROP_SOURCE,
+  PROP_CODE_CACHE,
   PROP_MAIN_CONTEXT,
   PROP_BACKEND
 };
@@ -98,6 +99,8 @@ static void gum_v8_script_once_unloaded (GumV8Script * self,
 static void gum_v8_script_set_message_handler (GumScript * script,
     GumScriptMessageHandler handler, gpointer data,
     GDestroyNotify data_destroy);
+static void gum_v8_script_set_message_batching (GumScript * script,
+    gsize max_size, guint max_delay);
 static void gum_v8_script_post (GumScript * script, const gchar * message,
     GBytes * data);
 static void gum_v8_script_do_post (GumPostData * d);
@@ -107,6 +110,13 @@ static GumStalker * gum_v8_script_get_stalker (GumScript * script);
 
 static void gum_v8_script_emit (GumV8Script * self, const gchar * message,
     GBytes * data);
+static GumMessageBatcher * gum_v8_script_ref_message_batcher (
+    GumV8Script * self);
+static void gum_v8_script_flush_message_batcher (GumV8Script * self);
+static void gum_v8_script_emit_batch (const gchar * message, GBytes * data,
+    GumV8Script * self);
+static void gum_v8_script_schedule_emit (GumV8Script * self,
+    const gchar * message, GBytes * data);
 static gboolean gum_v8_script_do_emit (GumEmitData * d);
 static void gum_v8_emit_data_free (GumEmitData * d);
 
@@ -138,6 +148,11 @@ gum_v8_script_class_init (GumV8ScriptClass * klass)
       g_param_spec_string ("source", "Source", "Source code", NULL,
       (GParamFlags) (G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY |
       G_PARAM_STATIC_STRINGS)));
+  g_object_class_install_property (object_class, PROP_CODE_CACHE,
+      g_param_spec_boxed ("code-cache", "CodeCache", "V8 code cache",
+      G_TYPE_BYTES,
+      (GParamFlags) (G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY |
+      G_PARAM_STATIC_STRINGS)));
   g_object_class_install_property (object_class, PROP_MAIN_CONTEXT,
       g_param_spec_boxed ("main-context", "MainContext",
       "MainContext being used", G_TYPE_MAIN_CONTEXT,
@@ -171,6 +186,7 @@ gum_v8_script_iface_init (gpointer g_iface,
   iface->unload_sync = gum_v8_script_unload_sync;
 
   iface->set_message_handler = gum_v8_script_set_message_handler;
+  iface->set_message_batching = gum_v8_script_set_message_batching;
   iface->post = gum_v8_script_post;
 
   iface->get_stalker = gum_v8_script_get_stalker;
@@ -181,6 +197,8 @@ gum_v8_script_init (GumV8Script * self)
 {
   self->state = GUM_SCRIPT_STATE_UNLOADED;
   self->on_unload = NULL;
+
+  g_mutex_init (&self->message_batcher_mutex);
 }
 
 static void
@@ -213,6 +231,8 @@ gum_v8_script_dispose (GObject * object)
 
     self->isolate = NULL;
 
+    gum_v8_script_set_message_batching (script, 0, 0);
+
     g_clear_pointer (&self->main_context, g_main_context_unref);
     g_clear_pointer (&self->backend, g_object_unref);
   }
@@ -227,6 +247,9 @@ gum_v8_script_finalize (GObject * object)
 
   g_free (self->name);
   g_free (self->source);
+  g_clear_pointer (&self->code_cache, g_bytes_unref);
+
+  g_mutex_clear (&self->message_batcher_mutex);
 
   G_OBJECT_CLASS (gum_v8_script_parent_class)->finalize (object);
 }
@@ -247,6 +270,9 @@ gum_v8_script_get_property (GObject * object,
     case PROP_SOURCE:
       g_value_set_string (value, self->source);
       break;
+    case PROP_CODE_CACHE:
+      g_value_set_boxed (value, self->code_cache);
+      break;
     case PROP_MAIN_CONTEXT:
       g_value_set_boxed (value, self->main_context);
       break;
@@ -276,6 +302,10 @@ gum_v8_script_set_property (GObject * object,
       g_free (self->source);
       self->source = g_value_dup_string (value);
       break;
+    case PROP_CODE_CACHE:
+      g_clear_pointer (&self->code_cache, g_bytes_unref);
+      self->code_cache = (GBytes *) g_value_dup_boxed (value);
+      break;
     case PROP_MAIN_CONTEXT:
       if (self->main_context != NULL)
         g_main_context_unref (self->main_context);
@@ -363,7 +393,25 @@ gum_v8_script_create_context (GumV8Script * self,
     auto source = String::NewFromUtf8 (isolate, self->source).ToLocalChecked ();
 
     TryCatch trycatch (isolate);
-    auto maybe_code = Script::Compile (context, source, &origin);
+    MaybeLocal<Script> maybe_code;
+    if (self->code_cache != NULL)
+    {
+      gsize size;
+      auto data = (const uint8_t *) g_bytes_get_data (self->code_cache, &size);
+
+      /*
+       * If V8 rejects the cache, e.g. due to a version or flags mismatch, it
+       * silently falls back to compiling the source.
+       */
+      ScriptCompiler::Source source_value (source, origin,
+          new ScriptCompiler::CachedData (data, size));
+      maybe_code = ScriptCompiler::Compile (context, &source_value,
+          ScriptCompiler::kConsumeCodeCache);
+    }
+    else
+    {
+      maybe_code = Script::Compile (context, source, &origin);
+    }
     Local<Script> code;
     if (maybe_code.ToLocal (&code))
     {
@@ -625,6 +673,8 @@ gum_v8_script_try_unload (GumV8Script * self)
   {
     gum_v8_script_destroy_context (self);
 
+    gum_v8_script_flush_message_batcher (self);
+
     self->state = GUM_SCRIPT_STATE_UNLOADED;
 
     while (self->on_unload != NULL)
@@ -671,6 +721,33 @@ gum_v8_script_set_message_handler (GumScript * script,
   self->message_handler_data_destroy = data_destroy;
 }
 
+static void
+gum_v8_script_set_message_batching (GumScript * script,
+                                    gsize max_size,
+                                    guint max_delay)
+{
+  auto self = GUM_V8_SCRIPT (script);
+
+  GumMessageBatcher * new_batcher = NULL;
+  if (max_size != 0)
+  {
+    new_batcher = gum_message_batcher_new (max_size, max_delay,
+        self->main_context, (GumMessageBatchFunc) gum_v8_script_emit_batch,
+        self);
+  }
+
+  g_mutex_lock (&self->message_batcher_mutex);
+  auto old_batcher = self->message_batcher;
+  g_atomic_pointer_set (&self->message_batcher, new_batcher);
+  g_mutex_unlock (&self->message_batcher_mutex);
+
+  if (old_batcher != NULL)
+  {
+    gum_message_batcher_flush (old_batcher);
+    gum_message_batcher_free (old_batcher);
+  }
+}
+
 static void
 gum_v8_script_post (GumScript * script,
                     const gchar * message,
@@ -716,10 +793,67 @@ gum_v8_script_get_stalker (GumScript * script)
   return _gum_v8_stalker_get (&self->stalker);
 }
 
+/*
+ * Batching is usually off, so emitters only take the lock when there is a
+ * batcher, and just long enough to grab a reference to it. It may get swapped
+ * out right after, in which case the batcher passes the message through on
+ * its own.
+ */
 static void
 gum_v8_script_emit (GumV8Script * self,
                     const gchar * message,
                     GBytes * data)
+{
+  auto batcher = gum_v8_script_ref_message_batcher (self);
+  if (batcher != NULL)
+  {
+    gum_message_batcher_add (batcher, message, data);
+    gum_message_batcher_unref (batcher);
+  }
+  else
+  {
+    gum_v8_script_schedule_emit (self, message, data);
+  }
+}
+
+static GumMessageBatcher *
+gum_v8_script_ref_message_batcher (GumV8Script * self)
+{
+  if (g_atomic_pointer_get (&self->message_batcher) == NULL)
+    return NULL;
+
+  g_mutex_lock (&self->message_batcher_mutex);
+  auto batcher = self->message_batcher;
+  if (batcher != NULL)
+    gum_message_batcher_ref (batcher);
+  g_mutex_unlock (&self->message_batcher_mutex);
+
+  return batcher;
+}
+
+static void
+gum_v8_script_flush_message_batcher (GumV8Script * self)
+{
+  auto batcher = gum_v8_script_ref_message_batcher (self);
+  if (batcher == NULL)
+    return;
+
+  gum_message_batcher_flush (batcher);
+  gum_message_batcher_unref (batcher);
+}
+
+static void
+gum_v8_script_emit_batch (const gchar * message,
+                          GBytes * data,
+                          GumV8Script * self)
+{
+  gum_v8_script_schedule_emit (self, message, data);
+}
+
+static void
+gum_v8_script_schedule_emit (GumV8Script * self,
+                             const gchar * message,
+                             GBytes * data)
 {
   auto d = g_slice_new (GumEmitData);
   d->script = self;
@@ -32,6 +32,8 @@
 # define GUM_V8_PLATFORM_FLAGS
 #endif
 
+#define GUM_V8_COMPILED_SCRIPT_MAGIC 0x43385647
+
 #define GUM_V8_FLAGS \
     GUM_V8_PLATFORM_FLAGS \
     "--use-strict " \
@@ -101,6 +103,19 @@ struct GumCompileScriptData
   gchar * source;
 };
 
+/*
+ * Compiled scripts are laid out as this header followed by the name, source,
+ * and V8 code cache, back to back and without terminators.
+ */
+struct GumV8CompiledScriptHeader
+{
+  guint32 magic;
+  guint32 version_tag;
+  guint32 name_size;
+  guint32 source_size;
+  guint32 code_cache_size;
+};
+
 struct GumEmitDebugMessageData
 {
   GumV8ScriptBackend * backend;
@@ -205,6 +220,10 @@ static void gum_compile_script_task_run (GumScriptTask * task,
     GumV8ScriptBackend * self, GumCompileScriptData * d,
     GCancellable * cancellable);
 static void gum_compile_script_data_free (GumCompileScriptData * d);
+static GBytes * gum_v8_compiled_script_build (const gchar * name,
+    const gchar * source, const ScriptCompiler::CachedData * code_cache);
+static gboolean gum_v8_compiled_script_parse (GBytes * bytes, gchar ** name,
+    gchar ** source, GBytes ** code_cache);
 
 static void gum_v8_script_backend_set_debug_message_handler (
     GumScriptBackend * backend, GumScriptBackendDebugMessageHandler handler,
@@ -588,9 +607,52 @@ gum_create_script_from_bytes_task_run (GumScriptTask * task,
                                        GumCreateScriptFromBytesData * d,
                                        GCancellable * cancellable)
 {
-  auto error = g_error_new (G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
-      "not yet supported by the V8 runtime");
-  gum_script_task_return_error (task, error);
+  auto isolate = GUM_V8_SCRIPT_BACKEND_GET_ISOLATE (self);
+
+  gchar * name, * source;
+  GBytes * code_cache;
+  if (!gum_v8_compiled_script_parse (d->bytes, &name, &source, &code_cache))
+  {
+    gum_script_task_return_error (task, g_error_new (G_IO_ERROR,
+        G_IO_ERROR_INVALID_DATA, "invalid compiled script"));
+    return;
+  }
+
+  auto script = GUM_V8_SCRIPT (g_object_new (GUM_V8_TYPE_SCRIPT,
+      "name", name,
+      "source", source,
+      "code-cache", code_cache,
+      "main-context", gum_script_task_get_context (task),
+      "backend", self,
+      NULL));
+  g_signal_connect_swapped (script, "context-created",
+      G_CALLBACK (gum_v8_script_backend_on_context_created), self);
+  g_signal_connect_swapped (script, "context-destroyed",
+      G_CALLBACK (gum_v8_script_backend_on_context_destroyed), self);
+
+  g_free (name);
+  g_free (source);
+  g_clear_pointer (&code_cache, g_bytes_unref);
+
+  GError * error = NULL;
+
+  {
+    Locker locker (isolate);
+    Isolate::Scope isolate_scope (isolate);
+    HandleScope handle_scope (isolate);
+
+    gum_v8_script_create_context (script, &error);
+  }
+
+  if (error == NULL)
+  {
+    gum_script_task_return_pointer (task, script, g_object_unref);
+  }
+  else
+  {
+    gum_script_task_return_error (task, error);
+    g_object_unref (script);
+  }
 }
 
 static void
@@ -688,9 +750,59 @@ gum_compile_script_task_run (GumScriptTask * task,
                              GumCompileScriptData * d,
                              GCancellable * cancellable)
 {
-  auto error = g_error_new (G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
-      "not yet supported by the V8 runtime");
-  gum_script_task_return_error (task, error);
+  auto isolate = GUM_V8_SCRIPT_BACKEND_GET_ISOLATE (self);
+  GBytes * bytes = NULL;
+  GError * error = NULL;
+
+  {
+    Locker locker (isolate);
+    Isolate::Scope isolate_scope (isolate);
+    HandleScope handle_scope (isolate);
+    auto context = Context::New (isolate);
+    Context::Scope context_scope (context);
+
+    auto resource_name_str = g_strconcat ("/", d->name, ".js", NULL);
+    auto resource_name = String::NewFromUtf8 (isolate, resource_name_str)
+        .ToLocalChecked ();
+    ScriptOrigin origin (resource_name);
+    g_free (resource_name_str);
+
+    auto source = String::NewFromUtf8 (isolate, d->source).ToLocalChecked ();
+    ScriptCompiler::Source source_value (source, origin);
+
+    /*
+     * Compile eagerly so the cache covers every function, not just the
+     * top-level code, which is what makes consuming it worthwhile.
+     */
+    TryCatch trycatch (isolate);
+    Local<UnboundScript> code;
+    if (ScriptCompiler::CompileUnboundScript (isolate, &source_value,
+        ScriptCompiler::kEagerCompile).ToLocal (&code))
+    {
+      auto code_cache = ScriptCompiler::CreateCodeCache (code);
+      bytes = gum_v8_compiled_script_build (d->name, d->source, code_cache);
+      delete code_cache;
+    }
+    else
+    {
+      Local<Message> message = trycatch.Message ();
+      Local<Value> exception = trycatch.Exception ();
+      String::Utf8Value exception_str (isolate, exception);
+      error = g_error_new (G_IO_ERROR, G_IO_ERROR_FAILED,
+          "Script(line %d): %s",
+          message->GetLineNumber (context).FromMaybe (-1), *exception_str);
+    }
+  }
+
+  if (error == NULL)
+  {
+    gum_script_task_return_pointer (task, bytes,
+        (GDestroyNotify) g_bytes_unref);
+  }
+  else
+  {
+    gum_script_task_return_error (task, error);
+  }
 }
 
 static void
@@ -702,6 +814,73 @@ gum_compile_script_data_free (GumCompileScriptData * d)
   g_slice_free (GumCompileScriptData, d);
 }
 
+static GBytes *
+gum_v8_compiled_script_build (const gchar * name,
+                              const gchar * source,
+                              const ScriptCompiler::CachedData * code_cache)
+{
+  GumV8CompiledScriptHeader header;
+  header.magic = GUM_V8_COMPILED_SCRIPT_MAGIC;
+  header.version_tag = ScriptCompiler::CachedDataVersionTag ();
+  header.name_size = strlen (name);
+  header.source_size = strlen (source);
+  header.code_cache_size = (code_cache != NULL) ? code_cache->length : 0;
+
+  auto blob = g_byte_array_sized_new (sizeof (header) + header.name_size +
+      header.source_size + header.code_cache_size);
+  g_byte_array_append (blob, (const guint8 *) &header, sizeof (header));
+  g_byte_array_append (blob, (const guint8 *) name, header.name_size);
+  g_byte_array_append (blob, (const guint8 *) source, header.source_size);
+  if (code_cache != NULL)
+    g_byte_array_append (blob, code_cache->data, code_cache->length);
+
+  return g_byte_array_free_to_bytes (blob);
+}
+
+static gboolean
+gum_v8_compiled_script_parse (GBytes * bytes,
+                              gchar ** name,
+                              gchar ** source,
+                              GBytes ** code_cache)
+{
+  gsize size;
+  auto data = (const guint8 *) g_bytes_get_data (bytes, &size);
+
+  GumV8CompiledScriptHeader header;
+  if (size < sizeof (header))
+    return FALSE;
+  memcpy (&header, data, sizeof (header));
+
+  if (header.magic != GUM_V8_COMPILED_SCRIPT_MAGIC)
+    return FALSE;
+
+  if ((guint64) sizeof (header) + header.name_size + header.source_size +
+      header.code_cache_size != size)
+    return FALSE;
+
+  auto cursor = (const gchar *) data + sizeof (header);
+
+  *name = g_strndup (cursor, header.name_size);
+  cursor += header.name_size;
+
+  *source = g_strndup (cursor, header.source_size);
+  cursor += header.source_size;
+
+  /* A cache from a different V8 build is useless, so don't even offer it. */
+  if (header.code_cache_size != 0 &&
+      header.version_tag == ScriptCompiler::CachedDataVersionTag ())
+  {
+    *code_cache = g_bytes_new_from_bytes (bytes,
+        (gsize) (cursor - (const gchar *) data), header.code_cache_size);
+  }
+  else
+  {
+    *code_cache = NULL;
+  }
+
+  return TRUE;
+}
+
 static void
 gum_v8_script_backend_set_debug_message_handler (
     GumScriptBackend * backend,
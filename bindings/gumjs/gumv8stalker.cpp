@@ -552,11 +552,13 @@ GUMJS_DEFINE_FUNCTION (gumjs_stalker_follow)
   so.queue_drain_interval = module->queue_drain_interval;
 
   gpointer user_data;
+  gpointer coverage_bitmap;
+  gsize coverage_size;
 
-  if (!_gum_v8_args_parse (args, "ZF*?uF?F?pp", &thread_id,
+  if (!_gum_v8_args_parse (args, "ZF*?uF?F?pppZ", &thread_id,
       &transformer_callback_js, &transformer_callback_c,
       &so.event_mask, &so.on_receive, &so.on_call_summary,
-      &so.on_event, &user_data))
+      &so.on_event, &user_data, &coverage_bitmap, &coverage_size))
     return;
 
   so.user_data = user_data;
@@ -579,6 +581,11 @@ GUMJS_DEFINE_FUNCTION (gumjs_stalker_follow)
     transformer = gum_stalker_transformer_make_from_callback (
         transformer_callback_c, user_data, NULL);
   }
+  else if (coverage_bitmap != NULL)
+  {
+    transformer = gum_stalker_transformer_make_edge_coverage (
+        (guint8 *) coverage_bitmap, coverage_size, NULL, NULL);
+  }
 
   auto sink = gum_v8_event_sink_new (&so);
   if (thread_id == gum_process_get_current_thread_id ())
@@ -1,5 +1,3 @@
-const hexdump = require('./hexdump');
-
 const engine = global;
 const slice = Array.prototype.slice;
 
@@ -31,7 +29,7 @@ function sendLogMessage(level, values) {
 
 function parseLogArgument(value) {
   if (value instanceof ArrayBuffer)
-    return hexdump(value);
+    return engine.hexdump(value);
 
   if (value === undefined)
     return 'undefined';
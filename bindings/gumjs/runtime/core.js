@@ -1,5 +1,4 @@
 const Console = require('./console');
-const hexdump = require('./hexdump');
 const MessageDispatcher = require('./message-dispatcher');
 
 const engine = global;
@@ -104,7 +103,12 @@ Object.defineProperties(engine, {
   },
   hexdump: {
     enumerable: true,
-    value: hexdump
+    configurable: true,
+    get: function () {
+      const m = require('./hexdump');
+      Object.defineProperty(engine, 'hexdump', { value: m });
+      return m;
+    }
   },
   ObjC: {
     enumerable: true,
@@ -169,9 +173,11 @@ Script.nextTick = function (callback, ...args) {
   _nextTick(callback.bind(engine, ...args));
 };
 
-makeEnumerateApi(Kernel, 'enumerateModules', 0);
-makeEnumerateRanges(Kernel);
-makeEnumerateApi(Kernel, 'enumerateModuleRanges', 2);
+defineLazyApi(['Kernel'], () => {
+  makeEnumerateApi(Kernel, 'enumerateModules', 0);
+  makeEnumerateRanges(Kernel);
+  makeEnumerateApi(Kernel, 'enumerateModuleRanges', 2);
+});
 
 Object.defineProperties(Memory, {
   alloc: {
@@ -386,6 +392,13 @@ Object.defineProperties(Interceptor, {
       return Interceptor._attach(target, callbacks, data);
     }
   },
+  attachMany: {
+    enumerable: true,
+    value: function (targets, callbacks, data) {
+      targets.forEach(target => Memory._checkCodePointer(target));
+      return Interceptor._attach(targets, callbacks, data);
+    }
+  },
   replace: {
     enumerable: true,
     value: function (target, replacement, data) {
@@ -393,290 +406,326 @@ Object.defineProperties(Interceptor, {
       Interceptor._replace(target, replacement, data);
     }
   },
-});
-
-const stalkerEventType = {
-  call: 1,
-  ret: 2,
-  exec: 4,
-  block: 8,
-  compile: 16,
-};
-
-Object.defineProperties(Stalker, {
-  exclude: {
+  enableStats: {
     enumerable: true,
-    value: function (range) {
-      Stalker._exclude(range.base, range.size);
+    value: function () {
+      Interceptor._setStatsEnabled(true);
     }
   },
-  follow: {
+  disableStats: {
     enumerable: true,
-    value: function (first, second) {
-      let threadId = first;
-      let options = second;
+    value: function () {
+      Interceptor._setStatsEnabled(false);
+    }
+  },
+});
+
+defineLazyApi(['Stalker', 'Instruction'], () => {
+  const stalkerEventType = {
+    call: 1,
+    ret: 2,
+    exec: 4,
+    block: 8,
+    compile: 16,
+  };
 
-      if (typeof first === 'object') {
-        threadId = undefined;
-        options = first;
+  Object.defineProperties(Stalker, {
+    exclude: {
+      enumerable: true,
+      value: function (range) {
+        Stalker._exclude(range.base, range.size);
       }
+    },
+    follow: {
+      enumerable: true,
+      value: function (first, second) {
+        let threadId = first;
+        let options = second;
+
+        if (typeof first === 'object') {
+          threadId = undefined;
+          options = first;
+        }
+
+        if (threadId === undefined)
+          threadId = Process.getCurrentThreadId();
+        if (options === undefined)
+          options = {};
+
+        if (typeof threadId !== 'number' || (options === null || typeof options !== 'object'))
+          throw new Error('invalid argument');
+
+        const {
+          transform = null,
+          events = {},
+          onReceive = null,
+          onCallSummary = null,
+          onEvent = NULL,
+          data = NULL,
+          coverage = null,
+        } = options;
 
-      if (threadId === undefined)
-        threadId = Process.getCurrentThreadId();
-      if (options === undefined)
-        options = {};
+        if (events === null || typeof events !== 'object')
+          throw new Error('events must be an object');
 
-      if (typeof threadId !== 'number' || (options === null || typeof options !== 'object'))
-        throw new Error('invalid argument');
+        let coverageBitmap = NULL;
+        let coverageSize = 0;
+        if (coverage !== null) {
+          if (transform !== null)
+            throw new Error('coverage precludes passing transform');
 
-      const {
-        transform = null,
-        events = {},
-        onReceive = null,
-        onCallSummary = null,
-        onEvent = NULL,
-        data = NULL,
-      } = options;
+          const { bitmap, size } = coverage;
+          if (!(bitmap instanceof NativePointer))
+            throw new Error('coverage bitmap must be a NativePointer');
+          if (typeof size !== 'number' || size <= 0 || (size & (size - 1)) !== 0)
+            throw new Error('coverage size must be a power of two');
 
-      if (events === null || typeof events !== 'object')
-        throw new Error('events must be an object');
+          coverageBitmap = bitmap;
+          coverageSize = size;
+        }
 
-      if (!data.isNull() && (onReceive !== null || onCallSummary !== null))
-        throw new Error('onEvent precludes passing onReceive/onCallSummary');
+        if (!data.isNull() && (onReceive !== null || onCallSummary !== null))
+          throw new Error('onEvent precludes passing onReceive/onCallSummary');
 
-      const eventMask = Object.keys(events).reduce((result, name) => {
-        const value = stalkerEventType[name];
-        if (value === undefined)
-          throw new Error(`unknown event type: ${name}`);
+        const eventMask = Object.keys(events).reduce((result, name) => {
+          const value = stalkerEventType[name];
+          if (value === undefined)
+            throw new Error(`unknown event type: ${name}`);
 
-        const enabled = events[name];
-        if (typeof enabled !== 'boolean')
-          throw new Error('desired events must be specified as boolean values');
+          const enabled = events[name];
+          if (typeof enabled !== 'boolean')
+            throw new Error('desired events must be specified as boolean values');
 
-        return enabled ? (result | value) : result;
-      }, 0);
+          return enabled ? (result | value) : result;
+        }, 0);
 
-      Stalker._follow(threadId, transform, eventMask, onReceive, onCallSummary, onEvent, data);
+        Stalker._follow(threadId, transform, eventMask, onReceive, onCallSummary, onEvent, data,
+            coverageBitmap, coverageSize);
+      }
+    },
+    parse: {
+      enumerable: true,
+      value: function (events, options = {}) {
+        const {
+          annotate = true,
+          stringify = false
+        } = options;
+
+        return Stalker._parse(events, annotate, stringify);
+      }
     }
-  },
-  parse: {
-    enumerable: true,
-    value: function (events, options = {}) {
-      const {
-        annotate = true,
-        stringify = false
-      } = options;
+  });
 
-      return Stalker._parse(events, annotate, stringify);
+  Object.defineProperty(Instruction, 'parse', {
+    enumerable: true,
+    value: function (target) {
+      Memory._checkCodePointer(target);
+      return Instruction._parse(target);
     }
-  }
+  });
 });
 
-Object.defineProperty(Instruction, 'parse', {
-  enumerable: true,
-  value: function (target) {
-    Memory._checkCodePointer(target);
-    return Instruction._parse(target);
-  }
+defineLazyApi(['ApiResolver'], () => {
+  makeEnumerateApi(ApiResolver.prototype, 'enumerateMatches', 1);
 });
 
-makeEnumerateApi(ApiResolver.prototype, 'enumerateMatches', 1);
-
-const _closeIOStream = IOStream.prototype._close;
-IOStream.prototype.close = function () {
-  const stream = this;
-  return new Promise(function (resolve, reject) {
-    _closeIOStream.call(stream, function (error, success) {
-      if (error === null)
-        resolve(success);
-      else
-        reject(error);
+defineLazyApi(['IOStream', 'InputStream', 'OutputStream', 'UnixInputStream', 'UnixOutputStream', 'Win32InputStream', 'Win32OutputStream', 'SocketListener', 'SocketConnection', 'Socket'], () => {
+  const _closeIOStream = IOStream.prototype._close;
+  IOStream.prototype.close = function () {
+    const stream = this;
+    return new Promise(function (resolve, reject) {
+      _closeIOStream.call(stream, function (error, success) {
+        if (error === null)
+          resolve(success);
+        else
+          reject(error);
+      });
     });
-  });
-};
+  };
 
-const _closeInput = InputStream.prototype._close;
-InputStream.prototype.close = function () {
-  const stream = this;
-  return new Promise(function (resolve, reject) {
-    _closeInput.call(stream, function (error, success) {
-      if (error === null)
-        resolve(success);
-      else
-        reject(error);
+  const _closeInput = InputStream.prototype._close;
+  InputStream.prototype.close = function () {
+    const stream = this;
+    return new Promise(function (resolve, reject) {
+      _closeInput.call(stream, function (error, success) {
+        if (error === null)
+          resolve(success);
+        else
+          reject(error);
+      });
     });
-  });
-};
+  };
 
-const _read = InputStream.prototype._read;
-InputStream.prototype.read = function (size) {
-  const stream = this;
-  return new Promise(function (resolve, reject) {
-    _read.call(stream, size, function (error, data) {
-      if (error === null)
-        resolve(data);
-      else
-        reject(error);
+  const _read = InputStream.prototype._read;
+  InputStream.prototype.read = function (size) {
+    const stream = this;
+    return new Promise(function (resolve, reject) {
+      _read.call(stream, size, function (error, data) {
+        if (error === null)
+          resolve(data);
+        else
+          reject(error);
+      });
     });
-  });
-};
+  };
 
-const _readAll = InputStream.prototype._readAll;
-InputStream.prototype.readAll = function (size) {
-  const stream = this;
-  return new Promise(function (resolve, reject) {
-    _readAll.call(stream, size, function (error, data) {
-      if (error === null) {
-        resolve(data);
-      } else {
-        error.partialData = data;
-        reject(error);
-      }
+  const _readAll = InputStream.prototype._readAll;
+  InputStream.prototype.readAll = function (size) {
+    const stream = this;
+    return new Promise(function (resolve, reject) {
+      _readAll.call(stream, size, function (error, data) {
+        if (error === null) {
+          resolve(data);
+        } else {
+          error.partialData = data;
+          reject(error);
+        }
+      });
     });
-  });
-};
+  };
 
-const _closeOutput = OutputStream.prototype._close;
-OutputStream.prototype.close = function () {
-  const stream = this;
-  return new Promise(function (resolve, reject) {
-    _closeOutput.call(stream, function (error, success) {
-      if (error === null)
-        resolve(success);
-      else
-        reject(error);
+  const _closeOutput = OutputStream.prototype._close;
+  OutputStream.prototype.close = function () {
+    const stream = this;
+    return new Promise(function (resolve, reject) {
+      _closeOutput.call(stream, function (error, success) {
+        if (error === null)
+          resolve(success);
+        else
+          reject(error);
+      });
     });
-  });
-};
+  };
 
-const _write = OutputStream.prototype._write;
-OutputStream.prototype.write = function (data) {
-  const stream = this;
-  return new Promise(function (resolve, reject) {
-    _write.call(stream, data, function (error, size) {
-      if (error === null)
-        resolve(size);
-      else
-        reject(error);
+  const _write = OutputStream.prototype._write;
+  OutputStream.prototype.write = function (data) {
+    const stream = this;
+    return new Promise(function (resolve, reject) {
+      _write.call(stream, data, function (error, size) {
+        if (error === null)
+          resolve(size);
+        else
+          reject(error);
+      });
     });
-  });
-};
+  };
 
-const _writeAll = OutputStream.prototype._writeAll;
-OutputStream.prototype.writeAll = function (data) {
-  const stream = this;
-  return new Promise(function (resolve, reject) {
-    _writeAll.call(stream, data, function (error, size) {
-      if (error === null) {
-        resolve(size);
-      } else {
-        error.partialSize = size;
-        reject(error);
-      }
+  const _writeAll = OutputStream.prototype._writeAll;
+  OutputStream.prototype.writeAll = function (data) {
+    const stream = this;
+    return new Promise(function (resolve, reject) {
+      _writeAll.call(stream, data, function (error, size) {
+        if (error === null) {
+          resolve(size);
+        } else {
+          error.partialSize = size;
+          reject(error);
+        }
+      });
     });
-  });
-};
+  };
 
-const _writeMemoryRegion = OutputStream.prototype._writeMemoryRegion;
-OutputStream.prototype.writeMemoryRegion = function (address, length) {
-  const stream = this;
-  return new Promise(function (resolve, reject) {
-    _writeMemoryRegion.call(stream, address, length, function (error, size) {
-      if (error === null) {
-        resolve(size);
-      } else {
-        error.partialSize = size;
-        reject(error);
-      }
+  const _writeMemoryRegion = OutputStream.prototype._writeMemoryRegion;
+  OutputStream.prototype.writeMemoryRegion = function (address, length) {
+    const stream = this;
+    return new Promise(function (resolve, reject) {
+      _writeMemoryRegion.call(stream, address, length, function (error, size) {
+        if (error === null) {
+          resolve(size);
+        } else {
+          error.partialSize = size;
+          reject(error);
+        }
+      });
     });
-  });
-};
-
-const _closeListener = SocketListener.prototype._close;
-SocketListener.prototype.close = function () {
-  const listener = this;
-  return new Promise(function (resolve) {
-    _closeListener.call(listener, resolve);
-  });
-};
+  };
 
-const _accept = SocketListener.prototype._accept;
-SocketListener.prototype.accept = function () {
-  const listener = this;
-  return new Promise(function (resolve, reject) {
-    _accept.call(listener, function (error, connection) {
-      if (error === null)
-        resolve(connection);
-      else
-        reject(error);
+  const _closeListener = SocketListener.prototype._close;
+  SocketListener.prototype.close = function () {
+    const listener = this;
+    return new Promise(function (resolve) {
+      _closeListener.call(listener, resolve);
     });
-  });
-};
+  };
 
-const _setNoDelay = SocketConnection.prototype._setNoDelay;
-SocketConnection.prototype.setNoDelay = function (noDelay = true) {
-  const connection = this;
-  return new Promise(function (resolve, reject) {
-    _setNoDelay.call(connection, noDelay, function (error, success) {
-      if (error === null)
-        resolve(success);
-      else
-        reject(error);
+  const _accept = SocketListener.prototype._accept;
+  SocketListener.prototype.accept = function () {
+    const listener = this;
+    return new Promise(function (resolve, reject) {
+      _accept.call(listener, function (error, connection) {
+        if (error === null)
+          resolve(connection);
+        else
+          reject(error);
+      });
     });
-  });
-};
-
-Object.defineProperties(Socket, {
-  listen: {
-    enumerable: true,
-    value: function (options = {}) {
-      return new Promise(function (resolve, reject) {
-        const {
-          family = null,
-
-          host = null,
-          port = 0,
-
-          type = null,
-          path = null,
+  };
 
-          backlog = 10,
-        } = options;
+  const _setNoDelay = SocketConnection.prototype._setNoDelay;
+  SocketConnection.prototype.setNoDelay = function (noDelay = true) {
+    const connection = this;
+    return new Promise(function (resolve, reject) {
+      _setNoDelay.call(connection, noDelay, function (error, success) {
+        if (error === null)
+          resolve(success);
+        else
+          reject(error);
+      });
+    });
+  };
 
-        Socket._listen(family, host, port, type, path, backlog, function (error, listener) {
-          if (error === null)
-            resolve(listener);
-          else
-            reject(error);
+  Object.defineProperties(Socket, {
+    listen: {
+      enumerable: true,
+      value: function (options = {}) {
+        return new Promise(function (resolve, reject) {
+          const {
+            family = null,
+
+            host = null,
+            port = 0,
+
+            type = null,
+            path = null,
+
+            backlog = 10,
+          } = options;
+
+          Socket._listen(family, host, port, type, path, backlog, function (error, listener) {
+            if (error === null)
+              resolve(listener);
+            else
+              reject(error);
+          });
         });
-      });
+      },
     },
-  },
-  connect: {
-    enumerable: true,
-    value: function (options) {
-      return new Promise(function (resolve, reject) {
-        const {
-          family = null,
-
-          host = 'localhost',
-          port = 0,
-
-          type = null,
-          path = null,
-
-          tls = false,
-        } = options;
-
-        Socket._connect(family, host, port, type, path, tls, function (error, connection) {
-          if (error === null)
-            resolve(connection);
-          else
-            reject(error);
+    connect: {
+      enumerable: true,
+      value: function (options) {
+        return new Promise(function (resolve, reject) {
+          const {
+            family = null,
+
+            host = 'localhost',
+            port = 0,
+
+            type = null,
+            path = null,
+
+            tls = false,
+          } = options;
+
+          Socket._connect(family, host, port, type, path, tls, function (error, connection) {
+            if (error === null)
+              resolve(connection);
+            else
+              reject(error);
+          });
         });
-      });
+      },
     },
-  },
+  });
 });
 
 SourceMap.prototype.resolve = function (generatedPosition) {
@@ -692,42 +741,90 @@ SourceMap.prototype.resolve = function (generatedPosition) {
   return {source, line, column, name};
 };
 
-const sqliteOpenFlags = {
-  readonly: 1,
-  readwrite: 2,
-  create: 4,
-};
+defineLazyApi(['SqliteDatabase'], () => {
+  const sqliteOpenFlags = {
+    readonly: 1,
+    readwrite: 2,
+    create: 4,
+  };
 
-Object.defineProperties(SqliteDatabase, {
-  open: {
-    enumerable: true,
-    value: function (file, options = {}) {
-      if (typeof file !== 'string' || (options === null || typeof options !== 'object'))
-        throw new Error('invalid argument');
+  Object.defineProperties(SqliteDatabase, {
+    open: {
+      enumerable: true,
+      value: function (file, options = {}) {
+        if (typeof file !== 'string' || (options === null || typeof options !== 'object'))
+          throw new Error('invalid argument');
 
-      const {
-        flags = ['readwrite', 'create'],
-      } = options;
+        const {
+          flags = ['readwrite', 'create'],
+        } = options;
 
-      if (!(flags instanceof Array) || flags.length === 0)
-        throw new Error('flags must be a non-empty array');
+        if (!(flags instanceof Array) || flags.length === 0)
+          throw new Error('flags must be a non-empty array');
 
-      const flagsValue = flags.reduce((result, name) => {
-        const value = sqliteOpenFlags[name];
-        if (value === undefined)
-          throw new Error(`unknown flag: ${name}`);
+        const flagsValue = flags.reduce((result, name) => {
+          const value = sqliteOpenFlags[name];
+          if (value === undefined)
+            throw new Error(`unknown flag: ${name}`);
 
-        return result | value;
-      }, 0);
+          return result | value;
+        }, 0);
 
-      if (flagsValue === 3 || flagsValue === 5 || flagsValue === 7)
-        throw new Error(`invalid flags combination: ${flags.join(' | ')}`);
+        if (flagsValue === 3 || flagsValue === 5 || flagsValue === 7)
+          throw new Error(`invalid flags combination: ${flags.join(' | ')}`);
 
-      return SqliteDatabase._open(file, flagsValue);
+        return SqliteDatabase._open(file, flagsValue);
+      }
     }
-  }
+  });
 });
 
+/*
+ * Rarely used APIs only get their JavaScript half installed the first time
+ * one of the globals they hang off of is looked up, so scripts that never
+ * touch them don't run that code at load time. How much that saves has not
+ * been measured; script_startup_performance reports the load time.
+ */
+function defineLazyApi(names, install) {
+  const descriptors = names
+    .map(name => [name, Object.getOwnPropertyDescriptor(engine, name)])
+    .filter(([, descriptor]) => descriptor !== undefined);
+
+  if (descriptors.some(([, descriptor]) => !descriptor.configurable)) {
+    install();
+    return;
+  }
+
+  let installed = false;
+
+  function ensureInstalled() {
+    if (installed)
+      return;
+    installed = true;
+
+    descriptors.forEach(([name, descriptor]) => {
+      Object.defineProperty(engine, name, descriptor);
+    });
+
+    install();
+  }
+
+  descriptors.forEach(([name, descriptor]) => {
+    Object.defineProperty(engine, name, {
+      enumerable: descriptor.enumerable,
+      configurable: true,
+      get() {
+        ensureInstalled();
+        return engine[name];
+      },
+      set(value) {
+        ensureInstalled();
+        engine[name] = value;
+      }
+    });
+  });
+}
+
 function makeEnumerateApi(mod, name, arity) {
   const impl = mod['_' + name];
 
@@ -6,6 +6,7 @@
 
 #include "gumarmrelocator.h"
 
+#include "gumcapstone.h"
 #include "gummemory.h"
 
 #define GUM_MAX_INPUT_INSN_COUNT (100)
@@ -78,8 +79,8 @@ gum_arm_relocator_init (GumArmRelocator * relocator,
 {
   relocator->ref_count = 1;
 
-  cs_open (CS_ARCH_ARM, CS_MODE_ARM | CS_MODE_V8, &relocator->capstone);
-  cs_option (relocator->capstone, CS_OPT_DETAIL, CS_OPT_ON);
+  relocator->capstone = _gum_capstone_acquire (CS_ARCH_ARM,
+      CS_MODE_ARM | CS_MODE_V8);
   relocator->input_insns = g_new0 (cs_insn *, GUM_MAX_INPUT_INSN_COUNT);
 
   relocator->output = NULL;
@@ -105,7 +106,7 @@ gum_arm_relocator_clear (GumArmRelocator * relocator)
   }
   g_free (relocator->input_insns);
 
-  cs_close (&relocator->capstone);
+  _gum_capstone_release (CS_ARCH_ARM, relocator->capstone);
 }
 
 void
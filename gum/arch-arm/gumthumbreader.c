@@ -6,6 +6,8 @@
 
 #include "gumthumbreader.h"
 
+#include "gumcapstone.h"
+
 #include <capstone.h>
 
 static cs_insn * disassemble_instruction_at (gconstpointer address);
@@ -39,12 +41,11 @@ disassemble_instruction_at (gconstpointer address)
   csh capstone;
   cs_insn * insn = NULL;
 
-  cs_open (CS_ARCH_ARM, CS_MODE_THUMB | CS_MODE_V8, &capstone);
-  cs_option (capstone, CS_OPT_DETAIL, CS_OPT_ON);
+  capstone = _gum_capstone_acquire (CS_ARCH_ARM, CS_MODE_THUMB | CS_MODE_V8);
 
   cs_disasm (capstone, code, 16, GPOINTER_TO_SIZE (code), 1, &insn);
 
-  cs_close (&capstone);
+  _gum_capstone_release (CS_ARCH_ARM, capstone);
 
   return insn;
 }
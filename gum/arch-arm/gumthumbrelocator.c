@@ -6,6 +6,7 @@
 
 #include "gumthumbrelocator.h"
 
+#include "gumcapstone.h"
 #include "gummemory.h"
 
 #include <string.h>
@@ -101,8 +102,8 @@ gum_thumb_relocator_init (GumThumbRelocator * relocator,
 {
   relocator->ref_count = 1;
 
-  cs_open (CS_ARCH_ARM, CS_MODE_THUMB | CS_MODE_V8, &relocator->capstone);
-  cs_option (relocator->capstone, CS_OPT_DETAIL, CS_OPT_ON);
+  relocator->capstone = _gum_capstone_acquire (CS_ARCH_ARM,
+      CS_MODE_THUMB | CS_MODE_V8);
   relocator->input_insns = g_new0 (cs_insn *, GUM_MAX_INPUT_INSN_COUNT);
 
   relocator->output = NULL;
@@ -129,7 +130,7 @@ gum_thumb_relocator_clear (GumThumbRelocator * relocator)
   }
   g_free (relocator->input_insns);
 
-  cs_close (&relocator->capstone);
+  _gum_capstone_release (CS_ARCH_ARM, relocator->capstone);
 }
 
 void
@@ -549,8 +550,7 @@ gum_thumb_relocator_can_relocate (gpointer address,
     size_t count, i;
     gboolean eoi;
 
-    cs_open (CS_ARCH_ARM, CS_MODE_THUMB, &capstone);
-    cs_option (capstone, CS_OPT_DETAIL, CS_OPT_ON);
+    capstone = _gum_capstone_acquire (CS_ARCH_ARM, CS_MODE_THUMB);
 
     gum_ensure_code_readable (rl.input_cur, max_code_size);
 
@@ -593,7 +593,7 @@ gum_thumb_relocator_can_relocate (gpointer address,
 
     cs_free (insn, count);
 
-    cs_close (&capstone);
+    _gum_capstone_release (CS_ARCH_ARM, capstone);
   }
 
   gum_thumb_relocator_clear (&rl);
@@ -8,6 +8,7 @@
 
 #include "gumarm64relocator.h"
 
+#include "gumcapstone.h"
 #include "gummemory.h"
 
 #define GUM_MAX_INPUT_INSN_COUNT (100)
@@ -78,8 +79,8 @@ gum_arm64_relocator_init (GumArm64Relocator * relocator,
 {
   relocator->ref_count = 1;
 
-  cs_open (CS_ARCH_ARM64, GUM_DEFAULT_CS_ENDIAN, &relocator->capstone);
-  cs_option (relocator->capstone, CS_OPT_DETAIL, CS_OPT_ON);
+  relocator->capstone = _gum_capstone_acquire (CS_ARCH_ARM64,
+      GUM_DEFAULT_CS_ENDIAN);
   relocator->input_insns = g_new0 (cs_insn *, GUM_MAX_INPUT_INSN_COUNT);
 
   relocator->output = NULL;
@@ -105,7 +106,7 @@ gum_arm64_relocator_clear (GumArm64Relocator * relocator)
   }
   g_free (relocator->input_insns);
 
-  cs_close (&relocator->capstone);
+  _gum_capstone_release (CS_ARCH_ARM64, relocator->capstone);
 }
 
 void
@@ -400,8 +401,7 @@ gum_arm64_relocator_can_relocate (gpointer address,
     checked_targets = g_hash_table_new (NULL, NULL);
     targets_to_check = g_hash_table_new (NULL, NULL);
 
-    cs_open (CS_ARCH_ARM64, GUM_DEFAULT_CS_ENDIAN, &capstone);
-    cs_option (capstone, CS_OPT_DETAIL, CS_OPT_ON);
+    capstone = _gum_capstone_acquire (CS_ARCH_ARM64, GUM_DEFAULT_CS_ENDIAN);
 
     insn = cs_malloc (capstone);
     current_code = rl.input_cur;
@@ -513,7 +513,7 @@ gum_arm64_relocator_can_relocate (gpointer address,
 
     cs_free (insn, 1);
 
-    cs_close (&capstone);
+    _gum_capstone_release (CS_ARCH_ARM64, capstone);
 
     g_hash_table_unref (targets_to_check);
     g_hash_table_unref (checked_targets);
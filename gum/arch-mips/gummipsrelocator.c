@@ -7,6 +7,7 @@
 
 #include "gummipsrelocator.h"
 
+#include "gumcapstone.h"
 #include "gummemory.h"
 
 #if GLIB_SIZEOF_VOID_P == 4
@@ -70,9 +71,8 @@ gum_mips_relocator_init (GumMipsRelocator * relocator,
 {
   relocator->ref_count = 1;
 
-  cs_open (CS_ARCH_MIPS, GUM_DEFAULT_MIPS_MODE | GUM_DEFAULT_CS_ENDIAN,
-      &relocator->capstone);
-  cs_option (relocator->capstone, CS_OPT_DETAIL, CS_OPT_ON);
+  relocator->capstone = _gum_capstone_acquire (CS_ARCH_MIPS,
+      GUM_DEFAULT_MIPS_MODE | GUM_DEFAULT_CS_ENDIAN);
   relocator->input_insns = g_new0 (cs_insn *, GUM_MAX_INPUT_INSN_COUNT);
 
   relocator->output = NULL;
@@ -98,7 +98,7 @@ gum_mips_relocator_clear (GumMipsRelocator * relocator)
   }
   g_free (relocator->input_insns);
 
-  cs_close (&relocator->capstone);
+  _gum_capstone_release (CS_ARCH_MIPS, relocator->capstone);
 }
 
 void
@@ -491,9 +491,8 @@ gum_mips_relocator_can_relocate (gpointer address,
     size_t count, i;
     gboolean eoi;
 
-    cs_open (CS_ARCH_MIPS, GUM_DEFAULT_MIPS_MODE | GUM_DEFAULT_CS_ENDIAN,
-        &capstone);
-    cs_option (capstone, CS_OPT_DETAIL, CS_OPT_ON);
+    capstone = _gum_capstone_acquire (CS_ARCH_MIPS,
+        GUM_DEFAULT_MIPS_MODE | GUM_DEFAULT_CS_ENDIAN);
 
     count = cs_disasm (capstone, rl.input_cur, 1024, rl.input_pc, 0, &insn);
     g_assert (insn != NULL);
@@ -589,7 +588,7 @@ gum_mips_relocator_can_relocate (gpointer address,
 
     cs_free (insn, count);
 
-    cs_close (&capstone);
+    _gum_capstone_release (CS_ARCH_MIPS, capstone);
   }
 
   if (available_scratch_reg != NULL)
@@ -0,0 +1,302 @@
+/*
+ * Copyright (C) 2021 Ole André Vadla Ravnås <oleavr@nowsecure.com>
+ *
+ * Licence: wxWindows Library Licence, Version 3.1
+ */
+
+#include "gumx86decoder.h"
+
+#define GUM_X86_MAX_INSN_LENGTH 15
+
+#define GUM_OP_VALID  (1 << 0)
+#define GUM_OP_MODRM  (1 << 1)
+#define GUM_OP_IMM8   (1 << 2)
+#define GUM_OP_IMM16  (1 << 3)
+#define GUM_OP_IMMZ   (1 << 4)
+#define GUM_OP_BRANCH (1 << 5)
+
+#define X_  0
+#define N_  (GUM_OP_VALID)
+#define M_  (GUM_OP_VALID | GUM_OP_MODRM)
+#define MB  (GUM_OP_VALID | GUM_OP_MODRM | GUM_OP_IMM8)
+#define MZ  (GUM_OP_VALID | GUM_OP_MODRM | GUM_OP_IMMZ)
+#define IB  (GUM_OP_VALID | GUM_OP_IMM8)
+#define IZ  (GUM_OP_VALID | GUM_OP_IMMZ)
+#define BN  (GUM_OP_VALID | GUM_OP_BRANCH)
+#define BB  (GUM_OP_VALID | GUM_OP_BRANCH | GUM_OP_IMM8)
+#define BW  (GUM_OP_VALID | GUM_OP_BRANCH | GUM_OP_IMM16)
+#define BZ  (GUM_OP_VALID | GUM_OP_BRANCH | GUM_OP_IMMZ)
+
+/*
+ * Opcodes marked X_ are either prefixes, escapes, invalid in 64-bit mode, or
+ * simply rare enough that we leave them to Capstone.
+ */
+static const guint8 gum_one_byte_opcodes[256] =
+{
+  /*        0   1   2   3   4   5   6   7   8   9   a   b   c   d   e   f */
+  /* 0 */  M_, M_, M_, M_, IB, IZ, X_, X_, M_, M_, M_, M_, IB, IZ, X_, X_,
+  /* 1 */  M_, M_, M_, M_, IB, IZ, X_, X_, M_, M_, M_, M_, IB, IZ, X_, X_,
+  /* 2 */  M_, M_, M_, M_, IB, IZ, X_, X_, M_, M_, M_, M_, IB, IZ, X_, X_,
+  /* 3 */  M_, M_, M_, M_, IB, IZ, X_, X_, M_, M_, M_, M_, IB, IZ, X_, X_,
+  /* 4 */  N_, N_, N_, N_, N_, N_, N_, N_, N_, N_, N_, N_, N_, N_, N_, N_,
+  /* 5 */  N_, N_, N_, N_, N_, N_, N_, N_, N_, N_, N_, N_, N_, N_, N_, N_,
+  /* 6 */  X_, X_, X_, M_, X_, X_, X_, X_, IZ, MZ, IB, MB, N_, N_, N_, N_,
+  /* 7 */  BB, BB, BB, BB, BB, BB, BB, BB, BB, BB, BB, BB, BB, BB, BB, BB,
+  /* 8 */  MB, MZ, X_, MB, M_, M_, M_, M_, M_, M_, M_, M_, M_, M_, M_, M_,
+  /* 9 */  N_, N_, N_, N_, N_, N_, N_, N_, N_, N_, X_, N_, N_, N_, N_, N_,
+  /* a */  X_, X_, X_, X_, N_, N_, N_, N_, IB, IZ, N_, N_, N_, N_, N_, N_,
+  /* b */  IB, IB, IB, IB, IB, IB, IB, IB, IZ, IZ, IZ, IZ, IZ, IZ, IZ, IZ,
+  /* c */  MB, MB, BW, BN, X_, X_, MB, MZ, X_, N_, BW, BN, BN, BB, X_, BN,
+  /* d */  M_, M_, M_, M_, X_, X_, X_, N_, M_, M_, M_, M_, M_, M_, M_, M_,
+  /* e */  BB, BB, BB, BB, IB, IB, IB, IB, BZ, BZ, X_, BB, N_, N_, N_, N_,
+  /* f */  X_, BN, X_, X_, N_, N_, M_, M_, N_, N_, N_, N_, N_, N_, M_, M_,
+};
+
+static const guint8 gum_two_byte_opcodes[256] =
+{
+  /*        0   1   2   3   4   5   6   7   8   9   a   b   c   d   e   f */
+  /* 0 */  M_, M_, M_, M_, X_, BN, N_, BN, N_, N_, X_, N_, X_, M_, X_, X_,
+  /* 1 */  M_, M_, M_, M_, M_, M_, M_, M_, M_, M_, M_, M_, M_, M_, M_, M_,
+  /* 2 */  M_, M_, M_, M_, X_, X_, X_, X_, M_, M_, M_, M_, M_, M_, M_, M_,
+  /* 3 */  N_, N_, N_, N_, BN, BN, X_, X_, X_, X_, X_, X_, X_, X_, X_, X_,
+  /* 4 */  M_, M_, M_, M_, M_, M_, M_, M_, M_, M_, M_, M_, M_, M_, M_, M_,
+  /* 5 */  M_, M_, M_, M_, M_, M_, M_, M_, M_, M_, M_, M_, M_, M_, M_, M_,
+  /* 6 */  M_, M_, M_, M_, M_, M_, M_, M_, M_, M_, M_, M_, M_, M_, M_, M_,
+  /* 7 */  MB, MB, MB, MB, M_, M_, M_, N_, X_, X_, X_, X_, M_, M_, M_, M_,
+  /* 8 */  BZ, BZ, BZ, BZ, BZ, BZ, BZ, BZ, BZ, BZ, BZ, BZ, BZ, BZ, BZ, BZ,
+  /* 9 */  M_, M_, M_, M_, M_, M_, M_, M_, M_, M_, M_, M_, M_, M_, M_, M_,
+  /* a */  N_, N_, N_, M_, MB, M_, X_, X_, N_, N_, X_, M_, MB, M_, M_, M_,
+  /* b */  M_, M_, M_, M_, M_, M_, M_, M_, M_, M_, MB, M_, M_, M_, M_, M_,
+  /* c */  M_, M_, MB, M_, MB, MB, MB, M_, N_, N_, N_, N_, N_, N_, N_, N_,
+  /* d */  M_, M_, M_, M_, M_, M_, M_, M_, M_, M_, M_, M_, M_, M_, M_, M_,
+  /* e */  M_, M_, M_, M_, M_, M_, M_, M_, M_, M_, M_, M_, M_, M_, M_, M_,
+  /* f */  M_, M_, M_, M_, M_, M_, M_, M_, M_, M_, M_, M_, M_, M_, M_, M_,
+};
+
+G_STATIC_ASSERT (G_N_ELEMENTS (gum_one_byte_opcodes) == 256);
+G_STATIC_ASSERT (G_N_ELEMENTS (gum_two_byte_opcodes) == 256);
+
+#undef X_
+#undef N_
+#undef M_
+#undef MB
+#undef MZ
+#undef IB
+#undef IZ
+#undef BN
+#undef BB
+#undef BW
+#undef BZ
+
+static guint gum_x86_decoder_get_immz_size (gboolean has_rex_w,
+    gboolean has_operand_size_prefix);
+static gboolean gum_x86_decoder_is_legacy_prefix (guint8 byte);
+
+/*
+ * Works out the length of the instruction at code, whether it transfers
+ * control, and whether it has a RIP-relative memory operand, without going
+ * through Capstone. Only the common general purpose and SSE encodings are
+ * handled; returns FALSE for anything else, including VEX/EVEX-encoded
+ * instructions, in which case the caller should fall back to Capstone.
+ */
+gboolean
+gum_x86_decoder_decode_one (const guint8 * code,
+                            GumCpuType cpu_type,
+                            GumX86InsnInfo * info)
+{
+  const gboolean is_64bit = cpu_type == GUM_CPU_AMD64;
+  const guint8 * p = code;
+  gboolean has_operand_size_prefix = FALSE;
+  gboolean has_rex_w = FALSE;
+  gboolean is_one_byte;
+  guint8 opcode, flags;
+  guint imm_size;
+
+  while (gum_x86_decoder_is_legacy_prefix (*p))
+  {
+    if (*p == 0x66)
+      has_operand_size_prefix = TRUE;
+    else if (*p == 0x67 && !is_64bit)
+      return FALSE;
+
+    p++;
+    if (p - code == GUM_X86_MAX_INSN_LENGTH)
+      return FALSE;
+  }
+
+  if (is_64bit && (*p & 0xf0) == 0x40)
+  {
+    has_rex_w = (*p & 0x08) != 0;
+    p++;
+  }
+
+  opcode = *p++;
+  if (is_64bit && (opcode & 0xf0) == 0x40)
+    return FALSE;
+
+  is_one_byte = opcode != 0x0f;
+  if (is_one_byte)
+  {
+    flags = gum_one_byte_opcodes[opcode];
+  }
+  else
+  {
+    opcode = *p++;
+    if (opcode == 0x38)
+    {
+      p++;
+      flags = GUM_OP_VALID | GUM_OP_MODRM;
+    }
+    else if (opcode == 0x3a)
+    {
+      p++;
+      flags = GUM_OP_VALID | GUM_OP_MODRM | GUM_OP_IMM8;
+    }
+    else
+    {
+      flags = gum_two_byte_opcodes[opcode];
+    }
+  }
+
+  if ((flags & GUM_OP_VALID) == 0)
+    return FALSE;
+
+  info->modrm_offset = 0;
+  info->is_branch = (flags & GUM_OP_BRANCH) != 0;
+  info->is_rip_relative = FALSE;
+
+  if ((flags & GUM_OP_IMM8) != 0)
+  {
+    imm_size = 1;
+  }
+  else if ((flags & GUM_OP_IMM16) != 0)
+  {
+    imm_size = 2;
+  }
+  else if ((flags & GUM_OP_IMMZ) != 0)
+  {
+    if (is_one_byte && opcode >= 0xb8 && opcode <= 0xbf && has_rex_w)
+      imm_size = 8;
+    else if (is_64bit && info->is_branch)
+      imm_size = 4;
+    else
+      imm_size = gum_x86_decoder_get_immz_size (has_rex_w,
+          has_operand_size_prefix);
+  }
+  else
+  {
+    imm_size = 0;
+  }
+
+  if ((flags & GUM_OP_MODRM) != 0)
+  {
+    guint8 modrm;
+    guint mod, reg, rm;
+
+    modrm = *p;
+    info->modrm_offset = p - code;
+    p++;
+
+    mod = (modrm & 0xc0) >> 6;
+    reg = (modrm & 0x38) >> 3;
+    rm  = (modrm & 0x07) >> 0;
+
+    if (mod != 3)
+    {
+      if (rm == 4)
+      {
+        guint8 sib = *p++;
+
+        if (mod == 0 && (sib & 0x07) == 5)
+          p += 4;
+      }
+      else if (mod == 0 && rm == 5)
+      {
+        p += 4;
+        info->is_rip_relative = is_64bit;
+      }
+
+      if (mod == 1)
+        p += 1;
+      else if (mod == 2)
+        p += 4;
+    }
+
+    if (is_one_byte)
+    {
+      switch (opcode)
+      {
+        case 0x8f:
+          if (reg != 0)
+            return FALSE;
+          break;
+        case 0xf6:
+          if (reg < 2)
+            imm_size = 1;
+          break;
+        case 0xf7:
+          if (reg < 2)
+          {
+            imm_size = gum_x86_decoder_get_immz_size (has_rex_w,
+                has_operand_size_prefix);
+          }
+          break;
+        case 0xff:
+          if (reg >= 2 && reg <= 5)
+            info->is_branch = TRUE;
+          break;
+        case 0xc7:
+          if (modrm == 0xf8)
+            info->is_branch = TRUE;
+          break;
+        default:
+          break;
+      }
+    }
+  }
+
+  p += imm_size;
+
+  if (p - code > GUM_X86_MAX_INSN_LENGTH)
+    return FALSE;
+
+  info->length = p - code;
+
+  return TRUE;
+}
+
+/*
+ * REX.W selects a 64-bit operand size, which takes precedence over 0x66, and
+ * whose immediate is still 32 bits wide and sign-extended.
+ */
+static guint
+gum_x86_decoder_get_immz_size (gboolean has_rex_w,
+                               gboolean has_operand_size_prefix)
+{
+  if (has_rex_w)
+    return 4;
+
+  return has_operand_size_prefix ? 2 : 4;
+}
+
+static gboolean
+gum_x86_decoder_is_legacy_prefix (guint8 byte)
+{
+  switch (byte)
+  {
+    case 0x26:
+    case 0x2e:
+    case 0x36:
+    case 0x3e:
+    case 0x64:
+    case 0x65:
+    case 0x66:
+    case 0x67:
+    case 0xf0:
+    case 0xf2:
+    case 0xf3:
+      return TRUE;
+    default:
+      return FALSE;
+  }
+}
@@ -0,0 +1,29 @@
+/*
+ * Copyright (C) 2021 Ole André Vadla Ravnås <oleavr@nowsecure.com>
+ *
+ * Licence: wxWindows Library Licence, Version 3.1
+ */
+
+#ifndef __GUM_X86_DECODER_H__
+#define __GUM_X86_DECODER_H__
+
+#include "gumdefs.h"
+
+G_BEGIN_DECLS
+
+typedef struct _GumX86InsnInfo GumX86InsnInfo;
+
+struct _GumX86InsnInfo
+{
+  guint length;
+  guint modrm_offset;
+  gboolean is_branch;
+  gboolean is_rip_relative;
+};
+
+G_GNUC_INTERNAL gboolean gum_x86_decoder_decode_one (const guint8 * code,
+    GumCpuType cpu_type, GumX86InsnInfo * info);
+
+G_END_DECLS
+
+#endif
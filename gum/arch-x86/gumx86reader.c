@@ -6,6 +6,9 @@
 
 #include "gumx86reader.h"
 
+#include "gumcapstone.h"
+#include "gumx86decoder.h"
+
 static gpointer try_get_relative_call_or_jump_target (gconstpointer address,
     guint call_or_jump);
 static cs_insn * disassemble_instruction_at (gconstpointer address);
@@ -14,8 +17,12 @@ guint
 gum_x86_reader_insn_length (guint8 * code)
 {
   guint result;
+  GumX86InsnInfo info;
   cs_insn * insn;
 
+  if (gum_x86_decoder_decode_one (code, GUM_NATIVE_CPU, &info))
+    return info.length;
+
   insn = disassemble_instruction_at (code);
   if (insn == NULL)
     return 0;
@@ -124,12 +131,11 @@ disassemble_instruction_at (gconstpointer address)
   csh capstone;
   cs_insn * insn = NULL;
 
-  cs_open (CS_ARCH_X86, GUM_CPU_MODE, &capstone);
-  cs_option (capstone, CS_OPT_DETAIL, CS_OPT_ON);
+  capstone = _gum_capstone_acquire (CS_ARCH_X86, GUM_CPU_MODE);
 
   cs_disasm (capstone, address, 16, GPOINTER_TO_SIZE (address), 1, &insn);
 
-  cs_close (&capstone);
+  _gum_capstone_release (CS_ARCH_X86, capstone);
 
   return insn;
 }
@@ -6,8 +6,10 @@
 
 #include "gumx86relocator.h"
 
+#include "gumcapstone.h"
 #include "gumlibc.h"
 #include "gummemory.h"
+#include "gumx86decoder.h"
 #include "gumx86reader.h"
 
 #include <string.h>
@@ -26,6 +28,10 @@ struct _GumCodeGenCtx
   GumX86Writer * code_writer;
 };
 
+static gboolean gum_x86_relocator_try_read_light (GumX86Relocator * self,
+    cs_insn * insn);
+static cs_insn * gum_x86_relocator_peek_next_write_insn_raw (
+    GumX86Relocator * self);
 static gboolean gum_x86_relocator_write_one_instruction (
     GumX86Relocator * self);
 static void gum_x86_relocator_put_label_for (GumX86Relocator * self,
@@ -81,10 +87,8 @@ gum_x86_relocator_init (GumX86Relocator * relocator,
 {
   relocator->ref_count = 1;
 
-  cs_open (CS_ARCH_X86,
-      (output->target_cpu == GUM_CPU_AMD64) ? CS_MODE_64 : CS_MODE_32,
-      &relocator->capstone);
-  cs_option (relocator->capstone, CS_OPT_DETAIL, CS_OPT_ON);
+  relocator->capstone = _gum_capstone_acquire (CS_ARCH_X86,
+      (output->target_cpu == GUM_CPU_AMD64) ? CS_MODE_64 : CS_MODE_32);
   relocator->input_insns = g_new0 (cs_insn *, GUM_MAX_INPUT_INSN_COUNT);
 
   relocator->output = NULL;
@@ -110,7 +114,7 @@ gum_x86_relocator_clear (GumX86Relocator * relocator)
   }
   g_free (relocator->input_insns);
 
-  cs_close (&relocator->capstone);
+  _gum_capstone_release (CS_ARCH_X86, relocator->capstone);
 }
 
 void
@@ -182,6 +186,17 @@ gum_x86_relocator_read_one (GumX86Relocator * self,
   address = GPOINTER_TO_SIZE (self->input_cur);
   insn = *insn_ptr;
 
+  if (instruction == NULL && gum_x86_relocator_try_read_light (self, insn))
+  {
+    self->eob = FALSE;
+
+    gum_x86_relocator_increment_inpos (self);
+
+    self->input_cur += insn->size;
+
+    return self->input_cur - self->input_start;
+  }
+
   if (!cs_disasm_iter (self->capstone, &code, &size, &address, insn))
     return 0;
 
@@ -224,8 +239,61 @@ gum_x86_relocator_read_one (GumX86Relocator * self,
   return self->input_cur - self->input_start;
 }
 
+/*
+ * When the caller does not need the decoded instruction we only work out its
+ * length through the table-driven decoder, and leave Capstone out of it. This
+ * is limited to instructions that get copied verbatim, i.e. anything that is
+ * neither a branch nor RIP-relative. Such instructions are marked by an id of
+ * X86_INS_INVALID, and get fully decoded on demand if anyone peeks at them.
+ */
+static gboolean
+gum_x86_relocator_try_read_light (GumX86Relocator * self,
+                                  cs_insn * insn)
+{
+  GumX86InsnInfo info;
+
+  if (!gum_x86_decoder_decode_one (self->input_cur, self->output->target_cpu,
+      &info))
+    return FALSE;
+
+  if (info.is_branch || info.is_rip_relative)
+    return FALSE;
+
+  insn->id = X86_INS_INVALID;
+  insn->address = GPOINTER_TO_SIZE (self->input_cur);
+  insn->size = info.length;
+  memcpy (insn->bytes, self->input_cur, info.length);
+
+  return TRUE;
+}
+
 cs_insn *
 gum_x86_relocator_peek_next_write_insn (GumX86Relocator * self)
+{
+  cs_insn * insn;
+
+  insn = gum_x86_relocator_peek_next_write_insn_raw (self);
+
+  if (insn != NULL && insn->id == X86_INS_INVALID)
+  {
+    const uint8_t * code;
+    size_t size;
+    uint64_t address;
+    gboolean decoded;
+
+    code = GSIZE_TO_POINTER (insn->address);
+    size = insn->size;
+    address = insn->address;
+
+    decoded = cs_disasm_iter (self->capstone, &code, &size, &address, insn);
+    g_assert (decoded);
+  }
+
+  return insn;
+}
+
+static cs_insn *
+gum_x86_relocator_peek_next_write_insn_raw (GumX86Relocator * self)
 {
   if (self->outpos == self->inpos)
     return NULL;
@@ -238,7 +306,7 @@ gum_x86_relocator_peek_next_write_source (GumX86Relocator * self)
 {
   cs_insn * next;
 
-  next = gum_x86_relocator_peek_next_write_insn (self);
+  next = gum_x86_relocator_peek_next_write_insn_raw (self);
   if (next == NULL)
     return NULL;
 
@@ -250,7 +318,7 @@ gum_x86_relocator_skip_one (GumX86Relocator * self)
 {
   cs_insn * next;
 
-  next = gum_x86_relocator_peek_next_write_insn (self);
+  next = gum_x86_relocator_peek_next_write_insn_raw (self);
   g_assert (next != NULL);
   gum_x86_relocator_increment_outpos (self);
 
@@ -260,7 +328,6 @@ gum_x86_relocator_skip_one (GumX86Relocator * self)
 void
 gum_x86_relocator_skip_one_no_label (GumX86Relocator * self)
 {
-  gum_x86_relocator_peek_next_write_insn (self);
   gum_x86_relocator_increment_outpos (self);
 }
 
@@ -269,7 +336,7 @@ gum_x86_relocator_write_one (GumX86Relocator * self)
 {
   cs_insn * cur;
 
-  if ((cur = gum_x86_relocator_peek_next_write_insn (self)) == NULL)
+  if ((cur = gum_x86_relocator_peek_next_write_insn_raw (self)) == NULL)
     return FALSE;
 
   gum_x86_relocator_put_label_for (self, cur);
@@ -289,7 +356,8 @@ gum_x86_relocator_write_one_instruction (GumX86Relocator * self)
   GumCodeGenCtx ctx;
   gboolean rewritten = FALSE;
 
-  if ((ctx.insn = gum_x86_relocator_peek_next_write_insn (self)) == NULL)
+  ctx.insn = gum_x86_relocator_peek_next_write_insn_raw (self);
+  if (ctx.insn == NULL)
     return FALSE;
   gum_x86_relocator_increment_outpos (self);
 
@@ -301,6 +369,9 @@ gum_x86_relocator_write_one_instruction (GumX86Relocator * self)
 
   switch (ctx.insn->id)
   {
+    case X86_INS_INVALID:
+      break;
+
     case X86_INS_CALL:
     case X86_INS_JMP:
       rewritten = gum_x86_relocator_rewrite_unconditional_branch (self, &ctx);
@@ -187,6 +187,18 @@ _gum_interceptor_backend_create_trampoline (GumInterceptorBackend * self,
   if (!gum_interceptor_backend_prepare_trampoline (self, ctx))
     return FALSE;
 
+  /*
+   * The shorter redirects go through a deflector and may clobber LR, which
+   * is only recovered by our enter thunk.
+   */
+  if (ctx->type == GUM_INTERCEPTOR_TYPE_FAST &&
+      data->redirect_code_size != data->full_redirect_size)
+  {
+    gum_code_slice_free (ctx->trampoline_slice);
+    ctx->trampoline_slice = NULL;
+    return FALSE;
+  }
+
   gum_thumb_writer_reset (tw, ctx->trampoline_slice->data);
 
   ctx->on_enter_trampoline = gum_thumb_writer_cur (tw) + 1;
@@ -240,22 +252,30 @@ _gum_interceptor_backend_create_trampoline (GumInterceptorBackend * self,
     }
   }
 
-  if (!is_thumb ||
-      data->redirect_code_size != GUM_INTERCEPTOR_THUMB_LINK_REDIRECT_SIZE)
+  if (ctx->type == GUM_INTERCEPTOR_TYPE_FAST)
   {
-    gum_emit_push_cpu_context_high_part (tw);
+    gum_thumb_writer_put_ldr_reg_address (tw, ARM_REG_PC,
+        GUM_ADDRESS (ctx->replacement_function));
   }
+  else
+  {
+    if (!is_thumb ||
+        data->redirect_code_size != GUM_INTERCEPTOR_THUMB_LINK_REDIRECT_SIZE)
+    {
+      gum_emit_push_cpu_context_high_part (tw);
+    }
 
-  gum_thumb_writer_put_ldr_reg_address (tw, ARM_REG_R7, GUM_ADDRESS (ctx));
-  gum_thumb_writer_put_ldr_reg_address (tw, ARM_REG_PC,
-      GUM_ADDRESS (self->enter_thunk));
+    gum_thumb_writer_put_ldr_reg_address (tw, ARM_REG_R7, GUM_ADDRESS (ctx));
+    gum_thumb_writer_put_ldr_reg_address (tw, ARM_REG_PC,
+        GUM_ADDRESS (self->enter_thunk));
 
-  ctx->on_leave_trampoline = gum_thumb_writer_cur (tw) + 1;
+    ctx->on_leave_trampoline = gum_thumb_writer_cur (tw) + 1;
 
-  gum_emit_push_cpu_context_high_part (tw);
-  gum_thumb_writer_put_ldr_reg_address (tw, ARM_REG_R7, GUM_ADDRESS (ctx));
-  gum_thumb_writer_put_ldr_reg_address (tw, ARM_REG_PC,
-      GUM_ADDRESS (self->leave_thunk));
+    gum_emit_push_cpu_context_high_part (tw);
+    gum_thumb_writer_put_ldr_reg_address (tw, ARM_REG_R7, GUM_ADDRESS (ctx));
+    gum_thumb_writer_put_ldr_reg_address (tw, ARM_REG_PC,
+        GUM_ADDRESS (self->leave_thunk));
+  }
 
   gum_thumb_writer_flush (tw);
   g_assert (gum_thumb_writer_offset (tw) <= ctx->trampoline_slice->size);
@@ -323,9 +343,11 @@ _gum_interceptor_backend_create_trampoline (GumInterceptorBackend * self,
      * have to replace LR on entry. That is however a bit complex, so we
      * opt for this simpler solution for now.
      */
-    is_eligible_for_lr_rewriting = strcmp (signature->str, "mov;b") == 0 ||
-        strcmp (signature->str, "mov;bx") == 0 ||
-        g_str_has_prefix (signature->str, "push;mov;bl");
+    is_eligible_for_lr_rewriting =
+        ctx->type == GUM_INTERCEPTOR_TYPE_DEFAULT &&
+        (strcmp (signature->str, "mov;b") == 0 ||
+         strcmp (signature->str, "mov;bx") == 0 ||
+         g_str_has_prefix (signature->str, "push;mov;bl"));
 
     g_string_free (signature, TRUE);
 
@@ -460,6 +482,41 @@ _gum_interceptor_backend_create_trampoline (GumInterceptorBackend * self,
   return TRUE;
 }
 
+gboolean
+_gum_interceptor_backend_create_import_trampoline (GumInterceptorBackend * self,
+                                                   GumFunctionContext * ctx)
+{
+  GumThumbWriter * tw = &self->thumb_writer;
+
+  ctx->trampoline_slice = gum_code_allocator_alloc_slice (self->allocator);
+
+  gum_thumb_writer_reset (tw, ctx->trampoline_slice->data);
+
+  ctx->on_enter_trampoline = gum_thumb_writer_cur (tw) + 1;
+
+  gum_emit_push_cpu_context_high_part (tw);
+  gum_thumb_writer_put_ldr_reg_address (tw, ARM_REG_R7, GUM_ADDRESS (ctx));
+  gum_thumb_writer_put_ldr_reg_address (tw, ARM_REG_PC,
+      GUM_ADDRESS (self->enter_thunk));
+
+  ctx->on_leave_trampoline = gum_thumb_writer_cur (tw) + 1;
+
+  gum_emit_push_cpu_context_high_part (tw);
+  gum_thumb_writer_put_ldr_reg_address (tw, ARM_REG_R7, GUM_ADDRESS (ctx));
+  gum_thumb_writer_put_ldr_reg_address (tw, ARM_REG_PC,
+      GUM_ADDRESS (self->leave_thunk));
+
+  gum_thumb_writer_flush (tw);
+  g_assert (gum_thumb_writer_offset (tw) <= ctx->trampoline_slice->size);
+
+  /* Keeps the Thumb bit, if any, so the callee runs in the right mode. */
+  ctx->on_invoke_trampoline = ctx->function_address;
+
+  ctx->overwritten_prologue_len = 0;
+
+  return TRUE;
+}
+
 void
 _gum_interceptor_backend_destroy_trampoline (GumInterceptorBackend * self,
                                              GumFunctionContext * ctx)
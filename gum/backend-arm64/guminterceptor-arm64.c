@@ -690,17 +690,28 @@ _gum_interceptor_backend_create_trampoline (GumInterceptorBackend * self,
     gum_arm64_writer_put_pop_reg_reg (aw, ARM64_REG_X0, ARM64_REG_LR);
   }
 
-  gum_arm64_writer_put_ldr_reg_address (aw, ARM64_REG_X17, GUM_ADDRESS (ctx));
-  gum_arm64_writer_put_ldr_reg_address (aw, ARM64_REG_X16,
-      GUM_ADDRESS (gum_sign_code_pointer (self->enter_thunk->data)));
-  gum_arm64_writer_put_br_reg (aw, ARM64_REG_X16);
-
-  ctx->on_leave_trampoline = gum_arm64_writer_cur (aw);
-
-  gum_arm64_writer_put_ldr_reg_address (aw, ARM64_REG_X17, GUM_ADDRESS (ctx));
-  gum_arm64_writer_put_ldr_reg_address (aw, ARM64_REG_X16,
-      GUM_ADDRESS (gum_sign_code_pointer (self->leave_thunk->data)));
-  gum_arm64_writer_put_br_reg (aw, ARM64_REG_X16);
+  if (ctx->type == GUM_INTERCEPTOR_TYPE_FAST)
+  {
+    gum_arm64_writer_put_ldr_reg_address (aw, ARM64_REG_X16,
+        GUM_ADDRESS (ctx->replacement_function));
+    gum_arm64_writer_put_br_reg (aw, ARM64_REG_X16);
+  }
+  else
+  {
+    gum_arm64_writer_put_ldr_reg_address (aw, ARM64_REG_X17,
+        GUM_ADDRESS (ctx));
+    gum_arm64_writer_put_ldr_reg_address (aw, ARM64_REG_X16,
+        GUM_ADDRESS (gum_sign_code_pointer (self->enter_thunk->data)));
+    gum_arm64_writer_put_br_reg (aw, ARM64_REG_X16);
+
+    ctx->on_leave_trampoline = gum_arm64_writer_cur (aw);
+
+    gum_arm64_writer_put_ldr_reg_address (aw, ARM64_REG_X17,
+        GUM_ADDRESS (ctx));
+    gum_arm64_writer_put_ldr_reg_address (aw, ARM64_REG_X16,
+        GUM_ADDRESS (gum_sign_code_pointer (self->leave_thunk->data)));
+    gum_arm64_writer_put_br_reg (aw, ARM64_REG_X16);
+  }
 
   gum_arm64_writer_flush (aw);
   g_assert (gum_arm64_writer_offset (aw) <= ctx->trampoline_slice->size);
@@ -742,8 +753,9 @@ _gum_interceptor_backend_create_trampoline (GumInterceptorBackend * self,
    * have to replace LR on entry. That is however a bit complex, so we
    * opt for this simpler solution for now.
    */
-  is_eligible_for_lr_rewriting = strcmp (signature->str, "mov;b") == 0 ||
-      g_str_has_prefix (signature->str, "stp;mov;mov;bl");
+  is_eligible_for_lr_rewriting = ctx->type == GUM_INTERCEPTOR_TYPE_DEFAULT &&
+      (strcmp (signature->str, "mov;b") == 0 ||
+       g_str_has_prefix (signature->str, "stp;mov;mov;bl"));
 
   g_string_free (signature, TRUE);
 
@@ -821,6 +833,40 @@ _gum_interceptor_backend_create_trampoline (GumInterceptorBackend * self,
   return TRUE;
 }
 
+gboolean
+_gum_interceptor_backend_create_import_trampoline (GumInterceptorBackend * self,
+                                                   GumFunctionContext * ctx)
+{
+  GumArm64Writer * aw = &self->writer;
+
+  ctx->trampoline_slice = gum_code_allocator_alloc_slice (self->allocator);
+
+  gum_arm64_writer_reset (aw, ctx->trampoline_slice->data);
+
+  ctx->on_enter_trampoline = gum_sign_code_pointer (gum_arm64_writer_cur (aw));
+
+  gum_arm64_writer_put_ldr_reg_address (aw, ARM64_REG_X17, GUM_ADDRESS (ctx));
+  gum_arm64_writer_put_ldr_reg_address (aw, ARM64_REG_X16,
+      GUM_ADDRESS (gum_sign_code_pointer (self->enter_thunk->data)));
+  gum_arm64_writer_put_br_reg (aw, ARM64_REG_X16);
+
+  ctx->on_leave_trampoline = gum_arm64_writer_cur (aw);
+
+  gum_arm64_writer_put_ldr_reg_address (aw, ARM64_REG_X17, GUM_ADDRESS (ctx));
+  gum_arm64_writer_put_ldr_reg_address (aw, ARM64_REG_X16,
+      GUM_ADDRESS (gum_sign_code_pointer (self->leave_thunk->data)));
+  gum_arm64_writer_put_br_reg (aw, ARM64_REG_X16);
+
+  gum_arm64_writer_flush (aw);
+  g_assert (gum_arm64_writer_offset (aw) <= ctx->trampoline_slice->size);
+
+  ctx->on_invoke_trampoline = gum_sign_code_pointer (ctx->function_address);
+
+  ctx->overwritten_prologue_len = 0;
+
+  return TRUE;
+}
+
 void
 _gum_interceptor_backend_destroy_trampoline (GumInterceptorBackend * self,
                                              GumFunctionContext * ctx)
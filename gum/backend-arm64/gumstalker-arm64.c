@@ -712,6 +712,100 @@ gum_stalker_set_trust_threshold (GumStalker * self,
   self->trust_threshold = trust_threshold;
 }
 
+guint
+gum_stalker_get_trace_threshold (GumStalker * self)
+{
+  return 0;
+}
+
+void
+gum_stalker_set_trace_threshold (GumStalker * self,
+                                 guint trace_threshold)
+{
+}
+
+gsize
+gum_stalker_get_code_cache_budget (GumStalker * self)
+{
+  return 0;
+}
+
+void
+gum_stalker_set_code_cache_budget (GumStalker * self,
+                                   gsize budget)
+{
+}
+
+void
+gum_stalker_query_code_cache_stats (GumStalker * self,
+                                    GumStalkerCodeCacheStats * stats)
+{
+  stats->evictions = 0;
+  stats->evicted_blocks = 0;
+  stats->evicted_bytes = 0;
+  stats->prefetched_blocks = 0;
+}
+
+gboolean
+gum_stalker_get_block_counters_enabled (GumStalker * self)
+{
+  return FALSE;
+}
+
+void
+gum_stalker_set_block_counters_enabled (GumStalker * self,
+                                        gboolean enabled)
+{
+}
+
+GArray *
+gum_stalker_snapshot_block_counts (GumStalker * self)
+{
+  return g_array_new (FALSE, FALSE, sizeof (GumStalkerBlockCount));
+}
+
+gboolean
+gum_stalker_get_shadow_stack_enabled (GumStalker * self)
+{
+  return FALSE;
+}
+
+void
+gum_stalker_set_shadow_stack_enabled (GumStalker * self,
+                                      gboolean enabled)
+{
+}
+
+GArray *
+gum_stalker_snapshot_call_stack (GumStalker * self)
+{
+  return g_array_new (FALSE, FALSE, sizeof (gpointer));
+}
+
+gboolean
+gum_stalker_get_prefetch_enabled (GumStalker * self)
+{
+  return FALSE;
+}
+
+void
+gum_stalker_set_prefetch_enabled (GumStalker * self,
+                                  gboolean enabled)
+{
+}
+
+gboolean
+gum_stalker_get_dual_mapping_enabled (GumStalker * self)
+{
+  return FALSE;
+}
+
+void
+gum_stalker_set_dual_mapping_enabled (GumStalker * self,
+                                      gboolean enabled)
+{
+}
+
 void
 gum_stalker_flush (GumStalker * self)
 {
@@ -891,6 +985,46 @@ gum_stalker_follow (GumStalker * self,
   }
 }
 
+void
+gum_stalker_follow_threads (GumStalker * self,
+                            const GumThreadId * thread_ids,
+                            guint n_threads,
+                            GumStalkerTransformer * transformer,
+                            GumEventSink * sink)
+{
+  GumThreadId current_thread_id, * unfollowed_thread_ids;
+  guint n_unfollowed_threads, i;
+  gboolean includes_current_thread;
+  GumInfectContext ctx;
+
+  current_thread_id = gum_process_get_current_thread_id ();
+
+  unfollowed_thread_ids = g_new (GumThreadId, n_threads);
+  n_unfollowed_threads = 0;
+  includes_current_thread = FALSE;
+  for (i = 0; i != n_threads; i++)
+  {
+    GumThreadId thread_id = thread_ids[i];
+
+    if (thread_id == current_thread_id)
+      includes_current_thread = TRUE;
+    else if (gum_stalker_find_exec_ctx_by_thread_id (self, thread_id) == NULL)
+      unfollowed_thread_ids[n_unfollowed_threads++] = thread_id;
+  }
+
+  ctx.stalker = self;
+  ctx.transformer = transformer;
+  ctx.sink = sink;
+
+  gum_process_modify_threads (unfollowed_thread_ids, n_unfollowed_threads,
+      gum_stalker_infect, &ctx);
+
+  g_free (unfollowed_thread_ids);
+
+  if (includes_current_thread)
+    gum_stalker_follow_me (self, transformer, sink);
+}
+
 void
 gum_stalker_unfollow (GumStalker * self,
                       GumThreadId thread_id)
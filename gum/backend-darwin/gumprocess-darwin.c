@@ -527,7 +527,8 @@ gum_process_modify_thread (GumThreadId thread_id,
 }
 
 void
-_gum_process_enumerate_threads (GumFoundThreadFunc func,
+_gum_process_enumerate_threads (GumThreadFlags flags,
+                                GumFoundThreadFunc func,
                                 gpointer user_data)
 {
   gum_darwin_enumerate_threads (mach_task_self (), func, user_data);
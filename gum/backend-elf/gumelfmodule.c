@@ -20,6 +20,7 @@ typedef struct _GumElfEnumerateDepsContext GumElfEnumerateDepsContext;
 typedef struct _GumElfEnumerateImportsContext GumElfEnumerateImportsContext;
 typedef struct _GumElfEnumerateExportsContext GumElfEnumerateExportsContext;
 typedef struct _GumElfStoreSymtabParamsContext GumElfStoreSymtabParamsContext;
+typedef struct _GumElfStoreRelocParamsContext GumElfStoreRelocParamsContext;
 
 enum
 {
@@ -41,6 +42,9 @@ struct _GumElfEnumerateImportsContext
 {
   GumFoundImportFunc func;
   gpointer user_data;
+
+  GHashTable * slot_by_symbol_index;
+  guint symbol_index;
 };
 
 struct _GumElfEnumerateExportsContext
@@ -61,6 +65,23 @@ struct _GumElfStoreSymtabParamsContext
   GumElfModule * module;
 };
 
+struct _GumElfStoreRelocParamsContext
+{
+  gpointer jmprel;
+  gsize jmprel_size;
+  GumElfDynamicEntryValue jmprel_type;
+
+  gpointer rela;
+  gsize rela_size;
+  gsize rela_entry_size;
+
+  gpointer rel;
+  gsize rel_size;
+  gsize rel_entry_size;
+
+  GumElfModule * module;
+};
+
 struct _GumElfStoreFindStringTableContext
 {
   GumElfModule * module;
@@ -75,6 +96,14 @@ static void gum_elf_module_set_property (GObject * object,
 
 static gboolean gum_emit_each_needed (const GumElfDynamicEntryDetails * details,
     gpointer user_data);
+static GHashTable * gum_elf_module_collect_import_slots (GumElfModule * self);
+static void gum_elf_module_collect_slots_in_relocs (GumElfModule * self,
+    gconstpointer relocs, gsize size, gsize entry_size, gboolean is_rela,
+    GHashTable * slots);
+static gboolean gum_elf_module_is_slot_reloc_type (GumElfModule * self,
+    guint type);
+static gboolean gum_store_reloc_params (
+    const GumElfDynamicEntryDetails * details, gpointer user_data);
 static gboolean gum_emit_elf_import (const GumElfSymbolDetails * details,
     gpointer user_data);
 static gboolean gum_emit_elf_export (const GumElfSymbolDetails * details,
@@ -326,7 +355,183 @@ gum_elf_module_enumerate_imports (GumElfModule * self,
   ctx.func = func;
   ctx.user_data = user_data;
 
+  ctx.slot_by_symbol_index = gum_elf_module_collect_import_slots (self);
+  ctx.symbol_index = 0;
+
   gum_elf_module_enumerate_dynamic_symbols (self, gum_emit_elf_import, &ctx);
+
+  g_hash_table_unref (ctx.slot_by_symbol_index);
+}
+
+/*
+ * The slot of an import is the GOT entry that the dynamic linker writes the
+ * resolved address into, i.e. the r_offset of the JUMP_SLOT or GLOB_DAT
+ * relocation that refers to the import's symbol.
+ */
+static GHashTable *
+gum_elf_module_collect_import_slots (GumElfModule * self)
+{
+  GHashTable * slots;
+  GumElfStoreRelocParamsContext ctx;
+
+  slots = g_hash_table_new (NULL, NULL);
+
+  ctx.jmprel = NULL;
+  ctx.jmprel_size = 0;
+  ctx.jmprel_type = DT_RELA;
+
+  ctx.rela = NULL;
+  ctx.rela_size = 0;
+  ctx.rela_entry_size = 0;
+
+  ctx.rel = NULL;
+  ctx.rel_size = 0;
+  ctx.rel_entry_size = 0;
+
+  ctx.module = self;
+
+  gum_elf_module_enumerate_dynamic_entries (self, gum_store_reloc_params,
+      &ctx);
+
+  if (ctx.jmprel != NULL)
+  {
+    gboolean is_rela = ctx.jmprel_type == DT_RELA;
+    gsize entry_size;
+
+    if (sizeof (gpointer) == 4)
+      entry_size = is_rela ? sizeof (Elf32_Rela) : sizeof (Elf32_Rel);
+    else
+      entry_size = is_rela ? sizeof (Elf64_Rela) : sizeof (Elf64_Rel);
+
+    gum_elf_module_collect_slots_in_relocs (self, ctx.jmprel, ctx.jmprel_size,
+        entry_size, is_rela, slots);
+  }
+
+  if (ctx.rela != NULL && ctx.rela_entry_size != 0)
+  {
+    gum_elf_module_collect_slots_in_relocs (self, ctx.rela, ctx.rela_size,
+        ctx.rela_entry_size, TRUE, slots);
+  }
+
+  if (ctx.rel != NULL && ctx.rel_entry_size != 0)
+  {
+    gum_elf_module_collect_slots_in_relocs (self, ctx.rel, ctx.rel_size,
+        ctx.rel_entry_size, FALSE, slots);
+  }
+
+  return slots;
+}
+
+static void
+gum_elf_module_collect_slots_in_relocs (GumElfModule * self,
+                                        gconstpointer relocs,
+                                        gsize size,
+                                        gsize entry_size,
+                                        gboolean is_rela,
+                                        GHashTable * slots)
+{
+  gsize offset;
+
+  for (offset = 0; offset + entry_size <= size; offset += entry_size)
+  {
+    gconstpointer entry = (const guint8 *) relocs + offset;
+    GumAddress r_offset;
+    guint sym, type;
+
+    if (sizeof (gpointer) == 4)
+    {
+      const Elf32_Rel * rel = entry;
+
+      r_offset = rel->r_offset;
+      sym = ELF32_R_SYM (rel->r_info);
+      type = ELF32_R_TYPE (rel->r_info);
+    }
+    else
+    {
+      const Elf64_Rel * rel = entry;
+
+      r_offset = rel->r_offset;
+      sym = ELF64_R_SYM (rel->r_info);
+      type = ELF64_R_TYPE (rel->r_info);
+    }
+
+    if (sym == 0 || !gum_elf_module_is_slot_reloc_type (self, type))
+      continue;
+
+    if (g_hash_table_contains (slots, GUINT_TO_POINTER (sym)))
+      continue;
+
+    g_hash_table_insert (slots, GUINT_TO_POINTER (sym), GSIZE_TO_POINTER (
+        gum_elf_module_resolve_static_virtual_address (self, r_offset)));
+  }
+}
+
+static gboolean
+gum_elf_module_is_slot_reloc_type (GumElfModule * self,
+                                   guint type)
+{
+  switch (self->ehdr->e_machine)
+  {
+    case EM_386:
+      return type == R_386_JMP_SLOT || type == R_386_GLOB_DAT;
+    case EM_X86_64:
+      return type == R_X86_64_JUMP_SLOT || type == R_X86_64_GLOB_DAT;
+    case EM_ARM:
+      return type == R_ARM_JUMP_SLOT || type == R_ARM_GLOB_DAT;
+    case EM_AARCH64:
+      return type == R_AARCH64_JUMP_SLOT || type == R_AARCH64_GLOB_DAT;
+    default:
+      return FALSE;
+  }
+}
+
+static gboolean
+gum_store_reloc_params (const GumElfDynamicEntryDetails * details,
+                        gpointer user_data)
+{
+  GumElfStoreRelocParamsContext * ctx = user_data;
+  GumElfModule * module = ctx->module;
+
+  switch (details->type)
+  {
+    case DT_JMPREL:
+      ctx->jmprel = GSIZE_TO_POINTER (
+          gum_elf_module_resolve_dynamic_virtual_address (module,
+              details->value));
+      break;
+    case DT_PLTRELSZ:
+      ctx->jmprel_size = details->value;
+      break;
+    case DT_PLTREL:
+      ctx->jmprel_type = details->value;
+      break;
+    case DT_RELA:
+      ctx->rela = GSIZE_TO_POINTER (
+          gum_elf_module_resolve_dynamic_virtual_address (module,
+              details->value));
+      break;
+    case DT_RELASZ:
+      ctx->rela_size = details->value;
+      break;
+    case DT_RELAENT:
+      ctx->rela_entry_size = details->value;
+      break;
+    case DT_REL:
+      ctx->rel = GSIZE_TO_POINTER (
+          gum_elf_module_resolve_dynamic_virtual_address (module,
+              details->value));
+      break;
+    case DT_RELSZ:
+      ctx->rel_size = details->value;
+      break;
+    case DT_RELENT:
+      ctx->rel_entry_size = details->value;
+      break;
+    default:
+      break;
+  }
+
+  return TRUE;
 }
 
 static gboolean
@@ -335,6 +540,8 @@ gum_emit_elf_import (const GumElfSymbolDetails * details,
 {
   GumElfEnumerateImportsContext * ctx = user_data;
 
+  ctx->symbol_index++;
+
   if (details->section_header_index == SHN_UNDEF &&
       (details->type == STT_FUNC || details->type == STT_OBJECT))
   {
@@ -346,7 +553,8 @@ gum_emit_elf_import (const GumElfSymbolDetails * details,
     d.name = details->name;
     d.module = NULL;
     d.address = 0;
-    d.slot = 0; /* TODO */
+    d.slot = GUM_ADDRESS (g_hash_table_lookup (ctx->slot_by_symbol_index,
+        GUINT_TO_POINTER (ctx->symbol_index)));
 
     if (!ctx->func (&d, ctx->user_data))
       return FALSE;
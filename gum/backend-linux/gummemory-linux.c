@@ -9,11 +9,18 @@
 #include "gummemory-priv.h"
 #include "valgrind.h"
 
+#include <errno.h>
 #include <stdio.h>
 #include <string.h>
 #include <sys/mman.h>
+#include <sys/syscall.h>
 #include <unistd.h>
 
+#ifndef MFD_CLOEXEC
+# define MFD_CLOEXEC 0x0001U
+#endif
+
+static gint gum_memfd_create (const gchar * name);
 static gboolean gum_memory_get_protection (gconstpointer address, gsize n,
     gsize * size, GumPageProtection * prot);
 
@@ -107,6 +114,107 @@ gum_try_mprotect (gpointer address,
   return result == 0;
 }
 
+gboolean
+gum_memory_can_dual_map (void)
+{
+  static gsize cached_result = 0;
+
+  if (g_once_init_enter (&cached_result))
+  {
+    gboolean supported = FALSE;
+    gsize page_size;
+    gpointer page;
+
+    page_size = gum_query_page_size ();
+
+    /* memfds may be mounted noexec, see the vm.memfd_noexec sysctl. */
+    page = gum_memory_allocate_dual_mapped (NULL, page_size, page_size,
+        page_size);
+    if (page != NULL)
+    {
+      supported = gum_try_mprotect (page, page_size, GUM_PAGE_RX);
+
+      gum_memory_free (page, 2 * page_size);
+    }
+
+    g_once_init_leave (&cached_result, supported + 1);
+  }
+
+  return cached_result - 1;
+}
+
+/*
+ * Maps the same memfd-backed pages twice: at the returned address, and at
+ * alias_offset bytes past it, with the range in between left reserved. Both
+ * views start out as RW, so the caller can turn the first one into RX once
+ * and keep patching through the second without any further mprotect() calls.
+ * Free the whole thing with gum_memory_free (base, alias_offset + size).
+ */
+gpointer
+gum_memory_allocate_dual_mapped (const GumAddressSpec * spec,
+                                 gsize size,
+                                 gsize alignment,
+                                 gsize alias_offset)
+{
+  gint fd;
+  guint8 * base;
+  gsize reserved_size;
+
+  g_assert (alias_offset >= size);
+
+  fd = gum_memfd_create ("gum-code");
+  if (fd == -1)
+    goto failed_to_create;
+
+  if (ftruncate (fd, size) != 0)
+    goto failed_to_allocate;
+
+  reserved_size = alias_offset + size;
+
+  base = gum_memory_allocate_near (spec, reserved_size, alignment,
+      GUM_PAGE_NO_ACCESS);
+  if (base == NULL)
+    goto failed_to_allocate;
+
+  if (mmap (base, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd,
+        0) == MAP_FAILED)
+    goto failed_to_map;
+
+  if (mmap (base + alias_offset, size, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED)
+    goto failed_to_map;
+
+  close (fd);
+
+  return base;
+
+failed_to_map:
+  {
+    gum_memory_free (base, reserved_size);
+    goto failed_to_allocate;
+  }
+failed_to_allocate:
+  {
+    close (fd);
+    goto failed_to_create;
+  }
+failed_to_create:
+  {
+    return NULL;
+  }
+}
+
+static gint
+gum_memfd_create (const gchar * name)
+{
+#ifdef __NR_memfd_create
+  return syscall (__NR_memfd_create, name, MFD_CLOEXEC);
+#else
+  errno = ENOSYS;
+  return -1;
+#endif
+}
+
 void
 gum_clear_cache (gpointer address,
                  gsize size)
@@ -9,6 +9,7 @@
 #include "backend-elf/gumelfmodule.h"
 #include "gum-init.h"
 #include "gumandroid.h"
+#include "gumcloak.h"
 #include "gumlinux.h"
 #include "gummodulemap.h"
 #include "valgrind.h"
@@ -84,8 +85,12 @@
       __result; \
     })
 
-typedef struct _GumModifyThreadContext GumModifyThreadContext;
+typedef struct _GumModifyThreadsContext GumModifyThreadsContext;
+typedef struct _GumModifyThreadEntry GumModifyThreadEntry;
 typedef guint8 GumModifyThreadAck;
+typedef guint GumModifyThreadStatus;
+
+typedef struct _GumCapturedThread GumCapturedThread;
 
 typedef struct _GumEnumerateModulesContext GumEnumerateModulesContext;
 typedef struct _GumEmitExecutableModuleContext GumEmitExecutableModuleContext;
@@ -111,21 +116,39 @@ enum _GumModifyThreadAck
   GUM_ACK_STOPPED,
   GUM_ACK_READ_CONTEXT,
   GUM_ACK_MODIFIED_CONTEXT,
-  GUM_ACK_WROTE_CONTEXT,
-  GUM_ACK_FAILED_TO_ATTACH,
-  GUM_ACK_FAILED_TO_STOP,
-  GUM_ACK_FAILED_TO_READ,
-  GUM_ACK_FAILED_TO_WRITE,
-  GUM_ACK_FAILED_TO_DETACH
+  GUM_ACK_WROTE_CONTEXT
+};
+
+enum _GumModifyThreadStatus
+{
+  GUM_MODIFY_THREAD_PENDING,
+  GUM_MODIFY_THREAD_ATTACHED,
+  GUM_MODIFY_THREAD_STOPPED,
+  GUM_MODIFY_THREAD_READ_CONTEXT,
+  GUM_MODIFY_THREAD_WROTE_CONTEXT
 };
 
-struct _GumModifyThreadContext
+struct _GumModifyThreadsContext
 {
   gint fd[2];
+  GumModifyThreadEntry * entries;
+  guint n_entries;
+};
+
+struct _GumModifyThreadEntry
+{
   GumThreadId thread_id;
+  GumModifyThreadStatus status;
+  GumRegs regs;
   GumCpuContext cpu_context;
 };
 
+struct _GumCapturedThread
+{
+  GumThreadDetails details;
+  gboolean captured;
+};
+
 struct _GumEnumerateModulesContext
 {
   GumFoundModuleFunc func;
@@ -213,11 +236,13 @@ static gboolean gum_try_resolve_dynamic_symbol (const gchar * name,
     Dl_info * info);
 static void gum_deinit_libc_name (void);
 
-static gint gum_do_modify_thread (gpointer data);
+static guint gum_modify_other_threads (const GumThreadId * thread_ids,
+    guint n_threads, GumModifyThreadFunc func, gpointer user_data);
+static gint gum_do_modify_threads (gpointer data);
 static gboolean gum_await_ack (gint fd, GumModifyThreadAck expected_ack);
 static void gum_put_ack (gint fd, GumModifyThreadAck ack);
 
-static void gum_store_cpu_context (GumThreadId thread_id,
+static void gum_store_captured_cpu_context (GumThreadId thread_id,
     GumCpuContext * cpu_context, gpointer user_data);
 
 static void gum_process_enumerate_modules_by_using_libc (
@@ -455,223 +480,307 @@ gum_process_modify_thread (GumThreadId thread_id,
   }
   else
   {
-    GumModifyThreadContext ctx;
-    gint fd;
-    gssize child;
-    gpointer stack, tls;
-    GumUserDesc * desc;
-    int prev_dumpable;
+    success = gum_modify_other_threads (&thread_id, 1, func, user_data) == 1;
+  }
 
-    if (socketpair (AF_UNIX, SOCK_STREAM, 0, ctx.fd) != 0)
-      return FALSE;
-    ctx.thread_id = thread_id;
+  return success;
+}
 
-    fd = ctx.fd[0];
+guint
+gum_process_modify_threads (const GumThreadId * thread_ids,
+                            guint n_threads,
+                            GumModifyThreadFunc func,
+                            gpointer user_data)
+{
+  guint n_modified = 0;
+  GumThreadId current_thread_id, * other_thread_ids;
+  guint n_other_threads, i;
+  gboolean includes_current_thread;
 
-    stack = gum_alloc_n_pages (1, GUM_PAGE_RW);
-    tls = gum_alloc_n_pages (1, GUM_PAGE_RW);
+  current_thread_id = gum_process_get_current_thread_id ();
 
-#if defined (HAVE_I386) && GLIB_SIZEOF_VOID_P == 4
-    GumUserDesc segment;
-    gint gs;
+  other_thread_ids = g_new (GumThreadId, n_threads);
+  n_other_threads = 0;
+  includes_current_thread = FALSE;
+  for (i = 0; i != n_threads; i++)
+  {
+    if (thread_ids[i] == current_thread_id)
+      includes_current_thread = TRUE;
+    else
+      other_thread_ids[n_other_threads++] = thread_ids[i];
+  }
 
-    asm volatile (
-        "movw %%gs, %w0"
-        : "=q" (gs)
-    );
+  if (n_other_threads != 0)
+  {
+    n_modified += gum_modify_other_threads (other_thread_ids, n_other_threads,
+        func, user_data);
+  }
+
+  if (includes_current_thread &&
+      gum_process_modify_thread (current_thread_id, func, user_data))
+  {
+    n_modified++;
+  }
+
+  g_free (other_thread_ids);
+
+  return n_modified;
+}
 
-    segment.entry_number = (gs & 0xffff) >> 3;
-    segment.base_addr = GPOINTER_TO_SIZE (tls);
-    segment.limit = 0xfffff;
-    segment.seg_32bit = 1;
-    segment.contents = 0;
-    segment.read_exec_only = 0;
-    segment.limit_in_pages = 1;
-    segment.seg_not_present = 0;
-    segment.useable = 1;
-
-    desc = &segment;
+static guint
+gum_modify_other_threads (const GumThreadId * thread_ids,
+                          guint n_threads,
+                          GumModifyThreadFunc func,
+                          gpointer user_data)
+{
+  guint n_modified = 0;
+  GumModifyThreadsContext ctx;
+  gint fd;
+  gssize child;
+  gpointer stack, tls;
+  GumUserDesc * desc;
+  int prev_dumpable;
+  guint i;
+
+  if (socketpair (AF_UNIX, SOCK_STREAM, 0, ctx.fd) != 0)
+    return 0;
+
+  ctx.entries = g_new0 (GumModifyThreadEntry, n_threads);
+  ctx.n_entries = n_threads;
+  for (i = 0; i != n_threads; i++)
+    ctx.entries[i].thread_id = thread_ids[i];
+
+  fd = ctx.fd[0];
+
+  stack = gum_alloc_n_pages (1, GUM_PAGE_RW);
+  tls = gum_alloc_n_pages (1, GUM_PAGE_RW);
+
+#if defined (HAVE_I386) && GLIB_SIZEOF_VOID_P == 4
+  GumUserDesc segment;
+  gint gs;
+
+  asm volatile (
+      "movw %%gs, %w0"
+      : "=q" (gs)
+  );
+
+  segment.entry_number = (gs & 0xffff) >> 3;
+  segment.base_addr = GPOINTER_TO_SIZE (tls);
+  segment.limit = 0xfffff;
+  segment.seg_32bit = 1;
+  segment.contents = 0;
+  segment.read_exec_only = 0;
+  segment.limit_in_pages = 1;
+  segment.seg_not_present = 0;
+  segment.useable = 1;
+
+  desc = &segment;
 #else
-    desc = tls;
+  desc = tls;
 #endif
 
 #if defined (HAVE_I386)
-    {
-      GumTcbHead * head = tls;
+  {
+    GumTcbHead * head = tls;
 
-      head->tcb = tls;
-      head->dtv = GSIZE_TO_POINTER (GPOINTER_TO_SIZE (tls) + 1024);
-      head->self = tls;
-    }
+    head->tcb = tls;
+    head->dtv = GSIZE_TO_POINTER (GPOINTER_TO_SIZE (tls) + 1024);
+    head->self = tls;
+  }
 #endif
 
-    /*
-     * It seems like the only reliable way to read/write the registers of
-     * another thread is to use ptrace(). We used to accomplish this by
-     * hi-jacking the target thread by installing a signal handler and sending a
-     * real-time signal directed at the target thread, and thus relying on the
-     * signal handler getting called in that thread. The signal handler would
-     * then provide us with read/write access to its registers. This hack would
-     * however not work if a thread was for example blocking in poll(), as the
-     * signal would then just get queued and we'd end up waiting indefinitely.
-     *
-     * It is however not possible to ptrace() another thread when we're in the
-     * same process group. This used to be supported in old kernels, but it was
-     * buggy and eventually dropped. So in order to use ptrace() we will need to
-     * spawn a new thread in a different process group so that it can ptrace()
-     * the target thread inside our process group. This is also the solution
-     * recommended by Linus:
-     *
-     * https://lkml.org/lkml/2006/9/1/217
-     *
-     * Because libc implementations don't expose an API to do this, and the
-     * thread setup code is private, where the TLS part is crucial for even just
-     * the syscall wrappers - due to them accessing `errno` - we cannot make any
-     * libc calls in this thread. And because the libc's clone() syscall wrapper
-     * typically writes to the child thread's TLS structures, which we cannot
-     * portably set up correctly, we cannot use the libc clone() syscall wrapper
-     * either.
-     */
-    child = gum_libc_clone (
-        gum_do_modify_thread,
-        stack + gum_query_page_size (),
-        CLONE_VM | CLONE_SETTLS,
-        &ctx,
-        NULL,
-        desc,
-        NULL);
-    if (child == -1)
-      goto beach;
+  /*
+   * It seems like the only reliable way to read/write the registers of
+   * another thread is to use ptrace(). We used to accomplish this by
+   * hi-jacking the target thread by installing a signal handler and sending a
+   * real-time signal directed at the target thread, and thus relying on the
+   * signal handler getting called in that thread. The signal handler would
+   * then provide us with read/write access to its registers. This hack would
+   * however not work if a thread was for example blocking in poll(), as the
+   * signal would then just get queued and we'd end up waiting indefinitely.
+   *
+   * It is however not possible to ptrace() another thread when we're in the
+   * same process group. This used to be supported in old kernels, but it was
+   * buggy and eventually dropped. So in order to use ptrace() we will need to
+   * spawn a new thread in a different process group so that it can ptrace()
+   * the target thread inside our process group. This is also the solution
+   * recommended by Linus:
+   *
+   * https://lkml.org/lkml/2006/9/1/217
+   *
+   * Because libc implementations don't expose an API to do this, and the
+   * thread setup code is private, where the TLS part is crucial for even just
+   * the syscall wrappers - due to them accessing `errno` - we cannot make any
+   * libc calls in this thread. And because the libc's clone() syscall wrapper
+   * typically writes to the child thread's TLS structures, which we cannot
+   * portably set up correctly, we cannot use the libc clone() syscall wrapper
+   * either.
+   *
+   * Spawning the helper is by far the most expensive part, so we use a single
+   * one for all of the threads. It attaches to all of them up front, which
+   * also means that each thread is stopped exactly once, and they all stay
+   * stopped until every one of them has been modified.
+   */
+  child = gum_libc_clone (
+      gum_do_modify_threads,
+      stack + gum_query_page_size (),
+      CLONE_VM | CLONE_SETTLS,
+      &ctx,
+      NULL,
+      desc,
+      NULL);
+  if (child == -1)
+    goto beach;
 
-    /*
-     * Some systems (notably Android on release applications) spawn processes as
-     * not dumpable by default, disabling ptrace() on that process for anyone
-     * other than root.
-     *
-     * To allow our child to ptrace() this process, we enable this temporarily.
-     */
-    prev_dumpable = prctl (PR_GET_DUMPABLE);
-    if (prev_dumpable != -1 && prev_dumpable != 1)
-      prctl (PR_SET_DUMPABLE, 1);
+  /*
+   * Some systems (notably Android on release applications) spawn processes as
+   * not dumpable by default, disabling ptrace() on that process for anyone
+   * other than root.
+   *
+   * To allow our child to ptrace() this process, we enable this temporarily.
+   */
+  prev_dumpable = prctl (PR_GET_DUMPABLE);
+  if (prev_dumpable != -1 && prev_dumpable != 1)
+    prctl (PR_SET_DUMPABLE, 1);
 
-    prctl (PR_SET_PTRACER, child);
+  prctl (PR_SET_PTRACER, child);
 
-    gum_put_ack (fd, GUM_ACK_READY);
+  gum_put_ack (fd, GUM_ACK_READY);
 
-    if (gum_await_ack (fd, GUM_ACK_ATTACHED))
+  if (gum_await_ack (fd, GUM_ACK_ATTACHED))
+  {
+    for (i = 0; i != n_threads; i++)
     {
+      GumModifyThreadEntry * entry = &ctx.entries[i];
       GumThreadState state;
       gboolean still_alive;
 
-      while ((still_alive = gum_thread_read_state (thread_id, &state)) &&
+      if (entry->status != GUM_MODIFY_THREAD_ATTACHED)
+        continue;
+
+      while ((still_alive = gum_thread_read_state (entry->thread_id, &state)) &&
           state != GUM_THREAD_STOPPED && state != GUM_THREAD_UNINTERRUPTIBLE)
       {
         g_usleep (G_USEC_PER_SEC / 100);
       }
 
-      if (state == GUM_THREAD_STOPPED)
-      {
-        gum_put_ack (fd, GUM_ACK_STOPPED);
+      if (still_alive && state == GUM_THREAD_STOPPED)
+        entry->status = GUM_MODIFY_THREAD_STOPPED;
+    }
 
-        if (still_alive)
-        {
-          gum_await_ack (fd, GUM_ACK_READ_CONTEXT);
-          func (thread_id, &ctx.cpu_context, user_data);
-          gum_put_ack (fd, GUM_ACK_MODIFIED_CONTEXT);
+    gum_put_ack (fd, GUM_ACK_STOPPED);
 
-          success = gum_await_ack (fd, GUM_ACK_WROTE_CONTEXT);
-        }
+    if (gum_await_ack (fd, GUM_ACK_READ_CONTEXT))
+    {
+      for (i = 0; i != n_threads; i++)
+      {
+        GumModifyThreadEntry * entry = &ctx.entries[i];
+
+        if (entry->status == GUM_MODIFY_THREAD_READ_CONTEXT)
+          func (entry->thread_id, &entry->cpu_context, user_data);
       }
-      else
+
+      gum_put_ack (fd, GUM_ACK_MODIFIED_CONTEXT);
+
+      if (gum_await_ack (fd, GUM_ACK_WROTE_CONTEXT))
       {
-        gum_put_ack (fd, GUM_ACK_FAILED_TO_STOP);
+        for (i = 0; i != n_threads; i++)
+        {
+          if (ctx.entries[i].status == GUM_MODIFY_THREAD_WROTE_CONTEXT)
+            n_modified++;
+        }
       }
     }
+  }
 
-    if (prev_dumpable != -1 && prev_dumpable != 1)
-      prctl (PR_SET_DUMPABLE, prev_dumpable);
+  if (prev_dumpable != -1 && prev_dumpable != 1)
+    prctl (PR_SET_DUMPABLE, prev_dumpable);
 
-    waitpid (child, NULL, __WCLONE);
+  waitpid (child, NULL, __WCLONE);
 
 beach:
-    gum_free_pages (tls);
-    gum_free_pages (stack);
+  gum_free_pages (tls);
+  gum_free_pages (stack);
 
-    close (ctx.fd[0]);
-    close (ctx.fd[1]);
-  }
+  g_free (ctx.entries);
 
-  return success;
+  close (ctx.fd[0]);
+  close (ctx.fd[1]);
+
+  return n_modified;
 }
 
 static gint
-gum_do_modify_thread (gpointer data)
+gum_do_modify_threads (gpointer data)
 {
-  GumModifyThreadContext * ctx = data;
+  GumModifyThreadsContext * ctx = data;
   gint fd;
-  gssize res;
-  GumRegs regs;
+  guint i;
 
   fd = ctx->fd[1];
 
-  gum_await_ack (fd, GUM_ACK_READY);
+  if (!gum_await_ack (fd, GUM_ACK_READY))
+    return 0;
+
+  for (i = 0; i != ctx->n_entries; i++)
+  {
+    GumModifyThreadEntry * entry = &ctx->entries[i];
 
-  res = gum_libc_ptrace (PTRACE_ATTACH, ctx->thread_id, NULL, NULL);
-  if (res < 0)
-    goto failed_to_attach;
+    if (gum_libc_ptrace (PTRACE_ATTACH, entry->thread_id, NULL, NULL) >= 0)
+      entry->status = GUM_MODIFY_THREAD_ATTACHED;
+  }
   gum_put_ack (fd, GUM_ACK_ATTACHED);
 
   if (!gum_await_ack (fd, GUM_ACK_STOPPED))
-    goto failed_to_stop;
-  res = gum_get_regs (ctx->thread_id, &regs);
-  if (res < 0)
-    goto failed_to_read;
-  gum_parse_regs (&regs, &ctx->cpu_context);
-  gum_put_ack (fd, GUM_ACK_READ_CONTEXT);
+    goto detach;
 
-  gum_await_ack (fd, GUM_ACK_MODIFIED_CONTEXT);
-  gum_unparse_regs (&ctx->cpu_context, &regs);
-  res = gum_set_regs (ctx->thread_id, &regs);
-  if (res < 0)
-    goto failed_to_write;
+  for (i = 0; i != ctx->n_entries; i++)
+  {
+    GumModifyThreadEntry * entry = &ctx->entries[i];
 
-  res = gum_libc_ptrace (PTRACE_DETACH, ctx->thread_id, NULL, NULL);
-  if (res < 0)
-    goto failed_to_detach;
+    if (entry->status != GUM_MODIFY_THREAD_STOPPED)
+      continue;
 
-  gum_put_ack (fd, GUM_ACK_WROTE_CONTEXT);
+    if (gum_get_regs (entry->thread_id, &entry->regs) >= 0)
+    {
+      gum_parse_regs (&entry->regs, &entry->cpu_context);
+      entry->status = GUM_MODIFY_THREAD_READ_CONTEXT;
+    }
+  }
+  gum_put_ack (fd, GUM_ACK_READ_CONTEXT);
 
-  goto beach;
+  if (!gum_await_ack (fd, GUM_ACK_MODIFIED_CONTEXT))
+    goto detach;
 
-failed_to_attach:
-  {
-    gum_put_ack (fd, GUM_ACK_FAILED_TO_ATTACH);
-    goto beach;
-  }
-failed_to_stop:
-  {
-    gum_libc_ptrace (PTRACE_DETACH, ctx->thread_id, NULL, NULL);
-    goto beach;
-  }
-failed_to_read:
-  {
-    gum_put_ack (fd, GUM_ACK_FAILED_TO_READ);
-    goto beach;
-  }
-failed_to_write:
+  for (i = 0; i != ctx->n_entries; i++)
   {
-    gum_put_ack (fd, GUM_ACK_FAILED_TO_WRITE);
-    goto beach;
-  }
-failed_to_detach:
-  {
-    gum_put_ack (fd, GUM_ACK_FAILED_TO_DETACH);
-    goto beach;
+    GumModifyThreadEntry * entry = &ctx->entries[i];
+
+    if (entry->status != GUM_MODIFY_THREAD_READ_CONTEXT)
+      continue;
+
+    gum_unparse_regs (&entry->cpu_context, &entry->regs);
+    if (gum_set_regs (entry->thread_id, &entry->regs) >= 0)
+      entry->status = GUM_MODIFY_THREAD_WROTE_CONTEXT;
   }
-beach:
+
+detach:
+  for (i = 0; i != ctx->n_entries; i++)
   {
-    return 0;
+    GumModifyThreadEntry * entry = &ctx->entries[i];
+
+    if (entry->status == GUM_MODIFY_THREAD_PENDING)
+      continue;
+
+    if (gum_libc_ptrace (PTRACE_DETACH, entry->thread_id, NULL, NULL) < 0 &&
+        entry->status == GUM_MODIFY_THREAD_WROTE_CONTEXT)
+    {
+      entry->status = GUM_MODIFY_THREAD_READ_CONTEXT;
+    }
   }
+  gum_put_ack (fd, GUM_ACK_WROTE_CONTEXT);
+
+  return 0;
 }
 
 static gboolean
@@ -698,41 +807,112 @@ gum_put_ack (gint fd,
   GUM_TEMP_FAILURE_RETRY (gum_libc_write (fd, &value, sizeof (value)));
 }
 
+GArray *
+_gum_process_list_thread_ids (void)
+{
+  GArray * thread_ids;
+  GDir * dir;
+  const gchar * name;
+
+  /*
+   * Unlike gum_process_enumerate_threads() this does not capture any CPU
+   * contexts, so callers about to modify the threads only stop them once.
+   */
+  thread_ids = g_array_new (FALSE, FALSE, sizeof (GumThreadId));
+
+  dir = g_dir_open ("/proc/self/task", 0, NULL);
+  g_assert (dir != NULL);
+
+  while ((name = g_dir_read_name (dir)) != NULL)
+  {
+    GumThreadId id = atoi (name);
+
+    if (!gum_cloak_has_thread (id))
+      g_array_append_val (thread_ids, id);
+  }
+
+  g_dir_close (dir);
+
+  return thread_ids;
+}
+
 void
-_gum_process_enumerate_threads (GumFoundThreadFunc func,
+_gum_process_enumerate_threads (GumThreadFlags flags,
+                                GumFoundThreadFunc func,
                                 gpointer user_data)
 {
+  GArray * threads;
+  GHashTable * thread_by_id;
+  GumThreadId * thread_ids;
   GDir * dir;
   const gchar * name;
-  gboolean carry_on = TRUE;
+  guint i;
+
+  threads = g_array_new (FALSE, FALSE, sizeof (GumCapturedThread));
 
   dir = g_dir_open ("/proc/self/task", 0, NULL);
   g_assert (dir != NULL);
 
-  while (carry_on && (name = g_dir_read_name (dir)) != NULL)
+  while ((name = g_dir_read_name (dir)) != NULL)
   {
-    GumThreadDetails details;
+    GumCapturedThread thread;
 
-    details.id = atoi (name);
-    if (gum_thread_read_state (details.id, &details.state))
-    {
-      if (gum_process_modify_thread (details.id, gum_store_cpu_context,
-            &details.cpu_context))
-      {
-        carry_on = func (&details, user_data);
-      }
-    }
+    thread.details.id = atoi (name);
+    gum_memset (&thread.details.cpu_context, 0, sizeof (GumCpuContext));
+    thread.captured = (flags & GUM_THREAD_FLAGS_CPU_CONTEXT) == 0;
+    if (gum_thread_read_state (thread.details.id, &thread.details.state))
+      g_array_append_val (threads, thread);
   }
 
   g_dir_close (dir);
+
+  if ((flags & GUM_THREAD_FLAGS_CPU_CONTEXT) == 0)
+    goto emit;
+
+  /*
+   * Capture the CPU context of all threads in one pass, so that we only need
+   * to spin up a single ptrace() helper rather than one per thread.
+   */
+  thread_by_id = g_hash_table_new (NULL, NULL);
+  thread_ids = g_new (GumThreadId, threads->len);
+  for (i = 0; i != threads->len; i++)
+  {
+    GumCapturedThread * thread = &g_array_index (threads, GumCapturedThread, i);
+
+    g_hash_table_insert (thread_by_id, GSIZE_TO_POINTER (thread->details.id),
+        thread);
+    thread_ids[i] = thread->details.id;
+  }
+
+  gum_process_modify_threads (thread_ids, threads->len,
+      gum_store_captured_cpu_context, thread_by_id);
+
+  g_free (thread_ids);
+  g_hash_table_unref (thread_by_id);
+
+emit:
+  for (i = 0; i != threads->len; i++)
+  {
+    GumCapturedThread * thread = &g_array_index (threads, GumCapturedThread, i);
+
+    if (thread->captured && !func (&thread->details, user_data))
+      break;
+  }
+
+  g_array_free (threads, TRUE);
 }
 
 static void
-gum_store_cpu_context (GumThreadId thread_id,
-                       GumCpuContext * cpu_context,
-                       gpointer user_data)
+gum_store_captured_cpu_context (GumThreadId thread_id,
+                                GumCpuContext * cpu_context,
+                                gpointer user_data)
 {
-  memcpy (user_data, cpu_context, sizeof (GumCpuContext));
+  GumCapturedThread * thread;
+
+  thread = g_hash_table_lookup (user_data, GSIZE_TO_POINTER (thread_id));
+
+  thread->details.cpu_context = *cpu_context;
+  thread->captured = TRUE;
 }
 
 void
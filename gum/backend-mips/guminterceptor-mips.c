@@ -182,35 +182,46 @@ _gum_interceptor_backend_create_trampoline (GumInterceptorBackend * self,
     g_assert_not_reached ();
   }
 
-  /* TODO: save $t0 on the stack? */
+  if (ctx->type == GUM_INTERCEPTOR_TYPE_FAST)
+  {
+    /* PIC code expects t9 to hold the address of the function being called */
+    gum_mips_writer_put_la_reg_address (cw, MIPS_REG_T9,
+        GUM_ADDRESS (ctx->replacement_function));
+    gum_mips_writer_put_jr_reg (cw, MIPS_REG_T9);
+  }
+  else
+  {
+    /* TODO: save $t0 on the stack? */
 
 #if GLIB_SIZEOF_VOID_P == 8
-  /*
-   * On MIPS64 the calling convention is that 8 arguments are passed in
-   * registers. The additional registers used for these arguments are a4-a7,
-   * these replace the registers t0-t3 used in MIPS32. Hence t4 is now our first
-   * available register, otherwise we will start clobbering function parameters.
-   */
-  gum_mips_writer_put_la_reg_address (cw, MIPS_REG_T4, GUM_ADDRESS (ctx));
+    /*
+     * On MIPS64 the calling convention is that 8 arguments are passed in
+     * registers. The additional registers used for these arguments are
+     * a4-a7, these replace the registers t0-t3 used in MIPS32. Hence t4 is
+     * now our first available register, otherwise we will start clobbering
+     * function parameters.
+     */
+    gum_mips_writer_put_la_reg_address (cw, MIPS_REG_T4, GUM_ADDRESS (ctx));
 #else
-  gum_mips_writer_put_la_reg_address (cw, MIPS_REG_T0, GUM_ADDRESS (ctx));
+    gum_mips_writer_put_la_reg_address (cw, MIPS_REG_T0, GUM_ADDRESS (ctx));
 #endif
-  gum_mips_writer_put_la_reg_address (cw, MIPS_REG_AT,
-      GUM_ADDRESS (self->enter_thunk->data));
-  gum_mips_writer_put_jr_reg (cw, MIPS_REG_AT);
+    gum_mips_writer_put_la_reg_address (cw, MIPS_REG_AT,
+        GUM_ADDRESS (self->enter_thunk->data));
+    gum_mips_writer_put_jr_reg (cw, MIPS_REG_AT);
 
-  ctx->on_leave_trampoline = gum_mips_writer_cur (cw);
+    ctx->on_leave_trampoline = gum_mips_writer_cur (cw);
 
-  /* TODO: save $t0 on the stack? */
+    /* TODO: save $t0 on the stack? */
 #if GLIB_SIZEOF_VOID_P == 8
-  /* See earlier comment on clobbered registers. */
-  gum_mips_writer_put_la_reg_address (cw, MIPS_REG_T4, GUM_ADDRESS (ctx));
+    /* See earlier comment on clobbered registers. */
+    gum_mips_writer_put_la_reg_address (cw, MIPS_REG_T4, GUM_ADDRESS (ctx));
 #else
-  gum_mips_writer_put_la_reg_address (cw, MIPS_REG_T0, GUM_ADDRESS (ctx));
+    gum_mips_writer_put_la_reg_address (cw, MIPS_REG_T0, GUM_ADDRESS (ctx));
 #endif
-  gum_mips_writer_put_la_reg_address (cw, MIPS_REG_AT,
-      GUM_ADDRESS (self->leave_thunk->data));
-  gum_mips_writer_put_jr_reg (cw, MIPS_REG_AT);
+    gum_mips_writer_put_la_reg_address (cw, MIPS_REG_AT,
+        GUM_ADDRESS (self->leave_thunk->data));
+    gum_mips_writer_put_jr_reg (cw, MIPS_REG_AT);
+  }
 
   gum_mips_writer_flush (cw);
   g_assert (gum_mips_writer_offset (cw) <= ctx->trampoline_slice->size);
@@ -250,6 +261,52 @@ _gum_interceptor_backend_create_trampoline (GumInterceptorBackend * self,
   return TRUE;
 }
 
+gboolean
+_gum_interceptor_backend_create_import_trampoline (GumInterceptorBackend * self,
+                                                   GumFunctionContext * ctx)
+{
+  GumMipsWriter * cw = &self->writer;
+
+  ctx->trampoline_slice = gum_code_allocator_alloc_slice (self->allocator);
+
+  gum_mips_writer_reset (cw, ctx->trampoline_slice->data);
+
+  ctx->on_enter_trampoline = gum_mips_writer_cur (cw);
+
+#if GLIB_SIZEOF_VOID_P == 8
+  gum_mips_writer_put_la_reg_address (cw, MIPS_REG_T4, GUM_ADDRESS (ctx));
+#else
+  gum_mips_writer_put_la_reg_address (cw, MIPS_REG_T0, GUM_ADDRESS (ctx));
+#endif
+  gum_mips_writer_put_la_reg_address (cw, MIPS_REG_AT,
+      GUM_ADDRESS (self->enter_thunk->data));
+  gum_mips_writer_put_jr_reg (cw, MIPS_REG_AT);
+
+  ctx->on_leave_trampoline = gum_mips_writer_cur (cw);
+
+#if GLIB_SIZEOF_VOID_P == 8
+  gum_mips_writer_put_la_reg_address (cw, MIPS_REG_T4, GUM_ADDRESS (ctx));
+#else
+  gum_mips_writer_put_la_reg_address (cw, MIPS_REG_T0, GUM_ADDRESS (ctx));
+#endif
+  gum_mips_writer_put_la_reg_address (cw, MIPS_REG_AT,
+      GUM_ADDRESS (self->leave_thunk->data));
+  gum_mips_writer_put_jr_reg (cw, MIPS_REG_AT);
+
+  /* PIC code expects t9 to hold the address of the function being called */
+  ctx->on_invoke_trampoline = gum_mips_writer_cur (cw);
+  gum_mips_writer_put_la_reg_address (cw, MIPS_REG_T9,
+      GUM_ADDRESS (ctx->function_address));
+  gum_mips_writer_put_jr_reg (cw, MIPS_REG_T9);
+
+  gum_mips_writer_flush (cw);
+  g_assert (gum_mips_writer_offset (cw) <= ctx->trampoline_slice->size);
+
+  ctx->overwritten_prologue_len = 0;
+
+  return TRUE;
+}
+
 void
 _gum_interceptor_backend_destroy_trampoline (GumInterceptorBackend * self,
                                              GumFunctionContext * ctx)
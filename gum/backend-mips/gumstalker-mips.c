@@ -53,6 +53,100 @@ gum_stalker_set_trust_threshold (GumStalker * self,
 {
 }
 
+guint
+gum_stalker_get_trace_threshold (GumStalker * self)
+{
+  return 0;
+}
+
+void
+gum_stalker_set_trace_threshold (GumStalker * self,
+                                 guint trace_threshold)
+{
+}
+
+gsize
+gum_stalker_get_code_cache_budget (GumStalker * self)
+{
+  return 0;
+}
+
+void
+gum_stalker_set_code_cache_budget (GumStalker * self,
+                                   gsize budget)
+{
+}
+
+void
+gum_stalker_query_code_cache_stats (GumStalker * self,
+                                    GumStalkerCodeCacheStats * stats)
+{
+  stats->evictions = 0;
+  stats->evicted_blocks = 0;
+  stats->evicted_bytes = 0;
+  stats->prefetched_blocks = 0;
+}
+
+gboolean
+gum_stalker_get_block_counters_enabled (GumStalker * self)
+{
+  return FALSE;
+}
+
+void
+gum_stalker_set_block_counters_enabled (GumStalker * self,
+                                        gboolean enabled)
+{
+}
+
+GArray *
+gum_stalker_snapshot_block_counts (GumStalker * self)
+{
+  return g_array_new (FALSE, FALSE, sizeof (GumStalkerBlockCount));
+}
+
+gboolean
+gum_stalker_get_shadow_stack_enabled (GumStalker * self)
+{
+  return FALSE;
+}
+
+void
+gum_stalker_set_shadow_stack_enabled (GumStalker * self,
+                                      gboolean enabled)
+{
+}
+
+GArray *
+gum_stalker_snapshot_call_stack (GumStalker * self)
+{
+  return g_array_new (FALSE, FALSE, sizeof (gpointer));
+}
+
+gboolean
+gum_stalker_get_prefetch_enabled (GumStalker * self)
+{
+  return FALSE;
+}
+
+void
+gum_stalker_set_prefetch_enabled (GumStalker * self,
+                                  gboolean enabled)
+{
+}
+
+gboolean
+gum_stalker_get_dual_mapping_enabled (GumStalker * self)
+{
+  return FALSE;
+}
+
+void
+gum_stalker_set_dual_mapping_enabled (GumStalker * self,
+                                      gboolean enabled)
+{
+}
+
 void
 gum_stalker_flush (GumStalker * self)
 {
@@ -95,6 +189,15 @@ gum_stalker_follow (GumStalker * self,
 {
 }
 
+void
+gum_stalker_follow_threads (GumStalker * self,
+                            const GumThreadId * thread_ids,
+                            guint n_threads,
+                            GumStalkerTransformer * transformer,
+                            GumEventSink * sink)
+{
+}
+
 void
 gum_stalker_unfollow (GumStalker * self,
                       GumThreadId thread_id)
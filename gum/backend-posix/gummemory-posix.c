@@ -10,6 +10,7 @@
 #include "gumprocess-priv.h"
 
 #include <errno.h>
+#include <string.h>
 #include <unistd.h>
 #include <sys/mman.h>
 
@@ -19,8 +20,12 @@
 # endif
 #endif
 
+#define GUM_NEAR_ARENA_SIZE (16 * 1024 * 1024)
+
 typedef struct _GumAllocNearContext GumAllocNearContext;
 typedef struct _GumEnumerateFreeRangesContext GumEnumerateFreeRangesContext;
+typedef struct _GumNearArena GumNearArena;
+typedef struct _GumNearExtent GumNearExtent;
 
 struct _GumAllocNearContext
 {
@@ -40,6 +45,45 @@ struct _GumEnumerateFreeRangesContext
   GumAddress prev_end;
 };
 
+struct _GumNearExtent
+{
+  guint8 * start;
+  gsize size;
+};
+
+/*
+ * An arena is a PROT_NONE reservation that near allocations get carved out
+ * of, so that only reserving a new arena needs to look for a free range in
+ * the address space. Its first page holds this header, and the free extents
+ * are kept sorted by address so that neighbours can be coalesced.
+ */
+struct _GumNearArena
+{
+  GumNearArena * next;
+
+  guint8 * base;
+  gsize size;
+
+  guint num_extents;
+  guint max_extents;
+  GumNearExtent extents[1];
+};
+
+static gpointer gum_try_alloc_in_arenas (const GumAddressSpec * spec,
+    gsize size, gsize alignment, GumPageProtection prot);
+static GumNearArena * gum_near_arena_reserve (const GumAddressSpec * spec);
+static gpointer gum_near_arena_try_alloc (GumNearArena * self,
+    const GumAddressSpec * spec, gsize size, gsize alignment,
+    GumPageProtection prot);
+static gboolean gum_near_arena_overlaps (GumNearArena * self,
+    gconstpointer address, gsize size);
+static gboolean gum_near_arena_free (GumNearArena * self, gpointer address,
+    gsize size);
+static void gum_near_arena_remove_extent (GumNearArena * self, guint index);
+static gboolean gum_near_arena_insert_extent (GumNearArena * self,
+    guint index, guint8 * start, gsize size);
+static gpointer gum_find_near_range (const GumAddressSpec * spec, gsize size,
+    gsize alignment, GumPageProtection prot);
 static gboolean gum_try_alloc_in_range_if_near_enough (
     const GumRangeDetails * details, gpointer user_data);
 static gboolean gum_try_suggest_allocation_base (const GumMemoryRange * range,
@@ -51,6 +95,10 @@ static void gum_enumerate_free_ranges (GumFoundRangeFunc func,
 static gboolean gum_emit_free_range (const GumRangeDetails * details,
     gpointer user_data);
 
+G_LOCK_DEFINE_STATIC (gum_near_arenas);
+static GumNearArena * gum_near_arenas = NULL;
+static guint gum_near_range_scans = 0;
+
 void
 _gum_memory_backend_init (void)
 {
@@ -59,6 +107,18 @@ _gum_memory_backend_init (void)
 void
 _gum_memory_backend_deinit (void)
 {
+  GumNearArena * arena;
+
+  arena = gum_near_arenas;
+  while (arena != NULL)
+  {
+    GumNearArena * next = arena->next;
+
+    munmap (arena->base, arena->size);
+
+    arena = next;
+  }
+  gum_near_arenas = NULL;
 }
 
 guint
@@ -67,6 +127,12 @@ _gum_memory_backend_query_page_size (void)
   return sysconf (_SC_PAGE_SIZE);
 }
 
+guint
+_gum_memory_backend_query_near_range_scans (void)
+{
+  return g_atomic_int_get (&gum_near_range_scans);
+}
+
 gpointer
 gum_try_alloc_n_pages (guint n_pages,
                        GumPageProtection prot)
@@ -170,7 +236,13 @@ gum_memory_allocate_near (const GumAddressSpec * spec,
                           GumPageProtection prot)
 {
   gpointer suggested_base, received_base;
-  GumAllocNearContext ctx;
+
+  if (spec != NULL)
+  {
+    received_base = gum_try_alloc_in_arenas (spec, size, alignment, prot);
+    if (received_base != NULL)
+      return received_base;
+  }
 
   suggested_base = (spec != NULL) ? spec->near_address : NULL;
 
@@ -181,6 +253,253 @@ gum_memory_allocate_near (const GumAddressSpec * spec,
     return received_base;
   gum_memory_free (received_base, size);
 
+  if (size <= GUM_NEAR_ARENA_SIZE / 4)
+  {
+    GumNearArena * arena;
+
+    arena = gum_near_arena_reserve (spec);
+    if (arena != NULL)
+    {
+      G_LOCK (gum_near_arenas);
+
+      arena->next = gum_near_arenas;
+      g_atomic_pointer_set (&gum_near_arenas, arena);
+
+      received_base =
+          gum_near_arena_try_alloc (arena, spec, size, alignment, prot);
+
+      G_UNLOCK (gum_near_arenas);
+
+      if (received_base != NULL)
+        return received_base;
+    }
+  }
+
+  return gum_find_near_range (spec, size, alignment, prot);
+}
+
+static gpointer
+gum_try_alloc_in_arenas (const GumAddressSpec * spec,
+                         gsize size,
+                         gsize alignment,
+                         GumPageProtection prot)
+{
+  gpointer result = NULL;
+  GumNearArena * arena;
+
+  if (g_atomic_pointer_get (&gum_near_arenas) == NULL)
+    return NULL;
+
+  G_LOCK (gum_near_arenas);
+
+  for (arena = gum_near_arenas; arena != NULL; arena = arena->next)
+  {
+    result = gum_near_arena_try_alloc (arena, spec, size, alignment, prot);
+    if (result != NULL)
+      break;
+  }
+
+  G_UNLOCK (gum_near_arenas);
+
+  return result;
+}
+
+static GumNearArena *
+gum_near_arena_reserve (const GumAddressSpec * spec)
+{
+  GumNearArena * arena;
+  gsize page_size;
+
+  page_size = gum_query_page_size ();
+
+  arena = gum_find_near_range (spec, GUM_NEAR_ARENA_SIZE, page_size,
+      GUM_PAGE_NO_ACCESS);
+  if (arena == NULL)
+    return NULL;
+
+  gum_mprotect (arena, page_size, GUM_PAGE_RW);
+
+  arena->base = (guint8 *) arena;
+  arena->size = GUM_NEAR_ARENA_SIZE;
+
+  arena->num_extents = 1;
+  arena->max_extents = 1 +
+      ((page_size - sizeof (GumNearArena)) / sizeof (GumNearExtent));
+  arena->extents[0].start = arena->base + page_size;
+  arena->extents[0].size = arena->size - page_size;
+
+  return arena;
+}
+
+static gpointer
+gum_near_arena_try_alloc (GumNearArena * self,
+                          const GumAddressSpec * spec,
+                          gsize size,
+                          gsize alignment,
+                          GumPageProtection prot)
+{
+  guint i;
+
+  for (i = 0; i != self->num_extents; i++)
+  {
+    GumNearExtent extent = self->extents[i];
+    guint8 * extent_end = extent.start + extent.size;
+    guint8 * start;
+    gsize prefix_size, suffix_size;
+
+    start = GUM_ALIGN_POINTER (guint8 *, extent.start, alignment);
+    if (start + size > extent_end)
+      continue;
+
+    if (!gum_address_spec_is_satisfied_by (spec, start))
+    {
+      start = GSIZE_TO_POINTER (
+          GPOINTER_TO_SIZE (extent_end - size) & ~(alignment - 1));
+      if (start < extent.start ||
+          !gum_address_spec_is_satisfied_by (spec, start))
+        continue;
+    }
+
+    if (mmap (start, size, _gum_page_protection_to_posix (prot),
+          MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) == MAP_FAILED)
+      return NULL;
+
+    prefix_size = start - extent.start;
+    suffix_size = extent_end - (start + size);
+
+    gum_near_arena_remove_extent (self, i);
+    if (suffix_size != 0)
+    {
+      if (!gum_near_arena_insert_extent (self, i, start + size, suffix_size))
+        munmap (start + size, suffix_size);
+    }
+    if (prefix_size != 0)
+    {
+      if (!gum_near_arena_insert_extent (self, i, extent.start, prefix_size))
+        munmap (extent.start, prefix_size);
+    }
+
+    return start;
+  }
+
+  return NULL;
+}
+
+static gboolean
+gum_near_arena_overlaps (GumNearArena * self,
+                         gconstpointer address,
+                         gsize size)
+{
+  const guint8 * start = address;
+
+  return start < self->base + self->size && start + size > self->base;
+}
+
+static gboolean
+gum_near_arena_free (GumNearArena * self,
+                     gpointer address,
+                     gsize size)
+{
+  guint8 * start = address;
+  guint8 * end = start + size;
+  GumNearExtent * prev, * next;
+  gboolean merge_with_prev, merge_with_next;
+  guint i;
+
+  if (size == 0 ||
+      start < self->base + gum_query_page_size () ||
+      end > self->base + self->size)
+  {
+    return FALSE;
+  }
+
+  for (i = 0; i != self->num_extents; i++)
+  {
+    if (self->extents[i].start > start)
+      break;
+  }
+
+  prev = (i != 0) ? &self->extents[i - 1] : NULL;
+  next = (i != self->num_extents) ? &self->extents[i] : NULL;
+
+  /*
+   * The range must lie between two free extents, i.e. within what has been
+   * handed out, or we would be freeing it twice, or merging extents that
+   * overlap.
+   */
+  if (prev != NULL && prev->start + prev->size > start)
+    return FALSE;
+  if (next != NULL && next->start < end)
+    return FALSE;
+
+  if (mmap (start, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED,
+        -1, 0) == MAP_FAILED)
+    return FALSE;
+
+  merge_with_prev = prev != NULL && prev->start + prev->size == start;
+  merge_with_next = next != NULL && next->start == end;
+
+  if (merge_with_next)
+  {
+    size += next->size;
+    gum_near_arena_remove_extent (self, i);
+  }
+
+  if (merge_with_prev)
+  {
+    start = prev->start;
+    size += prev->size;
+    gum_near_arena_remove_extent (self, --i);
+  }
+
+  /*
+   * Out of room for tracking it, so give the range back to the kernel and
+   * never hand it out again, as someone else may end up mapping it.
+   */
+  if (!gum_near_arena_insert_extent (self, i, start, size))
+    munmap (start, size);
+
+  return TRUE;
+}
+
+static void
+gum_near_arena_remove_extent (GumNearArena * self,
+                              guint index)
+{
+  memmove (&self->extents[index], &self->extents[index + 1],
+      (self->num_extents - index - 1) * sizeof (GumNearExtent));
+  self->num_extents--;
+}
+
+static gboolean
+gum_near_arena_insert_extent (GumNearArena * self,
+                              guint index,
+                              guint8 * start,
+                              gsize size)
+{
+  GumNearExtent * extent;
+
+  if (self->num_extents == self->max_extents)
+    return FALSE;
+
+  extent = &self->extents[index];
+  memmove (extent + 1, extent,
+      (self->num_extents - index) * sizeof (GumNearExtent));
+  extent->start = start;
+  extent->size = size;
+  self->num_extents++;
+
+  return TRUE;
+}
+
+static gpointer
+gum_find_near_range (const GumAddressSpec * spec,
+                     gsize size,
+                     gsize alignment,
+                     GumPageProtection prot)
+{
+  GumAllocNearContext ctx;
+
   ctx.spec = spec;
   ctx.size = size;
   ctx.alignment = alignment;
@@ -188,6 +507,8 @@ gum_memory_allocate_near (const GumAddressSpec * spec,
   ctx.prot = prot;
   ctx.result = NULL;
 
+  g_atomic_int_inc (&gum_near_range_scans);
+
   gum_enumerate_free_ranges (gum_try_alloc_in_range_if_near_enough, &ctx);
 
   return ctx.result;
@@ -264,6 +585,34 @@ gboolean
 gum_memory_free (gpointer address,
                  gsize size)
 {
+  if (g_atomic_pointer_get (&gum_near_arenas) != NULL)
+  {
+    GumNearArena * arena;
+    gboolean owned = FALSE;
+    gboolean freed = FALSE;
+
+    G_LOCK (gum_near_arenas);
+
+    for (arena = gum_near_arenas; arena != NULL; arena = arena->next)
+    {
+      if (gum_near_arena_overlaps (arena, address, size))
+      {
+        owned = TRUE;
+        freed = gum_near_arena_free (arena, address, size);
+        break;
+      }
+    }
+
+    G_UNLOCK (gum_near_arenas);
+
+    /*
+     * Unmapping part of an arena here would leave a hole that the kernel may
+     * hand to someone else while the arena still considers it its own.
+     */
+    if (owned)
+      return freed;
+  }
+
   return munmap (address, size) == 0;
 }
 
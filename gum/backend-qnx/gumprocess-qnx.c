@@ -226,7 +226,8 @@ gum_process_modify_thread (GumThreadId thread_id,
 }
 
 void
-_gum_process_enumerate_threads (GumFoundThreadFunc func,
+_gum_process_enumerate_threads (GumThreadFlags flags,
+                                GumFoundThreadFunc func,
                                 gpointer user_data)
 {
   gint fd, res;
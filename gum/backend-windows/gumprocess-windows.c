@@ -134,7 +134,8 @@ beach:
 }
 
 void
-_gum_process_enumerate_threads (GumFoundThreadFunc func,
+_gum_process_enumerate_threads (GumThreadFlags flags,
+                                GumFoundThreadFunc func,
                                 gpointer user_data)
 {
   DWORD this_process_id;
@@ -123,18 +123,29 @@ _gum_interceptor_backend_create_trampoline (GumInterceptorBackend * self,
 
   gum_x86_writer_reset (cw, ctx->trampoline_slice->data);
 
-  function_ctx_ptr = GUM_ADDRESS (gum_x86_writer_cur (cw));
-  gum_x86_writer_put_bytes (cw, (guint8 *) &ctx, sizeof (GumFunctionContext *));
+  if (ctx->type == GUM_INTERCEPTOR_TYPE_FAST)
+  {
+    /* Only used when the replacement is out of reach of the prologue. */
+    ctx->on_enter_trampoline = gum_x86_writer_cur (cw);
+    gum_x86_writer_put_jmp_address (cw,
+        GUM_ADDRESS (ctx->replacement_function));
+  }
+  else
+  {
+    function_ctx_ptr = GUM_ADDRESS (gum_x86_writer_cur (cw));
+    gum_x86_writer_put_bytes (cw, (guint8 *) &ctx,
+        sizeof (GumFunctionContext *));
 
-  ctx->on_enter_trampoline = gum_x86_writer_cur (cw);
+    ctx->on_enter_trampoline = gum_x86_writer_cur (cw);
 
-  gum_x86_writer_put_push_near_ptr (cw, function_ctx_ptr);
-  gum_x86_writer_put_jmp_address (cw, GUM_ADDRESS (self->enter_thunk->data));
+    gum_x86_writer_put_push_near_ptr (cw, function_ctx_ptr);
+    gum_x86_writer_put_jmp_address (cw, GUM_ADDRESS (self->enter_thunk->data));
 
-  ctx->on_leave_trampoline = gum_x86_writer_cur (cw);
+    ctx->on_leave_trampoline = gum_x86_writer_cur (cw);
 
-  gum_x86_writer_put_push_near_ptr (cw, function_ctx_ptr);
-  gum_x86_writer_put_jmp_address (cw, GUM_ADDRESS (self->leave_thunk->data));
+    gum_x86_writer_put_push_near_ptr (cw, function_ctx_ptr);
+    gum_x86_writer_put_jmp_address (cw, GUM_ADDRESS (self->leave_thunk->data));
+  }
 
   gum_x86_writer_flush (cw);
   g_assert (gum_x86_writer_offset (cw) <= ctx->trampoline_slice->size);
@@ -165,6 +176,40 @@ _gum_interceptor_backend_create_trampoline (GumInterceptorBackend * self,
   return TRUE;
 }
 
+gboolean
+_gum_interceptor_backend_create_import_trampoline (GumInterceptorBackend * self,
+                                                   GumFunctionContext * ctx)
+{
+  GumX86Writer * cw = &self->writer;
+  GumAddress function_ctx_ptr;
+
+  ctx->trampoline_slice = gum_code_allocator_alloc_slice (self->allocator);
+
+  gum_x86_writer_reset (cw, ctx->trampoline_slice->data);
+
+  function_ctx_ptr = GUM_ADDRESS (gum_x86_writer_cur (cw));
+  gum_x86_writer_put_bytes (cw, (guint8 *) &ctx, sizeof (GumFunctionContext *));
+
+  ctx->on_enter_trampoline = gum_x86_writer_cur (cw);
+
+  gum_x86_writer_put_push_near_ptr (cw, function_ctx_ptr);
+  gum_x86_writer_put_jmp_address (cw, GUM_ADDRESS (self->enter_thunk->data));
+
+  ctx->on_leave_trampoline = gum_x86_writer_cur (cw);
+
+  gum_x86_writer_put_push_near_ptr (cw, function_ctx_ptr);
+  gum_x86_writer_put_jmp_address (cw, GUM_ADDRESS (self->leave_thunk->data));
+
+  gum_x86_writer_flush (cw);
+  g_assert (gum_x86_writer_offset (cw) <= ctx->trampoline_slice->size);
+
+  ctx->on_invoke_trampoline = ctx->function_address;
+
+  ctx->overwritten_prologue_len = 0;
+
+  return TRUE;
+}
+
 void
 _gum_interceptor_backend_destroy_trampoline (GumInterceptorBackend * self,
                                              GumFunctionContext * ctx)
@@ -179,11 +224,21 @@ _gum_interceptor_backend_activate_trampoline (GumInterceptorBackend * self,
                                               gpointer prologue)
 {
   GumX86Writer * cw = &self->writer;
+  GumAddress target;
   guint padding;
 
   gum_x86_writer_reset (cw, prologue);
   cw->pc = GPOINTER_TO_SIZE (ctx->function_address);
-  gum_x86_writer_put_jmp_address (cw, GUM_ADDRESS (ctx->on_enter_trampoline));
+
+  target = GUM_ADDRESS (ctx->on_enter_trampoline);
+  if (ctx->type == GUM_INTERCEPTOR_TYPE_FAST &&
+      gum_x86_writer_can_branch_directly_between (cw->pc,
+          GUM_ADDRESS (ctx->replacement_function)))
+  {
+    target = GUM_ADDRESS (ctx->replacement_function);
+  }
+
+  gum_x86_writer_put_jmp_address (cw, target);
   gum_x86_writer_flush (cw);
   g_assert (gum_x86_writer_offset (cw) <= GUM_INTERCEPTOR_REDIRECT_CODE_SIZE);
 
@@ -6,7 +6,7 @@
  * Licence: wxWindows Library Licence, Version 3.1
  */
 
-#include "gumstalker.h"
+#include "gumstalker-priv.h"
 
 #include "gummetalhash.h"
 #include "gumx86reader.h"
@@ -34,6 +34,14 @@
 #define GUM_DATA_SLAB_SIZE_DYNAMIC  (GUM_CODE_SLAB_SIZE_DYNAMIC / 5)
 #define GUM_SCRATCH_SLAB_SIZE       16384
 #define GUM_EXEC_BLOCK_MIN_CAPACITY 1024
+#define GUM_MAX_TRACE_SEGMENTS      8
+#define GUM_PREFETCH_MAX_SUCCESSORS 4
+#define GUM_PREFETCH_MAX_DEPTH      3
+#define GUM_PREFETCH_MAX_PENDING    4096
+#define GUM_PREFETCH_DECODE_WINDOW  512
+#define GUM_PREFETCH_RANGES_MAX_AGE (G_USEC_PER_SEC / 10)
+#define GUM_MAX_INSN_SIZE           16
+#define GUM_PROBE_TABLE_MIN_CAPACITY 64
 
 #if GLIB_SIZEOF_VOID_P == 4
 # define GUM_INVALIDATE_TRAMPOLINE_SIZE            16
@@ -56,6 +64,10 @@ typedef struct _GumDisinfectContext GumDisinfectContext;
 typedef struct _GumActivation GumActivation;
 typedef struct _GumInvalidateContext GumInvalidateContext;
 typedef struct _GumCallProbe GumCallProbe;
+typedef struct _GumCallProbeList GumCallProbeList;
+typedef struct _GumCallProbeSlot GumCallProbeSlot;
+typedef struct _GumCallProbeTable GumCallProbeTable;
+typedef struct _GumPrefetchRequest GumPrefetchRequest;
 
 typedef struct _GumExecCtx GumExecCtx;
 typedef guint GumExecCtxMode;
@@ -65,6 +77,7 @@ typedef gpointer (GUM_THUNK * GumExecCtxReplaceCurrentBlockFunc) (
 
 typedef struct _GumExecBlock GumExecBlock;
 typedef guint GumExecBlockFlags;
+typedef struct _GumExecSegment GumExecSegment;
 
 typedef struct _GumExecFrame GumExecFrame;
 
@@ -116,6 +129,7 @@ struct _GumStalker
   gsize page_size;
   GumCpuFeatures cpu_features;
   gboolean is_rwx_supported;
+  gsize code_alias_offset;
 
   GMutex mutex;
   GSList * contexts;
@@ -123,11 +137,31 @@ struct _GumStalker
 
   GArray * exclusions;
   gint trust_threshold;
+  guint trace_threshold;
+  gboolean block_counters_enabled;
+  gboolean shadow_stack_enabled;
+  gsize code_cache_budget;
+  gboolean prefetch_enabled;
+  GThread * prefetch_thread;
+  GMutex prefetch_mutex;
+  GCond prefetch_cond;
+  GQueue prefetch_queue;
+  GumExecCtx * prefetch_ctx;
+  gboolean prefetch_stopping;
+  GArray * prefetch_ranges;
+  gint64 prefetch_ranges_updated_at;
+  volatile gint code_cache_evictions;
+  volatile gint code_cache_evicted_blocks;
+  volatile gsize code_cache_evicted_bytes;
+  volatile gint prefetched_blocks;
   volatile gboolean any_probes_attached;
   volatile gint last_probe_id;
   GumSpinlock probe_lock;
   GHashTable * probe_target_by_id;
-  GHashTable * probe_array_by_address;
+  GumCallProbeTable * volatile probe_table;
+  GSList * retired_probe_tables;
+  GSList * retired_probe_lists;
+  guint num_probed_targets;
 
 #ifdef HAVE_WINDOWS
   GumExceptor * exceptor;
@@ -141,9 +175,8 @@ struct _GumStalker
 
 struct _GumInfectContext
 {
-  GumStalker * stalker;
-  GumStalkerTransformer * transformer;
-  GumEventSink * sink;
+  GumExecCtx ** contexts;
+  guint n_contexts;
 };
 
 struct _GumDisinfectContext
@@ -174,6 +207,35 @@ struct _GumCallProbe
   GDestroyNotify user_notify;
 };
 
+/*
+ * Call probes are looked up without taking any locks. Each probed target gets
+ * a slot in an open-addressed table, and slots live for as long as the Stalker
+ * so that compiled blocks can refer to them directly. Both the table and the
+ * probe list in each slot are immutable once published; writers swap in a new
+ * copy under the probe lock and retire the old one. Readers announce
+ * themselves through a counter in their own exec context, so they never touch
+ * shared cache lines. After dropping the probe lock, writers wait for each
+ * context's readers to drain before freeing what was retired.
+ */
+struct _GumCallProbeList
+{
+  guint length;
+  GumCallProbe * items[1];
+};
+
+struct _GumCallProbeSlot
+{
+  gpointer target_address;
+  GumCallProbeList * volatile probes;
+};
+
+struct _GumCallProbeTable
+{
+  gsize mask;
+  guint size;
+  GumCallProbeSlot * slots[1];
+};
+
 struct _GumExecCtx
 {
   volatile gint state;
@@ -188,6 +250,8 @@ struct _GumExecCtx
   GumNativeRegisterValue previous_dr1;
   GumNativeRegisterValue previous_dr2;
   GumNativeRegisterValue previous_dr7;
+
+  guint32 edge_coverage_location;
 #endif
 
   GumX86Writer code_writer;
@@ -218,12 +282,25 @@ struct _GumExecCtx
   gpointer thunks;
   gpointer infect_thunk;
   GumAddress infect_body;
+  gpointer infect_pc;
+
+  volatile gint probe_readers;
 
   GumSpinlock code_lock;
   GumCodeSlab * code_slab;
   GumDataSlab * data_slab;
   GumCodeSlab * scratch_slab;
+  gsize code_cache_size;
+  GumCodeSlab * retired_code_slab;
+  GumDataSlab * retired_data_slab;
+  GumCodeSlab * spare_code_slab;
+  GumDataSlab * spare_data_slab;
   GumMetalHashTable * mappings;
+  gpointer successors[GUM_PREFETCH_MAX_SUCCESSORS];
+  guint n_successors;
+  GumExecSegment segments[GUM_MAX_TRACE_SEGMENTS];
+  guint n_segments;
+  const guint8 * prefetch_limit;
   gpointer last_prolog_minimal;
   gpointer last_epilog_minimal;
   gpointer last_prolog_full;
@@ -262,11 +339,24 @@ struct _GumExecBlock
 
   GumExecBlockFlags flags;
   gint recycle_count;
+  guint heat;
+  guint n_segments;
+
+  gsize execution_count;
+  gsize * segment_execution_counts;
+};
+
+struct _GumExecSegment
+{
+  guint8 * real_start;
+  guint real_size;
 };
 
 enum _GumExecBlockFlags
 {
   GUM_EXEC_BLOCK_ACTIVATION_TARGET = 1 << 0,
+  GUM_EXEC_BLOCK_TRACE             = 1 << 1,
+  GUM_EXEC_BLOCK_PREFETCHED        = 1 << 2,
 };
 
 struct _GumExecFrame
@@ -275,6 +365,13 @@ struct _GumExecFrame
   gpointer code_address;
 };
 
+struct _GumPrefetchRequest
+{
+  GumExecCtx * ctx;
+  gpointer real_address;
+  guint depth;
+};
+
 struct _GumSlab
 {
   guint8 * data;
@@ -317,6 +414,12 @@ struct _GumGeneratorContext
   gpointer continuation_real_address;
   GumPrologType opened_prolog;
   guint accumulated_stack_delta;
+
+  gpointer trace_continuation;
+  guint trace_segments_left;
+  guint entry_real_size;
+
+  const guint8 * decode_limit;
 };
 
 struct _GumInstruction
@@ -374,9 +477,20 @@ enum _GumVirtualizationRequirements
 static void gum_stalker_dispose (GObject * object);
 static void gum_stalker_finalize (GObject * object);
 
+static void gum_stalker_start_prefetching (GumStalker * self);
+static void gum_stalker_stop_prefetching (GumStalker * self);
+static gpointer gum_stalker_process_prefetch_requests (GumStalker * self);
+static void gum_stalker_cancel_prefetch_requests (GumStalker * self,
+    GumExecCtx * ctx);
+static void gum_stalker_remove_prefetch_requests (GumStalker * self,
+    GumExecCtx * ctx);
+
 G_GNUC_INTERNAL void _gum_stalker_do_follow_me (GumStalker * self,
     GumStalkerTransformer * transformer, GumEventSink * sink,
     gpointer * ret_addr_ptr);
+static GumExecCtx * gum_stalker_prepare_infection (GumStalker * self,
+    GumThreadId thread_id, GumStalkerTransformer * transformer,
+    GumEventSink * sink);
 static void gum_stalker_infect (GumThreadId thread_id,
     GumCpuContext * cpu_context, gpointer user_data);
 static void gum_stalker_disinfect (GumThreadId thread_id,
@@ -392,6 +506,26 @@ static void gum_stalker_try_invalidate_block_owned_by_thread (
 
 static GumCallProbe * gum_call_probe_ref (GumCallProbe * probe);
 static void gum_call_probe_unref (GumCallProbe * probe);
+static GumCallProbeList * gum_call_probe_list_new_with_probe (
+    const GumCallProbeList * list, GumCallProbe * probe);
+static GumCallProbeList * gum_call_probe_list_new_without_probe (
+    const GumCallProbeList * list, GumProbeId id);
+static void gum_call_probe_list_free (GumCallProbeList * list);
+static GumCallProbeTable * gum_call_probe_table_new (gsize capacity);
+static void gum_call_probe_table_free (GumCallProbeTable * table);
+static gsize gum_call_probe_table_hash (gconstpointer target_address);
+static GumCallProbeSlot * gum_call_probe_table_lookup (
+    const GumCallProbeTable * table, gconstpointer target_address);
+static void gum_call_probe_table_insert (GumCallProbeTable * table,
+    GumCallProbeSlot * slot);
+static GumCallProbeSlot * gum_exec_ctx_lookup_probe_slot (GumExecCtx * ctx,
+    gconstpointer target_address);
+static GumCallProbeSlot * gum_stalker_obtain_probe_slot (GumStalker * self,
+    gpointer target_address);
+static void gum_stalker_publish_probes (GumStalker * self,
+    GumCallProbeSlot * slot, GumCallProbeList * probes);
+static void gum_stalker_free_retired_probes (GumStalker * self);
+static void gum_stalker_synchronize_probe_readers (GumStalker * self);
 
 static GumExecCtx * gum_stalker_create_exec_ctx (GumStalker * self,
     GumThreadId thread_id, GumStalkerTransformer * transformer,
@@ -403,9 +537,20 @@ static GumExecCtx * gum_stalker_find_exec_ctx_by_thread_id (GumStalker * self,
 
 static gsize gum_stalker_snapshot_space_needed_for (GumStalker * self,
     gsize real_size);
+static gsize gum_exec_ctx_get_snapshot_size (GumExecCtx * ctx,
+    const GumExecBlock * block);
+static void gum_exec_ctx_write_snapshot (GumExecCtx * ctx, GumExecBlock * block,
+    guint8 * snapshot);
 
-static void gum_stalker_thaw (GumStalker * self, gpointer code, gsize size);
+static gpointer gum_stalker_thaw (GumStalker * self, gpointer code,
+    gsize size);
 static void gum_stalker_freeze (GumStalker * self, gpointer code, gsize size);
+static gpointer gum_stalker_get_writable_code (GumStalker * self,
+    gpointer code);
+static gpointer gum_stalker_allocate_code (GumStalker * self,
+    const GumAddressSpec * spec, gsize size);
+static void gum_stalker_free_code (GumStalker * self, gpointer code,
+    gsize size);
 
 static GumExecCtx * gum_exec_ctx_new (GumStalker * self, GumThreadId thread_id,
     GumStalkerTransformer * transformer, GumEventSink * sink);
@@ -415,6 +560,21 @@ static GumCodeSlab * gum_exec_ctx_add_code_slab (GumExecCtx * ctx,
     GumCodeSlab * code_slab);
 static GumDataSlab * gum_exec_ctx_add_data_slab (GumExecCtx * ctx,
     GumDataSlab * data_slab);
+static void gum_exec_ctx_clear_slabs (GumExecCtx * ctx,
+    GumCodeSlab * code_slab, GumDataSlab * data_slab);
+static void gum_exec_ctx_free_code_slabs (GumExecCtx * ctx,
+    GumCodeSlab * code_slab);
+static void gum_exec_ctx_free_data_slabs (GumExecCtx * ctx,
+    GumDataSlab * data_slab);
+static gboolean gum_exec_ctx_is_embedded_slab (GumExecCtx * ctx,
+    gconstpointer slab);
+static void gum_exec_ctx_maybe_evict (GumExecCtx * ctx);
+static void gum_exec_ctx_evict (GumExecCtx * ctx);
+static void gum_exec_ctx_recycle_retired_slabs (GumExecCtx * ctx);
+static void gum_exec_ctx_collect_block_counts (GumExecCtx * ctx,
+    GumDataSlab * data_slab, GArray * counts, GHashTable * index_by_start);
+static void gum_add_block_count (GArray * counts, GHashTable * index_by_start,
+    const GumExecSegment * segment, gsize execution_count);
 static void gum_exec_ctx_compute_code_address_spec (GumExecCtx * ctx,
     gsize slab_size, GumAddressSpec * spec);
 static void gum_exec_ctx_compute_data_address_spec (GumExecCtx * ctx,
@@ -431,6 +591,25 @@ static GumExecBlock * gum_exec_ctx_obtain_block_for (GumExecCtx * ctx,
     gpointer real_address, gpointer * code_address);
 static void gum_exec_ctx_recompile_block (GumExecCtx * ctx,
     GumExecBlock * block);
+static gboolean gum_exec_ctx_should_build_trace (GumExecCtx * ctx,
+    GumExecBlock * block);
+static GumExecBlock * gum_exec_ctx_build_trace (GumExecCtx * ctx,
+    GumExecBlock * block);
+static gboolean gum_exec_ctx_may_trace_into (GumExecCtx * ctx,
+    gconstpointer address);
+static void gum_exec_ctx_note_successor (GumExecCtx * ctx, gpointer address);
+static void gum_exec_ctx_request_prefetch (GumExecCtx * ctx,
+    gpointer * successors, guint n_successors, guint depth);
+static const guint8 * gum_stalker_find_prefetch_limit (GumStalker * self,
+    gconstpointer real_address);
+static const GumMemoryRange * gum_stalker_find_prefetch_range (
+    GumStalker * self, gconstpointer real_address);
+static void gum_stalker_update_prefetch_ranges (GumStalker * self);
+static gboolean gum_collect_prefetch_range (const GumRangeDetails * details,
+    gpointer user_data);
+static gint gum_compare_prefetch_ranges (gconstpointer a, gconstpointer b);
+static void gum_exec_ctx_prefetch_block (GumExecCtx * ctx,
+    gpointer real_address, guint depth);
 static void gum_exec_ctx_compile_block (GumExecCtx * ctx, GumExecBlock * block,
     gconstpointer input_code, gpointer output_code, GumAddress output_pc,
     guint * input_size, guint * output_size);
@@ -442,6 +621,8 @@ static gboolean gum_stalker_iterator_is_out_of_space (
 
 static void gum_stalker_invoke_callout (GumCalloutEntry * entry,
     GumCpuContext * cpu_context);
+static gboolean gum_stalker_resolve_light_callout_register (guint reg,
+    GumPrologType prolog, GumCpuReg * native_reg, gssize * frame_offset);
 
 static void gum_exec_ctx_write_prolog (GumExecCtx * ctx, GumPrologType type,
     GumX86Writer * cw);
@@ -492,6 +673,9 @@ static void gum_exec_block_clear (GumExecBlock * block);
 static void gum_exec_block_commit (GumExecBlock * block);
 static void gum_exec_block_invalidate (GumExecBlock * block);
 static gpointer gum_exec_block_get_snapshot_start (GumExecBlock * block);
+static gboolean gum_exec_block_is_up_to_date (GumExecBlock * block);
+static void gum_exec_block_get_segment (GumExecBlock * block, guint index,
+    GumExecSegment * segment);
 static GumCalloutEntry * gum_exec_block_get_last_callout_entry (
     const GumExecBlock * block);
 static void gum_exec_block_set_last_callout_entry (GumExecBlock * block,
@@ -507,6 +691,9 @@ static void gum_exec_block_backpatch_ret (GumExecBlock * block,
 
 static GumVirtualizationRequirements gum_exec_block_virtualize_branch_insn (
     GumExecBlock * block, GumGeneratorContext * gc);
+static gboolean gum_exec_block_try_extend_trace (GumExecBlock * block,
+    const GumBranchTarget * target, gboolean is_conditional,
+    GumGeneratorContext * gc);
 static GumVirtualizationRequirements gum_exec_block_virtualize_ret_insn (
     GumExecBlock * block, GumGeneratorContext * gc);
 static GumVirtualizationRequirements gum_exec_block_virtualize_sysenter_insn (
@@ -524,6 +711,9 @@ static void gum_exec_block_write_jmp_transfer_code (GumExecBlock * block,
     GumGeneratorContext * gc);
 static void gum_exec_block_write_ret_transfer_code (GumExecBlock * block,
     GumGeneratorContext * gc);
+static void gum_exec_block_write_shadow_ret_code (GumExecBlock * block,
+    GumGeneratorContext * gc);
+static void gum_exec_ctx_unwind_shadow_stack (GumExecCtx * ctx);
 static void gum_exec_block_write_single_step_transfer_code (
     GumExecBlock * block, GumGeneratorContext * gc);
 #if GLIB_SIZEOF_VOID_P == 4 && !defined (HAVE_QNX)
@@ -543,12 +733,14 @@ static void gum_exec_block_write_block_event_code (GumExecBlock * block,
 static void gum_exec_block_write_unfollow_check_code (GumExecBlock * block,
     GumGeneratorContext * gc, GumCodeContext cc);
 
+static void gum_exec_block_maybe_write_counter_code (GumExecBlock * block,
+    guint segment_index, GumGeneratorContext * gc);
 static void gum_exec_block_maybe_write_call_probe_code (GumExecBlock * block,
     GumGeneratorContext * gc);
 static void gum_exec_block_write_call_probe_code (GumExecBlock * block,
-    GumGeneratorContext * gc);
-static void gum_exec_block_invoke_call_probes (GumExecBlock * block,
-    GumCpuContext * cpu_context);
+    GumCallProbeSlot * slot, GumGeneratorContext * gc);
+static void gum_exec_ctx_invoke_call_probes (GumExecCtx * ctx,
+    GumCallProbeSlot * slot, GumCpuContext * cpu_context);
 
 static gpointer gum_exec_block_write_inline_data (GumX86Writer * cw,
     gconstpointer data, gsize size, GumAddress * address);
@@ -559,7 +751,8 @@ static void gum_exec_block_close_prolog (GumExecBlock * block,
     GumGeneratorContext * gc);
 
 static GumCodeSlab * gum_code_slab_new (GumExecCtx * ctx);
-static void gum_code_slab_free (GumCodeSlab * code_slab);
+static void gum_code_slab_free (GumCodeSlab * code_slab,
+    GumStalker * stalker);
 static void gum_code_slab_init (GumCodeSlab * code_slab, gsize slab_size,
     gsize page_size);
 
@@ -636,8 +829,7 @@ gum_stalker_init (GumStalker * self)
 
   gum_spinlock_init (&self->probe_lock);
   self->probe_target_by_id = g_hash_table_new_full (NULL, NULL, NULL, NULL);
-  self->probe_array_by_address = g_hash_table_new_full (NULL, NULL, NULL,
-      (GDestroyNotify) g_ptr_array_unref);
+  self->probe_table = gum_call_probe_table_new (GUM_PROBE_TABLE_MIN_CAPACITY);
 
   page_size = gum_query_page_size ();
 
@@ -679,6 +871,10 @@ gum_stalker_init (GumStalker * self)
   self->contexts = NULL;
   self->exec_ctx = gum_tls_key_new ();
 
+  g_mutex_init (&self->prefetch_mutex);
+  g_cond_init (&self->prefetch_cond);
+  g_queue_init (&self->prefetch_queue);
+
 #ifdef HAVE_WINDOWS
   self->exceptor = gum_exceptor_obtain ();
   gum_exceptor_add (self->exceptor, gum_stalker_on_exception, self);
@@ -766,11 +962,16 @@ gum_stalker_finalize (GObject * object)
   g_array_unref (self->wow_transition_impls);
 #endif
 
-  g_hash_table_unref (self->probe_array_by_address);
+  gum_call_probe_table_free (self->probe_table);
   g_hash_table_unref (self->probe_target_by_id);
 
   g_array_free (self->exclusions, TRUE);
 
+  if (self->prefetch_thread != NULL)
+    gum_stalker_stop_prefetching (self);
+  g_cond_clear (&self->prefetch_cond);
+  g_mutex_clear (&self->prefetch_mutex);
+
   g_assert (self->contexts == NULL);
   gum_tls_key_free (self->exec_ctx);
   g_mutex_clear (&self->mutex);
@@ -822,6 +1023,295 @@ gum_stalker_set_trust_threshold (GumStalker * self,
   self->trust_threshold = trust_threshold;
 }
 
+guint
+gum_stalker_get_trace_threshold (GumStalker * self)
+{
+  return self->trace_threshold;
+}
+
+void
+gum_stalker_set_trace_threshold (GumStalker * self,
+                                 guint trace_threshold)
+{
+  self->trace_threshold = trace_threshold;
+}
+
+gsize
+gum_stalker_get_code_cache_budget (GumStalker * self)
+{
+  return self->code_cache_budget;
+}
+
+void
+gum_stalker_set_code_cache_budget (GumStalker * self,
+                                   gsize budget)
+{
+  self->code_cache_budget = budget;
+}
+
+void
+gum_stalker_query_code_cache_stats (GumStalker * self,
+                                    GumStalkerCodeCacheStats * stats)
+{
+  stats->evictions = g_atomic_int_get (&self->code_cache_evictions);
+  stats->evicted_blocks = g_atomic_int_get (&self->code_cache_evicted_blocks);
+  stats->evicted_bytes =
+      (gsize) g_atomic_pointer_get (&self->code_cache_evicted_bytes);
+  stats->prefetched_blocks = g_atomic_int_get (&self->prefetched_blocks);
+}
+
+gboolean
+gum_stalker_get_block_counters_enabled (GumStalker * self)
+{
+  return self->block_counters_enabled;
+}
+
+void
+gum_stalker_set_block_counters_enabled (GumStalker * self,
+                                        gboolean enabled)
+{
+  self->block_counters_enabled = enabled;
+}
+
+gboolean
+gum_stalker_get_prefetch_enabled (GumStalker * self)
+{
+  return self->prefetch_enabled;
+}
+
+void
+gum_stalker_set_prefetch_enabled (GumStalker * self,
+                                  gboolean enabled)
+{
+  if (enabled == self->prefetch_enabled)
+    return;
+
+  self->prefetch_enabled = enabled;
+
+  if (enabled)
+    gum_stalker_start_prefetching (self);
+  else
+    gum_stalker_stop_prefetching (self);
+}
+
+gboolean
+gum_stalker_get_dual_mapping_enabled (GumStalker * self)
+{
+  return self->code_alias_offset != 0;
+}
+
+void
+gum_stalker_set_dual_mapping_enabled (GumStalker * self,
+                                      gboolean enabled)
+{
+  g_return_if_fail (self->contexts == NULL);
+
+  if (enabled && gum_memory_can_dual_map ())
+  {
+    self->code_alias_offset = GUM_ALIGN_SIZE (
+        MAX (self->ctx_size, self->code_slab_size_dynamic), self->page_size);
+  }
+  else
+  {
+    self->code_alias_offset = 0;
+  }
+}
+
+static void
+gum_stalker_start_prefetching (GumStalker * self)
+{
+  g_assert (self->prefetch_thread == NULL);
+
+  self->prefetch_stopping = FALSE;
+  self->prefetch_thread = g_thread_new ("gum-stalker-prefetch",
+      (GThreadFunc) gum_stalker_process_prefetch_requests, self);
+}
+
+static void
+gum_stalker_stop_prefetching (GumStalker * self)
+{
+  GumPrefetchRequest * request;
+
+  g_mutex_lock (&self->prefetch_mutex);
+  self->prefetch_stopping = TRUE;
+  g_cond_broadcast (&self->prefetch_cond);
+  g_mutex_unlock (&self->prefetch_mutex);
+
+  g_thread_join (self->prefetch_thread);
+  self->prefetch_thread = NULL;
+
+  if (self->prefetch_ranges != NULL)
+  {
+    g_array_free (self->prefetch_ranges, TRUE);
+    self->prefetch_ranges = NULL;
+  }
+
+  while ((request = g_queue_pop_head (&self->prefetch_queue)) != NULL)
+    g_slice_free (GumPrefetchRequest, request);
+}
+
+static gpointer
+gum_stalker_process_prefetch_requests (GumStalker * self)
+{
+  g_mutex_lock (&self->prefetch_mutex);
+
+  while (!self->prefetch_stopping)
+  {
+    GumPrefetchRequest * request;
+
+    request = g_queue_pop_head (&self->prefetch_queue);
+    if (request == NULL)
+    {
+      g_cond_wait (&self->prefetch_cond, &self->prefetch_mutex);
+      continue;
+    }
+
+    self->prefetch_ctx = request->ctx;
+    g_mutex_unlock (&self->prefetch_mutex);
+
+    gum_exec_ctx_prefetch_block (request->ctx, request->real_address,
+        request->depth);
+    g_slice_free (GumPrefetchRequest, request);
+
+    g_mutex_lock (&self->prefetch_mutex);
+    self->prefetch_ctx = NULL;
+    g_cond_broadcast (&self->prefetch_cond);
+  }
+
+  g_mutex_unlock (&self->prefetch_mutex);
+
+  return NULL;
+}
+
+static void
+gum_stalker_cancel_prefetch_requests (GumStalker * self,
+                                      GumExecCtx * ctx)
+{
+  g_mutex_lock (&self->prefetch_mutex);
+
+  gum_stalker_remove_prefetch_requests (self, ctx);
+
+  /*
+   * A prefetch that is in flight may queue requests for its successors, so
+   * we remove those again once it is done, before letting go of the lock.
+   */
+  while (self->prefetch_ctx == ctx)
+    g_cond_wait (&self->prefetch_cond, &self->prefetch_mutex);
+
+  gum_stalker_remove_prefetch_requests (self, ctx);
+
+  g_mutex_unlock (&self->prefetch_mutex);
+}
+
+static void
+gum_stalker_remove_prefetch_requests (GumStalker * self,
+                                      GumExecCtx * ctx)
+{
+  GList * cur;
+
+  cur = self->prefetch_queue.head;
+  while (cur != NULL)
+  {
+    GList * next = cur->next;
+    GumPrefetchRequest * request = cur->data;
+
+    if (request->ctx == ctx)
+    {
+      g_queue_delete_link (&self->prefetch_queue, cur);
+      g_slice_free (GumPrefetchRequest, request);
+    }
+
+    cur = next;
+  }
+}
+
+GArray *
+gum_stalker_snapshot_block_counts (GumStalker * self)
+{
+  GArray * counts;
+  GHashTable * index_by_start;
+  GumExecCtx * current_ctx;
+  GSList * cur;
+
+  counts = g_array_new (FALSE, FALSE, sizeof (GumStalkerBlockCount));
+  index_by_start = g_hash_table_new (NULL, NULL);
+
+  current_ctx = gum_stalker_get_exec_ctx (self);
+
+  GUM_STALKER_LOCK (self);
+
+  for (cur = self->contexts; cur != NULL; cur = cur->next)
+  {
+    GumExecCtx * ctx = cur->data;
+
+    /*
+     * If we are being followed, anything we call below may need compiling,
+     * which takes our own code lock, so our own context is read without it.
+     * Nothing can evict behind our back: only this thread does that, and the
+     * prefetch thread, which may still add blocks, is off with a budget.
+     */
+    if (ctx == current_ctx)
+    {
+      gum_exec_ctx_collect_block_counts (ctx, ctx->data_slab, counts,
+          index_by_start);
+      gum_exec_ctx_collect_block_counts (ctx, ctx->retired_data_slab, counts,
+          index_by_start);
+      continue;
+    }
+
+    /*
+     * Compilation and eviction happen with the code lock held, so this also
+     * keeps the retired generation from being recycled while we walk it.
+     */
+    gum_spinlock_acquire (&ctx->code_lock);
+
+    gum_exec_ctx_collect_block_counts (ctx, ctx->data_slab, counts,
+        index_by_start);
+    gum_exec_ctx_collect_block_counts (ctx, ctx->retired_data_slab, counts,
+        index_by_start);
+
+    gum_spinlock_release (&ctx->code_lock);
+  }
+
+  GUM_STALKER_UNLOCK (self);
+
+  g_hash_table_unref (index_by_start);
+
+  return counts;
+}
+
+gboolean
+gum_stalker_get_shadow_stack_enabled (GumStalker * self)
+{
+  return self->shadow_stack_enabled;
+}
+
+void
+gum_stalker_set_shadow_stack_enabled (GumStalker * self,
+                                      gboolean enabled)
+{
+  self->shadow_stack_enabled = enabled;
+}
+
+GArray *
+gum_stalker_snapshot_call_stack (GumStalker * self)
+{
+  GArray * return_addresses;
+  GumExecCtx * ctx;
+  GumExecFrame * frame;
+
+  return_addresses = g_array_new (FALSE, FALSE, sizeof (gpointer));
+
+  ctx = gum_stalker_get_exec_ctx (self);
+  if (ctx == NULL)
+    return return_addresses;
+
+  for (frame = ctx->current_frame; frame != ctx->first_frame; frame++)
+    g_array_append_val (return_addresses, frame->real_address);
+
+  return return_addresses;
+}
+
 void
 gum_stalker_flush (GumStalker * self)
 {
@@ -855,11 +1345,28 @@ gum_stalker_stop (GumStalker * self)
   GSList * cur;
 
   gum_spinlock_acquire (&self->probe_lock);
-  g_hash_table_remove_all (self->probe_target_by_id);
-  g_hash_table_remove_all (self->probe_array_by_address);
-  self->any_probes_attached = FALSE;
+  {
+    GumCallProbeTable * table = self->probe_table;
+    gsize i;
+
+    g_hash_table_remove_all (self->probe_target_by_id);
+
+    for (i = 0; i <= table->mask; i++)
+    {
+      GumCallProbeSlot * slot = table->slots[i];
+
+      if (slot == NULL || slot->probes == NULL)
+        continue;
+
+      gum_stalker_publish_probes (self, slot, NULL);
+    }
+    self->num_probed_targets = 0;
+    self->any_probes_attached = FALSE;
+  }
   gum_spinlock_release (&self->probe_lock);
 
+  gum_stalker_free_retired_probes (self);
+
 rescan:
   GUM_STALKER_LOCK (self);
 
@@ -1005,19 +1512,68 @@ gum_stalker_follow (GumStalker * self,
                     GumEventSink * sink)
 {
   if (thread_id == gum_process_get_current_thread_id ())
-  {
     gum_stalker_follow_me (self, transformer, sink);
-  }
   else
+    gum_stalker_follow_threads (self, &thread_id, 1, transformer, sink);
+}
+
+void
+gum_stalker_follow_threads (GumStalker * self,
+                            const GumThreadId * thread_ids,
+                            guint n_threads,
+                            GumStalkerTransformer * transformer,
+                            GumEventSink * sink)
+{
+  GumThreadId current_thread_id, * unfollowed_thread_ids;
+  guint n_unfollowed_threads, i;
+  gboolean includes_current_thread;
+  GumInfectContext ic;
+
+  current_thread_id = gum_process_get_current_thread_id ();
+
+  unfollowed_thread_ids = g_new (GumThreadId, n_threads);
+  n_unfollowed_threads = 0;
+  includes_current_thread = FALSE;
+  for (i = 0; i != n_threads; i++)
+  {
+    GumThreadId thread_id = thread_ids[i];
+
+    if (thread_id == current_thread_id)
+      includes_current_thread = TRUE;
+    else if (gum_stalker_find_exec_ctx_by_thread_id (self, thread_id) == NULL)
+      unfollowed_thread_ids[n_unfollowed_threads++] = thread_id;
+  }
+
+  /*
+   * Everything that may allocate or take locks happens before the threads are
+   * stopped, as a stopped thread might be holding one of those locks. The
+   * first block is compiled by the thread itself once it enters the infect
+   * thunk.
+   */
+  ic.contexts = g_new (GumExecCtx *, n_unfollowed_threads);
+  ic.n_contexts = n_unfollowed_threads;
+  for (i = 0; i != n_unfollowed_threads; i++)
   {
-    GumInfectContext ctx;
+    ic.contexts[i] = gum_stalker_prepare_infection (self,
+        unfollowed_thread_ids[i], transformer, sink);
+  }
+
+  gum_process_modify_threads (unfollowed_thread_ids, n_unfollowed_threads,
+      gum_stalker_infect, &ic);
 
-    ctx.stalker = self;
-    ctx.transformer = transformer;
-    ctx.sink = sink;
+  for (i = 0; i != ic.n_contexts; i++)
+  {
+    GumExecCtx * ctx = ic.contexts[i];
 
-    gum_process_modify_thread (thread_id, gum_stalker_infect, &ctx);
+    if (ctx->infect_pc == NULL)
+      gum_stalker_destroy_exec_ctx (self, ctx);
   }
+
+  g_free (ic.contexts);
+  g_free (unfollowed_thread_ids);
+
+  if (includes_current_thread)
+    gum_stalker_follow_me (self, transformer, sink);
 }
 
 void
@@ -1055,64 +1611,99 @@ gum_stalker_unfollow (GumStalker * self,
   }
 }
 
-static void
-gum_stalker_infect (GumThreadId thread_id,
-                    GumCpuContext * cpu_context,
-                    gpointer user_data)
+static GumExecCtx *
+gum_stalker_prepare_infection (GumStalker * self,
+                               GumThreadId thread_id,
+                               GumStalkerTransformer * transformer,
+                               GumEventSink * sink)
 {
-  GumInfectContext * infect_context = (GumInfectContext *) user_data;
-  GumStalker * self = infect_context->stalker;
   GumExecCtx * ctx;
-  guint8 * pc;
   const guint max_syscall_size = 2;
-  gpointer code_address;
   GumX86Writer * cw;
 
-  ctx = gum_stalker_create_exec_ctx (self, thread_id,
-      infect_context->transformer, infect_context->sink);
-
-  pc = GSIZE_TO_POINTER (GUM_CPU_CONTEXT_XIP (cpu_context));
-
-  ctx->current_block = gum_exec_ctx_obtain_block_for (ctx, pc, &code_address);
-
-  if (gum_exec_ctx_maybe_unfollow (ctx, NULL))
-  {
-    gum_stalker_destroy_exec_ctx (self, ctx);
-    return;
-  }
+  ctx = gum_stalker_create_exec_ctx (self, thread_id, transformer, sink);
 
   gum_spinlock_acquire (&ctx->code_lock);
 
-  gum_stalker_thaw (self, ctx->thunks, self->thunks_size);
   cw = &ctx->code_writer;
-  gum_x86_writer_reset (cw, ctx->infect_thunk);
+  gum_x86_writer_reset (cw,
+      gum_stalker_thaw (self, ctx->infect_thunk, self->thunks_size));
+  cw->pc = GUM_ADDRESS (ctx->infect_thunk);
 
   /*
    * In case the thread is in a Linux system call we should allow it to be
-   * restarted by bringing along the syscall instruction.
+   * restarted by bringing along the syscall instruction. These bytes are
+   * filled in once we know where the thread was stopped.
    */
-  gum_x86_writer_put_bytes (cw, pc - max_syscall_size, max_syscall_size);
+  gum_x86_writer_put_nop_padding (cw, max_syscall_size);
 
-  ctx->infect_body = GUM_ADDRESS (gum_x86_writer_cur (cw));
+  ctx->infect_body = cw->pc;
   gum_exec_ctx_write_prolog (ctx, GUM_PROLOG_MINIMAL, cw);
   gum_x86_writer_put_call_address_with_aligned_arguments (cw, GUM_CALL_CAPI,
       GUM_ADDRESS (gum_tls_key_set_value), 2,
       GUM_ARG_ADDRESS, GUM_ADDRESS (self->exec_ctx),
       GUM_ARG_ADDRESS, GUM_ADDRESS (ctx));
+
+  gum_x86_writer_put_mov_reg_near_ptr (cw, GUM_THUNK_REG_ARG1,
+      GUM_ADDRESS (&ctx->infect_pc));
+  gum_x86_writer_put_mov_reg_address (cw, GUM_THUNK_REG_ARG0,
+      GUM_ADDRESS (ctx));
+  gum_x86_writer_put_sub_reg_imm (cw, GUM_REG_XSP,
+      GUM_THUNK_ARGLIST_STACK_RESERVE);
+  gum_x86_writer_put_mov_reg_address (cw, GUM_REG_XAX,
+      GUM_ADDRESS (gum_exec_ctx_switch_block));
+  gum_x86_writer_put_call_reg (cw, GUM_REG_XAX);
+  gum_x86_writer_put_add_reg_imm (cw, GUM_REG_XSP,
+      GUM_THUNK_ARGLIST_STACK_RESERVE);
   gum_exec_ctx_write_epilog (ctx, GUM_PROLOG_MINIMAL, cw);
 
-  gum_x86_writer_put_jmp_address (cw, GUM_ADDRESS (code_address));
+  gum_x86_writer_put_jmp_near_ptr (cw, GUM_ADDRESS (&ctx->resume_at));
 
   gum_x86_writer_flush (cw);
-  gum_stalker_freeze (self, cw->base, gum_x86_writer_offset (cw));
+  gum_stalker_freeze (self, ctx->infect_thunk, gum_x86_writer_offset (cw));
 
   gum_spinlock_release (&ctx->code_lock);
 
   gum_event_sink_start (ctx->sink);
+  ctx->sink_started = TRUE;
 
-#ifdef HAVE_WINDOWS
-  {
-    gboolean probably_in_syscall;
+  return ctx;
+}
+
+static void
+gum_stalker_infect (GumThreadId thread_id,
+                    GumCpuContext * cpu_context,
+                    gpointer user_data)
+{
+  GumInfectContext * infect_context = (GumInfectContext *) user_data;
+  GumExecCtx * ctx = NULL;
+  GumStalker * self;
+  guint8 * pc;
+  const guint max_syscall_size = 2;
+  guint i;
+
+  for (i = 0; i != infect_context->n_contexts; i++)
+  {
+    if (infect_context->contexts[i]->thread_id == thread_id)
+    {
+      ctx = infect_context->contexts[i];
+      break;
+    }
+  }
+  if (ctx == NULL)
+    return;
+
+  self = ctx->stalker;
+
+  pc = GSIZE_TO_POINTER (GUM_CPU_CONTEXT_XIP (cpu_context));
+
+  memcpy (gum_stalker_thaw (self, ctx->infect_thunk, max_syscall_size),
+      pc - max_syscall_size, max_syscall_size);
+  gum_stalker_freeze (self, ctx->infect_thunk, max_syscall_size);
+
+#ifdef HAVE_WINDOWS
+  {
+    gboolean probably_in_syscall;
 
     probably_in_syscall =
 # if GLIB_SIZEOF_VOID_P == 8
@@ -1149,14 +1740,15 @@ gum_stalker_infect (GumThreadId thread_id,
         CloseHandle (thread);
       }
 
-      if (!breakpoint_deployed)
-        gum_stalker_destroy_exec_ctx (self, ctx);
+      if (breakpoint_deployed)
+        ctx->infect_pc = pc;
 
       return;
     }
   }
 #endif
 
+  ctx->infect_pc = pc;
   GUM_CPU_CONTEXT_XIP (cpu_context) = ctx->infect_body;
 }
 
@@ -1201,8 +1793,7 @@ gum_stalker_disinfect (GumThreadId thread_id,
       GUM_CPU_CONTEXT_XIP (cpu_context) == ctx->infect_body;
   if (infection_not_active_yet)
   {
-    GUM_CPU_CONTEXT_XIP (cpu_context) =
-        GPOINTER_TO_SIZE (ctx->current_block->real_start);
+    GUM_CPU_CONTEXT_XIP (cpu_context) = GPOINTER_TO_SIZE (ctx->infect_pc);
 
     disinfect_context->success = TRUE;
   }
@@ -1455,7 +2046,7 @@ gum_stalker_add_call_probe (GumStalker * self,
 {
   GumActivation activation;
   GumCallProbe * probe;
-  GPtrArray * probes;
+  GumCallProbeSlot * slot;
   gboolean is_first_for_target;
 
   gum_stalker_maybe_deactivate (self, &activation);
@@ -1475,22 +2066,23 @@ gum_stalker_add_call_probe (GumStalker * self,
   g_hash_table_insert (self->probe_target_by_id, GSIZE_TO_POINTER (probe->id),
       target_address);
 
-  probes = g_hash_table_lookup (self->probe_array_by_address, target_address);
-  if (probes == NULL)
+  slot = gum_stalker_obtain_probe_slot (self, target_address);
+  if (slot->probes == NULL)
   {
-    probes =
-        g_ptr_array_new_with_free_func ((GDestroyNotify) gum_call_probe_unref);
-    g_hash_table_insert (self->probe_array_by_address, target_address, probes);
+    self->num_probed_targets++;
 
     is_first_for_target = TRUE;
   }
 
-  g_ptr_array_add (probes, probe);
+  gum_stalker_publish_probes (self, slot,
+      gum_call_probe_list_new_with_probe (slot->probes, probe));
 
   self->any_probes_attached = TRUE;
 
   gum_spinlock_release (&self->probe_lock);
 
+  gum_stalker_free_retired_probes (self);
+
   if (is_first_for_target)
     gum_stalker_invalidate_for_all_threads (self, target_address, &activation);
 
@@ -1517,41 +2109,31 @@ gum_stalker_remove_call_probe (GumStalker * self,
 
   if (target_address != NULL)
   {
-    GPtrArray * probes;
-    gint match_index = -1;
-    guint i;
+    GumCallProbeSlot * slot;
+    GumCallProbeList * probes;
 
     g_hash_table_remove (self->probe_target_by_id, GSIZE_TO_POINTER (id));
 
-    probes = g_hash_table_lookup (self->probe_array_by_address, target_address);
-    g_assert (probes != NULL);
+    slot = gum_call_probe_table_lookup (self->probe_table, target_address);
+    g_assert (slot != NULL && slot->probes != NULL);
 
-    for (i = 0; i != probes->len; i++)
+    probes = gum_call_probe_list_new_without_probe (slot->probes, id);
+    if (probes == NULL)
     {
-      GumCallProbe * probe = g_ptr_array_index (probes, i);
-      if (probe->id == id)
-      {
-        match_index = i;
-        break;
-      }
-    }
-    g_assert (match_index != -1);
-
-    g_ptr_array_remove_index (probes, match_index);
-
-    if (probes->len == 0)
-    {
-      g_hash_table_remove (self->probe_array_by_address, target_address);
+      self->num_probed_targets--;
 
       is_last_for_target = TRUE;
     }
 
-    self->any_probes_attached =
-        g_hash_table_size (self->probe_array_by_address) != 0;
+    gum_stalker_publish_probes (self, slot, probes);
+
+    self->any_probes_attached = self->num_probed_targets != 0;
   }
 
   gum_spinlock_release (&self->probe_lock);
 
+  gum_stalker_free_retired_probes (self);
+
   if (is_last_for_target)
     gum_stalker_invalidate_for_all_threads (self, target_address, &activation);
 
@@ -1582,6 +2164,245 @@ gum_call_probe_unref (GumCallProbe * probe)
   }
 }
 
+static GumCallProbeList *
+gum_call_probe_list_new_with_probe (const GumCallProbeList * list,
+                                    GumCallProbe * probe)
+{
+  GumCallProbeList * result;
+  guint length, i;
+
+  length = (list != NULL) ? list->length + 1 : 1;
+
+  result = g_malloc (G_STRUCT_OFFSET (GumCallProbeList, items) +
+      length * sizeof (GumCallProbe *));
+  result->length = length;
+
+  for (i = 0; i != length - 1; i++)
+    result->items[i] = gum_call_probe_ref (list->items[i]);
+  result->items[i] = probe;
+
+  return result;
+}
+
+static GumCallProbeList *
+gum_call_probe_list_new_without_probe (const GumCallProbeList * list,
+                                       GumProbeId id)
+{
+  GumCallProbeList * result;
+  guint i, j;
+
+  if (list->length == 1)
+    return NULL;
+
+  result = g_malloc (G_STRUCT_OFFSET (GumCallProbeList, items) +
+      (list->length - 1) * sizeof (GumCallProbe *));
+  result->length = list->length - 1;
+
+  for (i = 0, j = 0; i != list->length; i++)
+  {
+    GumCallProbe * probe = list->items[i];
+
+    if (probe->id != id)
+      result->items[j++] = gum_call_probe_ref (probe);
+  }
+  g_assert (j == result->length);
+
+  return result;
+}
+
+static void
+gum_call_probe_list_free (GumCallProbeList * list)
+{
+  guint i;
+
+  for (i = 0; i != list->length; i++)
+    gum_call_probe_unref (list->items[i]);
+
+  g_free (list);
+}
+
+static GumCallProbeTable *
+gum_call_probe_table_new (gsize capacity)
+{
+  GumCallProbeTable * table;
+
+  table = g_malloc0 (G_STRUCT_OFFSET (GumCallProbeTable, slots) +
+      capacity * sizeof (GumCallProbeSlot *));
+  table->mask = capacity - 1;
+
+  return table;
+}
+
+static void
+gum_call_probe_table_free (GumCallProbeTable * table)
+{
+  gsize i;
+
+  for (i = 0; i <= table->mask; i++)
+  {
+    GumCallProbeSlot * slot = table->slots[i];
+
+    if (slot == NULL)
+      continue;
+
+    if (slot->probes != NULL)
+      gum_call_probe_list_free (slot->probes);
+    g_slice_free (GumCallProbeSlot, slot);
+  }
+
+  g_free (table);
+}
+
+static gsize
+gum_call_probe_table_hash (gconstpointer target_address)
+{
+  gsize h = GPOINTER_TO_SIZE (target_address);
+
+  h ^= h >> 16;
+  h *= 0x45d9f3b;
+  h ^= h >> 16;
+
+  return h;
+}
+
+static GumCallProbeSlot *
+gum_call_probe_table_lookup (const GumCallProbeTable * table,
+                             gconstpointer target_address)
+{
+  GumCallProbeSlot * slot;
+  gsize i;
+
+  i = gum_call_probe_table_hash (target_address) & table->mask;
+  while ((slot = g_atomic_pointer_get (&table->slots[i])) != NULL)
+  {
+    if (slot->target_address == target_address)
+      break;
+
+    i = (i + 1) & table->mask;
+  }
+
+  return slot;
+}
+
+static void
+gum_call_probe_table_insert (GumCallProbeTable * table,
+                             GumCallProbeSlot * slot)
+{
+  gsize i;
+
+  i = gum_call_probe_table_hash (slot->target_address) & table->mask;
+  while (table->slots[i] != NULL)
+    i = (i + 1) & table->mask;
+
+  g_atomic_pointer_set (&table->slots[i], slot);
+  table->size++;
+}
+
+static GumCallProbeSlot *
+gum_exec_ctx_lookup_probe_slot (GumExecCtx * ctx,
+                                gconstpointer target_address)
+{
+  GumCallProbeSlot * slot;
+
+  g_atomic_int_inc (&ctx->probe_readers);
+  slot = gum_call_probe_table_lookup (
+      g_atomic_pointer_get (&ctx->stalker->probe_table), target_address);
+  g_atomic_int_add (&ctx->probe_readers, -1);
+
+  return slot;
+}
+
+static GumCallProbeSlot *
+gum_stalker_obtain_probe_slot (GumStalker * self,
+                               gpointer target_address)
+{
+  GumCallProbeTable * table = self->probe_table;
+  GumCallProbeSlot * slot;
+
+  slot = gum_call_probe_table_lookup (table, target_address);
+  if (slot != NULL)
+    return slot;
+
+  if ((table->size + 1) * 2 > table->mask + 1)
+  {
+    GumCallProbeTable * old_table = table;
+    gsize i;
+
+    table = gum_call_probe_table_new ((old_table->mask + 1) * 2);
+    for (i = 0; i <= old_table->mask; i++)
+    {
+      if (old_table->slots[i] != NULL)
+        gum_call_probe_table_insert (table, old_table->slots[i]);
+    }
+
+    g_atomic_pointer_set (&self->probe_table, table);
+
+    self->retired_probe_tables =
+        g_slist_prepend (self->retired_probe_tables, old_table);
+  }
+
+  slot = g_slice_new (GumCallProbeSlot);
+  slot->target_address = target_address;
+  slot->probes = NULL;
+
+  gum_call_probe_table_insert (table, slot);
+
+  return slot;
+}
+
+static void
+gum_stalker_publish_probes (GumStalker * self,
+                            GumCallProbeSlot * slot,
+                            GumCallProbeList * probes)
+{
+  GumCallProbeList * old_probes = slot->probes;
+
+  g_atomic_pointer_set (&slot->probes, probes);
+
+  if (old_probes != NULL)
+  {
+    self->retired_probe_lists =
+        g_slist_prepend (self->retired_probe_lists, old_probes);
+  }
+}
+
+static void
+gum_stalker_free_retired_probes (GumStalker * self)
+{
+  GSList * tables, * lists;
+
+  gum_spinlock_acquire (&self->probe_lock);
+  tables = g_steal_pointer (&self->retired_probe_tables);
+  lists = g_steal_pointer (&self->retired_probe_lists);
+  gum_spinlock_release (&self->probe_lock);
+
+  if (tables == NULL && lists == NULL)
+    return;
+
+  gum_stalker_synchronize_probe_readers (self);
+
+  g_slist_free_full (tables, g_free);
+  g_slist_free_full (lists, (GDestroyNotify) gum_call_probe_list_free);
+}
+
+static void
+gum_stalker_synchronize_probe_readers (GumStalker * self)
+{
+  GSList * cur;
+
+  GUM_STALKER_LOCK (self);
+
+  for (cur = self->contexts; cur != NULL; cur = cur->next)
+  {
+    GumExecCtx * ctx = cur->data;
+
+    while (g_atomic_int_get (&ctx->probe_readers) != 0)
+      g_thread_yield ();
+  }
+
+  GUM_STALKER_UNLOCK (self);
+}
+
 static GumExecCtx *
 gum_stalker_create_exec_ctx (GumStalker * self,
                              GumThreadId thread_id,
@@ -1613,6 +2434,8 @@ gum_stalker_destroy_exec_ctx (GumStalker * self,
   if (entry == NULL)
     return;
 
+  gum_stalker_cancel_prefetch_requests (self, ctx);
+
   gum_exec_ctx_dispose (ctx);
 
   if (ctx->sink_started)
@@ -1663,13 +2486,75 @@ gum_stalker_snapshot_space_needed_for (GumStalker * self,
   return (self->trust_threshold != 0) ? real_size : 0;
 }
 
+/*
+ * A trace stores a table of its segments in front of its snapshot, so each
+ * segment can be validated and reported on its own. Other blocks consist of
+ * a single segment, and their snapshot is just a copy of it.
+ */
+static gsize
+gum_exec_ctx_get_snapshot_size (GumExecCtx * ctx,
+                                const GumExecBlock * block)
+{
+  gsize size;
+  guint i;
+
+  size = ((block->flags & GUM_EXEC_BLOCK_TRACE) != 0)
+      ? ctx->n_segments * sizeof (GumExecSegment)
+      : 0;
+
+  for (i = 0; i != ctx->n_segments; i++)
+  {
+    size += gum_stalker_snapshot_space_needed_for (ctx->stalker,
+        ctx->segments[i].real_size);
+  }
+
+  return size;
+}
+
 static void
+gum_exec_ctx_write_snapshot (GumExecCtx * ctx,
+                             GumExecBlock * block,
+                             guint8 * snapshot)
+{
+  guint i;
+
+  block->n_segments = ctx->n_segments;
+
+  if ((block->flags & GUM_EXEC_BLOCK_TRACE) != 0)
+  {
+    memcpy (snapshot, ctx->segments,
+        ctx->n_segments * sizeof (GumExecSegment));
+    snapshot += ctx->n_segments * sizeof (GumExecSegment);
+  }
+
+  for (i = 0; i != ctx->n_segments; i++)
+  {
+    const GumExecSegment * segment = &ctx->segments[i];
+    gsize size;
+
+    size = gum_stalker_snapshot_space_needed_for (ctx->stalker,
+        segment->real_size);
+    memcpy (snapshot, segment->real_start, size);
+    snapshot += size;
+  }
+}
+
+/*
+ * Makes code writable and returns the address to write it through. With dual
+ * mapping that's the RW alias of the code, and its protection never changes.
+ */
+static gpointer
 gum_stalker_thaw (GumStalker * self,
                   gpointer code,
                   gsize size)
 {
+  if (self->code_alias_offset != 0)
+    return (guint8 *) code + self->code_alias_offset;
+
   if (!self->is_rwx_supported)
     gum_mprotect (code, size, GUM_PAGE_RW);
+
+  return code;
 }
 
 static void
@@ -1677,12 +2562,42 @@ gum_stalker_freeze (GumStalker * self,
                     gpointer code,
                     gsize size)
 {
-  if (!self->is_rwx_supported)
+  if (!self->is_rwx_supported && self->code_alias_offset == 0)
     gum_memory_mark_code (code, size);
 
   gum_clear_cache (code, size);
 }
 
+static gpointer
+gum_stalker_get_writable_code (GumStalker * self,
+                               gpointer code)
+{
+  return (guint8 *) code + self->code_alias_offset;
+}
+
+static gpointer
+gum_stalker_allocate_code (GumStalker * self,
+                           const GumAddressSpec * spec,
+                           gsize size)
+{
+  if (self->code_alias_offset != 0)
+  {
+    return gum_memory_allocate_dual_mapped (spec, size, self->page_size,
+        self->code_alias_offset);
+  }
+
+  return gum_memory_allocate_near (spec, size, self->page_size,
+      self->is_rwx_supported ? GUM_PAGE_RWX : GUM_PAGE_RW);
+}
+
+static void
+gum_stalker_free_code (GumStalker * self,
+                       gpointer code,
+                       gsize size)
+{
+  gum_memory_free (code, self->code_alias_offset + size);
+}
+
 static GumExecCtx *
 gum_exec_ctx_new (GumStalker * stalker,
                   GumThreadId thread_id,
@@ -1694,8 +2609,7 @@ gum_exec_ctx_new (GumStalker * stalker,
   GumCodeSlab * code_slab;
   GumDataSlab * data_slab;
 
-  base = gum_memory_allocate (NULL, stalker->ctx_size, stalker->page_size,
-      stalker->is_rwx_supported ? GUM_PAGE_RWX : GUM_PAGE_RW);
+  base = gum_stalker_allocate_code (stalker, NULL, stalker->ctx_size);
 
   ctx = (GumExecCtx *) base;
 
@@ -1738,6 +2652,12 @@ gum_exec_ctx_new (GumStalker * stalker,
       stalker->page_size);
   gum_exec_ctx_add_code_slab (ctx, code_slab);
 
+  if (stalker->code_alias_offset != 0)
+  {
+    gum_mprotect (ctx->thunks, stalker->thunks_size, GUM_PAGE_RX);
+    gum_mprotect (code_slab->slab.data, code_slab->slab.size, GUM_PAGE_RX);
+  }
+
   data_slab = (GumDataSlab *) (base + stalker->data_slab_offset);
   gum_data_slab_init (data_slab, stalker->data_slab_size_initial);
   gum_exec_ctx_add_data_slab (ctx, data_slab);
@@ -1758,40 +2678,16 @@ static void
 gum_exec_ctx_free (GumExecCtx * ctx)
 {
   GumStalker * stalker = ctx->stalker;
-  GumDataSlab * data_slab;
-  GumCodeSlab * code_slab;
 
   gum_metal_hash_table_unref (ctx->mappings);
 
-  data_slab = ctx->data_slab;
-  while (TRUE)
-  {
-    GumDataSlab * next = (GumDataSlab *) data_slab->slab.next;
-    gboolean is_initial;
-
-    is_initial = next == NULL;
-    if (is_initial)
-      break;
-
-    gum_data_slab_free (data_slab);
-
-    data_slab = next;
-  }
-
-  code_slab = ctx->code_slab;
-  while (TRUE)
-  {
-    GumCodeSlab * next = (GumCodeSlab *) code_slab->slab.next;
-    gboolean is_initial;
-
-    is_initial = next == NULL;
-    if (is_initial)
-      break;
-
-    gum_code_slab_free (code_slab);
+  gum_exec_ctx_free_data_slabs (ctx, ctx->data_slab);
+  gum_exec_ctx_free_data_slabs (ctx, ctx->retired_data_slab);
+  gum_exec_ctx_free_data_slabs (ctx, ctx->spare_data_slab);
 
-    code_slab = next;
-  }
+  gum_exec_ctx_free_code_slabs (ctx, ctx->code_slab);
+  gum_exec_ctx_free_code_slabs (ctx, ctx->retired_code_slab);
+  gum_exec_ctx_free_code_slabs (ctx, ctx->spare_code_slab);
 
   g_object_unref (ctx->sink);
   g_object_unref (ctx->transformer);
@@ -1801,21 +2697,50 @@ gum_exec_ctx_free (GumExecCtx * ctx)
 
   g_object_unref (stalker);
 
-  gum_memory_free (ctx, stalker->ctx_size);
+  gum_stalker_free_code (stalker, ctx, stalker->ctx_size);
 }
 
 static void
 gum_exec_ctx_dispose (GumExecCtx * ctx)
+{
+  gum_exec_ctx_clear_slabs (ctx, ctx->code_slab, ctx->data_slab);
+  gum_exec_ctx_clear_slabs (ctx, ctx->retired_code_slab,
+      ctx->retired_data_slab);
+}
+
+static GumCodeSlab *
+gum_exec_ctx_add_code_slab (GumExecCtx * ctx,
+                            GumCodeSlab * code_slab)
+{
+  code_slab->slab.next = &ctx->code_slab->slab;
+  ctx->code_slab = code_slab;
+  ctx->code_cache_size += code_slab->slab.size;
+  return code_slab;
+}
+
+static GumDataSlab *
+gum_exec_ctx_add_data_slab (GumExecCtx * ctx,
+                            GumDataSlab * data_slab)
+{
+  data_slab->slab.next = &ctx->data_slab->slab;
+  ctx->data_slab = data_slab;
+  return data_slab;
+}
+
+static void
+gum_exec_ctx_clear_slabs (GumExecCtx * ctx,
+                          GumCodeSlab * code_slab,
+                          GumDataSlab * data_slab)
 {
   GumStalker * stalker = ctx->stalker;
   GumSlab * slab;
 
-  for (slab = &ctx->code_slab->slab; slab != NULL; slab = slab->next)
+  for (slab = &code_slab->slab; slab != NULL; slab = slab->next)
   {
     gum_stalker_thaw (stalker, gum_slab_start (slab), slab->offset);
   }
 
-  for (slab = &ctx->data_slab->slab; slab != NULL; slab = slab->next)
+  for (slab = &data_slab->slab; slab != NULL; slab = slab->next)
   {
     GumExecBlock * blocks;
     guint num_blocks;
@@ -1829,26 +2754,265 @@ gum_exec_ctx_dispose (GumExecCtx * ctx)
       GumExecBlock * block = &blocks[i];
 
       gum_exec_block_clear (block);
+      g_clear_pointer (&block->segment_execution_counts, g_free);
     }
   }
 }
 
-static GumCodeSlab *
-gum_exec_ctx_add_code_slab (GumExecCtx * ctx,
-                            GumCodeSlab * code_slab)
+static void
+gum_exec_ctx_free_code_slabs (GumExecCtx * ctx,
+                              GumCodeSlab * code_slab)
 {
-  code_slab->slab.next = &ctx->code_slab->slab;
-  ctx->code_slab = code_slab;
-  return code_slab;
+  while (code_slab != NULL)
+  {
+    GumCodeSlab * next = (GumCodeSlab *) code_slab->slab.next;
+
+    if (!gum_exec_ctx_is_embedded_slab (ctx, code_slab))
+      gum_code_slab_free (code_slab, ctx->stalker);
+
+    code_slab = next;
+  }
 }
 
-static GumDataSlab *
-gum_exec_ctx_add_data_slab (GumExecCtx * ctx,
-                            GumDataSlab * data_slab)
+static void
+gum_exec_ctx_free_data_slabs (GumExecCtx * ctx,
+                              GumDataSlab * data_slab)
 {
-  data_slab->slab.next = &ctx->data_slab->slab;
-  ctx->data_slab = data_slab;
-  return data_slab;
+  while (data_slab != NULL)
+  {
+    GumDataSlab * next = (GumDataSlab *) data_slab->slab.next;
+
+    if (!gum_exec_ctx_is_embedded_slab (ctx, data_slab))
+      gum_data_slab_free (data_slab);
+
+    data_slab = next;
+  }
+}
+
+static gboolean
+gum_exec_ctx_is_embedded_slab (GumExecCtx * ctx,
+                               gconstpointer slab)
+{
+  GumStalker * stalker = ctx->stalker;
+  const guint8 * base = (const guint8 *) ctx;
+
+  return slab == base + stalker->code_slab_offset ||
+      slab == base + stalker->data_slab_offset;
+}
+
+static void
+gum_exec_ctx_maybe_evict (GumExecCtx * ctx)
+{
+  GumStalker * stalker = ctx->stalker;
+  const gsize budget = stalker->code_cache_budget;
+
+  if (budget == 0)
+    return;
+
+  if (gum_slab_available (&ctx->code_slab->slab) >=
+      GUM_EXEC_BLOCK_MIN_CAPACITY)
+  {
+    return;
+  }
+
+  if (ctx->code_cache_size + stalker->code_slab_size_dynamic <= budget)
+    return;
+
+  if (g_atomic_int_get (&ctx->state) != GUM_EXEC_CTX_ACTIVE)
+    return;
+
+  /* Excluded calls will return straight into the current generation. */
+  if (ctx->pending_calls > 0)
+    return;
+
+  gum_exec_ctx_evict (ctx);
+}
+
+/*
+ * Eviction is generational: the current set of slabs is retired as a whole
+ * and a fresh generation is started, with its own copy of the inline helpers.
+ * Blocks in the new generation are only ever linked to each other, as every
+ * lookup goes through the (now empty) mappings, so backpatched branches and
+ * inline caches pointing into retired blocks are only reachable from retired
+ * code. The thread may still be executing in the retired generation when we
+ * get here, as we are called from one of its entrygates, so we hold on to it
+ * until the next eviction, by which time execution has long since moved on,
+ * and then recycle its slabs for future generations.
+ */
+static void
+gum_exec_ctx_evict (GumExecCtx * ctx)
+{
+  GumStalker * stalker = ctx->stalker;
+  GumCodeSlab * code_slab;
+  GumSlab * slab;
+  guint num_blocks;
+  gsize num_bytes;
+
+  gum_exec_ctx_recycle_retired_slabs (ctx);
+
+  num_bytes = 0;
+  for (slab = &ctx->code_slab->slab; slab != NULL; slab = slab->next)
+    num_bytes += slab->offset;
+
+  num_blocks = 0;
+  for (slab = &ctx->data_slab->slab; slab != NULL; slab = slab->next)
+    num_blocks += slab->offset / sizeof (GumExecBlock);
+
+  ctx->retired_code_slab = ctx->code_slab;
+  ctx->retired_data_slab = ctx->data_slab;
+
+  ctx->code_slab = NULL;
+  ctx->data_slab = NULL;
+  ctx->code_cache_size = 0;
+
+  code_slab = gum_exec_ctx_add_code_slab (ctx, gum_code_slab_new (ctx));
+  gum_exec_ctx_add_data_slab (ctx, gum_data_slab_new (ctx));
+
+  gum_metal_hash_table_remove_all (ctx->mappings);
+
+  ctx->last_prolog_minimal = NULL;
+  ctx->last_epilog_minimal = NULL;
+  ctx->last_prolog_full = NULL;
+  ctx->last_epilog_full = NULL;
+  ctx->last_stack_push = NULL;
+  ctx->last_stack_pop_and_go = NULL;
+  ctx->last_invalidator = NULL;
+  gum_exec_ctx_ensure_inline_helpers_reachable (ctx);
+
+  code_slab->invalidator = ctx->last_invalidator;
+
+  /* Pushed frames refer to return sites in the retired generation. */
+  ctx->current_frame = ctx->first_frame;
+
+  g_atomic_int_inc (&stalker->code_cache_evictions);
+  g_atomic_int_add (&stalker->code_cache_evicted_blocks, num_blocks);
+  g_atomic_pointer_add (&stalker->code_cache_evicted_bytes, num_bytes);
+}
+
+static void
+gum_exec_ctx_collect_block_counts (GumExecCtx * ctx,
+                                   GumDataSlab * data_slab,
+                                   GArray * counts,
+                                   GHashTable * index_by_start)
+{
+  GumSlab * slab;
+
+  for (slab = &data_slab->slab; slab != NULL; slab = slab->next)
+  {
+    GumExecBlock * blocks;
+    guint num_blocks;
+    guint i;
+
+    blocks = gum_slab_start (slab);
+    num_blocks = slab->offset / sizeof (GumExecBlock);
+
+    for (i = 0; i != num_blocks; i++)
+    {
+      GumExecBlock * block = &blocks[i];
+      GumExecSegment segment;
+      guint j;
+
+      segment.real_start = block->real_start;
+      segment.real_size = block->real_size;
+      gum_add_block_count (counts, index_by_start, &segment,
+          block->execution_count);
+
+      if (block->segment_execution_counts == NULL)
+        continue;
+
+      /*
+       * Segments inlined into a trace are entered without going through the
+       * blocks they were compiled from, so they are counted by the trace.
+       */
+      for (j = 1; j < block->n_segments; j++)
+      {
+        gum_exec_block_get_segment (block, j, &segment);
+        gum_add_block_count (counts, index_by_start, &segment,
+            block->segment_execution_counts[j - 1]);
+      }
+    }
+  }
+}
+
+static void
+gum_add_block_count (GArray * counts,
+                     GHashTable * index_by_start,
+                     const GumExecSegment * segment,
+                     gsize execution_count)
+{
+  gpointer existing_index;
+
+  if (execution_count == 0)
+    return;
+
+  if (g_hash_table_lookup_extended (index_by_start, segment->real_start,
+      NULL, &existing_index))
+  {
+    g_array_index (counts, GumStalkerBlockCount,
+        GPOINTER_TO_UINT (existing_index)).count += execution_count;
+  }
+  else
+  {
+    GumStalkerBlockCount count;
+
+    count.start = segment->real_start;
+    count.end = segment->real_start + segment->real_size;
+    count.count = execution_count;
+
+    g_hash_table_insert (index_by_start, segment->real_start,
+        GUINT_TO_POINTER (counts->len));
+    g_array_append_val (counts, count);
+  }
+}
+
+static void
+gum_exec_ctx_recycle_retired_slabs (GumExecCtx * ctx)
+{
+  GumStalker * stalker = ctx->stalker;
+  GumCodeSlab * code_slab;
+  GumDataSlab * data_slab;
+
+  if (ctx->retired_code_slab == NULL)
+    return;
+
+  gum_exec_ctx_clear_slabs (ctx, ctx->retired_code_slab,
+      ctx->retired_data_slab);
+
+  code_slab = ctx->retired_code_slab;
+  while (code_slab != NULL)
+  {
+    GumCodeSlab * next = (GumCodeSlab *) code_slab->slab.next;
+
+    if (!gum_exec_ctx_is_embedded_slab (ctx, code_slab))
+    {
+      gum_code_slab_init (code_slab, stalker->code_slab_size_dynamic,
+          stalker->page_size);
+      code_slab->slab.next = &ctx->spare_code_slab->slab;
+      ctx->spare_code_slab = code_slab;
+    }
+
+    code_slab = next;
+  }
+
+  data_slab = ctx->retired_data_slab;
+  while (data_slab != NULL)
+  {
+    GumDataSlab * next = (GumDataSlab *) data_slab->slab.next;
+
+    if (!gum_exec_ctx_is_embedded_slab (ctx, data_slab))
+    {
+      gum_data_slab_init (data_slab, stalker->data_slab_size_dynamic);
+      /* Blocks rely on their storage starting out zeroed, like fresh pages */
+      memset (data_slab->slab.data, 0, data_slab->slab.size);
+      data_slab->slab.next = &ctx->spare_data_slab->slab;
+      ctx->spare_data_slab = data_slab;
+    }
+
+    data_slab = next;
+  }
+
+  ctx->retired_code_slab = NULL;
+  ctx->retired_data_slab = NULL;
 }
 
 static void
@@ -1929,6 +3093,27 @@ gum_exec_ctx_contains (GumExecCtx * ctx,
   return FALSE;
 }
 
+static gboolean
+gum_exec_ctx_may_trace_into (GumExecCtx * ctx,
+                             gconstpointer address)
+{
+  GumStalker * stalker = ctx->stalker;
+  GumCallProbeSlot * slot;
+
+  if (ctx->activation_target != NULL)
+    return FALSE;
+
+  if (gum_stalker_is_excluding (stalker, address))
+    return FALSE;
+
+  if (!stalker->any_probes_attached)
+    return TRUE;
+
+  slot = gum_exec_ctx_lookup_probe_slot (ctx, address);
+
+  return slot == NULL || g_atomic_pointer_get (&slot->probes) == NULL;
+}
+
 static gboolean
 gum_exec_ctx_may_now_backpatch (GumExecCtx * ctx,
                                 GumExecBlock * target_block)
@@ -1942,6 +3127,11 @@ gum_exec_ctx_may_now_backpatch (GumExecCtx * ctx,
   if (target_block->recycle_count < ctx->stalker->trust_threshold)
     return FALSE;
 
+  /* Keep cold blocks going through the dispatcher so they can heat up */
+  if (ctx->stalker->trace_threshold != 0 &&
+      (target_block->flags & GUM_EXEC_BLOCK_TRACE) == 0)
+    return FALSE;
+
   return TRUE;
 }
 
@@ -2070,19 +3260,27 @@ gum_exec_ctx_obtain_block_for (GumExecCtx * ctx,
   if (block != NULL)
   {
     const gint trust_threshold = ctx->stalker->trust_threshold;
-    gboolean still_up_to_date;
+    gboolean was_prefetched, still_up_to_date;
+
+    was_prefetched = (block->flags & GUM_EXEC_BLOCK_PREFETCHED) != 0;
+    block->flags &= ~GUM_EXEC_BLOCK_PREFETCHED;
 
     still_up_to_date =
         (trust_threshold >= 0 && block->recycle_count >= trust_threshold) ||
-        memcmp (block->real_start, gum_exec_block_get_snapshot_start (block),
-            block->real_size) == 0;
+        gum_exec_block_is_up_to_date (block);
 
     gum_spinlock_release (&ctx->code_lock);
 
+    if (was_prefetched)
+      gum_exec_ctx_maybe_emit_compile_event (ctx, block);
+
     if (still_up_to_date)
     {
       if (trust_threshold > 0)
         block->recycle_count++;
+
+      if (gum_exec_ctx_should_build_trace (ctx, block))
+        block = gum_exec_ctx_build_trace (ctx, block);
     }
     else
     {
@@ -2091,17 +3289,28 @@ gum_exec_ctx_obtain_block_for (GumExecCtx * ctx,
   }
   else
   {
+    gpointer successors[GUM_PREFETCH_MAX_SUCCESSORS];
+    guint n_successors;
+
+    gum_exec_ctx_maybe_evict (ctx);
+
     block = gum_exec_block_new (ctx);
     block->real_start = real_address;
-    gum_exec_ctx_compile_block (ctx, block, real_address, block->code_start,
+    gum_exec_ctx_compile_block (ctx, block, real_address,
+        gum_stalker_get_writable_code (ctx->stalker, block->code_start),
         GUM_ADDRESS (block->code_start), &block->real_size, &block->code_size);
     gum_exec_block_commit (block);
 
     gum_metal_hash_table_insert (ctx->mappings, real_address, block);
 
+    n_successors = ctx->n_successors;
+    memcpy (successors, ctx->successors, n_successors * sizeof (gpointer));
+
     gum_spinlock_release (&ctx->code_lock);
 
     gum_exec_ctx_maybe_emit_compile_event (ctx, block);
+
+    gum_exec_ctx_request_prefetch (ctx, successors, n_successors, 1);
   }
 
   *code_address = block->code_start;
@@ -2115,6 +3324,7 @@ gum_exec_ctx_recompile_block (GumExecCtx * ctx,
 {
   GumStalker * stalker = ctx->stalker;
   guint8 * internal_code = block->code_start;
+  guint8 * writable_code;
   GumCodeSlab * slab;
   guint8 * scratch_base;
   guint input_size, output_size;
@@ -2122,7 +3332,7 @@ gum_exec_ctx_recompile_block (GumExecCtx * ctx,
 
   gum_spinlock_acquire (&ctx->code_lock);
 
-  gum_stalker_thaw (stalker, internal_code, block->capacity);
+  writable_code = gum_stalker_thaw (stalker, internal_code, block->capacity);
 
   if (block->storage_block != NULL)
     gum_exec_block_clear (block->storage_block);
@@ -2137,8 +3347,7 @@ gum_exec_ctx_recompile_block (GumExecCtx * ctx,
 
   block->code_slab = slab;
 
-  new_snapshot_size =
-      gum_stalker_snapshot_space_needed_for (stalker, input_size);
+  new_snapshot_size = gum_exec_ctx_get_snapshot_size (ctx, block);
 
   new_block_size = output_size + new_snapshot_size;
 
@@ -2147,9 +3356,8 @@ gum_exec_ctx_recompile_block (GumExecCtx * ctx,
     block->real_size = input_size;
     block->code_size = output_size;
 
-    memcpy (internal_code, scratch_base, output_size);
-    memcpy (gum_exec_block_get_snapshot_start (block), block->real_start,
-        new_snapshot_size);
+    memcpy (writable_code, scratch_base, output_size);
+    gum_exec_ctx_write_snapshot (ctx, block, writable_code + output_size);
 
     gum_stalker_freeze (stalker, internal_code, new_block_size);
   }
@@ -2160,15 +3368,18 @@ gum_exec_ctx_recompile_block (GumExecCtx * ctx,
 
     storage_block = gum_exec_block_new (ctx);
     storage_block->real_start = block->real_start;
+    storage_block->flags = block->flags & GUM_EXEC_BLOCK_TRACE;
     gum_exec_ctx_compile_block (ctx, block, block->real_start,
-        storage_block->code_start, GUM_ADDRESS (storage_block->code_start),
-        &storage_block->real_size, &storage_block->code_size);
+        gum_stalker_get_writable_code (stalker, storage_block->code_start),
+        GUM_ADDRESS (storage_block->code_start), &storage_block->real_size,
+        &storage_block->code_size);
     gum_exec_block_commit (storage_block);
 
     block->storage_block = storage_block;
 
-    gum_stalker_thaw (stalker, internal_code, block->capacity);
-    gum_x86_writer_reset (cw, internal_code);
+    gum_x86_writer_reset (cw,
+        gum_stalker_thaw (stalker, internal_code, block->capacity));
+    cw->pc = GUM_ADDRESS (internal_code);
 
     gum_x86_writer_put_jmp_address (cw,
         GUM_ADDRESS (storage_block->code_start));
@@ -2182,6 +3393,302 @@ gum_exec_ctx_recompile_block (GumExecCtx * ctx,
   gum_exec_ctx_maybe_emit_compile_event (ctx, block);
 }
 
+static void
+gum_exec_ctx_note_successor (GumExecCtx * ctx,
+                             gpointer address)
+{
+  if (ctx->n_successors != G_N_ELEMENTS (ctx->successors))
+    ctx->successors[ctx->n_successors++] = address;
+}
+
+/*
+ * Prefetching compiles on another thread, so we only do it when nothing can
+ * tell the difference: the default transformer, no code cache budget that
+ * would need evicting, and RWX or dual-mapped pages so code that's running is
+ * never thawed.
+ */
+static void
+gum_exec_ctx_request_prefetch (GumExecCtx * ctx,
+                               gpointer * successors,
+                               guint n_successors,
+                               guint depth)
+{
+  GumStalker * stalker = ctx->stalker;
+  guint i;
+
+  if (!stalker->prefetch_enabled || n_successors == 0)
+    return;
+
+  if ((!stalker->is_rwx_supported && stalker->code_alias_offset == 0) ||
+      stalker->code_cache_budget != 0)
+    return;
+
+  if (!GUM_IS_DEFAULT_STALKER_TRANSFORMER (ctx->transformer) ||
+      ctx->activation_target != NULL)
+    return;
+
+  g_mutex_lock (&stalker->prefetch_mutex);
+
+  for (i = 0; i != n_successors; i++)
+  {
+    GumPrefetchRequest * request;
+
+    if (stalker->prefetch_queue.length == GUM_PREFETCH_MAX_PENDING)
+      break;
+
+    request = g_slice_new (GumPrefetchRequest);
+    request->ctx = ctx;
+    request->real_address = successors[i];
+    request->depth = depth;
+
+    g_queue_push_tail (&stalker->prefetch_queue, request);
+  }
+
+  g_cond_broadcast (&stalker->prefetch_cond);
+
+  g_mutex_unlock (&stalker->prefetch_mutex);
+}
+
+static void
+gum_exec_ctx_prefetch_block (GumExecCtx * ctx,
+                             gpointer real_address,
+                             guint depth)
+{
+  GumExecBlock * block;
+  const guint8 * limit;
+  gpointer successors[GUM_PREFETCH_MAX_SUCCESSORS];
+  guint n_successors;
+
+  if (g_atomic_int_get (&ctx->state) != GUM_EXEC_CTX_ACTIVE)
+    return;
+
+  if (gum_stalker_is_excluding (ctx->stalker, real_address))
+    return;
+
+  limit = gum_stalker_find_prefetch_limit (ctx->stalker, real_address);
+  if (limit == NULL)
+    return;
+
+  gum_spinlock_acquire (&ctx->code_lock);
+
+  if (gum_metal_hash_table_lookup (ctx->mappings, real_address) != NULL)
+  {
+    gum_spinlock_release (&ctx->code_lock);
+    return;
+  }
+
+  block = gum_exec_block_new (ctx);
+  block->real_start = real_address;
+  block->flags = GUM_EXEC_BLOCK_PREFETCHED;
+  ctx->prefetch_limit = limit;
+  gum_exec_ctx_compile_block (ctx, block, real_address,
+      gum_stalker_get_writable_code (ctx->stalker, block->code_start),
+      GUM_ADDRESS (block->code_start), &block->real_size, &block->code_size);
+  ctx->prefetch_limit = NULL;
+  gum_exec_block_commit (block);
+
+  gum_metal_hash_table_insert (ctx->mappings, real_address, block);
+
+  g_atomic_int_inc (&ctx->stalker->prefetched_blocks);
+
+  n_successors = ctx->n_successors;
+  memcpy (successors, ctx->successors, n_successors * sizeof (gpointer));
+
+  gum_spinlock_release (&ctx->code_lock);
+
+  if (depth != GUM_PREFETCH_MAX_DEPTH)
+    gum_exec_ctx_request_prefetch (ctx, successors, n_successors, depth + 1);
+}
+
+/*
+ * The followed thread may never get to a prefetched address, so we can't rely
+ * on it faulting first if the address isn't code. We only decode up to
+ * GUM_PREFETCH_DECODE_WINDOW bytes ahead, and only if that window lies within
+ * a single executable mapping. The returned limit is where decoding must stop.
+ *
+ * Enumerating ranges means parsing the memory map on some OSes, so we keep a
+ * sorted copy of the executable ranges, only owned by the prefetch thread. It
+ * is refreshed when an address isn't found, at most once per
+ * GUM_PREFETCH_RANGES_MAX_AGE.
+ */
+static const guint8 *
+gum_stalker_find_prefetch_limit (GumStalker * self,
+                                 gconstpointer real_address)
+{
+  const GumMemoryRange * range;
+  GumAddress address, end;
+
+  range = gum_stalker_find_prefetch_range (self, real_address);
+  if (range == NULL)
+  {
+    gint64 now = g_get_monotonic_time ();
+
+    if (self->prefetch_ranges != NULL &&
+        now - self->prefetch_ranges_updated_at < GUM_PREFETCH_RANGES_MAX_AGE)
+    {
+      return NULL;
+    }
+
+    gum_stalker_update_prefetch_ranges (self);
+    self->prefetch_ranges_updated_at = now;
+
+    range = gum_stalker_find_prefetch_range (self, real_address);
+    if (range == NULL)
+      return NULL;
+  }
+
+  address = GUM_ADDRESS (real_address);
+  end = MIN (range->base_address + range->size,
+      address + GUM_PREFETCH_DECODE_WINDOW);
+  if (end - address < GUM_MAX_INSN_SIZE)
+    return NULL;
+
+  return GSIZE_TO_POINTER (end);
+}
+
+static const GumMemoryRange *
+gum_stalker_find_prefetch_range (GumStalker * self,
+                                 gconstpointer real_address)
+{
+  GArray * ranges = self->prefetch_ranges;
+  GumAddress address = GUM_ADDRESS (real_address);
+  guint lo, hi;
+
+  if (ranges == NULL)
+    return NULL;
+
+  lo = 0;
+  hi = ranges->len;
+  while (lo != hi)
+  {
+    guint mid = lo + ((hi - lo) / 2);
+    const GumMemoryRange * range =
+        &g_array_index (ranges, GumMemoryRange, mid);
+
+    if (address < range->base_address)
+      hi = mid;
+    else if (address >= range->base_address + range->size)
+      lo = mid + 1;
+    else
+      return range;
+  }
+
+  return NULL;
+}
+
+static void
+gum_stalker_update_prefetch_ranges (GumStalker * self)
+{
+  if (self->prefetch_ranges == NULL)
+  {
+    self->prefetch_ranges =
+        g_array_new (FALSE, FALSE, sizeof (GumMemoryRange));
+  }
+
+  g_array_set_size (self->prefetch_ranges, 0);
+
+  gum_process_enumerate_ranges (GUM_PAGE_RX, gum_collect_prefetch_range,
+      self->prefetch_ranges);
+  g_array_sort (self->prefetch_ranges, gum_compare_prefetch_ranges);
+}
+
+static gboolean
+gum_collect_prefetch_range (const GumRangeDetails * details,
+                            gpointer user_data)
+{
+  GArray * ranges = user_data;
+
+  g_array_append_val (ranges, *details->range);
+
+  return TRUE;
+}
+
+static gint
+gum_compare_prefetch_ranges (gconstpointer a,
+                             gconstpointer b)
+{
+  const GumMemoryRange * ra = a;
+  const GumMemoryRange * rb = b;
+
+  if (ra->base_address < rb->base_address)
+    return -1;
+  if (ra->base_address > rb->base_address)
+    return 1;
+  return 0;
+}
+
+static gboolean
+gum_exec_ctx_should_build_trace (GumExecCtx * ctx,
+                                 GumExecBlock * block)
+{
+  const guint trace_threshold = ctx->stalker->trace_threshold;
+
+  if (trace_threshold == 0)
+    return FALSE;
+
+  if ((block->flags & GUM_EXEC_BLOCK_TRACE) != 0)
+    return FALSE;
+
+  return ++block->heat >= trace_threshold;
+}
+
+/*
+ * Recompiles a hot block as a superblock: a single straight-line run of code
+ * that keeps going through direct branches, following jmps, backward jccs and
+ * the fall-through of forward jccs, with side exits for the other direction.
+ * The trace takes over the block's mapping, and the old code is redirected to
+ * it so that anything already linked to it ends up there as well.
+ */
+static GumExecBlock *
+gum_exec_ctx_build_trace (GumExecCtx * ctx,
+                          GumExecBlock * block)
+{
+  GumStalker * stalker = ctx->stalker;
+  GumX86Writer * cw = &ctx->code_writer;
+  GumExecBlock * trace;
+  guint8 * internal_code = block->code_start;
+  gsize jmp_size;
+
+  gum_spinlock_acquire (&ctx->code_lock);
+
+  gum_exec_ctx_maybe_evict (ctx);
+
+  trace = gum_exec_block_new (ctx);
+  trace->real_start = block->real_start;
+  trace->flags = GUM_EXEC_BLOCK_TRACE;
+  trace->recycle_count = block->recycle_count;
+  gum_exec_ctx_compile_block (ctx, trace, trace->real_start,
+      gum_stalker_get_writable_code (stalker, trace->code_start),
+      GUM_ADDRESS (trace->code_start), &trace->real_size, &trace->code_size);
+  gum_exec_block_commit (trace);
+
+  gum_metal_hash_table_insert (ctx->mappings, trace->real_start, trace);
+
+  /*
+   * If the block is too small to hold the jmp it is left alone, and whatever
+   * is already linked to it keeps running the old code until it is evicted.
+   */
+  jmp_size = GUM_IS_WITHIN_INT32_RANGE ((gssize) trace->code_start -
+      (gssize) (internal_code + 5)) ? 5 : 14;
+  if (block->code_size >= jmp_size)
+  {
+    gum_x86_writer_reset (cw,
+        gum_stalker_thaw (stalker, internal_code, block->capacity));
+    cw->pc = GUM_ADDRESS (internal_code);
+
+    gum_x86_writer_put_jmp_address (cw, GUM_ADDRESS (trace->code_start));
+
+    gum_x86_writer_flush (cw);
+    gum_stalker_freeze (stalker, internal_code, block->capacity);
+  }
+
+  gum_spinlock_release (&ctx->code_lock);
+
+  gum_exec_ctx_maybe_emit_compile_event (ctx, trace);
+
+  return trace;
+}
+
 static void
 gum_exec_ctx_compile_block (GumExecCtx * ctx,
                             GumExecBlock * block,
@@ -2196,7 +3703,10 @@ gum_exec_ctx_compile_block (GumExecCtx * ctx,
   GumGeneratorContext gc;
   GumStalkerIterator iterator;
   GumStalkerOutput output;
-  gboolean all_labels_resolved;
+  gboolean is_prefetch, all_labels_resolved;
+
+  /* pending_calls belongs to the followed thread */
+  is_prefetch = (block->flags & GUM_EXEC_BLOCK_PREFETCHED) != 0;
 
   gum_x86_writer_reset (cw, output_code);
   cw->pc = output_pc;
@@ -2210,6 +3720,15 @@ gum_exec_ctx_compile_block (GumExecCtx * ctx,
   gc.continuation_real_address = NULL;
   gc.opened_prolog = GUM_PROLOG_NONE;
   gc.accumulated_stack_delta = 0;
+  gc.trace_continuation = NULL;
+  gc.trace_segments_left = ((block->flags & GUM_EXEC_BLOCK_TRACE) != 0)
+      ? GUM_MAX_TRACE_SEGMENTS - 1
+      : 0;
+  gc.entry_real_size = 0;
+  gc.decode_limit = is_prefetch ? ctx->prefetch_limit : NULL;
+
+  ctx->n_successors = 0;
+  ctx->n_segments = 0;
 
   iterator.exec_context = ctx;
   iterator.exec_block = block;
@@ -2223,11 +3742,71 @@ gum_exec_ctx_compile_block (GumExecCtx * ctx,
   output.writer.x86 = cw;
   output.encoding = GUM_INSTRUCTION_DEFAULT;
 
+  gum_exec_block_maybe_write_counter_code (block, 0, &gc);
   gum_exec_block_maybe_write_call_probe_code (block, &gc);
 
-  ctx->pending_calls++;
-  ctx->transform_block_impl (ctx->transformer, &iterator, &output);
-  ctx->pending_calls--;
+  while (TRUE)
+  {
+    GumExecSegment * segment;
+    GumAddress pc;
+
+    segment = &ctx->segments[ctx->n_segments++];
+    segment->real_start = (guint8 *) rl->input_start;
+    segment->real_size = 0;
+
+    if (is_prefetch)
+    {
+      ctx->transform_block_impl (ctx->transformer, &iterator, &output);
+    }
+    else
+    {
+      ctx->pending_calls++;
+      ctx->transform_block_impl (ctx->transformer, &iterator, &output);
+      ctx->pending_calls--;
+    }
+
+    segment->real_size = rl->input_cur - rl->input_start;
+
+    if (gc.entry_real_size == 0)
+      gc.entry_real_size = segment->real_size;
+
+    if (gc.trace_continuation == NULL)
+      break;
+
+    gum_x86_writer_put_label (cw, &gc.trace_continuation);
+
+    if (gc.continuation_real_address != NULL ||
+        gum_stalker_iterator_is_out_of_space (&iterator))
+    {
+      gc.continuation_real_address = gc.trace_continuation;
+      break;
+    }
+
+    /*
+     * The next segment may revisit instructions already in the trace, e.g.
+     * when unrolling a loop, so start over with a fresh set of labels.
+     */
+    all_labels_resolved = gum_x86_writer_flush (cw);
+    if (!all_labels_resolved)
+      g_error ("Failed to resolve labels");
+    pc = cw->pc;
+    gum_x86_writer_reset (cw, gum_x86_writer_cur (cw));
+    cw->pc = pc;
+
+    gum_x86_relocator_reset (rl, gc.trace_continuation, cw);
+    gum_ensure_code_readable (gc.trace_continuation, ctx->stalker->page_size);
+
+    gc.instruction = NULL;
+    gc.trace_continuation = NULL;
+    gc.trace_segments_left--;
+
+    iterator.instruction.ci = NULL;
+    iterator.instruction.start = NULL;
+    iterator.instruction.end = NULL;
+    iterator.requirements = GUM_REQUIRE_NOTHING;
+
+    gum_exec_block_maybe_write_counter_code (block, ctx->n_segments, &gc);
+  }
 
   if (gc.continuation_real_address != NULL)
   {
@@ -2246,8 +3825,8 @@ gum_exec_ctx_compile_block (GumExecCtx * ctx,
   if (!all_labels_resolved)
     g_error ("Failed to resolve labels");
 
-  *input_size = rl->input_cur - rl->input_start;
-  *output_size = gum_x86_writer_offset (cw);
+  *input_size = gc.entry_real_size;
+  *output_size = (guint8 *) gum_x86_writer_cur (cw) - (guint8 *) output_code;
 }
 
 static void
@@ -2291,11 +3870,17 @@ gum_stalker_iterator_next (GumStalkerIterator * self,
 
     if (gum_stalker_iterator_is_out_of_space (self))
     {
-      gc->continuation_real_address = instruction->end;
+      gc->continuation_real_address = instruction->end;
+      return FALSE;
+    }
+    else if (gum_x86_relocator_eob (rl))
+    {
       return FALSE;
     }
-    else if (gum_x86_relocator_eob (rl))
+    else if (gc->decode_limit != NULL &&
+        instruction->end + GUM_MAX_INSN_SIZE > gc->decode_limit)
     {
+      gc->continuation_real_address = instruction->end;
       return FALSE;
     }
   }
@@ -2326,16 +3911,32 @@ gum_stalker_iterator_next (GumStalkerIterator * self,
 static gboolean
 gum_stalker_iterator_is_out_of_space (GumStalkerIterator * self)
 {
+  GumExecCtx * ctx = self->exec_context;
   GumExecBlock * block = self->exec_block;
-  GumSlab * slab = &block->code_slab->slab;
-  gsize capacity, snapshot_size;
+  GumGeneratorContext * gc = self->generator_context;
+  GumCodeSlab * code_slab = block->code_slab;
+  guint8 * slab_end;
+  gsize capacity, real_size, snapshot_size;
+  guint i;
+
+  slab_end = gum_slab_end (&code_slab->slab);
+  if (code_slab != self->exec_context->scratch_slab)
+  {
+    slab_end = gum_stalker_get_writable_code (self->exec_context->stalker,
+        slab_end);
+  }
 
-  capacity = (guint8 *) gum_slab_end (slab) -
-      (guint8 *) gum_x86_writer_cur (self->generator_context->code_writer);
+  capacity = slab_end - (guint8 *) gum_x86_writer_cur (gc->code_writer);
 
-  snapshot_size = gum_stalker_snapshot_space_needed_for (
-      self->exec_context->stalker,
-      self->generator_context->instruction->end - block->real_start);
+  real_size = gc->instruction->end -
+      ctx->segments[ctx->n_segments - 1].real_start;
+  for (i = 0; i != ctx->n_segments - 1; i++)
+    real_size += ctx->segments[i].real_size;
+
+  snapshot_size = gum_stalker_snapshot_space_needed_for (ctx->stalker,
+      real_size);
+  if ((block->flags & GUM_EXEC_BLOCK_TRACE) != 0)
+    snapshot_size += sizeof (ctx->segments);
 
   return capacity < GUM_EXEC_BLOCK_MIN_CAPACITY + snapshot_size;
 }
@@ -2391,6 +3992,12 @@ gum_stalker_iterator_keep (GumStalkerIterator * self)
   self->requirements = requirements;
 }
 
+guint32 *
+_gum_stalker_iterator_get_edge_coverage_location (GumStalkerIterator * self)
+{
+  return &self->exec_context->edge_coverage_location;
+}
+
 static void
 gum_exec_ctx_emit_call_event (GumExecCtx * ctx,
                               gpointer location,
@@ -2449,18 +4056,22 @@ gum_exec_ctx_emit_exec_event (GumExecCtx * ctx,
 
 static void
 gum_exec_ctx_emit_block_event (GumExecCtx * ctx,
-                               const GumExecBlock * block,
+                               GumExecBlock * block,
+                               guint segment_index,
                                GumCpuContext * cpu_context)
 {
   GumEvent ev;
   GumBlockEvent * bev = &ev.block;
+  GumExecSegment segment;
+
+  gum_exec_block_get_segment (block, segment_index, &segment);
 
   ev.type = GUM_BLOCK;
 
-  bev->start = block->real_start;
-  bev->end = block->real_start + block->real_size;
+  bev->start = segment.real_start;
+  bev->end = segment.real_start + segment.real_size;
 
-  GUM_CPU_CONTEXT_XIP (cpu_context) = GPOINTER_TO_SIZE (block->real_start);
+  GUM_CPU_CONTEXT_XIP (cpu_context) = GPOINTER_TO_SIZE (segment.real_start);
 
   ctx->sink_process_impl (ctx->sink, &ev, cpu_context);
 }
@@ -2496,6 +4107,192 @@ gum_stalker_iterator_put_callout (GumStalkerIterator * self,
   gum_exec_block_close_prolog (block, gc);
 }
 
+void
+gum_stalker_iterator_put_light_callout (GumStalkerIterator * self,
+                                        const guint * registers,
+                                        guint n_registers,
+                                        GumStalkerLightCallout callout,
+                                        gpointer data,
+                                        GDestroyNotify data_destroy)
+{
+  GumExecBlock * block = self->exec_block;
+  GumGeneratorContext * gc = self->generator_context;
+  GumX86Writer * cw = gc->code_writer;
+  GumExecCtx * ctx = block->ctx;
+  gsize array_size;
+  guint i;
+
+  g_return_if_fail (n_registers == 0 || registers != NULL);
+
+  if (data_destroy != NULL)
+  {
+    GumCalloutEntry entry;
+    GumAddress entry_address;
+
+    /*
+     * Never invoked, only kept around so that data gets destroyed along with
+     * the block.
+     */
+    entry.callout = NULL;
+    entry.data = data;
+    entry.data_destroy = data_destroy;
+    entry.pc = gc->instruction->start;
+    entry.exec_context = self->exec_context;
+    entry.next = gum_exec_block_get_last_callout_entry (block);
+    gum_exec_block_write_inline_data (cw, &entry, sizeof (entry),
+        &entry_address);
+
+    gum_exec_block_set_last_callout_entry (block,
+        GSIZE_TO_POINTER (entry_address));
+  }
+
+  /*
+   * Reuses a full prolog if one is already open, otherwise we only pay for
+   * the volatile registers and pick up the callee-saved ones where they live.
+   */
+  gum_exec_block_open_prolog (block, GUM_PROLOG_MINIMAL, gc);
+
+  array_size = GUM_ALIGN_SIZE (MAX (n_registers, 1) * sizeof (gpointer), 16);
+  gum_x86_writer_put_sub_reg_imm (cw, GUM_REG_XSP, array_size);
+
+  for (i = 0; i != n_registers; i++)
+  {
+    GumCpuReg native_reg;
+    gssize frame_offset;
+    gssize slot_offset = i * sizeof (gpointer);
+
+    if (!gum_stalker_resolve_light_callout_register (registers[i],
+        gc->opened_prolog, &native_reg, &frame_offset))
+    {
+      g_error ("Unsupported light callout register: %u", registers[i]);
+    }
+
+    if (frame_offset != -1)
+    {
+      gum_x86_writer_put_mov_reg_reg_offset_ptr (cw, GUM_REG_XAX,
+          GUM_REG_XBX, frame_offset);
+      gum_x86_writer_put_mov_reg_offset_ptr_reg (cw, GUM_REG_XSP,
+          slot_offset, GUM_REG_XAX);
+    }
+    else
+    {
+      gum_x86_writer_put_mov_reg_offset_ptr_reg (cw, GUM_REG_XSP,
+          slot_offset, native_reg);
+    }
+  }
+
+  gum_x86_writer_put_mov_reg_address (cw, GUM_REG_XAX,
+      GUM_ADDRESS (&ctx->pending_calls));
+  gum_x86_writer_put_inc_reg_ptr (cw, GUM_PTR_DWORD, GUM_REG_XAX);
+
+  gum_x86_writer_put_mov_reg_reg (cw, GUM_REG_XAX, GUM_REG_XSP);
+  gum_x86_writer_put_call_address_with_aligned_arguments (cw,
+      GUM_CALL_CAPI, GUM_ADDRESS (callout), 2,
+      GUM_ARG_REGISTER, GUM_REG_XAX,
+      GUM_ARG_ADDRESS, GUM_ADDRESS (data));
+
+  gum_x86_writer_put_mov_reg_address (cw, GUM_REG_XAX,
+      GUM_ADDRESS (&ctx->pending_calls));
+  gum_x86_writer_put_dec_reg_ptr (cw, GUM_PTR_DWORD, GUM_REG_XAX);
+
+  for (i = 0; i != n_registers; i++)
+  {
+    GumCpuReg native_reg;
+    gssize frame_offset;
+    gssize slot_offset = i * sizeof (gpointer);
+
+    gum_stalker_resolve_light_callout_register (registers[i],
+        gc->opened_prolog, &native_reg, &frame_offset);
+
+    if (frame_offset != -1)
+    {
+      gum_x86_writer_put_mov_reg_reg_offset_ptr (cw, GUM_REG_XAX,
+          GUM_REG_XSP, slot_offset);
+      gum_x86_writer_put_mov_reg_offset_ptr_reg (cw, GUM_REG_XBX,
+          frame_offset, GUM_REG_XAX);
+    }
+    else
+    {
+      gum_x86_writer_put_mov_reg_reg_offset_ptr (cw, native_reg,
+          GUM_REG_XSP, slot_offset);
+    }
+  }
+
+  gum_x86_writer_put_add_reg_imm (cw, GUM_REG_XSP, array_size);
+
+  gum_exec_block_close_prolog (block, gc);
+}
+
+static gboolean
+gum_stalker_resolve_light_callout_register (guint reg,
+                                            GumPrologType prolog,
+                                            GumCpuReg * native_reg,
+                                            gssize * frame_offset)
+{
+  gint index;
+#if GLIB_SIZEOF_VOID_P == 8
+  static const gssize minimal_offsets[16] = {
+    72, 64, 56, 48, -1, -1, 40, 32, 24, 16, 8, 0, -1, -1, -1, -1
+  };
+  static const gssize full_offsets[16] = {
+    G_STRUCT_OFFSET (GumCpuContext, rax),
+    G_STRUCT_OFFSET (GumCpuContext, rcx),
+    G_STRUCT_OFFSET (GumCpuContext, rdx),
+    G_STRUCT_OFFSET (GumCpuContext, rbx),
+    -1,
+    G_STRUCT_OFFSET (GumCpuContext, rbp),
+    G_STRUCT_OFFSET (GumCpuContext, rsi),
+    G_STRUCT_OFFSET (GumCpuContext, rdi),
+    G_STRUCT_OFFSET (GumCpuContext, r8),
+    G_STRUCT_OFFSET (GumCpuContext, r9),
+    G_STRUCT_OFFSET (GumCpuContext, r10),
+    G_STRUCT_OFFSET (GumCpuContext, r11),
+    G_STRUCT_OFFSET (GumCpuContext, r12),
+    G_STRUCT_OFFSET (GumCpuContext, r13),
+    G_STRUCT_OFFSET (GumCpuContext, r14),
+    G_STRUCT_OFFSET (GumCpuContext, r15),
+  };
+  const gint n = 16;
+  const GumCpuReg first_native_reg = GUM_REG_RAX;
+#else
+  static const gssize minimal_offsets[8] = {
+    12, 8, 4, 0, -1, -1, -1, -1
+  };
+  static const gssize full_offsets[8] = {
+    G_STRUCT_OFFSET (GumCpuContext, eax),
+    G_STRUCT_OFFSET (GumCpuContext, ecx),
+    G_STRUCT_OFFSET (GumCpuContext, edx),
+    G_STRUCT_OFFSET (GumCpuContext, ebx),
+    -1,
+    G_STRUCT_OFFSET (GumCpuContext, ebp),
+    G_STRUCT_OFFSET (GumCpuContext, esi),
+    G_STRUCT_OFFSET (GumCpuContext, edi),
+  };
+  const gint n = 8;
+  const GumCpuReg first_native_reg = GUM_REG_EAX;
+#endif
+
+  if (reg >= GUM_REG_XAX && reg <= GUM_REG_XDI)
+    index = reg - GUM_REG_XAX;
+  else if (reg >= GUM_REG_RAX && reg <= GUM_REG_R15)
+    index = reg - GUM_REG_RAX;
+  else if (reg <= GUM_REG_R15D)
+    index = reg - GUM_REG_EAX;
+  else
+    return FALSE;
+
+  /* The application's stack pointer is not ours to hand out. */
+  if (index >= n || index == 4)
+    return FALSE;
+
+  *native_reg = first_native_reg + index;
+  *frame_offset = (prolog == GUM_PROLOG_FULL)
+      ? full_offsets[index]
+      : minimal_offsets[index];
+
+  return TRUE;
+}
+
 static void
 gum_stalker_invoke_callout (GumCalloutEntry * entry,
                             GumCpuContext * cpu_context)
@@ -2997,14 +4794,15 @@ gum_exec_ctx_ensure_helper_reachable (GumExecCtx * ctx,
     return;
 
   start = gum_slab_cursor (slab);
-  gum_stalker_thaw (ctx->stalker, start, gum_slab_available (slab));
-  gum_x86_writer_reset (cw, start);
-  *helper_ptr = gum_x86_writer_cur (cw);
+  gum_x86_writer_reset (cw,
+      gum_stalker_thaw (ctx->stalker, start, gum_slab_available (slab)));
+  cw->pc = GUM_ADDRESS (start);
+  *helper_ptr = start;
 
   write (ctx, cw);
 
   gum_x86_writer_flush (cw);
-  gum_stalker_freeze (ctx->stalker, cw->base, gum_x86_writer_offset (cw));
+  gum_stalker_freeze (ctx->stalker, start, gum_x86_writer_offset (cw));
 
   gum_slab_reserve (slab, gum_x86_writer_offset (cw));
 }
@@ -3310,6 +5108,8 @@ gum_exec_block_new (GumExecCtx * ctx)
 
   block->ctx = ctx;
   block->code_slab = code_slab;
+  block->execution_count = 0;
+  block->segment_execution_counts = NULL;
 
   block->code_start = gum_slab_cursor (&code_slab->slab);
 
@@ -3338,13 +5138,13 @@ gum_exec_block_clear (GumExecBlock * block)
 static void
 gum_exec_block_commit (GumExecBlock * block)
 {
-  GumStalker * stalker = block->ctx->stalker;
+  GumExecCtx * ctx = block->ctx;
+  GumStalker * stalker = ctx->stalker;
   gsize snapshot_size;
 
-  snapshot_size =
-      gum_stalker_snapshot_space_needed_for (stalker, block->real_size);
-  memcpy (gum_exec_block_get_snapshot_start (block), block->real_start,
-      snapshot_size);
+  snapshot_size = gum_exec_ctx_get_snapshot_size (ctx, block);
+  gum_exec_ctx_write_snapshot (ctx, block, gum_stalker_get_writable_code (
+      stalker, gum_exec_block_get_snapshot_start (block)));
 
   block->capacity = block->code_size + snapshot_size;
 
@@ -3362,8 +5162,9 @@ gum_exec_block_invalidate (GumExecBlock * block)
   const gsize max_size = GUM_INVALIDATE_TRAMPOLINE_SIZE;
   gint32 distance_to_data;
 
-  gum_stalker_thaw (stalker, block->code_start, max_size);
-  gum_x86_writer_reset (cw, block->code_start);
+  gum_x86_writer_reset (cw,
+      gum_stalker_thaw (stalker, block->code_start, max_size));
+  cw->pc = GUM_ADDRESS (block->code_start);
 
   gum_x86_writer_put_lea_reg_reg_offset (cw, GUM_REG_XSP, GUM_REG_XSP,
       -GUM_RED_ZONE_SIZE);
@@ -3384,6 +5185,55 @@ gum_exec_block_get_snapshot_start (GumExecBlock * block)
   return block->code_start + block->code_size;
 }
 
+static gboolean
+gum_exec_block_is_up_to_date (GumExecBlock * block)
+{
+  GumExecBlock * storage_block;
+  const guint8 * snapshot;
+  guint i;
+
+  storage_block = (block->storage_block != NULL) ? block->storage_block : block;
+
+  snapshot = gum_exec_block_get_snapshot_start (storage_block);
+  if ((storage_block->flags & GUM_EXEC_BLOCK_TRACE) != 0)
+    snapshot += storage_block->n_segments * sizeof (GumExecSegment);
+
+  for (i = 0; i != storage_block->n_segments; i++)
+  {
+    GumExecSegment segment;
+
+    gum_exec_block_get_segment (block, i, &segment);
+
+    if (memcmp (segment.real_start, snapshot, segment.real_size) != 0)
+      return FALSE;
+
+    snapshot += segment.real_size;
+  }
+
+  return TRUE;
+}
+
+static void
+gum_exec_block_get_segment (GumExecBlock * block,
+                            guint index,
+                            GumExecSegment * segment)
+{
+  GumExecBlock * storage_block;
+
+  storage_block = (block->storage_block != NULL) ? block->storage_block : block;
+
+  if ((storage_block->flags & GUM_EXEC_BLOCK_TRACE) == 0)
+  {
+    segment->real_start = storage_block->real_start;
+    segment->real_size = storage_block->real_size;
+    return;
+  }
+
+  /* The table follows the code, so it may not be suitably aligned. */
+  memcpy (segment, (guint8 *) gum_exec_block_get_snapshot_start (
+      storage_block) + index * sizeof (GumExecSegment), sizeof (*segment));
+}
+
 static GumCalloutEntry *
 gum_exec_block_get_last_callout_entry (const GumExecBlock * block)
 {
@@ -3427,8 +5277,9 @@ gum_exec_block_backpatch_call (GumExecBlock * block,
 
     gum_spinlock_acquire (&ctx->code_lock);
 
-    gum_stalker_thaw (stalker, code_start, code_max_size);
-    gum_x86_writer_reset (cw, code_start);
+    gum_x86_writer_reset (cw,
+        gum_stalker_thaw (stalker, code_start, code_max_size));
+    cw->pc = GUM_ADDRESS (code_start);
 
     if (opened_prolog == GUM_PROLOG_NONE)
     {
@@ -3494,8 +5345,9 @@ gum_exec_block_backpatch_jmp (GumExecBlock * block,
 
     gum_spinlock_acquire (&ctx->code_lock);
 
-    gum_stalker_thaw (stalker, code_start, code_max_size);
-    gum_x86_writer_reset (cw, code_start);
+    gum_x86_writer_reset (cw,
+        gum_stalker_thaw (stalker, code_start, code_max_size));
+    cw->pc = GUM_ADDRESS (code_start);
 
     if (opened_prolog != GUM_PROLOG_NONE)
     {
@@ -3532,8 +5384,9 @@ gum_exec_block_backpatch_ret (GumExecBlock * block,
 
     gum_spinlock_acquire (&ctx->code_lock);
 
-    gum_stalker_thaw (stalker, code_start, code_max_size);
-    gum_x86_writer_reset (cw, code_start);
+    gum_x86_writer_reset (cw,
+        gum_stalker_thaw (stalker, code_start, code_max_size));
+    cw->pc = GUM_ADDRESS (code_start);
 
     gum_x86_writer_put_jmp_address (cw, GUM_ADDRESS (block->code_start));
 
@@ -3566,13 +5419,14 @@ gum_exec_block_backpatch_inline_cache (GumExecBlock * block,
     {
       GumStalker * stalker = ctx->stalker;
       const gsize ic_slot_size = 2 * sizeof (gpointer);
+      gpointer * ic_slot;
 
       gum_spinlock_acquire (&ctx->code_lock);
 
-      gum_stalker_thaw (stalker, ic_entries + offset, ic_slot_size);
+      ic_slot = gum_stalker_thaw (stalker, ic_entries + offset, ic_slot_size);
 
-      ic_entries[offset + 0] = block->real_start;
-      ic_entries[offset + 1] = block->code_start;
+      ic_slot[0] = block->real_start;
+      ic_slot[1] = block->code_start;
 
       gum_stalker_freeze (stalker, ic_entries + offset, ic_slot_size);
 
@@ -3657,6 +5511,11 @@ gum_exec_block_virtualize_branch_insn (GumExecBlock * block,
     g_assert_not_reached ();
   }
 
+  if (!target.is_indirect && target.base == X86_REG_INVALID)
+    gum_exec_ctx_note_successor (ctx, target.absolute_address);
+  if (is_conditional || insn->ci->id == X86_INS_CALL)
+    gum_exec_ctx_note_successor (ctx, insn->end);
+
   if (insn->ci->id == X86_INS_CALL)
   {
     gboolean target_is_excluded = FALSE;
@@ -3741,6 +5600,9 @@ gum_exec_block_virtualize_branch_insn (GumExecBlock * block,
 
     gum_x86_relocator_skip_one_no_label (gc->relocator);
 
+    if (gum_exec_block_try_extend_trace (block, &target, is_conditional, gc))
+      return GUM_REQUIRE_NOTHING;
+
     is_false =
         GUINT_TO_POINTER ((GPOINTER_TO_UINT (insn->start) << 16) | 0xbeef);
 
@@ -3789,6 +5651,65 @@ gum_exec_block_virtualize_branch_insn (GumExecBlock * block,
   return GUM_REQUIRE_NOTHING;
 }
 
+static gboolean
+gum_exec_block_try_extend_trace (GumExecBlock * block,
+                                 const GumBranchTarget * target,
+                                 gboolean is_conditional,
+                                 GumGeneratorContext * gc)
+{
+  GumInstruction * insn = gc->instruction;
+  GumX86Writer * cw = gc->code_writer;
+  gpointer hot_address, cold_address;
+
+  if (gc->trace_segments_left == 0)
+    return FALSE;
+
+  if (target->is_indirect || target->base != X86_REG_INVALID)
+    return FALSE;
+
+  if (!is_conditional)
+  {
+    hot_address = target->absolute_address;
+    cold_address = NULL;
+  }
+  else if ((guint8 *) target->absolute_address <= insn->start)
+  {
+    /* Backward branches are most likely loops */
+    hot_address = target->absolute_address;
+    cold_address = insn->end;
+  }
+  else
+  {
+    hot_address = insn->end;
+    cold_address = target->absolute_address;
+  }
+
+  if (!gum_exec_ctx_may_trace_into (block->ctx, hot_address))
+    return FALSE;
+
+  gum_exec_block_close_prolog (block, gc);
+
+  if (cold_address != NULL)
+  {
+    GumBranchTarget exit_target = { 0, };
+
+    gum_x86_writer_put_jcc_near_label (cw,
+        (hot_address == target->absolute_address)
+            ? insn->ci->id
+            : gum_negate_jcc (insn->ci->id),
+        &gc->trace_continuation, GUM_NO_HINT);
+
+    exit_target.is_indirect = FALSE;
+    exit_target.absolute_address = cold_address;
+    gum_exec_block_write_jmp_transfer_code (block, &exit_target,
+        GUM_ENTRYGATE (jmp_cond_imm), gc);
+  }
+
+  gc->trace_continuation = hot_address;
+
+  return TRUE;
+}
+
 static GumVirtualizationRequirements
 gum_exec_block_virtualize_ret_insn (GumExecBlock * block,
                                     GumGeneratorContext * gc)
@@ -3798,6 +5719,9 @@ gum_exec_block_virtualize_ret_insn (GumExecBlock * block,
 
   gum_x86_relocator_skip_one_no_label (gc->relocator);
 
+  if (block->ctx->stalker->shadow_stack_enabled)
+    gum_exec_block_write_shadow_ret_code (block, gc);
+
   gum_exec_block_write_ret_transfer_code (block, gc);
 
   return GUM_REQUIRE_NOTHING;
@@ -3966,14 +5890,14 @@ gum_exec_block_write_call_invoke_code (GumExecBlock * block,
 
     gum_x86_writer_put_jmp_short_label (cw, look_in_cache);
 
-    ic_entries = gum_x86_writer_cur (cw);
+    ic_entries = GSIZE_TO_POINTER (cw->pc);
     ic1_real = ic_entries;
     gum_x86_writer_put_bytes (cw, (guint8 *) &null_ptr, sizeof (null_ptr));
-    ic1_code = gum_x86_writer_cur (cw);
+    ic1_code = GSIZE_TO_POINTER (cw->pc);
     gum_x86_writer_put_bytes (cw, (guint8 *) &null_ptr, sizeof (null_ptr));
-    ic2_real = gum_x86_writer_cur (cw);
+    ic2_real = GSIZE_TO_POINTER (cw->pc);
     gum_x86_writer_put_bytes (cw, (guint8 *) &null_ptr, sizeof (null_ptr));
-    ic2_code = gum_x86_writer_cur (cw);
+    ic2_code = GSIZE_TO_POINTER (cw->pc);
     gum_x86_writer_put_bytes (cw, (guint8 *) &null_ptr, sizeof (null_ptr));
 
     gum_x86_writer_put_label (cw, look_in_cache);
@@ -4156,14 +6080,14 @@ gum_exec_block_write_jmp_transfer_code (GumExecBlock * block,
 
     gum_x86_writer_put_jmp_short_label (cw, look_in_cache);
 
-    ic_entries = gum_x86_writer_cur (cw);
+    ic_entries = GSIZE_TO_POINTER (cw->pc);
     ic1_real = ic_entries;
     gum_x86_writer_put_bytes (cw, (guint8 *) &null_ptr, sizeof (null_ptr));
-    ic1_code = gum_x86_writer_cur (cw);
+    ic1_code = GSIZE_TO_POINTER (cw->pc);
     gum_x86_writer_put_bytes (cw, (guint8 *) &null_ptr, sizeof (null_ptr));
-    ic2_real = gum_x86_writer_cur (cw);
+    ic2_real = GSIZE_TO_POINTER (cw->pc);
     gum_x86_writer_put_bytes (cw, (guint8 *) &null_ptr, sizeof (null_ptr));
-    ic2_code = gum_x86_writer_cur (cw);
+    ic2_code = GSIZE_TO_POINTER (cw->pc);
     gum_x86_writer_put_bytes (cw, (guint8 *) &null_ptr, sizeof (null_ptr));
 
     gum_x86_writer_put_label (cw, look_in_cache);
@@ -4253,6 +6177,89 @@ gum_exec_block_write_ret_transfer_code (GumExecBlock * block,
       GUM_ADDRESS (block->ctx->last_stack_pop_and_go));
 }
 
+/*
+ * Inline version of the fast path in the stack pop-and-go helper: if the top
+ * of our stack matches the return address we swap in the translated one and
+ * execute a copy of the ret right here. Otherwise we first try to unwind our
+ * stack to a matching frame, e.g. after a longjmp(), and then go through the
+ * regular transfer code that follows.
+ */
+static void
+gum_exec_block_write_shadow_ret_code (GumExecBlock * block,
+                                      GumGeneratorContext * gc)
+{
+  GumExecCtx * ctx = block->ctx;
+  GumInstruction * insn = gc->instruction;
+  GumX86Writer * cw = gc->code_writer;
+  gconstpointer mismatch = cw->code + 1;
+  const gssize stack_delta = GUM_RED_ZONE_SIZE + 3 * sizeof (gpointer);
+
+  gum_exec_block_close_prolog (block, gc);
+
+  gum_x86_writer_put_lea_reg_reg_offset (cw, GUM_REG_XSP,
+      GUM_REG_XSP, -GUM_RED_ZONE_SIZE);
+  gum_x86_writer_put_pushfx (cw);
+  gum_x86_writer_put_push_reg (cw, GUM_REG_XAX);
+  gum_x86_writer_put_push_reg (cw, GUM_REG_XCX);
+
+  gum_x86_writer_put_mov_reg_address (cw, GUM_REG_XAX,
+      GUM_ADDRESS (&ctx->current_frame));
+  gum_x86_writer_put_mov_reg_reg_ptr (cw, GUM_REG_XAX, GUM_REG_XAX);
+
+  gum_x86_writer_put_mov_reg_reg_ptr (cw, GUM_REG_XCX, GUM_REG_XAX);
+  gum_x86_writer_put_cmp_reg_offset_ptr_reg (cw, GUM_REG_XSP, stack_delta,
+      GUM_REG_XCX);
+  gum_x86_writer_put_jcc_near_label (cw, X86_INS_JNE, mismatch, GUM_UNLIKELY);
+
+  gum_x86_writer_put_mov_reg_reg_offset_ptr (cw, GUM_REG_XCX,
+      GUM_REG_XAX, G_STRUCT_OFFSET (GumExecFrame, code_address));
+  gum_x86_writer_put_mov_reg_offset_ptr_reg (cw, GUM_REG_XSP, stack_delta,
+      GUM_REG_XCX);
+
+  gum_x86_writer_put_add_reg_imm (cw, GUM_REG_XAX, sizeof (GumExecFrame));
+  gum_x86_writer_put_mov_reg_address (cw, GUM_REG_XCX,
+      GUM_ADDRESS (&ctx->current_frame));
+  gum_x86_writer_put_mov_reg_ptr_reg (cw, GUM_REG_XCX, GUM_REG_XAX);
+
+  gum_x86_writer_put_pop_reg (cw, GUM_REG_XCX);
+  gum_x86_writer_put_pop_reg (cw, GUM_REG_XAX);
+  gum_x86_writer_put_popfx (cw);
+  gum_x86_writer_put_lea_reg_reg_offset (cw, GUM_REG_XSP,
+      GUM_REG_XSP, GUM_RED_ZONE_SIZE);
+
+  /* A ret, possibly with an immediate, is position-independent */
+  gum_x86_writer_put_bytes (cw, insn->start, insn->ci->size);
+
+  gum_x86_writer_put_label (cw, mismatch);
+  gum_x86_writer_put_pop_reg (cw, GUM_REG_XCX);
+  gum_x86_writer_put_pop_reg (cw, GUM_REG_XAX);
+  gum_x86_writer_put_popfx (cw);
+  gum_x86_writer_put_lea_reg_reg_offset (cw, GUM_REG_XSP,
+      GUM_REG_XSP, GUM_RED_ZONE_SIZE);
+
+  gum_exec_block_open_prolog (block, GUM_PROLOG_MINIMAL, gc);
+  gum_x86_writer_put_call_address_with_aligned_arguments (cw, GUM_CALL_CAPI,
+      GUM_ADDRESS (gum_exec_ctx_unwind_shadow_stack), 1,
+      GUM_ARG_ADDRESS, GUM_ADDRESS (ctx));
+  gum_exec_block_close_prolog (block, gc);
+}
+
+static void
+gum_exec_ctx_unwind_shadow_stack (GumExecCtx * ctx)
+{
+  gpointer return_address = *((gpointer *) ctx->app_stack);
+  GumExecFrame * frame;
+
+  for (frame = ctx->current_frame; frame != ctx->first_frame; frame++)
+  {
+    if (frame->real_address == return_address)
+    {
+      ctx->current_frame = frame;
+      return;
+    }
+  }
+}
+
 static void
 gum_exec_block_write_single_step_transfer_code (GumExecBlock * block,
                                                 GumGeneratorContext * gc)
@@ -4421,9 +6428,10 @@ gum_exec_block_write_block_event_code (GumExecBlock * block,
   gum_exec_block_open_prolog (block, GUM_PROLOG_FULL, gc);
 
   gum_x86_writer_put_call_address_with_aligned_arguments (gc->code_writer,
-      GUM_CALL_CAPI, GUM_ADDRESS (gum_exec_ctx_emit_block_event), 3,
+      GUM_CALL_CAPI, GUM_ADDRESS (gum_exec_ctx_emit_block_event), 4,
       GUM_ARG_ADDRESS, GUM_ADDRESS (block->ctx),
       GUM_ARG_ADDRESS, GUM_ADDRESS (block),
+      GUM_ARG_ADDRESS, GUM_ADDRESS (block->ctx->n_segments - 1),
       GUM_ARG_REGISTER, GUM_REG_XBX);
 
   gum_exec_block_write_unfollow_check_code (block, gc, cc);
@@ -4458,46 +6466,89 @@ gum_exec_block_write_unfollow_check_code (GumExecBlock * block,
   gum_x86_writer_put_label (cw, beach);
 }
 
+static void
+gum_exec_block_maybe_write_counter_code (GumExecBlock * block,
+                                         guint segment_index,
+                                         GumGeneratorContext * gc)
+{
+  GumX86Writer * cw = gc->code_writer;
+  gsize * counter;
+
+  if (!block->ctx->stalker->block_counters_enabled)
+    return;
+
+  if (segment_index == 0)
+  {
+    counter = &block->execution_count;
+  }
+  else
+  {
+    /*
+     * Kept across recompilation, and freed along with the slab's blocks, as
+     * the block itself is only recycled with its slab.
+     */
+    if (block->segment_execution_counts == NULL)
+    {
+      block->segment_execution_counts =
+          g_new0 (gsize, GUM_MAX_TRACE_SEGMENTS - 1);
+    }
+    counter = &block->segment_execution_counts[segment_index - 1];
+  }
+
+  /* Increment through LEA so we don't have to preserve the flags. */
+  gum_x86_writer_put_lea_reg_reg_offset (cw, GUM_REG_XSP, GUM_REG_XSP,
+      -GUM_RED_ZONE_SIZE);
+  gum_x86_writer_put_push_reg (cw, GUM_REG_XAX);
+  gum_x86_writer_put_push_reg (cw, GUM_REG_XCX);
+
+  gum_x86_writer_put_mov_reg_address (cw, GUM_REG_XAX, GUM_ADDRESS (counter));
+  gum_x86_writer_put_mov_reg_reg_ptr (cw, GUM_REG_XCX, GUM_REG_XAX);
+  gum_x86_writer_put_lea_reg_reg_offset (cw, GUM_REG_XCX, GUM_REG_XCX, 1);
+  gum_x86_writer_put_mov_reg_ptr_reg (cw, GUM_REG_XAX, GUM_REG_XCX);
+
+  gum_x86_writer_put_pop_reg (cw, GUM_REG_XCX);
+  gum_x86_writer_put_pop_reg (cw, GUM_REG_XAX);
+  gum_x86_writer_put_lea_reg_reg_offset (cw, GUM_REG_XSP, GUM_REG_XSP,
+      GUM_RED_ZONE_SIZE);
+}
+
 static void
 gum_exec_block_maybe_write_call_probe_code (GumExecBlock * block,
                                             GumGeneratorContext * gc)
 {
   GumStalker * stalker = block->ctx->stalker;
+  GumCallProbeSlot * slot;
 
   if (!stalker->any_probes_attached)
     return;
 
-  gum_spinlock_acquire (&stalker->probe_lock);
-
-  if (g_hash_table_contains (stalker->probe_array_by_address,
-          block->real_start))
-  {
-    gum_exec_block_write_call_probe_code (block, gc);
-  }
-
-  gum_spinlock_release (&stalker->probe_lock);
+  slot = gum_exec_ctx_lookup_probe_slot (block->ctx, block->real_start);
+  if (slot != NULL && g_atomic_pointer_get (&slot->probes) != NULL)
+    gum_exec_block_write_call_probe_code (block, slot, gc);
 }
 
 static void
 gum_exec_block_write_call_probe_code (GumExecBlock * block,
+                                      GumCallProbeSlot * slot,
                                       GumGeneratorContext * gc)
 {
   g_assert (gc->opened_prolog == GUM_PROLOG_NONE);
   gum_exec_block_open_prolog (block, GUM_PROLOG_FULL, gc);
 
   gum_x86_writer_put_call_address_with_aligned_arguments (gc->code_writer,
-      GUM_CALL_CAPI, GUM_ADDRESS (gum_exec_block_invoke_call_probes),
-      2,
-      GUM_ARG_ADDRESS, GUM_ADDRESS (block),
+      GUM_CALL_CAPI, GUM_ADDRESS (gum_exec_ctx_invoke_call_probes),
+      3,
+      GUM_ARG_ADDRESS, GUM_ADDRESS (block->ctx),
+      GUM_ARG_ADDRESS, GUM_ADDRESS (slot),
       GUM_ARG_REGISTER, GUM_REG_XBX);
 }
 
 static void
-gum_exec_block_invoke_call_probes (GumExecBlock * block,
-                                   GumCpuContext * cpu_context)
+gum_exec_ctx_invoke_call_probes (GumExecCtx * ctx,
+                                 GumCallProbeSlot * slot,
+                                 GumCpuContext * cpu_context)
 {
-  GumStalker * stalker = block->ctx->stalker;
-  const gpointer target_address = block->real_start;
+  const gpointer target_address = slot->target_address;
   GumCallProbe ** probes_copy;
   guint num_probes, i;
   gpointer * return_address_slot;
@@ -4506,23 +6557,20 @@ gum_exec_block_invoke_call_probes (GumExecBlock * block,
   probes_copy = NULL;
   num_probes = 0;
   {
-    GPtrArray * probes;
+    GumCallProbeList * probes;
 
-    gum_spinlock_acquire (&stalker->probe_lock);
+    g_atomic_int_inc (&ctx->probe_readers);
 
-    probes =
-        g_hash_table_lookup (stalker->probe_array_by_address, target_address);
+    probes = g_atomic_pointer_get (&slot->probes);
     if (probes != NULL)
     {
-      num_probes = probes->len;
+      num_probes = probes->length;
       probes_copy = g_newa (GumCallProbe *, num_probes);
       for (i = 0; i != num_probes; i++)
-      {
-        probes_copy[i] = gum_call_probe_ref (g_ptr_array_index (probes, i));
-      }
+        probes_copy[i] = gum_call_probe_ref (probes->items[i]);
     }
 
-    gum_spinlock_release (&stalker->probe_lock);
+    g_atomic_int_add (&ctx->probe_readers, -1);
   }
   if (num_probes == 0)
     return;
@@ -4613,20 +6661,34 @@ gum_code_slab_new (GumExecCtx * ctx)
   const gsize slab_size = stalker->code_slab_size_dynamic;
   GumAddressSpec spec;
 
+  slab = ctx->spare_code_slab;
+  if (slab != NULL)
+  {
+    ctx->spare_code_slab = (GumCodeSlab *) slab->slab.next;
+    slab->slab.next = NULL;
+    return slab;
+  }
+
   gum_exec_ctx_compute_code_address_spec (ctx, slab_size, &spec);
 
-  slab = gum_memory_allocate_near (&spec, slab_size, stalker->page_size,
-      stalker->is_rwx_supported ? GUM_PAGE_RWX : GUM_PAGE_RW);
+  slab = gum_stalker_allocate_code (stalker, &spec, slab_size);
 
   gum_code_slab_init (slab, slab_size, stalker->page_size);
 
+  if (stalker->code_alias_offset != 0)
+    gum_mprotect (slab->slab.data, slab->slab.size, GUM_PAGE_RX);
+
   return slab;
 }
 
 static void
-gum_code_slab_free (GumCodeSlab * code_slab)
+gum_code_slab_free (GumCodeSlab * code_slab,
+                    GumStalker * stalker)
 {
-  gum_slab_free (&code_slab->slab);
+  GumSlab * slab = &code_slab->slab;
+  const gsize header_size = slab->data - (guint8 *) slab;
+
+  gum_stalker_free_code (stalker, slab, header_size + slab->size);
 }
 
 static void
@@ -4655,6 +6717,17 @@ gum_data_slab_new (GumExecCtx * ctx)
 
   gum_exec_ctx_compute_data_address_spec (ctx, slab_size, &spec);
 
+  while ((slab = ctx->spare_data_slab) != NULL)
+  {
+    ctx->spare_data_slab = (GumDataSlab *) slab->slab.next;
+    slab->slab.next = NULL;
+
+    if (gum_address_spec_is_satisfied_by (&spec, gum_slab_start (&slab->slab)))
+      return slab;
+
+    gum_data_slab_free (slab);
+  }
+
   slab = gum_memory_allocate_near (&spec, slab_size, stalker->page_size,
       GUM_PAGE_RW);
 
@@ -7,6 +7,7 @@
 #include "gum.h"
 
 #include "gum-init.h"
+#include "gumcapstone.h"
 #include "gumexceptorbackend.h"
 #include "guminterceptor-priv.h"
 #include "gummemory-priv.h"
@@ -154,6 +155,7 @@ gum_deinit (void)
   gum_final_destructors = NULL;
 
   _gum_interceptor_deinit ();
+  _gum_capstone_deinit ();
 
   gum_initialized = FALSE;
 }
@@ -176,6 +178,7 @@ gum_do_init (void)
 #endif
 
   cs_option (0, CS_OPT_MEM, GPOINTER_TO_SIZE (&gum_cs_mem_callbacks));
+  _gum_capstone_init ();
 
   _gum_tls_init ();
   _gum_interceptor_init ();
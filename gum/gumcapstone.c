@@ -0,0 +1,230 @@
+/*
+ * Copyright (C) 2021 Ole André Vadla Ravnås <oleavr@nowsecure.com>
+ *
+ * Licence: wxWindows Library Licence, Version 3.1
+ */
+
+#include "gumcapstone.h"
+
+#define GUM_CAPSTONE_CACHE_CAPACITY 8
+
+typedef struct _GumCapstoneCache GumCapstoneCache;
+typedef struct _GumCapstoneCacheEntry GumCapstoneCacheEntry;
+
+struct _GumCapstoneCacheEntry
+{
+  cs_arch arch;
+  csh handle;
+};
+
+struct _GumCapstoneCache
+{
+  GumCapstoneCacheEntry entries[GUM_CAPSTONE_CACHE_CAPACITY];
+  guint length;
+};
+
+static GumCapstoneCache * gum_capstone_cache_get (void);
+static gboolean gum_capstone_cache_is_current (guint generation);
+static void gum_capstone_cache_release (GumCapstoneCache * cache);
+static void gum_capstone_cache_free (GumCapstoneCache * cache);
+
+static csh gum_capstone_open (cs_arch arch, cs_mode mode);
+
+static GMutex gum_capstone_lock;
+static GHashTable * gum_capstone_caches = NULL;
+static GPrivate gum_capstone_cache_private =
+    G_PRIVATE_INIT ((GDestroyNotify) gum_capstone_cache_release);
+
+/*
+ * Bumped by every init and deinit. Each thread remembers which generation its
+ * cache belongs to, so that once _gum_capstone_deinit() has freed the caches,
+ * a stale pointer left behind in another thread's TLS is never dereferenced.
+ */
+static volatile gint gum_capstone_generation = 0;
+static GPrivate gum_capstone_cache_generation_private;
+
+static volatile gint gum_capstone_cache_enabled = TRUE;
+
+void
+_gum_capstone_init (void)
+{
+  gum_capstone_caches = g_hash_table_new_full (NULL, NULL,
+      (GDestroyNotify) gum_capstone_cache_free, NULL);
+
+  g_atomic_int_inc (&gum_capstone_generation);
+}
+
+void
+_gum_capstone_deinit (void)
+{
+  GHashTable * caches;
+
+  g_mutex_lock (&gum_capstone_lock);
+  caches = gum_capstone_caches;
+  gum_capstone_caches = NULL;
+  g_atomic_int_inc (&gum_capstone_generation);
+  g_mutex_unlock (&gum_capstone_lock);
+
+  g_private_set (&gum_capstone_cache_private, NULL);
+
+  g_hash_table_unref (caches);
+}
+
+/*
+ * Hands out a capstone instance with details turned on, in the given mode.
+ * Instances are recycled through a small per-thread cache, so relocators and
+ * readers can be created at a high rate without paying for cs_open() each
+ * time. The caller owns the instance until it is given back through
+ * _gum_capstone_release(), which may happen on a different thread, and must
+ * not change any options other than the mode.
+ */
+csh
+_gum_capstone_acquire (cs_arch arch,
+                       cs_mode mode)
+{
+  GumCapstoneCache * cache;
+  gint i;
+
+  cache = gum_capstone_cache_get ();
+  if (cache == NULL)
+    return gum_capstone_open (arch, mode);
+
+  for (i = (gint) cache->length - 1; i >= 0; i--)
+  {
+    GumCapstoneCacheEntry * entry = &cache->entries[i];
+
+    if (entry->arch == arch)
+    {
+      csh handle = entry->handle;
+
+      *entry = cache->entries[--cache->length];
+
+      cs_option (handle, CS_OPT_MODE, mode);
+
+      return handle;
+    }
+  }
+
+  return gum_capstone_open (arch, mode);
+}
+
+void
+_gum_capstone_release (cs_arch arch,
+                       csh capstone)
+{
+  GumCapstoneCache * cache;
+  GumCapstoneCacheEntry * entry;
+
+  cache = gum_capstone_cache_get ();
+  if (cache == NULL || cache->length == GUM_CAPSTONE_CACHE_CAPACITY)
+  {
+    cs_close (&capstone);
+    return;
+  }
+
+  entry = &cache->entries[cache->length++];
+  entry->arch = arch;
+  entry->handle = capstone;
+}
+
+/*
+ * Lets benchmarks compare against opening a fresh instance every time. Cached
+ * instances are kept around while disabled, and used again once re-enabled.
+ */
+void
+_gum_capstone_set_cache_enabled (gboolean enabled)
+{
+  g_atomic_int_set (&gum_capstone_cache_enabled, enabled);
+}
+
+static GumCapstoneCache *
+gum_capstone_cache_get (void)
+{
+  GumCapstoneCache * cache;
+  guint generation;
+
+  if (!g_atomic_int_get (&gum_capstone_cache_enabled))
+    return NULL;
+
+  generation = g_atomic_int_get (&gum_capstone_generation);
+
+  cache = g_private_get (&gum_capstone_cache_private);
+  if (cache != NULL && !gum_capstone_cache_is_current (generation))
+  {
+    cache = NULL;
+    g_private_set (&gum_capstone_cache_private, NULL);
+  }
+
+  if (cache == NULL)
+  {
+    gboolean registered = FALSE;
+
+    if (gum_capstone_caches == NULL)
+      return NULL;
+
+    cache = g_slice_new0 (GumCapstoneCache);
+
+    g_mutex_lock (&gum_capstone_lock);
+    if (gum_capstone_caches != NULL &&
+        g_atomic_int_get (&gum_capstone_generation) == (gint) generation)
+    {
+      g_hash_table_add (gum_capstone_caches, cache);
+      registered = TRUE;
+    }
+    g_mutex_unlock (&gum_capstone_lock);
+
+    if (!registered)
+    {
+      g_slice_free (GumCapstoneCache, cache);
+      return NULL;
+    }
+
+    g_private_set (&gum_capstone_cache_generation_private,
+        GUINT_TO_POINTER (generation));
+    g_private_set (&gum_capstone_cache_private, cache);
+  }
+
+  return cache;
+}
+
+static gboolean
+gum_capstone_cache_is_current (guint generation)
+{
+  return GPOINTER_TO_UINT (
+      g_private_get (&gum_capstone_cache_generation_private)) == generation;
+}
+
+static void
+gum_capstone_cache_release (GumCapstoneCache * cache)
+{
+  g_mutex_lock (&gum_capstone_lock);
+  if (gum_capstone_caches != NULL &&
+      gum_capstone_cache_is_current (gum_capstone_generation))
+  {
+    g_hash_table_remove (gum_capstone_caches, cache);
+  }
+  g_mutex_unlock (&gum_capstone_lock);
+}
+
+static void
+gum_capstone_cache_free (GumCapstoneCache * cache)
+{
+  guint i;
+
+  for (i = 0; i != cache->length; i++)
+    cs_close (&cache->entries[i].handle);
+
+  g_slice_free (GumCapstoneCache, cache);
+}
+
+static csh
+gum_capstone_open (cs_arch arch,
+                   cs_mode mode)
+{
+  csh handle;
+
+  cs_open (arch, mode, &handle);
+  cs_option (handle, CS_OPT_DETAIL, CS_OPT_ON);
+
+  return handle;
+}
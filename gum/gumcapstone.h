@@ -0,0 +1,25 @@
+/*
+ * Copyright (C) 2021 Ole André Vadla Ravnås <oleavr@nowsecure.com>
+ *
+ * Licence: wxWindows Library Licence, Version 3.1
+ */
+
+#ifndef __GUM_CAPSTONE_H__
+#define __GUM_CAPSTONE_H__
+
+#include <capstone.h>
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+G_GNUC_INTERNAL void _gum_capstone_init (void);
+G_GNUC_INTERNAL void _gum_capstone_deinit (void);
+
+G_GNUC_INTERNAL csh _gum_capstone_acquire (cs_arch arch, cs_mode mode);
+G_GNUC_INTERNAL void _gum_capstone_release (cs_arch arch, csh capstone);
+
+G_GNUC_INTERNAL void _gum_capstone_set_cache_enabled (gboolean enabled);
+
+G_END_DECLS
+
+#endif
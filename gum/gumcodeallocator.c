@@ -20,6 +20,13 @@
 
 #include <string.h>
 
+#define GUM_CODE_SLICE_BUCKET_SHIFT 24
+#define GUM_CODE_SLICE_BUCKET_SIZE ((gsize) 1 << GUM_CODE_SLICE_BUCKET_SHIFT)
+#define GUM_CODE_SLICE_BUCKET_KEY(address) \
+    GSIZE_TO_POINTER (GPOINTER_TO_SIZE (address) >> GUM_CODE_SLICE_BUCKET_SHIFT)
+
+#define GUM_CODE_ALLOCATOR_MAX_PAGES_PER_BATCH 64
+
 #define GUM_CODE_SLICE_ELEMENT_FROM_SLICE(s) \
     ((GumCodeSliceElement *) (((guint8 *) (s)) - \
         G_STRUCT_OFFSET (GumCodeSliceElement, slice)))
@@ -33,12 +40,25 @@
 #endif
 
 typedef struct _GumCodePages GumCodePages;
+typedef struct _GumCodeSliceBucket GumCodeSliceBucket;
 typedef struct _GumCodeSliceElement GumCodeSliceElement;
 typedef struct _GumCodeDeflectorDispatcher GumCodeDeflectorDispatcher;
 typedef struct _GumCodeDeflectorImpl GumCodeDeflectorImpl;
 typedef struct _GumProbeRangeForCodeCaveContext GumProbeRangeForCodeCaveContext;
 typedef struct _GumInsertDeflectorContext GumInsertDeflectorContext;
 
+/*
+ * Free slices are kept in buckets keyed by the 16 MB region of address space
+ * they live in. Looking for a slice near an address starts with the bucket
+ * that address falls in. It then considers only the other non-empty buckets
+ * within reach, so the cost no longer depends on how many free slices are
+ * far away.
+ */
+struct _GumCodeSliceBucket
+{
+  GList * slices;
+};
+
 struct _GumCodeSliceElement
 {
   GList parent;
@@ -48,6 +68,8 @@ struct _GumCodeSliceElement
 struct _GumCodePages
 {
   gint ref_count;
+  gboolean dirty;
+  guint num_slices;
 
   GumCodeSegment * segment;
   gpointer data;
@@ -99,7 +121,21 @@ struct _GumInsertDeflectorContext
 static GumCodeSlice * gum_code_allocator_try_alloc_batch_near (
     GumCodeAllocator * self, const GumAddressSpec * spec);
 
+static void gum_code_allocator_add_free_slice (GumCodeAllocator * self,
+    GumCodeSliceElement * element);
+static void gum_code_allocator_drop_free_slices (GumCodeAllocator * self);
+static void gum_code_allocator_mark_dirty (GumCodeAllocator * self,
+    GumCodePages * pages);
+
+static gsize gum_code_allocator_compute_batch_pages (GumCodeAllocator * self);
 static void gum_code_pages_unref (GumCodePages * self);
+static gsize gum_code_pages_compute_metadata_size (guint num_slices);
+
+static void gum_code_slice_bucket_free (GumCodeSliceBucket * bucket);
+static GumCodeSlice * gum_code_slice_bucket_try_take (
+    GumCodeSliceBucket * self, const GumAddressSpec * spec, gsize alignment);
+static gboolean gum_code_slice_bucket_is_near (gpointer key,
+    const GumAddressSpec * spec);
 
 static gboolean gum_code_slice_is_near (const GumCodeSlice * self,
     const GumAddressSpec * spec);
@@ -129,14 +165,12 @@ gum_code_allocator_init (GumCodeAllocator * allocator,
 {
   allocator->slice_size = slice_size;
   allocator->pages_per_batch = 7;
-  allocator->slices_per_batch =
-      (allocator->pages_per_batch * gum_query_page_size ()) / slice_size;
-  allocator->pages_metadata_size = sizeof (GumCodePages) +
-      ((allocator->slices_per_batch - 1) * sizeof (GumCodeSliceElement));
+  allocator->batch_slices_left = 0;
 
   allocator->uncommitted_pages = NULL;
-  allocator->dirty_pages = g_hash_table_new (NULL, NULL);
-  allocator->free_slices = NULL;
+  allocator->dirty_pages = NULL;
+  allocator->free_slices = g_hash_table_new_full (NULL, NULL, NULL,
+      (GDestroyNotify) gum_code_slice_bucket_free);
 
   allocator->dispatchers = NULL;
 }
@@ -149,8 +183,9 @@ gum_code_allocator_free (GumCodeAllocator * allocator)
   g_slist_free (allocator->dispatchers);
   allocator->dispatchers = NULL;
 
-  g_list_foreach (allocator->free_slices, (GFunc) gum_code_pages_unref, NULL);
-  g_hash_table_unref (allocator->dirty_pages);
+  gum_code_allocator_drop_free_slices (allocator);
+  g_hash_table_unref (allocator->free_slices);
+  g_slist_free (allocator->dirty_pages);
   g_slist_free (allocator->uncommitted_pages);
   allocator->uncommitted_pages = NULL;
   allocator->dirty_pages = NULL;
@@ -168,27 +203,53 @@ gum_code_allocator_try_alloc_slice_near (GumCodeAllocator * self,
                                          const GumAddressSpec * spec,
                                          gsize alignment)
 {
-  GList * cur;
+  GumCodeSlice * slice = NULL;
+  gpointer near_key = NULL;
+  GumCodeSliceBucket * bucket;
+  GHashTableIter iter;
+  gpointer key;
 
-  for (cur = self->free_slices; cur != NULL; cur = cur->next)
+  if (self->batch_slices_left != 0)
+    self->batch_slices_left--;
+
+  if (spec != NULL)
   {
-    GumCodeSliceElement * element = (GumCodeSliceElement *) cur;
-    GumCodeSlice * slice = &element->slice;
+    near_key = GUM_CODE_SLICE_BUCKET_KEY (spec->near_address);
 
-    if (gum_code_slice_is_near (slice, spec) &&
-        gum_code_slice_is_aligned (slice, alignment))
+    bucket = g_hash_table_lookup (self->free_slices, near_key);
+    if (bucket != NULL)
     {
-      GumCodePages * pages = element->parent.data;
+      slice = gum_code_slice_bucket_try_take (bucket, spec, alignment);
+      if (bucket->slices == NULL)
+        g_hash_table_remove (self->free_slices, near_key);
+    }
+  }
 
-      self->free_slices = g_list_remove_link (self->free_slices, cur);
+  if (slice == NULL)
+  {
+    g_hash_table_iter_init (&iter, self->free_slices);
+    while (g_hash_table_iter_next (&iter, &key, (gpointer *) &bucket))
+    {
+      if (spec != NULL &&
+          (key == near_key || !gum_code_slice_bucket_is_near (key, spec)))
+        continue;
 
-      g_hash_table_add (self->dirty_pages, pages);
+      slice = gum_code_slice_bucket_try_take (bucket, spec, alignment);
+      if (bucket->slices == NULL)
+        g_hash_table_iter_remove (&iter);
 
-      return slice;
+      if (slice != NULL)
+        break;
     }
   }
 
-  return gum_code_allocator_try_alloc_batch_near (self, spec);
+  if (slice == NULL)
+    return gum_code_allocator_try_alloc_batch_near (self, spec);
+
+  gum_code_allocator_mark_dirty (self,
+      GUM_CODE_SLICE_ELEMENT_FROM_SLICE (slice)->parent.data);
+
+  return slice;
 }
 
 void
@@ -197,7 +258,6 @@ gum_code_allocator_commit (GumCodeAllocator * self)
   gboolean rwx_supported;
   GSList * cur;
   GumCodePages * pages;
-  GHashTableIter iter;
 
   rwx_supported = gum_query_is_rwx_supported ();
 
@@ -223,18 +283,88 @@ gum_code_allocator_commit (GumCodeAllocator * self)
   g_slist_free (self->uncommitted_pages);
   self->uncommitted_pages = NULL;
 
-  g_hash_table_iter_init (&iter, self->dirty_pages);
-  while (g_hash_table_iter_next (&iter, (gpointer *) &pages, NULL))
+  for (cur = self->dirty_pages; cur != NULL; cur = cur->next)
   {
+    pages = cur->data;
+
     gum_clear_cache (pages->data, pages->size);
+    pages->dirty = FALSE;
   }
-  g_hash_table_remove_all (self->dirty_pages);
+  g_slist_free (self->dirty_pages);
+  self->dirty_pages = NULL;
 
   if (!rwx_supported)
+    gum_code_allocator_drop_free_slices (self);
+}
+
+/*
+ * Hints that about n_slices slices are about to be allocated in one go, e.g.
+ * when hooking many functions at once. Until the batch ends, fresh pages are
+ * allocated to fit the slices still expected, instead of a few pages at a
+ * time, so that neighbouring functions don't each pay for looking up and
+ * mapping memory near them.
+ */
+void
+gum_code_allocator_begin_batch (GumCodeAllocator * self,
+                                guint n_slices)
+{
+  self->batch_slices_left = n_slices;
+}
+
+void
+gum_code_allocator_end_batch (GumCodeAllocator * self)
+{
+  self->batch_slices_left = 0;
+}
+
+static void
+gum_code_allocator_add_free_slice (GumCodeAllocator * self,
+                                   GumCodeSliceElement * element)
+{
+  gpointer key;
+  GumCodeSliceBucket * bucket;
+  GList * link;
+
+  key = GUM_CODE_SLICE_BUCKET_KEY (element->slice.data);
+
+  bucket = g_hash_table_lookup (self->free_slices, key);
+  if (bucket == NULL)
   {
-    g_list_foreach (self->free_slices, (GFunc) gum_code_pages_unref, NULL);
-    self->free_slices = NULL;
+    bucket = g_slice_new (GumCodeSliceBucket);
+    bucket->slices = NULL;
+    g_hash_table_insert (self->free_slices, key, bucket);
   }
+
+  link = &element->parent;
+  link->prev = NULL;
+  link->next = bucket->slices;
+  if (bucket->slices != NULL)
+    bucket->slices->prev = link;
+  bucket->slices = link;
+}
+
+static void
+gum_code_allocator_drop_free_slices (GumCodeAllocator * self)
+{
+  GHashTableIter iter;
+  GumCodeSliceBucket * bucket;
+
+  g_hash_table_iter_init (&iter, self->free_slices);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &bucket))
+    g_list_foreach (bucket->slices, (GFunc) gum_code_pages_unref, NULL);
+
+  g_hash_table_remove_all (self->free_slices);
+}
+
+static void
+gum_code_allocator_mark_dirty (GumCodeAllocator * self,
+                               GumCodePages * pages)
+{
+  if (pages->dirty)
+    return;
+
+  pages->dirty = TRUE;
+  self->dirty_pages = g_slist_prepend (self->dirty_pages, pages);
 }
 
 static GumCodeSlice *
@@ -247,15 +377,22 @@ gum_code_allocator_try_alloc_batch_near (GumCodeAllocator * self,
   GumCodeSegment * segment;
   gpointer data;
   GumCodePages * pages;
-  guint i;
+  guint num_slices, i;
 
   rwx_supported = gum_query_is_rwx_supported ();
   code_segment_supported = gum_code_segment_is_supported ();
 
   page_size = gum_query_page_size ();
-  size_in_pages = self->pages_per_batch;
+  size_in_pages = gum_code_allocator_compute_batch_pages (self);
   size_in_bytes = size_in_pages * page_size;
-
+  num_slices = size_in_bytes / self->slice_size;
+
+  /*
+   * TODO: Use gum_memory_allocate_dual_mapped() where RWX is not allowed, as
+   *       the Stalker does, so slices can be written through an RW alias and
+   *       reused after being committed. This needs the backends to write
+   *       trampolines through the alias while targeting the RX view.
+   */
   if (rwx_supported || !code_segment_supported)
   {
     GumPageProtection protection;
@@ -286,8 +423,10 @@ gum_code_allocator_try_alloc_batch_near (GumCodeAllocator * self,
     data = gum_code_segment_get_address (segment);
   }
 
-  pages = g_slice_alloc (self->pages_metadata_size);
-  pages->ref_count = self->slices_per_batch;
+  pages = g_slice_alloc (gum_code_pages_compute_metadata_size (num_slices));
+  pages->ref_count = num_slices;
+  pages->dirty = FALSE;
+  pages->num_slices = num_slices;
 
   pages->segment = segment;
   pages->data = data;
@@ -295,42 +434,52 @@ gum_code_allocator_try_alloc_batch_near (GumCodeAllocator * self,
 
   pages->allocator = self;
 
-  for (i = self->slices_per_batch; i != 0; i--)
+  for (i = num_slices; i != 0; i--)
   {
     guint slice_index = i - 1;
     GumCodeSliceElement * element = &pages->elements[slice_index];
-    GList * link;
     GumCodeSlice * slice;
 
     slice = &element->slice;
     slice->data = (guint8 *) data + (slice_index * self->slice_size);
     slice->size = self->slice_size;
 
-    link = &element->parent;
-    link->data = pages;
-    link->prev = NULL;
+    element->parent.data = pages;
     if (slice_index == 0)
     {
-      link->next = NULL;
+      element->parent.prev = NULL;
+      element->parent.next = NULL;
       result = slice;
     }
     else
     {
-      if (self->free_slices != NULL)
-        self->free_slices->prev = link;
-      link->next = self->free_slices;
-      self->free_slices = link;
+      gum_code_allocator_add_free_slice (self, element);
     }
   }
 
   if (!rwx_supported)
     self->uncommitted_pages = g_slist_prepend (self->uncommitted_pages, pages);
 
-  g_hash_table_add (self->dirty_pages, pages);
+  gum_code_allocator_mark_dirty (self, pages);
 
   return result;
 }
 
+static gsize
+gum_code_allocator_compute_batch_pages (GumCodeAllocator * self)
+{
+  gsize page_size, wanted_pages;
+
+  page_size = gum_query_page_size ();
+
+  /* Also make room for the slice being allocated right now. */
+  wanted_pages = GUM_ALIGN_SIZE ((self->batch_slices_left + 1) *
+      self->slice_size, page_size) / page_size;
+
+  return CLAMP (wanted_pages, self->pages_per_batch,
+      GUM_CODE_ALLOCATOR_MAX_PAGES_PER_BATCH);
+}
+
 static void
 gum_code_pages_unref (GumCodePages * self)
 {
@@ -351,10 +500,18 @@ gum_code_pages_unref (GumCodePages * self)
       gum_cloak_remove_range (&range);
     }
 
-    g_slice_free1 (self->allocator->pages_metadata_size, self);
+    g_slice_free1 (gum_code_pages_compute_metadata_size (self->num_slices),
+        self);
   }
 }
 
+static gsize
+gum_code_pages_compute_metadata_size (guint num_slices)
+{
+  return sizeof (GumCodePages) +
+      ((num_slices - 1) * sizeof (GumCodeSliceElement));
+}
+
 void
 gum_code_slice_free (GumCodeSlice * slice)
 {
@@ -369,13 +526,7 @@ gum_code_slice_free (GumCodeSlice * slice)
 
   if (gum_query_is_rwx_supported ())
   {
-    GumCodeAllocator * allocator = pages->allocator;
-    GList * link = &element->parent;
-
-    if (allocator->free_slices != NULL)
-      allocator->free_slices->prev = link;
-    link->next = allocator->free_slices;
-    allocator->free_slices = link;
+    gum_code_allocator_add_free_slice (pages->allocator, element);
   }
   else
   {
@@ -383,6 +534,56 @@ gum_code_slice_free (GumCodeSlice * slice)
   }
 }
 
+static void
+gum_code_slice_bucket_free (GumCodeSliceBucket * bucket)
+{
+  g_slice_free (GumCodeSliceBucket, bucket);
+}
+
+static GumCodeSlice *
+gum_code_slice_bucket_try_take (GumCodeSliceBucket * self,
+                                const GumAddressSpec * spec,
+                                gsize alignment)
+{
+  GList * cur;
+
+  for (cur = self->slices; cur != NULL; cur = cur->next)
+  {
+    GumCodeSliceElement * element = (GumCodeSliceElement *) cur;
+    GumCodeSlice * slice = &element->slice;
+
+    if (gum_code_slice_is_near (slice, spec) &&
+        gum_code_slice_is_aligned (slice, alignment))
+    {
+      self->slices = g_list_remove_link (self->slices, cur);
+
+      return slice;
+    }
+  }
+
+  return NULL;
+}
+
+static gboolean
+gum_code_slice_bucket_is_near (gpointer key,
+                               const GumAddressSpec * spec)
+{
+  gsize near_address, bucket_start, bucket_end;
+
+  near_address = GPOINTER_TO_SIZE (spec->near_address);
+
+  bucket_start = GPOINTER_TO_SIZE (key) << GUM_CODE_SLICE_BUCKET_SHIFT;
+  bucket_end = bucket_start + GUM_CODE_SLICE_BUCKET_SIZE - 1;
+
+  if (near_address < bucket_start)
+    return bucket_start - near_address <= spec->max_distance;
+
+  if (near_address > bucket_end)
+    return near_address - bucket_end <= spec->max_distance;
+
+  return TRUE;
+}
+
 static gboolean
 gum_code_slice_is_near (const GumCodeSlice * self,
                         const GumAddressSpec * spec)
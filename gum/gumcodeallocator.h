@@ -17,12 +17,11 @@ struct _GumCodeAllocator
 {
   gsize slice_size;
   gsize pages_per_batch;
-  gsize slices_per_batch;
-  gsize pages_metadata_size;
+  guint batch_slices_left;
 
   GSList * uncommitted_pages;
-  GHashTable * dirty_pages;
-  GList * free_slices;
+  GSList * dirty_pages;
+  GHashTable * free_slices;
 
   GSList * dispatchers;
 };
@@ -47,6 +46,8 @@ GumCodeSlice * gum_code_allocator_alloc_slice (GumCodeAllocator * self);
 GumCodeSlice * gum_code_allocator_try_alloc_slice_near (GumCodeAllocator * self,
     const GumAddressSpec * spec, gsize alignment);
 void gum_code_allocator_commit (GumCodeAllocator * self);
+void gum_code_allocator_begin_batch (GumCodeAllocator * self, guint n_slices);
+void gum_code_allocator_end_batch (GumCodeAllocator * self);
 void gum_code_slice_free (GumCodeSlice * slice);
 
 GumCodeDeflector * gum_code_allocator_alloc_deflector (GumCodeAllocator * self,
@@ -17,6 +17,13 @@
 typedef struct _GumInterceptorBackend GumInterceptorBackend;
 typedef struct _GumFunctionContext GumFunctionContext;
 typedef struct _GumFunctionContextBackendData GumFunctionContextBackendData;
+typedef struct _GumHookStatsShard GumHookStatsShard;
+
+typedef enum
+{
+  GUM_INTERCEPTOR_TYPE_DEFAULT,
+  GUM_INTERCEPTOR_TYPE_FAST
+} GumInterceptorType;
 
 struct _GumFunctionContextBackendData
 {
@@ -26,6 +33,7 @@ struct _GumFunctionContextBackendData
 struct _GumFunctionContext
 {
   gpointer function_address;
+  GumInterceptorType type;
 
   gboolean destroyed;
   gboolean activated;
@@ -34,6 +42,10 @@ struct _GumFunctionContext
   gpointer grafted_hook;
   gpointer import_target;
 
+  gpointer * import_slot;
+  gpointer import_slot_original;
+  GumPageProtection import_slot_protection;
+
   GumCodeSlice * trampoline_slice;
   GumCodeDeflector * trampoline_deflector;
   volatile gint trampoline_usage_counter;
@@ -53,6 +65,8 @@ struct _GumFunctionContext
 
   GumFunctionContextBackendData backend_data;
 
+  GumHookStatsShard ** volatile stats_blocks;
+
   GumInterceptor * interceptor;
 };
 
@@ -74,6 +88,8 @@ G_GNUC_INTERNAL gboolean _gum_interceptor_backend_claim_grafted_trampoline (
     GumInterceptorBackend * self, GumFunctionContext * ctx);
 G_GNUC_INTERNAL gboolean _gum_interceptor_backend_create_trampoline (
     GumInterceptorBackend * self, GumFunctionContext * ctx);
+G_GNUC_INTERNAL gboolean _gum_interceptor_backend_create_import_trampoline (
+    GumInterceptorBackend * self, GumFunctionContext * ctx);
 G_GNUC_INTERNAL void _gum_interceptor_backend_destroy_trampoline (
     GumInterceptorBackend * self, GumFunctionContext * ctx);
 G_GNUC_INTERNAL void _gum_interceptor_backend_activate_trampoline (
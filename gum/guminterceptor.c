@@ -11,10 +11,13 @@
 #include "guminterceptor-priv.h"
 #include "gumlibc.h"
 #include "gummemory.h"
-#include "gumprocess.h"
+#include "gumprocess-priv.h"
 #include "gumtls.h"
 
 #include <string.h>
+#ifndef HAVE_WINDOWS
+# include <time.h>
+#endif
 
 #ifdef HAVE_MIPS
 #define GUM_INTERCEPTOR_CODE_SLICE_SIZE 1024
@@ -22,13 +25,26 @@
 #define GUM_INTERCEPTOR_CODE_SLICE_SIZE 256
 #endif
 
+#define GUM_INVOCATION_STACK_ALIGNMENT 64
+#define GUM_LISTENER_DATA_SLOTS_PER_CHUNK 4
+#define GUM_HOOK_STATS_SHARDS_PER_BLOCK 16
+#define GUM_HOOK_STATS_MAX_BLOCKS 64
+#define GUM_HOOK_STATS_MAX_SHARDS \
+    (GUM_HOOK_STATS_SHARDS_PER_BLOCK * GUM_HOOK_STATS_MAX_BLOCKS)
+#define GUM_HOOK_STATS_SHARD_ALIGNMENT 64
+#define GUM_HOOK_STATS_NO_SHARD G_MAXUINT
+
 #define GUM_INTERCEPTOR_LOCK(o) g_rec_mutex_lock (&(o)->mutex)
 #define GUM_INTERCEPTOR_UNLOCK(o) g_rec_mutex_unlock (&(o)->mutex)
 
 typedef struct _GumInterceptorTransaction GumInterceptorTransaction;
+typedef struct _GumAttachTarget GumAttachTarget;
+typedef struct _GumFindImportSlotContext GumFindImportSlotContext;
 typedef guint GumInstrumentationError;
 typedef struct _GumDestroyTask GumDestroyTask;
 typedef struct _GumUpdateTask GumUpdateTask;
+typedef struct _GumPatchRange GumPatchRange;
+typedef struct _GumPatchInPlaceContext GumPatchInPlaceContext;
 typedef struct _ListenerEntry ListenerEntry;
 typedef struct _InterceptorThreadContext InterceptorThreadContext;
 typedef struct _GumInvocationStackEntry GumInvocationStackEntry;
@@ -55,20 +71,45 @@ struct _GumInterceptor
   GRecMutex mutex;
 
   GHashTable * function_by_address;
+  GHashTable * import_hook_by_slot;
+
+  GHashTable * thread_data_index_by_listener;
+  GArray * free_thread_data_indices;
+  guint next_thread_data_index;
 
   GumInterceptorBackend * backend;
   GumCodeAllocator allocator;
+  GSList * retired_fast_contexts;
 
   volatile guint selected_thread_id;
 
+  volatile gint stats_enabled;
+  volatile gint thread_suspension_enabled;
+
   GumInterceptorTransaction current_transaction;
 };
 
+struct _GumAttachTarget
+{
+  gpointer address;
+  guint index;
+};
+
+struct _GumFindImportSlotContext
+{
+  const gchar * name;
+  gpointer * slot;
+  gpointer address;
+  gpointer bound_address;
+  GumPageProtection protection;
+};
+
 enum _GumInstrumentationError
 {
   GUM_INSTRUMENTATION_ERROR_NONE,
   GUM_INSTRUMENTATION_ERROR_WRONG_SIGNATURE,
   GUM_INSTRUMENTATION_ERROR_POLICY_VIOLATION,
+  GUM_INSTRUMENTATION_ERROR_WRONG_TYPE,
 };
 
 struct _GumDestroyTask
@@ -84,23 +125,88 @@ struct _GumUpdateTask
   GumUpdateTaskFunc func;
 };
 
+struct _GumPatchRange
+{
+  guint8 * base;
+  gsize size;
+};
+
+struct _GumPatchInPlaceContext
+{
+  GumInterceptorTransaction * transaction;
+  GList * addresses;
+  GArray * ranges;
+  gboolean rwx_supported;
+  gboolean patched;
+};
+
 struct _ListenerEntry
 {
   GumInvocationListenerInterface * listener_interface;
   GumInvocationListener * listener_instance;
   gpointer function_data;
+  guint thread_data_index;
+};
+
+/*
+ * Entries live in a cache-aligned block that is sized for GUM_MAX_CALL_DEPTH
+ * up front, and only gets reallocated for deeper recursion. Pushing does not
+ * clear the entry, listener invocation data is cleared on first use instead.
+ */
+struct _GumInvocationStack
+{
+  GumInvocationStackEntry * entries;
+  guint len;
+  guint capacity;
+  gpointer storage;
+};
+
+/*
+ * Each live thread context owns one shard index, which no other thread uses
+ * until the owner goes away, so the counters can be bumped without atomics
+ * and without hot hooks bouncing a shared cache line around. The shards of a
+ * function are allocated in blocks as threads with higher indices call it.
+ * Threads beyond GUM_HOOK_STATS_MAX_SHARDS are not counted.
+ */
+struct _GumHookStatsShard
+{
+  guint64 enter_count;
+  guint64 leave_count;
+  guint64 bypass_count;
+  guint64 listener_time;
+
+  guint8 padding[32];
 };
 
+struct _ListenerDataSlot
+{
+  GumInvocationListener * owner;
+  guint8 data[GUM_MAX_LISTENER_DATA];
+};
+
+/*
+ * Listener thread data is indexed by the slot index that the interceptor
+ * hands out to each listener when it is first attached, so lookups don't
+ * have to search. Slots live in chunks that are only allocated once the
+ * thread runs into a listener that needs one, so a thread that only ever
+ * calls a few hooked functions doesn't pay for every listener attached. The
+ * first chunk is stored inline.
+ */
 struct _InterceptorThreadContext
 {
   GumInvocationBackend listener_backend;
   GumInvocationBackend replacement_backend;
 
   gint ignore_level;
+  guint stats_shard;
 
-  GumInvocationStack * stack;
+  GumInvocationStack stack;
 
-  GArray * listener_data_slots;
+  ListenerDataSlot ** listener_data_chunks;
+  guint num_listener_data_chunks;
+  ListenerDataSlot * inline_listener_data_chunks[1];
+  ListenerDataSlot inline_listener_data_slots[
+      GUM_LISTENER_DATA_SLOTS_PER_CHUNK];
 };
 
 struct _GumInvocationStackEntry
@@ -109,24 +215,20 @@ struct _GumInvocationStackEntry
   gpointer caller_ret_addr;
   GumInvocationContext invocation_context;
   GumCpuContext cpu_context;
+  guint listener_invocation_data_cleared;
   guint8 listener_invocation_data[GUM_MAX_LISTENERS_PER_FUNCTION]
       [GUM_MAX_LISTENER_DATA];
   gboolean calling_replacement;
   gint original_system_error;
 };
 
-struct _ListenerDataSlot
-{
-  GumInvocationListener * owner;
-  guint8 data[GUM_MAX_LISTENER_DATA];
-};
-
 struct _ListenerInvocationState
 {
   GumPointCut point_cut;
   ListenerEntry * entry;
   InterceptorThreadContext * interceptor_ctx;
-  guint8 * invocation_data;
+  GumInvocationStackEntry * stack_entry;
+  guint listener_index;
 };
 
 static void gum_interceptor_dispose (GObject * object);
@@ -135,8 +237,33 @@ static void gum_interceptor_finalize (GObject * object);
 static void the_interceptor_weak_notify (gpointer data,
     GObject * where_the_object_was);
 
+static GumAttachReturn gum_interceptor_attach_unlocked (GumInterceptor * self,
+    gpointer function_address, GumInvocationListener * listener,
+    gpointer listener_function_data);
+static gint gum_attach_target_compare (const GumAttachTarget * a,
+    const GumAttachTarget * b);
+static gboolean gum_find_import_slot (const GumImportDetails * details,
+    GumFindImportSlotContext * ctx);
+static gboolean gum_inspect_import_slot_range (
+    const GumRangeDetails * details, GumFindImportSlotContext * ctx);
+static GumFunctionContext * gum_interceptor_instrument_import (
+    GumInterceptor * self, const GumFindImportSlotContext * import,
+    GumInstrumentationError * error);
+static void gum_interceptor_release_import_hook (
+    GumFunctionContext * function_ctx);
+static void gum_interceptor_write_import_slot (
+    GumFunctionContext * function_ctx, gpointer value);
+static guint gum_interceptor_obtain_thread_data_index (GumInterceptor * self,
+    GumInvocationListener * listener);
+static gboolean gum_interceptor_release_thread_data_index (
+    GumInterceptor * self, GumInvocationListener * listener, guint * index);
+
+static GumReplaceReturn gum_replace_return_from_instrumentation_error (
+    GumInstrumentationError error);
+
 static GumFunctionContext * gum_interceptor_instrument (GumInterceptor * self,
-    gpointer function_address, GumInstrumentationError * error);
+    GumInterceptorType type, gpointer function_address,
+    gpointer replacement_function, GumInstrumentationError * error);
 static void gum_interceptor_activate (GumInterceptor * self,
     GumFunctionContext * ctx, gpointer prologue);
 static void gum_interceptor_deactivate (GumInterceptor * self,
@@ -156,8 +283,14 @@ static void gum_interceptor_transaction_schedule_update (
     GumInterceptorTransaction * self, GumFunctionContext * ctx,
     GumUpdateTaskFunc func);
 
+static GPtrArray * gum_interceptor_list_function_contexts (
+    GumInterceptor * self);
+static void gum_interceptor_enable_stats_for_function (
+    GumFunctionContext * function_ctx);
+
 static GumFunctionContext * gum_function_context_new (
-    GumInterceptor * interceptor, gpointer function_address);
+    GumInterceptor * interceptor, GumInterceptorType type,
+    gpointer function_address);
 static void gum_function_context_finalize (GumFunctionContext * function_ctx);
 static void gum_function_context_destroy (GumFunctionContext * function_ctx);
 static void gum_function_context_perform_destroy (
@@ -178,6 +311,12 @@ static ListenerEntry ** gum_function_context_find_taken_listener_slot (
     GumFunctionContext * function_ctx);
 static void gum_function_context_fixup_cpu_context (
     GumFunctionContext * function_ctx, GumCpuContext * cpu_context);
+static GumHookStatsShard * gum_function_context_get_stats_shard (
+    GumFunctionContext * function_ctx,
+    InterceptorThreadContext * interceptor_ctx);
+static guint gum_interceptor_acquire_stats_shard (void);
+static void gum_interceptor_release_stats_shard (guint index);
+static guint64 gum_hook_stats_now (void);
 
 static InterceptorThreadContext * get_interceptor_thread_context (void);
 static void release_interceptor_thread_context (
@@ -185,11 +324,19 @@ static void release_interceptor_thread_context (
 static InterceptorThreadContext * interceptor_thread_context_new (void);
 static void interceptor_thread_context_destroy (
     InterceptorThreadContext * context);
+static ListenerDataSlot *
+    interceptor_thread_context_ensure_listener_data_chunk (
+    InterceptorThreadContext * self, guint chunk_index);
 static gpointer interceptor_thread_context_get_listener_data (
-    InterceptorThreadContext * self, GumInvocationListener * listener,
+    InterceptorThreadContext * self, ListenerEntry * entry,
     gsize required_size);
 static void interceptor_thread_context_forget_listener_data (
-    InterceptorThreadContext * self, GumInvocationListener * listener);
+    InterceptorThreadContext * self, GumInvocationListener * listener,
+    guint thread_data_index);
+static void gum_invocation_stack_init (GumInvocationStack * stack);
+static void gum_invocation_stack_destroy (GumInvocationStack * stack);
+static void gum_invocation_stack_reserve (GumInvocationStack * stack,
+    guint capacity);
 static GumInvocationStackEntry * gum_invocation_stack_push (
     GumInvocationStack * stack, GumFunctionContext * function_ctx,
     gpointer caller_ret_addr);
@@ -204,6 +351,17 @@ static gboolean gum_interceptor_has (GumInterceptor * self,
 
 static gpointer gum_page_address_from_pointer (gpointer ptr);
 static gint gum_page_address_compare (gconstpointer a, gconstpointer b);
+static void gum_interceptor_transaction_apply_updates (
+    GumInterceptorTransaction * self, GList * addresses);
+static void gum_patch_in_place (GumPatchInPlaceContext * ctx);
+#ifdef HAVE_LINUX
+static void gum_patch_in_place_with_other_threads_stopped (
+    GumPatchInPlaceContext * ctx);
+static void gum_patch_in_place_once (GumThreadId thread_id,
+    GumCpuContext * cpu_context, gpointer user_data);
+#endif
+static GArray * gum_patch_ranges_from_sorted_pages (GList * pages,
+    gsize page_size);
 
 G_DEFINE_TYPE (GumInterceptor, gum_interceptor, G_TYPE_OBJECT)
 
@@ -215,8 +373,11 @@ static GHashTable * gum_interceptor_thread_contexts;
 static GPrivate gum_interceptor_context_private =
     G_PRIVATE_INIT ((GDestroyNotify) release_interceptor_thread_context);
 static GumTlsKey gum_interceptor_guard_key;
+static GumSpinlock gum_interceptor_stats_shard_lock = GUM_SPINLOCK_INIT;
+static guint32 gum_interceptor_used_stats_shards[
+    GUM_HOOK_STATS_MAX_SHARDS / 32];
 
-static GumInvocationStack _gum_interceptor_empty_stack = { NULL, 0 };
+static GumInvocationStack _gum_interceptor_empty_stack = { NULL, 0, 0, NULL };
 
 static void
 gum_interceptor_class_init (GumInterceptorClass * klass)
@@ -252,6 +413,11 @@ gum_interceptor_init (GumInterceptor * self)
 
   self->function_by_address = g_hash_table_new_full (NULL, NULL, NULL,
       (GDestroyNotify) gum_function_context_destroy);
+  self->import_hook_by_slot = g_hash_table_new_full (NULL, NULL, NULL,
+      (GDestroyNotify) gum_interceptor_release_import_hook);
+
+  self->thread_data_index_by_listener = g_hash_table_new (NULL, NULL);
+  self->free_thread_data_indices = g_array_new (FALSE, FALSE, sizeof (guint));
 
   gum_code_allocator_init (&self->allocator, GUM_INTERCEPTOR_CODE_SLICE_SIZE);
 
@@ -267,6 +433,7 @@ gum_interceptor_dispose (GObject * object)
   gum_interceptor_transaction_begin (&self->current_transaction);
   self->current_transaction.is_dirty = TRUE;
 
+  g_hash_table_remove_all (self->import_hook_by_slot);
   g_hash_table_remove_all (self->function_by_address);
 
   gum_interceptor_transaction_end (&self->current_transaction);
@@ -282,13 +449,20 @@ gum_interceptor_finalize (GObject * object)
 
   gum_interceptor_transaction_destroy (&self->current_transaction);
 
+  g_slist_free_full (self->retired_fast_contexts,
+      (GDestroyNotify) gum_function_context_perform_destroy);
+
   if (self->backend != NULL)
     _gum_interceptor_backend_destroy (self->backend);
 
   g_rec_mutex_clear (&self->mutex);
 
+  g_hash_table_unref (self->import_hook_by_slot);
   g_hash_table_unref (self->function_by_address);
 
+  g_array_free (self->free_thread_data_indices, TRUE);
+  g_hash_table_unref (self->thread_data_index_by_listener);
+
   gum_code_allocator_free (&self->allocator);
 
   G_OBJECT_CLASS (gum_interceptor_parent_class)->finalize (object);
@@ -337,18 +511,100 @@ gum_interceptor_attach (GumInterceptor * self,
                         GumInvocationListener * listener,
                         gpointer listener_function_data)
 {
-  GumAttachReturn result = GUM_ATTACH_OK;
-  GumFunctionContext * function_ctx;
-  GumInstrumentationError error;
+  GumAttachReturn result;
 
   gum_interceptor_ignore_current_thread (self);
   GUM_INTERCEPTOR_LOCK (self);
   gum_interceptor_transaction_begin (&self->current_transaction);
   self->current_transaction.is_dirty = TRUE;
 
+  result = gum_interceptor_attach_unlocked (self, function_address, listener,
+      listener_function_data);
+
+  gum_interceptor_transaction_end (&self->current_transaction);
+  GUM_INTERCEPTOR_UNLOCK (self);
+  gum_interceptor_unignore_current_thread (self);
+
+  return result;
+}
+
+/*
+ * Attaches the listener to all of the given functions while holding the lock
+ * once, and within a single transaction, so that all of the patching happens
+ * in one go when it ends. Functions are instrumented in address order, which
+ * keeps neighbouring functions on the same pages and lets their trampolines
+ * share the code pages that were allocated near them. Those are allocated
+ * with room for the trampolines still to come, rather than a few pages at a
+ * time.
+ */
+guint
+gum_interceptor_attach_many (GumInterceptor * self,
+                             const gpointer * function_addresses,
+                             guint n_functions,
+                             GumInvocationListener * listener,
+                             gpointer listener_function_data,
+                             GumAttachReturn * results)
+{
+  guint num_attached = 0;
+  GArray * targets;
+  guint i;
+
+  targets = g_array_sized_new (FALSE, FALSE, sizeof (GumAttachTarget),
+      n_functions);
+  for (i = 0; i != n_functions; i++)
+  {
+    GumAttachTarget target;
+
+    target.address = gum_strip_code_pointer (function_addresses[i]);
+    target.index = i;
+
+    g_array_append_val (targets, target);
+  }
+  g_array_sort (targets, (GCompareFunc) gum_attach_target_compare);
+
+  gum_interceptor_ignore_current_thread (self);
+  GUM_INTERCEPTOR_LOCK (self);
+  gum_interceptor_transaction_begin (&self->current_transaction);
+  self->current_transaction.is_dirty = TRUE;
+  gum_code_allocator_begin_batch (&self->allocator, n_functions);
+
+  for (i = 0; i != n_functions; i++)
+  {
+    GumAttachTarget * target = &g_array_index (targets, GumAttachTarget, i);
+    GumAttachReturn result;
+
+    result = gum_interceptor_attach_unlocked (self, target->address, listener,
+        listener_function_data);
+    if (result == GUM_ATTACH_OK)
+      num_attached++;
+
+    if (results != NULL)
+      results[target->index] = result;
+  }
+
+  gum_code_allocator_end_batch (&self->allocator);
+  gum_interceptor_transaction_end (&self->current_transaction);
+  GUM_INTERCEPTOR_UNLOCK (self);
+  gum_interceptor_unignore_current_thread (self);
+
+  g_array_free (targets, TRUE);
+
+  return num_attached;
+}
+
+static GumAttachReturn
+gum_interceptor_attach_unlocked (GumInterceptor * self,
+                                 gpointer function_address,
+                                 GumInvocationListener * listener,
+                                 gpointer listener_function_data)
+{
+  GumFunctionContext * function_ctx;
+  GumInstrumentationError error;
+
   function_address = gum_interceptor_resolve (self, function_address);
 
-  function_ctx = gum_interceptor_instrument (self, function_address, &error);
+  function_ctx = gum_interceptor_instrument (self, GUM_INTERCEPTOR_TYPE_DEFAULT,
+      function_address, NULL, &error);
   if (function_ctx == NULL)
     goto instrumentation_error;
 
@@ -358,36 +614,291 @@ gum_interceptor_attach (GumInterceptor * self,
   gum_function_context_add_listener (function_ctx, listener,
       listener_function_data);
 
-  goto beach;
+  return GUM_ATTACH_OK;
 
 instrumentation_error:
   {
     switch (error)
     {
       case GUM_INSTRUMENTATION_ERROR_WRONG_SIGNATURE:
-        result = GUM_ATTACH_WRONG_SIGNATURE;
-        break;
+        return GUM_ATTACH_WRONG_SIGNATURE;
       case GUM_INSTRUMENTATION_ERROR_POLICY_VIOLATION:
-        result = GUM_ATTACH_POLICY_VIOLATION;
-        break;
+        return GUM_ATTACH_POLICY_VIOLATION;
+      case GUM_INSTRUMENTATION_ERROR_WRONG_TYPE:
+        return GUM_ATTACH_WRONG_TYPE;
       default:
         g_assert_not_reached ();
     }
-    goto beach;
   }
 already_attached:
+  {
+    return GUM_ATTACH_ALREADY_ATTACHED;
+  }
+}
+
+static gint
+gum_attach_target_compare (const GumAttachTarget * a,
+                           const GumAttachTarget * b)
+{
+  if (a->address < b->address)
+    return -1;
+  if (a->address > b->address)
+    return 1;
+  return (gint) a->index - (gint) b->index;
+}
+
+/*
+ * Hooks calls that go through one module's GOT/PLT slot for the given import,
+ * leaving the imported function itself untouched. The slot is pointed at the
+ * hook's trampoline, which calls straight through to the function the slot
+ * was bound to, so other callers of the function are not affected and its
+ * prologue doesn't need to be relocatable.
+ */
+GumAttachReturn
+gum_interceptor_attach_import (GumInterceptor * self,
+                               const gchar * module_name,
+                               const gchar * import_name,
+                               GumInvocationListener * listener,
+                               gpointer listener_function_data)
+{
+  GumAttachReturn result = GUM_ATTACH_OK;
+  GumFindImportSlotContext import;
+  GumFunctionContext * function_ctx;
+  GumInstrumentationError error;
+
+  import.name = import_name;
+  import.slot = NULL;
+  import.address = NULL;
+  import.bound_address = NULL;
+  import.protection = GUM_PAGE_READ;
+
+  gum_module_enumerate_imports (module_name,
+      (GumFoundImportFunc) gum_find_import_slot, &import);
+  if (import.slot == NULL || import.address == NULL)
+    return GUM_ATTACH_NOT_FOUND;
+
+  gum_module_enumerate_ranges (module_name, GUM_PAGE_READ,
+      (GumFoundRangeFunc) gum_inspect_import_slot_range, &import);
+
+  /*
+   * The resolved address comes from a global lookup, which may pick a
+   * different definition than the one this module is bound to. Once the slot
+   * has been bound, what it points to is the function that its callers
+   * actually reach.
+   */
+  if (import.bound_address != NULL)
+    import.address = import.bound_address;
+
+  gum_interceptor_ignore_current_thread (self);
+  GUM_INTERCEPTOR_LOCK (self);
+  gum_interceptor_transaction_begin (&self->current_transaction);
+  self->current_transaction.is_dirty = TRUE;
+
+  function_ctx = g_hash_table_lookup (self->import_hook_by_slot, import.slot);
+  if (function_ctx == NULL)
+  {
+    function_ctx = gum_interceptor_instrument_import (self, &import, &error);
+    if (function_ctx == NULL)
+    {
+      result = (error == GUM_INSTRUMENTATION_ERROR_POLICY_VIOLATION)
+          ? GUM_ATTACH_POLICY_VIOLATION
+          : GUM_ATTACH_WRONG_SIGNATURE;
+      goto beach;
+    }
+  }
+
+  if (gum_function_context_has_listener (function_ctx, listener))
   {
     result = GUM_ATTACH_ALREADY_ATTACHED;
     goto beach;
   }
+
+  gum_function_context_add_listener (function_ctx, listener,
+      listener_function_data);
+
 beach:
+  gum_interceptor_transaction_end (&self->current_transaction);
+  GUM_INTERCEPTOR_UNLOCK (self);
+  gum_interceptor_unignore_current_thread (self);
+
+  return result;
+}
+
+static gboolean
+gum_find_import_slot (const GumImportDetails * details,
+                      GumFindImportSlotContext * ctx)
+{
+  if (details->type != GUM_IMPORT_FUNCTION ||
+      strcmp (details->name, ctx->name) != 0)
+    return TRUE;
+
+  ctx->slot = GSIZE_TO_POINTER (details->slot);
+  ctx->address = GSIZE_TO_POINTER (
+      gum_strip_code_address (details->address));
+  if (ctx->slot != NULL)
+    ctx->bound_address = gum_strip_code_pointer (*ctx->slot);
+
+  return FALSE;
+}
+
+static gboolean
+gum_inspect_import_slot_range (const GumRangeDetails * details,
+                               GumFindImportSlotContext * ctx)
+{
+  if (GUM_MEMORY_RANGE_INCLUDES (details->range, GUM_ADDRESS (ctx->slot)))
+    ctx->protection = details->protection;
+
+  /* A lazily bound slot still points back into the module's own PLT. */
+  if (GUM_MEMORY_RANGE_INCLUDES (details->range,
+      GUM_ADDRESS (ctx->bound_address)))
   {
-    gum_interceptor_transaction_end (&self->current_transaction);
-    GUM_INTERCEPTOR_UNLOCK (self);
-    gum_interceptor_unignore_current_thread (self);
+    ctx->bound_address = NULL;
+  }
 
-    return result;
+  return TRUE;
+}
+
+static GumFunctionContext *
+gum_interceptor_instrument_import (GumInterceptor * self,
+                                   const GumFindImportSlotContext * import,
+                                   GumInstrumentationError * error)
+{
+  GumFunctionContext * ctx;
+
+  *error = GUM_INSTRUMENTATION_ERROR_NONE;
+
+  if (gum_process_get_code_signing_policy () == GUM_CODE_SIGNING_REQUIRED)
+  {
+    *error = GUM_INSTRUMENTATION_ERROR_POLICY_VIOLATION;
+    return NULL;
+  }
+
+  if (self->backend == NULL)
+  {
+    self->backend =
+        _gum_interceptor_backend_create (&self->mutex, &self->allocator);
   }
+
+  ctx = gum_function_context_new (self, GUM_INTERCEPTOR_TYPE_DEFAULT,
+      import->address);
+
+  if (g_atomic_int_get (&self->stats_enabled))
+    gum_interceptor_enable_stats_for_function (ctx);
+
+  if (!_gum_interceptor_backend_create_import_trampoline (self->backend, ctx))
+  {
+    gum_function_context_finalize (ctx);
+
+    *error = GUM_INSTRUMENTATION_ERROR_WRONG_SIGNATURE;
+    return NULL;
+  }
+
+  ctx->import_slot = import->slot;
+  ctx->import_slot_original = *import->slot;
+  ctx->import_slot_protection = import->protection;
+
+  g_hash_table_insert (self->import_hook_by_slot, import->slot, ctx);
+
+  /*
+   * The trampoline must be executable before anyone can reach it through
+   * the slot, so commit it right away instead of waiting for the end of the
+   * transaction. The callee's code is never written to.
+   */
+  gum_code_allocator_commit (&self->allocator);
+
+  gum_interceptor_write_import_slot (ctx,
+      gum_sign_code_pointer (ctx->on_enter_trampoline));
+
+  return ctx;
+}
+
+static void
+gum_interceptor_release_import_hook (GumFunctionContext * function_ctx)
+{
+  gum_interceptor_write_import_slot (function_ctx,
+      function_ctx->import_slot_original);
+
+  gum_function_context_destroy (function_ctx);
+}
+
+static void
+gum_interceptor_write_import_slot (GumFunctionContext * function_ctx,
+                                   gpointer value)
+{
+  gpointer * slot = function_ctx->import_slot;
+  GumPageProtection protection = function_ctx->import_slot_protection;
+  gboolean writable;
+  gpointer page;
+  guint page_size;
+
+  writable = (protection & GUM_PAGE_WRITE) != 0;
+  page = gum_page_address_from_pointer (slot);
+  page_size = gum_query_page_size ();
+
+  if (!writable)
+    gum_mprotect (page, page_size, protection | GUM_PAGE_WRITE);
+
+  g_atomic_pointer_set (slot, value);
+
+  if (!writable)
+    gum_mprotect (page, page_size, protection);
+}
+
+static guint
+gum_interceptor_obtain_thread_data_index (GumInterceptor * self,
+                                          GumInvocationListener * listener)
+{
+  gpointer value;
+  guint index;
+
+  value = g_hash_table_lookup (self->thread_data_index_by_listener, listener);
+  if (value != NULL)
+    return GPOINTER_TO_UINT (value) - 1;
+
+  if (self->free_thread_data_indices->len != 0)
+  {
+    GArray * free_indices = self->free_thread_data_indices;
+    guint i, lowest = 0;
+
+    /* Reuse the lowest index so threads touch as few chunks as possible. */
+    for (i = 1; i != free_indices->len; i++)
+    {
+      if (g_array_index (free_indices, guint, i) <
+          g_array_index (free_indices, guint, lowest))
+        lowest = i;
+    }
+
+    index = g_array_index (free_indices, guint, lowest);
+    g_array_remove_index_fast (free_indices, lowest);
+  }
+  else
+  {
+    index = self->next_thread_data_index++;
+  }
+
+  g_hash_table_insert (self->thread_data_index_by_listener, listener,
+      GUINT_TO_POINTER (index + 1));
+
+  return index;
+}
+
+static gboolean
+gum_interceptor_release_thread_data_index (GumInterceptor * self,
+                                           GumInvocationListener * listener,
+                                           guint * index)
+{
+  gpointer value;
+
+  value = g_hash_table_lookup (self->thread_data_index_by_listener, listener);
+  if (value == NULL)
+    return FALSE;
+
+  *index = GPOINTER_TO_UINT (value) - 1;
+
+  g_hash_table_remove (self->thread_data_index_by_listener, listener);
+  g_array_append_val (self->free_thread_data_indices, *index);
+
+  return TRUE;
 }
 
 void
@@ -396,6 +907,7 @@ gum_interceptor_detach (GumInterceptor * self,
 {
   GHashTableIter iter;
   GumFunctionContext * function_ctx;
+  guint thread_data_index;
   InterceptorThreadContext * thread_ctx;
 
   gum_interceptor_ignore_current_thread (self);
@@ -420,11 +932,35 @@ gum_interceptor_detach (GumInterceptor * self,
     }
   }
 
-  gum_spinlock_acquire (&gum_interceptor_thread_context_lock);
-  g_hash_table_iter_init (&iter, gum_interceptor_thread_contexts);
-  while (g_hash_table_iter_next (&iter, (gpointer *) &thread_ctx, NULL))
-    interceptor_thread_context_forget_listener_data (thread_ctx, listener);
-  gum_spinlock_release (&gum_interceptor_thread_context_lock);
+  g_hash_table_iter_init (&iter, self->import_hook_by_slot);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &function_ctx))
+  {
+    if (gum_function_context_has_listener (function_ctx, listener))
+    {
+      gum_function_context_remove_listener (function_ctx, listener);
+
+      gum_interceptor_transaction_schedule_destroy (&self->current_transaction,
+          function_ctx, g_object_unref, g_object_ref (listener));
+
+      if (gum_function_context_is_empty (function_ctx))
+      {
+        g_hash_table_iter_remove (&iter);
+      }
+    }
+  }
+
+  if (gum_interceptor_release_thread_data_index (self, listener,
+      &thread_data_index))
+  {
+    gum_spinlock_acquire (&gum_interceptor_thread_context_lock);
+    g_hash_table_iter_init (&iter, gum_interceptor_thread_contexts);
+    while (g_hash_table_iter_next (&iter, (gpointer *) &thread_ctx, NULL))
+    {
+      interceptor_thread_context_forget_listener_data (thread_ctx, listener,
+          thread_data_index);
+    }
+    gum_spinlock_release (&gum_interceptor_thread_context_lock);
+  }
 
   gum_interceptor_transaction_end (&self->current_transaction);
   GUM_INTERCEPTOR_UNLOCK (self);
@@ -447,7 +983,8 @@ gum_interceptor_replace (GumInterceptor * self,
 
   function_address = gum_interceptor_resolve (self, function_address);
 
-  function_ctx = gum_interceptor_instrument (self, function_address, &error);
+  function_ctx = gum_interceptor_instrument (self, GUM_INTERCEPTOR_TYPE_DEFAULT,
+      function_address, NULL, &error);
   if (function_ctx == NULL)
     goto instrumentation_error;
 
@@ -461,17 +998,73 @@ gum_interceptor_replace (GumInterceptor * self,
 
 instrumentation_error:
   {
-    switch (error)
-    {
-      case GUM_INSTRUMENTATION_ERROR_WRONG_SIGNATURE:
-        result = GUM_REPLACE_WRONG_SIGNATURE;
-        break;
-      case GUM_INSTRUMENTATION_ERROR_POLICY_VIOLATION:
-        result = GUM_REPLACE_POLICY_VIOLATION;
-        break;
-      default:
-        g_assert_not_reached ();
-    }
+    result = gum_replace_return_from_instrumentation_error (error);
+    goto beach;
+  }
+already_replaced:
+  {
+    result = GUM_REPLACE_ALREADY_REPLACED;
+    goto beach;
+  }
+beach:
+  {
+    gum_interceptor_transaction_end (&self->current_transaction);
+    GUM_INTERCEPTOR_UNLOCK (self);
+
+    return result;
+  }
+}
+
+/*
+ * Replaces the function by patching its prologue with a branch that ends up
+ * straight in the replacement, without going through the invocation machinery.
+ * This keeps the overhead of a replaced function close to that of a plain
+ * call, at the cost of the replacement not having access to an invocation
+ * context, i.e. gum_interceptor_get_current_invocation() will not reflect it,
+ * and listeners cannot be attached to the same function.
+ *
+ * The original implementation remains callable through the pointer stored in
+ * original_function, once the current transaction has ended.
+ *
+ * As no thread is accounted for while inside the replacement, reverting only
+ * restores the prologue: the trampoline backing original_function is kept
+ * alive until the interceptor is destroyed. Callers must still make sure that
+ * no thread is executing the replacement itself before unloading it.
+ */
+GumReplaceReturn
+gum_interceptor_replace_fast (GumInterceptor * self,
+                              gpointer function_address,
+                              gpointer replacement_function,
+                              gpointer * original_function)
+{
+  GumReplaceReturn result = GUM_REPLACE_OK;
+  GumFunctionContext * function_ctx;
+  GumInstrumentationError error;
+
+  GUM_INTERCEPTOR_LOCK (self);
+  gum_interceptor_transaction_begin (&self->current_transaction);
+  self->current_transaction.is_dirty = TRUE;
+
+  function_address = gum_interceptor_resolve (self, function_address);
+
+  function_ctx = (GumFunctionContext *) g_hash_table_lookup (
+      self->function_by_address, function_address);
+  if (function_ctx != NULL && function_ctx->type == GUM_INTERCEPTOR_TYPE_FAST)
+    goto already_replaced;
+
+  function_ctx = gum_interceptor_instrument (self, GUM_INTERCEPTOR_TYPE_FAST,
+      function_address, replacement_function, &error);
+  if (function_ctx == NULL)
+    goto instrumentation_error;
+
+  if (original_function != NULL)
+    *original_function = function_ctx->on_invoke_trampoline;
+
+  goto beach;
+
+instrumentation_error:
+  {
+    result = gum_replace_return_from_instrumentation_error (error);
     goto beach;
   }
 already_replaced:
@@ -488,6 +1081,24 @@ beach:
   }
 }
 
+static GumReplaceReturn
+gum_replace_return_from_instrumentation_error (GumInstrumentationError error)
+{
+  switch (error)
+  {
+    case GUM_INSTRUMENTATION_ERROR_WRONG_SIGNATURE:
+      return GUM_REPLACE_WRONG_SIGNATURE;
+    case GUM_INSTRUMENTATION_ERROR_POLICY_VIOLATION:
+      return GUM_REPLACE_POLICY_VIOLATION;
+    case GUM_INSTRUMENTATION_ERROR_WRONG_TYPE:
+      return GUM_REPLACE_WRONG_TYPE;
+    default:
+      g_assert_not_reached ();
+  }
+
+  return GUM_REPLACE_WRONG_SIGNATURE;
+}
+
 void
 gum_interceptor_revert (GumInterceptor * self,
                         gpointer function_address)
@@ -555,6 +1166,195 @@ gum_interceptor_flush (GumInterceptor * self)
   return flushed;
 }
 
+/*
+ * Lets callers that end and begin a transaction to synchronize with the
+ * instrumentation they just did skip doing so when there is nothing to apply.
+ * No lock is taken: changes made by the calling thread are always visible to
+ * it, and those made by other threads are theirs to apply.
+ */
+gboolean
+gum_interceptor_has_pending_changes (GumInterceptor * self)
+{
+  return g_atomic_int_get (&self->current_transaction.is_dirty);
+}
+
+void
+gum_interceptor_set_stats_enabled (GumInterceptor * self,
+                                   gboolean enabled)
+{
+  GUM_INTERCEPTOR_LOCK (self);
+
+  if (enabled)
+  {
+    GPtrArray * contexts;
+    guint i;
+
+    contexts = gum_interceptor_list_function_contexts (self);
+    for (i = 0; i != contexts->len; i++)
+    {
+      gum_interceptor_enable_stats_for_function (
+          g_ptr_array_index (contexts, i));
+    }
+    g_ptr_array_unref (contexts);
+  }
+
+  g_atomic_int_set (&self->stats_enabled, enabled);
+
+  GUM_INTERCEPTOR_UNLOCK (self);
+}
+
+gboolean
+gum_interceptor_get_stats_enabled (GumInterceptor * self)
+{
+  return g_atomic_int_get (&self->stats_enabled);
+}
+
+/*
+ * When enabled, other threads are stopped once for the whole commit of each
+ * transaction that patches code in place, instead of racing the patching.
+ * Only supported on Linux, this is a no-op elsewhere.
+ */
+void
+gum_interceptor_set_thread_suspension_enabled (GumInterceptor * self,
+                                               gboolean enabled)
+{
+  g_atomic_int_set (&self->thread_suspension_enabled, enabled);
+}
+
+gboolean
+gum_interceptor_get_thread_suspension_enabled (GumInterceptor * self)
+{
+  return g_atomic_int_get (&self->thread_suspension_enabled);
+}
+
+void
+gum_interceptor_enumerate_stats (GumInterceptor * self,
+                                 GumFoundHookStatsFunc func,
+                                 gpointer user_data)
+{
+  GArray * all_stats;
+  GPtrArray * contexts;
+  guint i, j;
+
+  all_stats = g_array_new (FALSE, FALSE, sizeof (GumHookStats));
+
+  GUM_INTERCEPTOR_LOCK (self);
+
+  contexts = gum_interceptor_list_function_contexts (self);
+  for (j = 0; j != contexts->len; j++)
+  {
+    GumFunctionContext * function_ctx = g_ptr_array_index (contexts, j);
+    GumHookStatsShard ** blocks;
+    GumHookStats stats;
+
+    blocks = function_ctx->stats_blocks;
+    if (blocks == NULL)
+      continue;
+
+    stats.function_address = function_ctx->function_address;
+    stats.enter_count = 0;
+    stats.leave_count = 0;
+    stats.bypass_count = 0;
+    stats.listener_time = 0;
+
+    for (i = 0; i != GUM_HOOK_STATS_MAX_SHARDS; i++)
+    {
+      GumHookStatsShard * block, * shard;
+
+      block = g_atomic_pointer_get (
+          &blocks[i / GUM_HOOK_STATS_SHARDS_PER_BLOCK]);
+      if (block == NULL)
+        continue;
+      shard = &block[i % GUM_HOOK_STATS_SHARDS_PER_BLOCK];
+
+      stats.enter_count += shard->enter_count;
+      stats.leave_count += shard->leave_count;
+      stats.bypass_count += shard->bypass_count;
+      stats.listener_time += shard->listener_time;
+    }
+
+    g_array_append_val (all_stats, stats);
+  }
+
+  g_ptr_array_unref (contexts);
+
+  GUM_INTERCEPTOR_UNLOCK (self);
+
+  for (i = 0; i != all_stats->len; i++)
+  {
+    if (!func (&g_array_index (all_stats, GumHookStats, i), user_data))
+      break;
+  }
+
+  g_array_free (all_stats, TRUE);
+}
+
+void
+gum_interceptor_reset_stats (GumInterceptor * self)
+{
+  GPtrArray * contexts;
+  guint i;
+
+  GUM_INTERCEPTOR_LOCK (self);
+
+  contexts = gum_interceptor_list_function_contexts (self);
+  for (i = 0; i != contexts->len; i++)
+  {
+    GumFunctionContext * function_ctx = g_ptr_array_index (contexts, i);
+    GumHookStatsShard ** blocks = function_ctx->stats_blocks;
+    guint j;
+
+    if (blocks == NULL)
+      continue;
+
+    for (j = 0; j != GUM_HOOK_STATS_MAX_BLOCKS; j++)
+    {
+      GumHookStatsShard * block = g_atomic_pointer_get (&blocks[j]);
+
+      if (block != NULL)
+      {
+        gum_memset (block, 0,
+            GUM_HOOK_STATS_SHARDS_PER_BLOCK * sizeof (GumHookStatsShard));
+      }
+    }
+  }
+  g_ptr_array_unref (contexts);
+
+  GUM_INTERCEPTOR_UNLOCK (self);
+}
+
+static GPtrArray *
+gum_interceptor_list_function_contexts (GumInterceptor * self)
+{
+  GPtrArray * contexts;
+  GHashTableIter iter;
+  gpointer function_ctx;
+
+  contexts = g_ptr_array_sized_new (g_hash_table_size (
+      self->function_by_address) + g_hash_table_size (
+      self->import_hook_by_slot));
+
+  g_hash_table_iter_init (&iter, self->function_by_address);
+  while (g_hash_table_iter_next (&iter, NULL, &function_ctx))
+    g_ptr_array_add (contexts, function_ctx);
+
+  g_hash_table_iter_init (&iter, self->import_hook_by_slot);
+  while (g_hash_table_iter_next (&iter, NULL, &function_ctx))
+    g_ptr_array_add (contexts, function_ctx);
+
+  return contexts;
+}
+
+static void
+gum_interceptor_enable_stats_for_function (GumFunctionContext * function_ctx)
+{
+  if (function_ctx->stats_blocks != NULL)
+    return;
+
+  g_atomic_pointer_set (&function_ctx->stats_blocks,
+      g_new0 (GumHookStatsShard *, GUM_HOOK_STATS_MAX_BLOCKS));
+}
+
 GumInvocationContext *
 gum_interceptor_get_current_invocation (void)
 {
@@ -562,7 +1362,7 @@ gum_interceptor_get_current_invocation (void)
   GumInvocationStackEntry * entry;
 
   interceptor_ctx = get_interceptor_thread_context ();
-  entry = gum_invocation_stack_peek_top (interceptor_ctx->stack);
+  entry = gum_invocation_stack_peek_top (&interceptor_ctx->stack);
   if (entry == NULL)
     return NULL;
 
@@ -578,7 +1378,7 @@ gum_interceptor_get_current_stack (void)
   if (context == NULL)
     return &_gum_interceptor_empty_stack;
 
-  return context->stack;
+  return &context->stack;
 }
 
 void
@@ -620,9 +1420,8 @@ gum_invocation_stack_translate (GumInvocationStack * self,
 
   for (i = 0; i != self->len; i++)
   {
-    GumInvocationStackEntry * entry;
+    GumInvocationStackEntry * entry = &self->entries[i];
 
-    entry = &g_array_index (self, GumInvocationStackEntry, i);
     if (entry->function_ctx->on_leave_trampoline == return_address)
       return entry->caller_ret_addr;
   }
@@ -651,14 +1450,12 @@ gum_interceptor_restore (GumInvocationState * state)
 
   for (i = old_depth; i != new_depth; i++)
   {
-    GumInvocationStackEntry * entry;
-
-    entry = &g_array_index (stack, GumInvocationStackEntry, i);
+    GumInvocationStackEntry * entry = &stack->entries[i];
 
     g_atomic_int_dec_and_test (&entry->function_ctx->trampoline_usage_counter);
   }
 
-  g_array_set_size (stack, old_depth);
+  stack->len = old_depth;
 }
 
 gpointer
@@ -671,7 +1468,7 @@ _gum_interceptor_peek_top_caller_return_address (void)
   if (stack->len == 0)
     return NULL;
 
-  entry = &g_array_index (stack, GumInvocationStackEntry, stack->len - 1);
+  entry = &stack->entries[stack->len - 1];
 
   return entry->caller_ret_addr;
 }
@@ -686,7 +1483,7 @@ _gum_interceptor_translate_top_return_address (gpointer return_address)
   if (stack->len == 0)
     goto fallback;
 
-  entry = &g_array_index (stack, GumInvocationStackEntry, stack->len - 1);
+  entry = &stack->entries[stack->len - 1];
   if (entry->function_ctx->on_leave_trampoline != return_address)
     goto fallback;
 
@@ -696,9 +1493,15 @@ fallback:
   return return_address;
 }
 
+/*
+ * Fast replacements have their replacement baked into the trampoline, so it
+ * has to be known up front. It is ignored for the default type.
+ */
 static GumFunctionContext *
 gum_interceptor_instrument (GumInterceptor * self,
+                            GumInterceptorType type,
                             gpointer function_address,
+                            gpointer replacement_function,
                             GumInstrumentationError * error)
 {
   GumFunctionContext * ctx;
@@ -708,7 +1511,11 @@ gum_interceptor_instrument (GumInterceptor * self,
   ctx = (GumFunctionContext *) g_hash_table_lookup (self->function_by_address,
       function_address);
   if (ctx != NULL)
+  {
+    if (ctx->type != type)
+      goto wrong_type;
     return ctx;
+  }
 
   if (self->backend == NULL)
   {
@@ -716,11 +1523,18 @@ gum_interceptor_instrument (GumInterceptor * self,
         _gum_interceptor_backend_create (&self->mutex, &self->allocator);
   }
 
-  ctx = gum_function_context_new (self, function_address);
+  ctx = gum_function_context_new (self, type, function_address);
+
+  if (type == GUM_INTERCEPTOR_TYPE_FAST)
+    ctx->replacement_function = replacement_function;
+
+  if (g_atomic_int_get (&self->stats_enabled))
+    gum_interceptor_enable_stats_for_function (ctx);
 
   if (gum_process_get_code_signing_policy () == GUM_CODE_SIGNING_REQUIRED)
   {
-    if (!_gum_interceptor_backend_claim_grafted_trampoline (self->backend, ctx))
+    if (type == GUM_INTERCEPTOR_TYPE_FAST ||
+        !_gum_interceptor_backend_claim_grafted_trampoline (self->backend, ctx))
       goto policy_violation;
   }
   else
@@ -746,6 +1560,11 @@ wrong_signature:
     *error = GUM_INSTRUMENTATION_ERROR_WRONG_SIGNATURE;
     goto propagate_error;
   }
+wrong_type:
+  {
+    *error = GUM_INSTRUMENTATION_ERROR_WRONG_TYPE;
+    return NULL;
+  }
 propagate_error:
   {
     gum_function_context_finalize (ctx);
@@ -852,86 +1671,39 @@ gum_interceptor_transaction_end (GumInterceptorTransaction * self)
 
   if (gum_process_get_code_signing_policy () == GUM_CODE_SIGNING_REQUIRED)
   {
-    for (cur = addresses; cur != NULL; cur = cur->next)
-    {
-      gpointer target_page = cur->data;
-      GArray * pending;
-      guint i;
-
-      pending = g_hash_table_lookup (self->pending_update_tasks, target_page);
-      g_assert (pending != NULL);
-
-      for (i = 0; i != pending->len; i++)
-      {
-        GumUpdateTask * update;
-
-        update = &g_array_index (pending, GumUpdateTask, i);
-
-        update->func (interceptor, update->ctx,
-            _gum_interceptor_backend_get_function_address (update->ctx));
-      }
-    }
+    gum_interceptor_transaction_apply_updates (self, addresses);
   }
   else
   {
     guint page_size;
     gboolean rwx_supported, code_segment_supported;
+    GArray * ranges;
+    guint range_index;
 
     page_size = gum_query_page_size ();
 
     rwx_supported = gum_query_is_rwx_supported ();
     code_segment_supported = gum_code_segment_is_supported ();
 
+    ranges = gum_patch_ranges_from_sorted_pages (addresses, page_size);
+
     if (rwx_supported || !code_segment_supported)
     {
-      GumPageProtection protection;
-
-      protection = rwx_supported ? GUM_PAGE_RWX : GUM_PAGE_RW;
-
-      for (cur = addresses; cur != NULL; cur = cur->next)
-      {
-        gpointer target_page = cur->data;
-
-        gum_mprotect (target_page, page_size, protection);
-      }
-
-      for (cur = addresses; cur != NULL; cur = cur->next)
-      {
-        gpointer target_page = cur->data;
-        GArray * pending;
-        guint i;
-
-        pending = g_hash_table_lookup (self->pending_update_tasks,
-            target_page);
-        g_assert (pending != NULL);
-
-        for (i = 0; i != pending->len; i++)
-        {
-          GumUpdateTask * update;
-
-          update = &g_array_index (pending, GumUpdateTask, i);
-
-          update->func (interceptor, update->ctx,
-              _gum_interceptor_backend_get_function_address (update->ctx));
-        }
-      }
+      GumPatchInPlaceContext patch;
 
-      if (!rwx_supported)
-      {
-        for (cur = addresses; cur != NULL; cur = cur->next)
-        {
-          gpointer target_page = cur->data;
-
-          gum_mprotect (target_page, page_size, GUM_PAGE_RX);
-        }
-      }
+      patch.transaction = self;
+      patch.addresses = addresses;
+      patch.ranges = ranges;
+      patch.rwx_supported = rwx_supported;
+      patch.patched = FALSE;
 
-      for (cur = addresses; cur != NULL; cur = cur->next)
-      {
-        gpointer target_page = cur->data;
+#ifdef HAVE_LINUX
+      if (g_atomic_int_get (&interceptor->thread_suspension_enabled))
+        gum_patch_in_place_with_other_threads_stopped (&patch);
+#endif
 
-        gum_clear_cache (target_page, page_size);
-      }
+      if (!patch.patched)
+        gum_patch_in_place (&patch);
     }
     else
     {
@@ -946,13 +1718,14 @@ gum_interceptor_transaction_end (GumInterceptorTransaction * self)
       source_page = gum_code_segment_get_address (segment);
 
       current_page = source_page;
-      for (cur = addresses; cur != NULL; cur = cur->next)
+      for (range_index = 0; range_index != ranges->len; range_index++)
       {
-        guint8 * target_page = cur->data;
+        GumPatchRange * range =
+            &g_array_index (ranges, GumPatchRange, range_index);
 
-        memcpy (current_page, target_page, page_size);
+        memcpy (current_page, range->base, range->size);
 
-        current_page += page_size;
+        current_page += range->size;
       }
 
       for (cur = addresses; cur != NULL; cur = cur->next)
@@ -982,19 +1755,23 @@ gum_interceptor_transaction_end (GumInterceptorTransaction * self)
       gum_code_segment_realize (segment);
 
       source_offset = 0;
-      for (cur = addresses; cur != NULL; cur = cur->next)
+      for (range_index = 0; range_index != ranges->len; range_index++)
       {
-        gpointer target_page = cur->data;
+        GumPatchRange * range =
+            &g_array_index (ranges, GumPatchRange, range_index);
 
-        gum_code_segment_map (segment, source_offset, page_size, target_page);
+        gum_code_segment_map (segment, source_offset, range->size,
+            range->base);
 
-        gum_clear_cache (target_page, page_size);
+        gum_clear_cache (range->base, range->size);
 
-        source_offset += page_size;
+        source_offset += range->size;
       }
 
       gum_code_segment_free (segment);
     }
+
+    g_array_free (ranges, TRUE);
   }
 
   g_list_free (addresses);
@@ -1083,12 +1860,14 @@ gum_interceptor_transaction_schedule_update (GumInterceptorTransaction * self,
 
 static GumFunctionContext *
 gum_function_context_new (GumInterceptor * interceptor,
+                          GumInterceptorType type,
                           gpointer function_address)
 {
   GumFunctionContext * ctx;
 
   ctx = g_slice_new0 (GumFunctionContext);
   ctx->function_address = function_address;
+  ctx->type = type;
 
   ctx->listener_entries =
       g_ptr_array_new_full (1, (GDestroyNotify) listener_entry_free);
@@ -1106,6 +1885,15 @@ gum_function_context_finalize (GumFunctionContext * function_ctx)
   g_ptr_array_unref (
       (GPtrArray *) g_atomic_pointer_get (&function_ctx->listener_entries));
 
+  if (function_ctx->stats_blocks != NULL)
+  {
+    guint i;
+
+    for (i = 0; i != GUM_HOOK_STATS_MAX_BLOCKS; i++)
+      gum_free (function_ctx->stats_blocks[i]);
+    g_free (function_ctx->stats_blocks);
+  }
+
   g_slice_free (GumFunctionContext, function_ctx);
 }
 
@@ -1124,6 +1912,21 @@ gum_function_context_destroy (GumFunctionContext * function_ctx)
         gum_interceptor_deactivate);
   }
 
+  /*
+   * Fast replacements branch straight into the replacement, so nothing counts
+   * the threads that are inside the trampoline or the original function, and
+   * we cannot know when it is safe to free them. Keep them around until the
+   * interceptor itself goes away.
+   */
+  if (function_ctx->type == GUM_INTERCEPTOR_TYPE_FAST)
+  {
+    GumInterceptor * interceptor = function_ctx->interceptor;
+
+    interceptor->retired_fast_contexts = g_slist_prepend (
+        interceptor->retired_fast_contexts, function_ctx);
+    return;
+  }
+
   gum_interceptor_transaction_schedule_destroy (transaction, function_ctx,
       (GDestroyNotify) gum_function_context_perform_destroy, function_ctx);
 }
@@ -1159,6 +1962,8 @@ gum_function_context_add_listener (GumFunctionContext * function_ctx,
   entry->listener_interface = GUM_INVOCATION_LISTENER_GET_IFACE (listener);
   entry->listener_instance = listener;
   entry->function_data = function_data;
+  entry->thread_data_index = gum_interceptor_obtain_thread_data_index (
+      function_ctx->interceptor, listener);
 
   old_entries =
       (GPtrArray *) g_atomic_pointer_get (&function_ctx->listener_entries);
@@ -1276,6 +2081,7 @@ _gum_function_context_begin_invocation (GumFunctionContext * function_ctx,
   GumInvocationStack * stack;
   GumInvocationStackEntry * stack_entry;
   GumInvocationContext * invocation_ctx = NULL;
+  GumHookStatsShard * stats_shard;
   gint system_error;
   gboolean invoke_listeners = TRUE;
   gboolean will_trap_on_leave;
@@ -1296,7 +2102,7 @@ _gum_function_context_begin_invocation (GumFunctionContext * function_ctx,
   gum_tls_key_set_value (gum_interceptor_guard_key, interceptor);
 
   interceptor_ctx = get_interceptor_thread_context ();
-  stack = interceptor_ctx->stack;
+  stack = &interceptor_ctx->stack;
 
   stack_entry = gum_invocation_stack_peek_top (stack);
   if (stack_entry != NULL &&
@@ -1325,6 +2131,16 @@ _gum_function_context_begin_invocation (GumFunctionContext * function_ctx,
     invoke_listeners = (interceptor_ctx->ignore_level <= 0);
   }
 
+  stats_shard =
+      gum_function_context_get_stats_shard (function_ctx, interceptor_ctx);
+  if (stats_shard != NULL)
+  {
+    if (invoke_listeners)
+      stats_shard->enter_count++;
+    else
+      stats_shard->bypass_count++;
+  }
+
   will_trap_on_leave = function_ctx->replacement_function != NULL ||
       (invoke_listeners && function_ctx->has_on_leave_listener);
   if (will_trap_on_leave)
@@ -1349,6 +2165,10 @@ _gum_function_context_begin_invocation (GumFunctionContext * function_ctx,
   {
     GPtrArray * listener_entries;
     guint i;
+    guint64 start_time = 0;
+
+    if (stats_shard != NULL)
+      start_time = gum_hook_stats_now ();
 
     invocation_ctx->cpu_context = cpu_context;
     invocation_ctx->backend = &interceptor_ctx->listener_backend;
@@ -1367,7 +2187,8 @@ _gum_function_context_begin_invocation (GumFunctionContext * function_ctx,
       state.point_cut = GUM_POINT_ENTER;
       state.entry = listener_entry;
       state.interceptor_ctx = interceptor_ctx;
-      state.invocation_data = stack_entry->listener_invocation_data[i];
+      state.stack_entry = stack_entry;
+      state.listener_index = i;
       invocation_ctx->backend->data = &state;
 
       if (listener_entry->listener_interface->on_enter != NULL)
@@ -1377,12 +2198,15 @@ _gum_function_context_begin_invocation (GumFunctionContext * function_ctx,
       }
     }
 
+    if (stats_shard != NULL)
+      stats_shard->listener_time += gum_hook_stats_now () - start_time;
+
     system_error = invocation_ctx->system_error;
   }
 
   if (!will_trap_on_leave && invoke_listeners)
   {
-    gum_invocation_stack_pop (interceptor_ctx->stack);
+    gum_invocation_stack_pop (stack);
   }
 
   gum_thread_set_system_error (system_error);
@@ -1418,6 +2242,22 @@ _gum_function_context_begin_invocation (GumFunctionContext * function_ctx,
   return;
 
 bypass:
+  if (g_atomic_int_get (&interceptor->stats_enabled))
+  {
+    /*
+     * Don't create a thread context just to count a bypass, as that would
+     * allocate on a path that is taken while the thread is ignored.
+     */
+    interceptor_ctx = g_private_get (&gum_interceptor_context_private);
+    if (interceptor_ctx != NULL)
+    {
+      stats_shard = gum_function_context_get_stats_shard (function_ctx,
+          interceptor_ctx);
+      if (stats_shard != NULL)
+        stats_shard->bypass_count++;
+    }
+  }
+
   g_atomic_int_dec_and_test (&function_ctx->trampoline_usage_counter);
 }
 
@@ -1430,6 +2270,8 @@ _gum_function_context_end_invocation (GumFunctionContext * function_ctx,
   InterceptorThreadContext * interceptor_ctx;
   GumInvocationStackEntry * stack_entry;
   GumInvocationContext * invocation_ctx;
+  GumHookStatsShard * stats_shard;
+  guint64 start_time = 0;
   GPtrArray * listener_entries;
   guint i;
 
@@ -1445,7 +2287,7 @@ _gum_function_context_end_invocation (GumFunctionContext * function_ctx,
 
   interceptor_ctx = get_interceptor_thread_context ();
 
-  stack_entry = gum_invocation_stack_peek_top (interceptor_ctx->stack);
+  stack_entry = gum_invocation_stack_peek_top (&interceptor_ctx->stack);
   *next_hop = gum_sign_code_pointer (stack_entry->caller_ret_addr);
 
   invocation_ctx = &stack_entry->invocation_context;
@@ -1463,6 +2305,14 @@ _gum_function_context_end_invocation (GumFunctionContext * function_ctx,
 
   gum_function_context_fixup_cpu_context (function_ctx, cpu_context);
 
+  stats_shard =
+      gum_function_context_get_stats_shard (function_ctx, interceptor_ctx);
+  if (stats_shard != NULL)
+  {
+    stats_shard->leave_count++;
+    start_time = gum_hook_stats_now ();
+  }
+
   listener_entries =
       (GPtrArray *) g_atomic_pointer_get (&function_ctx->listener_entries);
   for (i = 0; i != listener_entries->len; i++)
@@ -1477,7 +2327,8 @@ _gum_function_context_end_invocation (GumFunctionContext * function_ctx,
     state.point_cut = GUM_POINT_LEAVE;
     state.entry = listener_entry;
     state.interceptor_ctx = interceptor_ctx;
-    state.invocation_data = stack_entry->listener_invocation_data[i];
+    state.stack_entry = stack_entry;
+    state.listener_index = i;
     invocation_ctx->backend->data = &state;
 
     if (listener_entry->listener_interface->on_leave != NULL)
@@ -1487,9 +2338,12 @@ _gum_function_context_end_invocation (GumFunctionContext * function_ctx,
     }
   }
 
+  if (stats_shard != NULL)
+    stats_shard->listener_time += gum_hook_stats_now () - start_time;
+
   gum_thread_set_system_error (invocation_ctx->system_error);
 
-  gum_invocation_stack_pop (interceptor_ctx->stack);
+  gum_invocation_stack_pop (&interceptor_ctx->stack);
 
   gum_tls_key_set_value (gum_interceptor_guard_key, NULL);
 
@@ -1524,6 +2378,100 @@ gum_function_context_fixup_cpu_context (GumFunctionContext * function_ctx,
 #endif
 }
 
+static GumHookStatsShard *
+gum_function_context_get_stats_shard (
+    GumFunctionContext * function_ctx,
+    InterceptorThreadContext * interceptor_ctx)
+{
+  guint index = interceptor_ctx->stats_shard;
+  GumHookStatsShard ** blocks, * block;
+  GumHookStatsShard ** block_ptr;
+
+  if (!g_atomic_int_get (&function_ctx->interceptor->stats_enabled))
+    return NULL;
+
+  if (index == GUM_HOOK_STATS_NO_SHARD)
+    return NULL;
+
+  blocks = g_atomic_pointer_get (&function_ctx->stats_blocks);
+  if (blocks == NULL)
+    return NULL;
+
+  block_ptr = &blocks[index / GUM_HOOK_STATS_SHARDS_PER_BLOCK];
+
+  block = g_atomic_pointer_get (block_ptr);
+  if (block == NULL)
+  {
+    const gsize size =
+        GUM_HOOK_STATS_SHARDS_PER_BLOCK * sizeof (GumHookStatsShard);
+
+    block = gum_memalign (GUM_HOOK_STATS_SHARD_ALIGNMENT, size);
+    gum_memset (block, 0, size);
+
+    if (!g_atomic_pointer_compare_and_exchange (block_ptr, NULL, block))
+    {
+      gum_free (block);
+      block = g_atomic_pointer_get (block_ptr);
+    }
+  }
+
+  return &block[index % GUM_HOOK_STATS_SHARDS_PER_BLOCK];
+}
+
+static guint
+gum_interceptor_acquire_stats_shard (void)
+{
+  guint index = GUM_HOOK_STATS_NO_SHARD;
+  guint i;
+
+  gum_spinlock_acquire (&gum_interceptor_stats_shard_lock);
+
+  for (i = 0; i != G_N_ELEMENTS (gum_interceptor_used_stats_shards); i++)
+  {
+    guint32 used = gum_interceptor_used_stats_shards[i];
+    guint bit;
+
+    if (used == G_MAXUINT32)
+      continue;
+
+    for (bit = 0; (used & (1U << bit)) != 0; bit++)
+      ;
+
+    gum_interceptor_used_stats_shards[i] = used | (1U << bit);
+    index = (i * 32) + bit;
+    break;
+  }
+
+  gum_spinlock_release (&gum_interceptor_stats_shard_lock);
+
+  return index;
+}
+
+static void
+gum_interceptor_release_stats_shard (guint index)
+{
+  if (index == GUM_HOOK_STATS_NO_SHARD)
+    return;
+
+  gum_spinlock_acquire (&gum_interceptor_stats_shard_lock);
+  gum_interceptor_used_stats_shards[index / 32] &= ~(1U << (index % 32));
+  gum_spinlock_release (&gum_interceptor_stats_shard_lock);
+}
+
+static guint64
+gum_hook_stats_now (void)
+{
+#ifdef HAVE_WINDOWS
+  return (guint64) g_get_monotonic_time () * G_GUINT64_CONSTANT (1000);
+#else
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+
+  return ((guint64) ts.tv_sec * G_GUINT64_CONSTANT (1000000000)) + ts.tv_nsec;
+#endif
+}
+
 static InterceptorThreadContext *
 get_interceptor_thread_context (void)
 {
@@ -1581,7 +2529,7 @@ gum_interceptor_invocation_get_depth (GumInvocationContext * context)
   InterceptorThreadContext * interceptor_ctx =
       (InterceptorThreadContext *) context->backend->state;
 
-  return interceptor_ctx->stack->len - 1;
+  return interceptor_ctx->stack.len - 1;
 }
 
 static gpointer
@@ -1593,7 +2541,7 @@ gum_interceptor_invocation_get_listener_thread_data (
       (ListenerInvocationState *) context->backend->data;
 
   return interceptor_thread_context_get_listener_data (data->interceptor_ctx,
-      data->entry->listener_instance, required_size);
+      data->entry, required_size);
 }
 
 static gpointer
@@ -1610,13 +2558,26 @@ gum_interceptor_invocation_get_listener_invocation_data (
     gsize required_size)
 {
   ListenerInvocationState * data;
+  GumInvocationStackEntry * stack_entry;
+  guint index, mask;
 
   data = (ListenerInvocationState *) context->backend->data;
 
   if (required_size > GUM_MAX_LISTENER_DATA)
     return NULL;
 
-  return data->invocation_data;
+  stack_entry = data->stack_entry;
+  index = data->listener_index;
+  mask = 1U << index;
+
+  if ((stack_entry->listener_invocation_data_cleared & mask) == 0)
+  {
+    gum_memset (stack_entry->listener_invocation_data[index], 0,
+        GUM_MAX_LISTENER_DATA);
+    stack_entry->listener_invocation_data_cleared |= mask;
+  }
+
+  return stack_entry->listener_invocation_data[index];
 }
 
 static gpointer
@@ -1679,11 +2640,15 @@ interceptor_thread_context_new (void)
 
   context->ignore_level = 0;
 
-  context->stack = g_array_sized_new (FALSE, TRUE,
-      sizeof (GumInvocationStackEntry), GUM_MAX_CALL_DEPTH);
+  context->stats_shard = gum_interceptor_acquire_stats_shard ();
 
-  context->listener_data_slots = g_array_sized_new (FALSE, TRUE,
-      sizeof (ListenerDataSlot), GUM_MAX_LISTENERS_PER_FUNCTION);
+  gum_invocation_stack_init (&context->stack);
+
+  context->inline_listener_data_chunks[0] =
+      context->inline_listener_data_slots;
+  context->listener_data_chunks = context->inline_listener_data_chunks;
+  context->num_listener_data_chunks =
+      G_N_ELEMENTS (context->inline_listener_data_chunks);
 
   return context;
 }
@@ -1691,70 +2656,150 @@ interceptor_thread_context_new (void)
 static void
 interceptor_thread_context_destroy (InterceptorThreadContext * context)
 {
-  g_array_free (context->listener_data_slots, TRUE);
+  guint i;
 
-  g_array_free (context->stack, TRUE);
+  for (i = 1; i < context->num_listener_data_chunks; i++)
+    g_free (context->listener_data_chunks[i]);
+  if (context->listener_data_chunks != context->inline_listener_data_chunks)
+    g_free (context->listener_data_chunks);
+
+  gum_invocation_stack_destroy (&context->stack);
+
+  gum_interceptor_release_stats_shard (context->stats_shard);
 
   g_slice_free (InterceptorThreadContext, context);
 }
 
+static ListenerDataSlot *
+interceptor_thread_context_ensure_listener_data_chunk (
+    InterceptorThreadContext * self,
+    guint chunk_index)
+{
+  ListenerDataSlot ** chunks = self->listener_data_chunks;
+  ListenerDataSlot * chunk;
+  guint num_chunks = self->num_listener_data_chunks;
+
+  if (chunk_index >= num_chunks)
+  {
+    num_chunks = MAX (chunk_index + 1, 2 * num_chunks);
+
+    chunks = g_new0 (ListenerDataSlot *, num_chunks);
+    gum_memcpy (chunks, self->listener_data_chunks,
+        self->num_listener_data_chunks * sizeof (ListenerDataSlot *));
+  }
+
+  chunk = g_new0 (ListenerDataSlot, GUM_LISTENER_DATA_SLOTS_PER_CHUNK);
+
+  gum_spinlock_acquire (&gum_interceptor_thread_context_lock);
+
+  chunks[chunk_index] = chunk;
+
+  if (chunks != self->listener_data_chunks)
+  {
+    if (self->listener_data_chunks != self->inline_listener_data_chunks)
+      g_free (self->listener_data_chunks);
+    self->listener_data_chunks = chunks;
+    self->num_listener_data_chunks = num_chunks;
+  }
+
+  gum_spinlock_release (&gum_interceptor_thread_context_lock);
+
+  return chunk;
+}
+
 static gpointer
 interceptor_thread_context_get_listener_data (InterceptorThreadContext * self,
-                                              GumInvocationListener * listener,
+                                              ListenerEntry * entry,
                                               gsize required_size)
 {
-  guint i;
-  ListenerDataSlot * available_slot = NULL;
+  guint index = entry->thread_data_index;
+  guint chunk_index = index / GUM_LISTENER_DATA_SLOTS_PER_CHUNK;
+  ListenerDataSlot * chunk, * slot;
 
   if (required_size > GUM_MAX_LISTENER_DATA)
     return NULL;
 
-  for (i = 0; i != self->listener_data_slots->len; i++)
+  if (chunk_index < self->num_listener_data_chunks)
+    chunk = self->listener_data_chunks[chunk_index];
+  else
+    chunk = NULL;
+  if (chunk == NULL)
   {
-    ListenerDataSlot * slot;
-
-    slot = &g_array_index (self->listener_data_slots, ListenerDataSlot, i);
-    if (slot->owner == listener)
-      return slot->data;
-    else if (slot->owner == NULL)
-      available_slot = slot;
+    chunk = interceptor_thread_context_ensure_listener_data_chunk (self,
+        chunk_index);
   }
 
-  if (available_slot == NULL)
-  {
-    g_array_set_size (self->listener_data_slots,
-        self->listener_data_slots->len + 1);
-    available_slot = &g_array_index (self->listener_data_slots,
-        ListenerDataSlot, self->listener_data_slots->len - 1);
-  }
-  else
+  slot = &chunk[index % GUM_LISTENER_DATA_SLOTS_PER_CHUNK];
+  if (slot->owner != entry->listener_instance)
   {
-    gum_memset (available_slot->data, 0, sizeof (available_slot->data));
+    gum_memset (slot->data, 0, sizeof (slot->data));
+    slot->owner = entry->listener_instance;
   }
 
-  available_slot->owner = listener;
-
-  return available_slot->data;
+  return slot->data;
 }
 
 static void
 interceptor_thread_context_forget_listener_data (
     InterceptorThreadContext * self,
-    GumInvocationListener * listener)
+    GumInvocationListener * listener,
+    guint thread_data_index)
 {
-  guint i;
+  guint chunk_index = thread_data_index / GUM_LISTENER_DATA_SLOTS_PER_CHUNK;
+  ListenerDataSlot * chunk, * slot;
 
-  for (i = 0; i != self->listener_data_slots->len; i++)
-  {
-    ListenerDataSlot * slot;
+  if (chunk_index >= self->num_listener_data_chunks)
+    return;
 
-    slot = &g_array_index (self->listener_data_slots, ListenerDataSlot, i);
-    if (slot->owner == listener)
-    {
-      slot->owner = NULL;
-      return;
-    }
+  chunk = self->listener_data_chunks[chunk_index];
+  if (chunk == NULL)
+    return;
+
+  slot = &chunk[thread_data_index % GUM_LISTENER_DATA_SLOTS_PER_CHUNK];
+  if (slot->owner == listener)
+    slot->owner = NULL;
+}
+
+static void
+gum_invocation_stack_init (GumInvocationStack * stack)
+{
+  stack->entries = NULL;
+  stack->len = 0;
+  stack->capacity = 0;
+  stack->storage = NULL;
+
+  gum_invocation_stack_reserve (stack, GUM_MAX_CALL_DEPTH);
+}
+
+static void
+gum_invocation_stack_destroy (GumInvocationStack * stack)
+{
+  g_free (stack->storage);
+}
+
+static void
+gum_invocation_stack_reserve (GumInvocationStack * stack,
+                              guint capacity)
+{
+  gpointer storage;
+  GumInvocationStackEntry * entries;
+
+  storage = g_malloc ((capacity * sizeof (GumInvocationStackEntry)) +
+      GUM_INVOCATION_STACK_ALIGNMENT - 1);
+  entries = GUM_ALIGN_POINTER (GumInvocationStackEntry *, storage,
+      GUM_INVOCATION_STACK_ALIGNMENT);
+
+  if (stack->len != 0)
+  {
+    gum_memcpy (entries, stack->entries,
+        stack->len * sizeof (GumInvocationStackEntry));
   }
+
+  g_free (stack->storage);
+
+  stack->entries = entries;
+  stack->capacity = capacity;
+  stack->storage = storage;
 }
 
 static GumInvocationStackEntry *
@@ -1765,11 +2810,14 @@ gum_invocation_stack_push (GumInvocationStack * stack,
   GumInvocationStackEntry * entry;
   GumInvocationContext * ctx;
 
-  g_array_set_size (stack, stack->len + 1);
-  entry = (GumInvocationStackEntry *)
-      &g_array_index (stack, GumInvocationStackEntry, stack->len - 1);
+  if (G_UNLIKELY (stack->len == stack->capacity))
+    gum_invocation_stack_reserve (stack, 2 * stack->capacity);
+
+  entry = &stack->entries[stack->len++];
   entry->function_ctx = function_ctx;
   entry->caller_ret_addr = caller_ret_addr;
+  entry->listener_invocation_data_cleared = 0;
+  entry->calling_replacement = FALSE;
 
   ctx = &entry->invocation_context;
   ctx->function = GUM_POINTER_TO_FUNCPTR (GCallback,
@@ -1783,15 +2831,7 @@ gum_invocation_stack_push (GumInvocationStack * stack,
 static gpointer
 gum_invocation_stack_pop (GumInvocationStack * stack)
 {
-  GumInvocationStackEntry * entry;
-  gpointer caller_ret_addr;
-
-  entry = (GumInvocationStackEntry *)
-      &g_array_index (stack, GumInvocationStackEntry, stack->len - 1);
-  caller_ret_addr = entry->caller_ret_addr;
-  g_array_set_size (stack, stack->len - 1);
-
-  return caller_ret_addr;
+  return stack->entries[--stack->len].caller_ret_addr;
 }
 
 static GumInvocationStackEntry *
@@ -1800,7 +2840,7 @@ gum_invocation_stack_peek_top (GumInvocationStack * stack)
   if (stack->len == 0)
     return NULL;
 
-  return &g_array_index (stack, GumInvocationStackEntry, stack->len - 1);
+  return &stack->entries[stack->len - 1];
 }
 
 static gpointer
@@ -1848,5 +2888,152 @@ static gint
 gum_page_address_compare (gconstpointer a,
                           gconstpointer b)
 {
-  return GPOINTER_TO_SIZE (a) - GPOINTER_TO_SIZE (b);
+  gsize lhs = GPOINTER_TO_SIZE (a);
+  gsize rhs = GPOINTER_TO_SIZE (b);
+
+  if (lhs < rhs)
+    return -1;
+  if (lhs > rhs)
+    return 1;
+  return 0;
+}
+
+static void
+gum_interceptor_transaction_apply_updates (GumInterceptorTransaction * self,
+                                           GList * addresses)
+{
+  GList * cur;
+
+  for (cur = addresses; cur != NULL; cur = cur->next)
+  {
+    gpointer target_page = cur->data;
+    GArray * pending;
+    guint i;
+
+    pending = g_hash_table_lookup (self->pending_update_tasks, target_page);
+    g_assert (pending != NULL);
+
+    for (i = 0; i != pending->len; i++)
+    {
+      GumUpdateTask * update;
+
+      update = &g_array_index (pending, GumUpdateTask, i);
+
+      update->func (self->interceptor, update->ctx,
+          _gum_interceptor_backend_get_function_address (update->ctx));
+    }
+  }
+}
+
+static void
+gum_patch_in_place (GumPatchInPlaceContext * ctx)
+{
+  GArray * ranges = ctx->ranges;
+  GumPageProtection protection;
+  guint i;
+
+  protection = ctx->rwx_supported ? GUM_PAGE_RWX : GUM_PAGE_RW;
+
+  for (i = 0; i != ranges->len; i++)
+  {
+    GumPatchRange * range = &g_array_index (ranges, GumPatchRange, i);
+
+    gum_mprotect (range->base, range->size, protection);
+  }
+
+  gum_interceptor_transaction_apply_updates (ctx->transaction, ctx->addresses);
+
+  for (i = 0; i != ranges->len; i++)
+  {
+    GumPatchRange * range = &g_array_index (ranges, GumPatchRange, i);
+
+    if (!ctx->rwx_supported)
+      gum_mprotect (range->base, range->size, GUM_PAGE_RX);
+
+    gum_clear_cache (range->base, range->size);
+  }
+
+  ctx->patched = TRUE;
+}
+
+#ifdef HAVE_LINUX
+
+/*
+ * On Linux, gum_process_modify_threads() stops all of the given threads before
+ * it calls back for any of them, and the callbacks run on the calling thread.
+ * We use the first callback as a window where no other thread can execute the
+ * pages being patched, or fault on them while they are writable but not
+ * executable. The patching itself neither allocates nor takes locks, so it is
+ * safe to do while the other threads are stopped.
+ */
+static void
+gum_patch_in_place_with_other_threads_stopped (GumPatchInPlaceContext * ctx)
+{
+  GArray * thread_ids;
+  GumThreadId current_thread_id;
+  guint i;
+
+  thread_ids = _gum_process_list_thread_ids ();
+
+  current_thread_id = gum_process_get_current_thread_id ();
+  for (i = 0; i != thread_ids->len; i++)
+  {
+    if (g_array_index (thread_ids, GumThreadId, i) == current_thread_id)
+    {
+      g_array_remove_index_fast (thread_ids, i);
+      break;
+    }
+  }
+
+  gum_process_modify_threads ((const GumThreadId *) thread_ids->data,
+      thread_ids->len, gum_patch_in_place_once, ctx);
+
+  g_array_free (thread_ids, TRUE);
+}
+
+static void
+gum_patch_in_place_once (GumThreadId thread_id,
+                         GumCpuContext * cpu_context,
+                         gpointer user_data)
+{
+  GumPatchInPlaceContext * ctx = user_data;
+
+  if (!ctx->patched)
+    gum_patch_in_place (ctx);
+}
+
+#endif
+
+/*
+ * Pages that are adjacent in memory are merged into a single range, so a
+ * transaction touching many neighbouring functions only needs one
+ * protection change, remap and cache flush per range rather than per page.
+ */
+static GArray *
+gum_patch_ranges_from_sorted_pages (GList * pages,
+                                    gsize page_size)
+{
+  GArray * ranges;
+  GumPatchRange * range = NULL;
+  GList * cur;
+
+  ranges = g_array_new (FALSE, FALSE, sizeof (GumPatchRange));
+
+  for (cur = pages; cur != NULL; cur = cur->next)
+  {
+    guint8 * page = cur->data;
+
+    if (range != NULL && range->base + range->size == page)
+    {
+      range->size += page_size;
+      continue;
+    }
+
+    g_array_set_size (ranges, ranges->len + 1);
+    range = &g_array_index (ranges, GumPatchRange, ranges->len - 1);
+    range->base = page;
+    range->size = page_size;
+  }
+
+  return ranges;
 }
@@ -18,15 +18,18 @@ G_BEGIN_DECLS
 G_DECLARE_FINAL_TYPE (GumInterceptor, gum_interceptor, GUM, INTERCEPTOR,
     GObject)
 
-typedef GArray GumInvocationStack;
+typedef struct _GumInvocationStack GumInvocationStack;
 typedef guint GumInvocationState;
+typedef struct _GumHookStats GumHookStats;
 
 typedef enum
 {
   GUM_ATTACH_OK               =  0,
   GUM_ATTACH_WRONG_SIGNATURE  = -1,
   GUM_ATTACH_ALREADY_ATTACHED = -2,
-  GUM_ATTACH_POLICY_VIOLATION = -3
+  GUM_ATTACH_POLICY_VIOLATION = -3,
+  GUM_ATTACH_NOT_FOUND        = -4,
+  GUM_ATTACH_WRONG_TYPE       = -5
 } GumAttachReturn;
 
 typedef enum
@@ -34,26 +37,63 @@ typedef enum
   GUM_REPLACE_OK               =  0,
   GUM_REPLACE_WRONG_SIGNATURE  = -1,
   GUM_REPLACE_ALREADY_REPLACED = -2,
-  GUM_REPLACE_POLICY_VIOLATION = -3
+  GUM_REPLACE_POLICY_VIOLATION = -3,
+  GUM_REPLACE_WRONG_TYPE       = -4
 } GumReplaceReturn;
 
+struct _GumHookStats
+{
+  gpointer function_address;
+
+  guint64 enter_count;
+  guint64 leave_count;
+  guint64 bypass_count;
+  guint64 listener_time;
+};
+
+typedef gboolean (* GumFoundHookStatsFunc) (const GumHookStats * stats,
+    gpointer user_data);
+
 GUM_API GumInterceptor * gum_interceptor_obtain (void);
 
 GUM_API GumAttachReturn gum_interceptor_attach (GumInterceptor * self,
     gpointer function_address, GumInvocationListener * listener,
     gpointer listener_function_data);
+GUM_API guint gum_interceptor_attach_many (GumInterceptor * self,
+    const gpointer * function_addresses, guint n_functions,
+    GumInvocationListener * listener, gpointer listener_function_data,
+    GumAttachReturn * results);
+GUM_API GumAttachReturn gum_interceptor_attach_import (GumInterceptor * self,
+    const gchar * module_name, const gchar * import_name,
+    GumInvocationListener * listener, gpointer listener_function_data);
 GUM_API void gum_interceptor_detach (GumInterceptor * self,
     GumInvocationListener * listener);
 
 GUM_API GumReplaceReturn gum_interceptor_replace (GumInterceptor * self,
     gpointer function_address, gpointer replacement_function,
     gpointer replacement_data);
+GUM_API GumReplaceReturn gum_interceptor_replace_fast (GumInterceptor * self,
+    gpointer function_address, gpointer replacement_function,
+    gpointer * original_function);
 GUM_API void gum_interceptor_revert (GumInterceptor * self,
     gpointer function_address);
 
 GUM_API void gum_interceptor_begin_transaction (GumInterceptor * self);
 GUM_API void gum_interceptor_end_transaction (GumInterceptor * self);
 GUM_API gboolean gum_interceptor_flush (GumInterceptor * self);
+GUM_API gboolean gum_interceptor_has_pending_changes (GumInterceptor * self);
+
+GUM_API void gum_interceptor_set_stats_enabled (GumInterceptor * self,
+    gboolean enabled);
+GUM_API gboolean gum_interceptor_get_stats_enabled (GumInterceptor * self);
+GUM_API void gum_interceptor_enumerate_stats (GumInterceptor * self,
+    GumFoundHookStatsFunc func, gpointer user_data);
+GUM_API void gum_interceptor_reset_stats (GumInterceptor * self);
+
+GUM_API void gum_interceptor_set_thread_suspension_enabled (
+    GumInterceptor * self, gboolean enabled);
+GUM_API gboolean gum_interceptor_get_thread_suspension_enabled (
+    GumInterceptor * self);
 
 GUM_API GumInvocationContext * gum_interceptor_get_current_invocation (void);
 GUM_API GumInvocationStack * gum_interceptor_get_current_stack (void);
@@ -340,6 +340,25 @@ gum_memory_mark_code (gpointer address,
   return success;
 }
 
+#ifndef HAVE_LINUX
+
+gboolean
+gum_memory_can_dual_map (void)
+{
+  return FALSE;
+}
+
+gpointer
+gum_memory_allocate_dual_mapped (const GumAddressSpec * spec,
+                                 gsize size,
+                                 gsize alignment,
+                                 gsize alias_offset)
+{
+  return NULL;
+}
+
+#endif
+
 void
 gum_memory_scan (const GumMemoryRange * range,
                  const GumMatchPattern * pattern,
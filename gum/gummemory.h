@@ -146,6 +146,9 @@ GUM_API gpointer gum_memory_allocate (gpointer address, gsize size,
 GUM_API gpointer gum_memory_allocate_near (const GumAddressSpec * spec,
     gsize size, gsize alignment, GumPageProtection prot);
 GUM_API gboolean gum_memory_free (gpointer address, gsize size);
+GUM_API gboolean gum_memory_can_dual_map (void);
+GUM_API gpointer gum_memory_allocate_dual_mapped (const GumAddressSpec * spec,
+    gsize size, gsize alignment, gsize alias_offset);
 GUM_API gboolean gum_memory_release (gpointer address, gsize size);
 GUM_API gboolean gum_memory_commit (gpointer address, gsize size,
     GumPageProtection prot);
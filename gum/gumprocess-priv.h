@@ -11,8 +11,9 @@
 
 G_BEGIN_DECLS
 
-G_GNUC_INTERNAL void _gum_process_enumerate_threads (GumFoundThreadFunc func,
-    gpointer user_data);
+G_GNUC_INTERNAL void _gum_process_enumerate_threads (GumThreadFlags flags,
+    GumFoundThreadFunc func, gpointer user_data);
+G_GNUC_INTERNAL GArray * _gum_process_list_thread_ids (void);
 G_GNUC_INTERNAL void _gum_process_enumerate_ranges (GumPageProtection prot,
     GumFoundRangeFunc func, gpointer user_data);
 
@@ -32,6 +32,10 @@ struct _GumResolveSymbolContext
 
 static gboolean gum_emit_thread_if_not_cloaked (
     const GumThreadDetails * details, gpointer user_data);
+#ifndef HAVE_LINUX
+static gboolean gum_collect_thread_id (const GumThreadDetails * details,
+    gpointer user_data);
+#endif
 static gboolean gum_emit_range_if_not_cloaked (const GumRangeDetails * details,
     gpointer user_data);
 static gboolean gum_store_address_if_name_matches (
@@ -74,15 +78,75 @@ gum_process_set_code_signing_policy (GumCodeSigningPolicy policy)
   gum_code_signing_policy = policy;
 }
 
+#ifndef HAVE_LINUX
+
+guint
+gum_process_modify_threads (const GumThreadId * thread_ids,
+                            guint n_threads,
+                            GumModifyThreadFunc func,
+                            gpointer user_data)
+{
+  guint n_modified = 0;
+  guint i;
+
+  for (i = 0; i != n_threads; i++)
+  {
+    if (gum_process_modify_thread (thread_ids[i], func, user_data))
+      n_modified++;
+  }
+
+  return n_modified;
+}
+
+GArray *
+_gum_process_list_thread_ids (void)
+{
+  GArray * thread_ids;
+
+  thread_ids = g_array_new (FALSE, FALSE, sizeof (GumThreadId));
+  gum_process_enumerate_threads_full (GUM_THREAD_FLAGS_NONE,
+      gum_collect_thread_id, thread_ids);
+
+  return thread_ids;
+}
+
+static gboolean
+gum_collect_thread_id (const GumThreadDetails * details,
+                       gpointer user_data)
+{
+  GArray * thread_ids = user_data;
+
+  g_array_append_val (thread_ids, details->id);
+
+  return TRUE;
+}
+
+#endif
+
 void
 gum_process_enumerate_threads (GumFoundThreadFunc func,
                                gpointer user_data)
+{
+  gum_process_enumerate_threads_full (GUM_THREAD_FLAGS_CPU_CONTEXT, func,
+      user_data);
+}
+
+/*
+ * Capturing CPU contexts may mean stopping every thread, e.g. on Linux, so
+ * callers that only care about the threads themselves should leave out
+ * GUM_THREAD_FLAGS_CPU_CONTEXT. The cpu_context of each thread is then left
+ * zeroed on backends where it would be costly to obtain.
+ */
+void
+gum_process_enumerate_threads_full (GumThreadFlags flags,
+                                    GumFoundThreadFunc func,
+                                    gpointer user_data)
 {
   GumEmitThreadsContext ctx;
 
   ctx.func = func;
   ctx.user_data = user_data;
-  _gum_process_enumerate_threads (gum_emit_thread_if_not_cloaked, &ctx);
+  _gum_process_enumerate_threads (flags, gum_emit_thread_if_not_cloaked, &ctx);
 }
 
 static gboolean
@@ -37,6 +37,11 @@ typedef enum {
   GUM_CODE_SIGNING_REQUIRED
 } GumCodeSigningPolicy;
 
+typedef enum {
+  GUM_THREAD_FLAGS_NONE        = 0,
+  GUM_THREAD_FLAGS_CPU_CONTEXT = (1 << 0),
+} GumThreadFlags;
+
 enum _GumThreadState
 {
   GUM_THREAD_RUNNING = 1,
@@ -171,8 +176,12 @@ GUM_API GumThreadId gum_process_get_current_thread_id (void);
 GUM_API gboolean gum_process_has_thread (GumThreadId thread_id);
 GUM_API gboolean gum_process_modify_thread (GumThreadId thread_id,
     GumModifyThreadFunc func, gpointer user_data);
+GUM_API guint gum_process_modify_threads (const GumThreadId * thread_ids,
+    guint n_threads, GumModifyThreadFunc func, gpointer user_data);
 GUM_API void gum_process_enumerate_threads (GumFoundThreadFunc func,
     gpointer user_data);
+GUM_API void gum_process_enumerate_threads_full (GumThreadFlags flags,
+    GumFoundThreadFunc func, gpointer user_data);
 GUM_API void gum_process_enumerate_modules (GumFoundModuleFunc func,
     gpointer user_data);
 GUM_API void gum_process_enumerate_ranges (GumPageProtection prot,
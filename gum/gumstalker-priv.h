@@ -0,0 +1,21 @@
+/*
+ * Copyright (C) 2020 Ole André Vadla Ravnås <oleavr@nowsecure.com>
+ *
+ * Licence: wxWindows Library Licence, Version 3.1
+ */
+
+#ifndef __GUM_STALKER_PRIV_H__
+#define __GUM_STALKER_PRIV_H__
+
+#include "gumstalker.h"
+
+G_BEGIN_DECLS
+
+#ifdef HAVE_I386
+G_GNUC_INTERNAL guint32 * _gum_stalker_iterator_get_edge_coverage_location (
+    GumStalkerIterator * self);
+#endif
+
+G_END_DECLS
+
+#endif
@@ -4,7 +4,10 @@
  * Licence: wxWindows Library Licence, Version 3.1
  */
 
-#include "gumstalker.h"
+#include "gumstalker-priv.h"
+#include "gumprocess-priv.h"
+
+#include "gumtls.h"
 
 struct _GumDefaultStalkerTransformer
 {
@@ -20,6 +23,20 @@ struct _GumCallbackStalkerTransformer
   GDestroyNotify data_destroy;
 };
 
+struct _GumEdgeCoverageStalkerTransformer
+{
+  GObject parent;
+
+  guint8 * bitmap;
+  guint32 mask;
+  GumEdgeCoverageHashFunc hash;
+  gpointer hash_data;
+
+#ifndef HAVE_I386
+  GumTlsKey previous_location;
+#endif
+};
+
 static void gum_default_stalker_transformer_iface_init (gpointer g_iface,
     gpointer iface_data);
 static void gum_default_stalker_transformer_transform_block (
@@ -33,6 +50,22 @@ static void gum_callback_stalker_transformer_transform_block (
     GumStalkerTransformer * transformer, GumStalkerIterator * iterator,
     GumStalkerOutput * output);
 
+static void gum_edge_coverage_stalker_transformer_iface_init (gpointer g_iface,
+    gpointer iface_data);
+static void gum_edge_coverage_stalker_transformer_finalize (GObject * object);
+static void gum_edge_coverage_stalker_transformer_transform_block (
+    GumStalkerTransformer * transformer, GumStalkerIterator * iterator,
+    GumStalkerOutput * output);
+static void gum_edge_coverage_stalker_transformer_put_update (
+    GumEdgeCoverageStalkerTransformer * self, GumStalkerIterator * iterator,
+    GumStalkerOutput * output, guint32 location);
+#ifndef HAVE_I386
+static void gum_edge_coverage_stalker_transformer_on_block (
+    GumCpuContext * cpu_context, gpointer user_data);
+#endif
+static guint32 gum_edge_coverage_hash_afl (GumAddress block_address,
+    gpointer user_data);
+
 G_DEFINE_INTERFACE (GumStalkerTransformer, gum_stalker_transformer,
     G_TYPE_OBJECT)
 
@@ -50,6 +83,40 @@ G_DEFINE_TYPE_EXTENDED (GumCallbackStalkerTransformer,
                         G_IMPLEMENT_INTERFACE (GUM_TYPE_STALKER_TRANSFORMER,
                             gum_callback_stalker_transformer_iface_init))
 
+G_DEFINE_TYPE_EXTENDED (GumEdgeCoverageStalkerTransformer,
+                        gum_edge_coverage_stalker_transformer,
+                        G_TYPE_OBJECT,
+                        0,
+                        G_IMPLEMENT_INTERFACE (GUM_TYPE_STALKER_TRANSFORMER,
+                            gum_edge_coverage_stalker_transformer_iface_init))
+
+void
+gum_stalker_follow_all (GumStalker * self,
+                        GumStalkerTransformer * transformer,
+                        GumEventSink * sink)
+{
+  GArray * thread_ids;
+  GumThreadId current_thread_id;
+  guint i;
+
+  thread_ids = _gum_process_list_thread_ids ();
+
+  current_thread_id = gum_process_get_current_thread_id ();
+  for (i = 0; i != thread_ids->len; i++)
+  {
+    if (g_array_index (thread_ids, GumThreadId, i) == current_thread_id)
+    {
+      g_array_remove_index_fast (thread_ids, i);
+      break;
+    }
+  }
+
+  gum_stalker_follow_threads (self, (const GumThreadId *) thread_ids->data,
+      thread_ids->len, transformer, sink);
+
+  g_array_free (thread_ids, TRUE);
+}
+
 static void
 gum_stalker_transformer_default_init (GumStalkerTransformerInterface * iface)
 {
@@ -77,6 +144,26 @@ gum_stalker_transformer_make_from_callback (
   return GUM_STALKER_TRANSFORMER (transformer);
 }
 
+GumStalkerTransformer *
+gum_stalker_transformer_make_edge_coverage (guint8 * bitmap,
+                                            gsize size,
+                                            GumEdgeCoverageHashFunc hash,
+                                            gpointer hash_data)
+{
+  GumEdgeCoverageStalkerTransformer * transformer;
+
+  g_return_val_if_fail (size != 0 && (size & (size - 1)) == 0, NULL);
+
+  transformer = g_object_new (GUM_TYPE_EDGE_COVERAGE_STALKER_TRANSFORMER,
+      NULL);
+  transformer->bitmap = bitmap;
+  transformer->mask = size - 1;
+  transformer->hash = (hash != NULL) ? hash : gum_edge_coverage_hash_afl;
+  transformer->hash_data = hash_data;
+
+  return GUM_STALKER_TRANSFORMER (transformer);
+}
+
 void
 gum_stalker_transformer_transform_block (GumStalkerTransformer * self,
                                          GumStalkerIterator * iterator,
@@ -171,3 +258,319 @@ gum_callback_stalker_transformer_transform_block (
 
   self->callback (iterator, output, self->data);
 }
+
+static void
+gum_edge_coverage_stalker_transformer_class_init (
+    GumEdgeCoverageStalkerTransformerClass * klass)
+{
+  GObjectClass * object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = gum_edge_coverage_stalker_transformer_finalize;
+}
+
+static void
+gum_edge_coverage_stalker_transformer_iface_init (gpointer g_iface,
+                                                  gpointer iface_data)
+{
+  GumStalkerTransformerInterface * iface =
+      (GumStalkerTransformerInterface *) g_iface;
+
+  iface->transform_block =
+      gum_edge_coverage_stalker_transformer_transform_block;
+}
+
+/*
+ * The previous location is per thread, as edges must never be formed between
+ * blocks executed by different threads. On x86 it lives in the exec context
+ * that the generated code belongs to, elsewhere the callout uses a TLS key.
+ */
+
+static void
+gum_edge_coverage_stalker_transformer_init (
+    GumEdgeCoverageStalkerTransformer * self)
+{
+#ifndef HAVE_I386
+  self->previous_location = gum_tls_key_new ();
+#endif
+}
+
+static void
+gum_edge_coverage_stalker_transformer_finalize (GObject * object)
+{
+#ifndef HAVE_I386
+  GumEdgeCoverageStalkerTransformer * self =
+      GUM_EDGE_COVERAGE_STALKER_TRANSFORMER (object);
+
+  gum_tls_key_free (self->previous_location);
+#endif
+
+  G_OBJECT_CLASS (
+      gum_edge_coverage_stalker_transformer_parent_class)->finalize (object);
+}
+
+static void
+gum_edge_coverage_stalker_transformer_transform_block (
+    GumStalkerTransformer * transformer,
+    GumStalkerIterator * iterator,
+    GumStalkerOutput * output)
+{
+  GumEdgeCoverageStalkerTransformer * self =
+      (GumEdgeCoverageStalkerTransformer *) transformer;
+  const cs_insn * insn;
+  gboolean is_first_insn = TRUE;
+
+  while (gum_stalker_iterator_next (iterator, &insn))
+  {
+    if (is_first_insn)
+    {
+      guint32 location;
+
+      location = self->hash (insn->address, self->hash_data) & self->mask;
+
+      gum_edge_coverage_stalker_transformer_put_update (self, iterator,
+          output, location);
+
+      is_first_insn = FALSE;
+    }
+
+    gum_stalker_iterator_keep (iterator);
+  }
+}
+
+#ifdef HAVE_I386
+
+static void
+gum_edge_coverage_stalker_transformer_put_update (
+    GumEdgeCoverageStalkerTransformer * self,
+    GumStalkerIterator * iterator,
+    GumStalkerOutput * output,
+    guint32 location)
+{
+  GumX86Writer * cw = output->writer.x86;
+
+  gum_x86_writer_put_lea_reg_reg_offset (cw, GUM_REG_XSP, GUM_REG_XSP,
+      -GUM_RED_ZONE_SIZE);
+  gum_x86_writer_put_pushfx (cw);
+  gum_x86_writer_put_push_reg (cw, GUM_REG_XAX);
+  gum_x86_writer_put_push_reg (cw, GUM_REG_XCX);
+
+  gum_x86_writer_put_mov_reg_address (cw, GUM_REG_XCX,
+      GUM_ADDRESS (_gum_stalker_iterator_get_edge_coverage_location (
+          iterator)));
+  gum_x86_writer_put_mov_reg_reg_ptr (cw, GUM_REG_EAX, GUM_REG_XCX);
+  gum_x86_writer_put_mov_reg_ptr_u32 (cw, GUM_REG_XCX, location >> 1);
+
+  gum_x86_writer_put_mov_reg_u32 (cw, GUM_REG_ECX, location);
+  gum_x86_writer_put_xor_reg_reg (cw, GUM_REG_EAX, GUM_REG_ECX);
+
+  gum_x86_writer_put_mov_reg_address (cw, GUM_REG_XCX,
+      GUM_ADDRESS (self->bitmap));
+  gum_x86_writer_put_add_reg_reg (cw, GUM_REG_XCX, GUM_REG_XAX);
+  gum_x86_writer_put_inc_reg_ptr (cw, GUM_PTR_BYTE, GUM_REG_XCX);
+
+  gum_x86_writer_put_pop_reg (cw, GUM_REG_XCX);
+  gum_x86_writer_put_pop_reg (cw, GUM_REG_XAX);
+  gum_x86_writer_put_popfx (cw);
+  gum_x86_writer_put_lea_reg_reg_offset (cw, GUM_REG_XSP, GUM_REG_XSP,
+      GUM_RED_ZONE_SIZE);
+}
+
+#else
+
+typedef struct _GumEdgeCoverageSite GumEdgeCoverageSite;
+
+struct _GumEdgeCoverageSite
+{
+  GumEdgeCoverageStalkerTransformer * transformer;
+  guint32 location;
+};
+
+static void gum_edge_coverage_site_free (GumEdgeCoverageSite * site);
+
+static void
+gum_edge_coverage_stalker_transformer_put_update (
+    GumEdgeCoverageStalkerTransformer * self,
+    GumStalkerIterator * iterator,
+    GumStalkerOutput * output,
+    guint32 location)
+{
+  GumEdgeCoverageSite * site;
+
+  site = g_slice_new (GumEdgeCoverageSite);
+  site->transformer = self;
+  site->location = location;
+
+  gum_stalker_iterator_put_callout (iterator,
+      gum_edge_coverage_stalker_transformer_on_block, site,
+      (GDestroyNotify) gum_edge_coverage_site_free);
+}
+
+static void
+gum_edge_coverage_stalker_transformer_on_block (GumCpuContext * cpu_context,
+                                                gpointer user_data)
+{
+  GumEdgeCoverageSite * site = user_data;
+  GumEdgeCoverageStalkerTransformer * self = site->transformer;
+  guint32 previous_location;
+
+  previous_location = GPOINTER_TO_UINT (
+      gum_tls_key_get_value (self->previous_location));
+
+  self->bitmap[site->location ^ previous_location]++;
+  gum_tls_key_set_value (self->previous_location,
+      GUINT_TO_POINTER (site->location >> 1));
+}
+
+static void
+gum_edge_coverage_site_free (GumEdgeCoverageSite * site)
+{
+  g_slice_free (GumEdgeCoverageSite, site);
+}
+
+#endif
+
+static guint32
+gum_edge_coverage_hash_afl (GumAddress block_address,
+                            gpointer user_data)
+{
+  return (guint32) ((block_address >> 4) ^ (block_address << 8));
+}
+
+#ifndef HAVE_I386
+
+typedef struct _GumLightCalloutShim GumLightCalloutShim;
+
+struct _GumLightCalloutShim
+{
+  GumStalkerLightCallout callout;
+  gpointer data;
+  GDestroyNotify data_destroy;
+
+  guint * registers;
+  guint n_registers;
+};
+
+static void gum_light_callout_shim_invoke (GumCpuContext * cpu_context,
+    gpointer user_data);
+static void gum_light_callout_shim_free (GumLightCalloutShim * shim);
+static gsize * gum_light_callout_resolve_register (GumCpuContext * cpu_context,
+    guint reg);
+
+/*
+ * Backends without a specialized code path emit a regular callout and copy
+ * the requested registers in and out of the full context.
+ */
+void
+gum_stalker_iterator_put_light_callout (GumStalkerIterator * self,
+                                        const guint * registers,
+                                        guint n_registers,
+                                        GumStalkerLightCallout callout,
+                                        gpointer data,
+                                        GDestroyNotify data_destroy)
+{
+  GumLightCalloutShim * shim;
+
+  g_return_if_fail (n_registers == 0 || registers != NULL);
+
+  shim = g_slice_new (GumLightCalloutShim);
+  shim->callout = callout;
+  shim->data = data;
+  shim->data_destroy = data_destroy;
+  shim->registers = g_memdup (registers, n_registers * sizeof (guint));
+  shim->n_registers = n_registers;
+
+  gum_stalker_iterator_put_callout (self, gum_light_callout_shim_invoke, shim,
+      (GDestroyNotify) gum_light_callout_shim_free);
+}
+
+static void
+gum_light_callout_shim_invoke (GumCpuContext * cpu_context,
+                               gpointer user_data)
+{
+  GumLightCalloutShim * shim = user_data;
+  gsize * values;
+  guint i;
+
+  values = g_newa (gsize, MAX (shim->n_registers, 1));
+
+  for (i = 0; i != shim->n_registers; i++)
+  {
+    gsize * slot;
+
+    slot = gum_light_callout_resolve_register (cpu_context,
+        shim->registers[i]);
+    values[i] = (slot != NULL) ? *slot : 0;
+  }
+
+  shim->callout (values, shim->data);
+
+  for (i = 0; i != shim->n_registers; i++)
+  {
+    gsize * slot;
+
+    slot = gum_light_callout_resolve_register (cpu_context,
+        shim->registers[i]);
+    if (slot != NULL)
+      *slot = values[i];
+  }
+}
+
+static void
+gum_light_callout_shim_free (GumLightCalloutShim * shim)
+{
+  if (shim->data_destroy != NULL)
+    shim->data_destroy (shim->data);
+
+  g_free (shim->registers);
+
+  g_slice_free (GumLightCalloutShim, shim);
+}
+
+static gsize *
+gum_light_callout_resolve_register (GumCpuContext * cpu_context,
+                                    guint reg)
+{
+#if defined (HAVE_ARM64)
+  if (reg >= ARM64_REG_X0 && reg <= ARM64_REG_X28)
+    return (gsize *) &cpu_context->x[reg - ARM64_REG_X0];
+
+  switch (reg)
+  {
+    case ARM64_REG_FP:
+      return (gsize *) &cpu_context->fp;
+    case ARM64_REG_LR:
+      return (gsize *) &cpu_context->lr;
+    case ARM64_REG_SP:
+      return (gsize *) &cpu_context->sp;
+    default:
+      return NULL;
+  }
+#elif defined (HAVE_ARM)
+  if (reg >= ARM_REG_R0 && reg <= ARM_REG_R7)
+    return (gsize *) &cpu_context->r[reg - ARM_REG_R0];
+
+  switch (reg)
+  {
+    case ARM_REG_R8:
+      return (gsize *) &cpu_context->r8;
+    case ARM_REG_R9:
+      return (gsize *) &cpu_context->r9;
+    case ARM_REG_R10:
+      return (gsize *) &cpu_context->r10;
+    case ARM_REG_R11:
+      return (gsize *) &cpu_context->r11;
+    case ARM_REG_R12:
+      return (gsize *) &cpu_context->r12;
+    case ARM_REG_SP:
+      return (gsize *) &cpu_context->sp;
+    case ARM_REG_LR:
+      return (gsize *) &cpu_context->lr;
+    default:
+      return NULL;
+  }
+#else
+  return NULL;
+#endif
+}
+
+#endif
@@ -40,6 +40,12 @@ G_DECLARE_FINAL_TYPE (GumCallbackStalkerTransformer,
     gum_callback_stalker_transformer, GUM, CALLBACK_STALKER_TRANSFORMER,
     GObject)
 
+#define GUM_TYPE_EDGE_COVERAGE_STALKER_TRANSFORMER \
+    (gum_edge_coverage_stalker_transformer_get_type ())
+G_DECLARE_FINAL_TYPE (GumEdgeCoverageStalkerTransformer,
+    gum_edge_coverage_stalker_transformer, GUM,
+    EDGE_COVERAGE_STALKER_TRANSFORMER, GObject)
+
 typedef struct _GumStalkerIterator GumStalkerIterator;
 typedef struct _GumStalkerOutput GumStalkerOutput;
 typedef union _GumStalkerWriter GumStalkerWriter;
@@ -47,9 +53,15 @@ typedef void (* GumStalkerTransformerCallback) (GumStalkerIterator * iterator,
     GumStalkerOutput * output, gpointer user_data);
 typedef void (* GumStalkerCallout) (GumCpuContext * cpu_context,
     gpointer user_data);
+typedef void (* GumStalkerLightCallout) (gsize * registers,
+    gpointer user_data);
+typedef guint32 (* GumEdgeCoverageHashFunc) (GumAddress block_address,
+    gpointer user_data);
 
 typedef guint GumProbeId;
 typedef struct _GumCallDetails GumCallDetails;
+typedef struct _GumStalkerCodeCacheStats GumStalkerCodeCacheStats;
+typedef struct _GumStalkerBlockCount GumStalkerBlockCount;
 typedef void (* GumCallProbeCallback) (GumCallDetails * details,
     gpointer user_data);
 
@@ -85,6 +97,21 @@ struct _GumCallDetails
   GumCpuContext * cpu_context;
 };
 
+struct _GumStalkerCodeCacheStats
+{
+  guint evictions;
+  guint evicted_blocks;
+  gsize evicted_bytes;
+  guint prefetched_blocks;
+};
+
+struct _GumStalkerBlockCount
+{
+  gpointer start;
+  gpointer end;
+  guint64 count;
+};
+
 GUM_API gboolean gum_stalker_is_supported (void);
 
 GUM_API GumStalker * gum_stalker_new (void);
@@ -96,6 +123,86 @@ GUM_API gint gum_stalker_get_trust_threshold (GumStalker * self);
 GUM_API void gum_stalker_set_trust_threshold (GumStalker * self,
     gint trust_threshold);
 
+/*
+ * Once a block has been dispatched trace_threshold times it is recompiled as
+ * a superblock that runs straight through direct jumps and conditional
+ * branches, leaving through side exits when the other way is taken. Backward
+ * branches are assumed taken, so hot loops get unrolled a few times. Blocks
+ * are only linked to each other once they have become traces, and only the
+ * first block of a trace is checked for modifications and invalidated. A
+ * threshold of 0 disables traces, which is the default. Only supported on x86
+ * for now.
+ */
+GUM_API guint gum_stalker_get_trace_threshold (GumStalker * self);
+GUM_API void gum_stalker_set_trace_threshold (GumStalker * self,
+    guint trace_threshold);
+
+/*
+ * Caps the amount of memory each followed thread may use for translated code.
+ * Once exceeded, the thread's code cache is flushed and rebuilt on demand,
+ * recycling the slabs of the previous generation. A budget of 0 means
+ * unlimited, which is the default. Only supported on x86 for now.
+ */
+GUM_API gsize gum_stalker_get_code_cache_budget (GumStalker * self);
+GUM_API void gum_stalker_set_code_cache_budget (GumStalker * self,
+    gsize budget);
+GUM_API void gum_stalker_query_code_cache_stats (GumStalker * self,
+    GumStalkerCodeCacheStats * stats);
+
+/*
+ * When enabled, blocks compiled from then on bump a counter stored next to
+ * their metadata each time they are entered. Blocks inlined into a trace get
+ * counters of their own, so the counts don't depend on the trace threshold.
+ * The snapshot is an array of GumStalkerBlockCount covering blocks that have
+ * run at least once, summed across all followed threads, and is taken without
+ * stopping them. Only supported on x86 for now.
+ */
+GUM_API gboolean gum_stalker_get_block_counters_enabled (GumStalker * self);
+GUM_API void gum_stalker_set_block_counters_enabled (GumStalker * self,
+    gboolean enabled);
+GUM_API GArray * gum_stalker_snapshot_block_counts (GumStalker * self);
+
+/*
+ * Stalker keeps a per-thread stack of (return address, translated return
+ * address) pairs for the calls it has seen. With the shadow stack enabled,
+ * rets compiled from then on check the top of it inline and return straight
+ * into the translated code, and when it doesn't match, e.g. after longjmp(),
+ * the stack is unwound to the matching frame instead of being dropped. The
+ * snapshot lists the return addresses of the calling thread, innermost first,
+ * and is meant to be taken from a callout or probe. Only supported on x86 for
+ * now.
+ */
+GUM_API gboolean gum_stalker_get_shadow_stack_enabled (GumStalker * self);
+GUM_API void gum_stalker_set_shadow_stack_enabled (GumStalker * self,
+    gboolean enabled);
+GUM_API GArray * gum_stalker_snapshot_call_stack (GumStalker * self);
+
+/*
+ * Spawns a helper thread that compiles the static successors of freshly
+ * compiled blocks, i.e. direct call, jump and branch targets, a few levels
+ * deep, so followed threads spend less time compiling on first use. Compile
+ * events for such blocks are emitted once they are first reached, and the
+ * number of blocks prefetched so far is included in the code cache stats. Only
+ * takes effect with the default transformer, without a code cache budget, and
+ * where RWX pages are supported. Only supported on x86 for now.
+ */
+GUM_API gboolean gum_stalker_get_prefetch_enabled (GumStalker * self);
+GUM_API void gum_stalker_set_prefetch_enabled (GumStalker * self,
+    gboolean enabled);
+
+/*
+ * Maps each code slab twice, once RX for execution and once RW for writing,
+ * so code can be written and patched without flipping page protections, even
+ * where RWX pages are not allowed. Backed by a memfd, so only available on
+ * Linux, and must be set before any thread is followed. Beware that the pages
+ * remain shared with any child created with fork(). Only supported on x86 for
+ * now, and only covers the Stalker's own slabs: trampolines from the code
+ * allocator, e.g. the Interceptor's, still have their protections flipped.
+ */
+GUM_API gboolean gum_stalker_get_dual_mapping_enabled (GumStalker * self);
+GUM_API void gum_stalker_set_dual_mapping_enabled (GumStalker * self,
+    gboolean enabled);
+
 GUM_API void gum_stalker_flush (GumStalker * self);
 GUM_API void gum_stalker_stop (GumStalker * self);
 GUM_API gboolean gum_stalker_garbage_collect (GumStalker * self);
@@ -107,6 +214,17 @@ GUM_API gboolean gum_stalker_is_following_me (GumStalker * self);
 
 GUM_API void gum_stalker_follow (GumStalker * self, GumThreadId thread_id,
     GumStalkerTransformer * transformer, GumEventSink * sink);
+/*
+ * Follows many threads at once. Threads that are already being followed are
+ * skipped. On Linux all of the other threads are stopped and infected in one
+ * go, which is far cheaper than calling gum_stalker_follow() for each of them.
+ * gum_stalker_follow_all() follows every thread except the calling one.
+ */
+GUM_API void gum_stalker_follow_threads (GumStalker * self,
+    const GumThreadId * thread_ids, guint n_threads,
+    GumStalkerTransformer * transformer, GumEventSink * sink);
+GUM_API void gum_stalker_follow_all (GumStalker * self,
+    GumStalkerTransformer * transformer, GumEventSink * sink);
 GUM_API void gum_stalker_unfollow (GumStalker * self, GumThreadId thread_id);
 
 GUM_API void gum_stalker_activate (GumStalker * self, gconstpointer target);
@@ -239,6 +357,16 @@ GUM_API GumStalkerTransformer * gum_stalker_transformer_make_default (void);
 GUM_API GumStalkerTransformer * gum_stalker_transformer_make_from_callback (
     GumStalkerTransformerCallback callback, gpointer data,
     GDestroyNotify data_destroy);
+/*
+ * AFL-style edge coverage: each block increments
+ * bitmap[hash (block) ^ (hash (previous block) >> 1)], where size must be a
+ * power of two. On x86 this is done by a few inline instructions without
+ * leaving the translated code. A NULL hash picks AFL's location hashing. The
+ * previous location is shared by all threads using the same transformer.
+ */
+GUM_API GumStalkerTransformer * gum_stalker_transformer_make_edge_coverage (
+    guint8 * bitmap, gsize size, GumEdgeCoverageHashFunc hash,
+    gpointer hash_data);
 
 GUM_API void gum_stalker_transformer_transform_block (
     GumStalkerTransformer * self, GumStalkerIterator * iterator,
@@ -249,6 +377,16 @@ GUM_API gboolean gum_stalker_iterator_next (GumStalkerIterator * self,
 GUM_API void gum_stalker_iterator_keep (GumStalkerIterator * self);
 GUM_API void gum_stalker_iterator_put_callout (GumStalkerIterator * self,
     GumStalkerCallout callout, gpointer data, GDestroyNotify data_destroy);
+/*
+ * Like a callout, but only the given registers are saved and handed to the
+ * callout as an array of values in the same order; changes made to the array
+ * are written back. Registers are GumCpuReg values on x86 and Capstone
+ * register IDs elsewhere. The stack pointer may not be requested on x86.
+ */
+GUM_API void gum_stalker_iterator_put_light_callout (
+    GumStalkerIterator * self, const guint * registers, guint n_registers,
+    GumStalkerLightCallout callout, gpointer data,
+    GDestroyNotify data_destroy);
 
 GUM_API void gum_stalker_set_counters_enabled (gboolean enabled);
 GUM_API void gum_stalker_dump_counters (void);
@@ -7,6 +7,7 @@
 #include "gumx86relocator.h"
 
 #include "gummemory.h"
+#include "gumx86decoder.h"
 #include "testutil.h"
 
 #include <string.h>
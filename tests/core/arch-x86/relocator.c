@@ -25,6 +25,12 @@ TESTLIST_BEGIN (relocator)
   TESTENTRY (jcxz_short_within_block)
   TESTENTRY (jcxz_short_outside_block)
   TESTENTRY (peek_next_write)
+  TESTENTRY (read_without_instruction)
+  TESTENTRY (decoder_rex_w_immediate)
+  TESTENTRY (decoder_operand_size_immediate)
+  TESTENTRY (decoder_operand_size_with_rex_w_immediate)
+  TESTENTRY (decoder_sib_without_base)
+  TESTENTRY (decoder_rip_relative)
   TESTENTRY (skip_instruction)
   TESTENTRY (eob_and_eoi_on_jmp)
   TESTENTRY (eob_but_not_eoi_on_call)
@@ -467,6 +473,154 @@ TESTCASE (peek_next_write)
   g_assert_false (gum_x86_relocator_write_one (&fixture->rl));
 }
 
+TESTCASE (read_without_instruction)
+{
+  guint8 input[] = {
+    0x55,                               /* push ebp                 */
+    0x8b, 0xec,                         /* mov ebp, esp             */
+    0x81, 0xec, 0x00, 0x01, 0x00, 0x00, /* sub esp, 0x100           */
+    0x66, 0xc7, 0x44, 0x24, 0x08,       /* mov word [esp + 8], 0x2a */
+        0x2a, 0x00,
+    0xc1, 0xe0, 0x04,                   /* shl eax, 4               */
+    0x74, 0x01,                         /* jz +1                    */
+    0xc3                                /* retn                     */
+  };
+
+  SETUP_RELOCATOR_WITH (input);
+
+  g_assert_cmpuint (gum_x86_relocator_read_one (&fixture->rl, NULL), ==, 1);
+  g_assert_cmpuint (gum_x86_relocator_read_one (&fixture->rl, NULL), ==, 3);
+  g_assert_cmpuint (gum_x86_relocator_read_one (&fixture->rl, NULL), ==, 9);
+  g_assert_cmpuint (gum_x86_relocator_read_one (&fixture->rl, NULL), ==, 16);
+  g_assert_cmpuint (gum_x86_relocator_read_one (&fixture->rl, NULL), ==, 19);
+  g_assert_false (gum_x86_relocator_eob (&fixture->rl));
+  g_assert_cmpuint (gum_x86_relocator_read_one (&fixture->rl, NULL), ==, 21);
+  g_assert_true (gum_x86_relocator_eob (&fixture->rl));
+  g_assert_false (gum_x86_relocator_eoi (&fixture->rl));
+
+  g_assert_true (gum_x86_relocator_write_one (&fixture->rl));
+  g_assert_cmpint (gum_x86_relocator_peek_next_write_insn (&fixture->rl)->id,
+      ==, X86_INS_MOV);
+  g_assert_cmpuint (
+      gum_x86_relocator_peek_next_write_insn (&fixture->rl)->size, ==, 2);
+  while (gum_x86_relocator_peek_next_write_insn (&fixture->rl)->id !=
+      X86_INS_JE)
+  {
+    g_assert_true (gum_x86_relocator_write_one (&fixture->rl));
+  }
+  gum_x86_writer_flush (&fixture->cw);
+
+  g_assert_cmpuint (gum_x86_writer_offset (&fixture->cw), ==, 19);
+  g_assert_cmpint (memcmp (fixture->output, input, 19), ==, 0);
+}
+
+TESTCASE (decoder_rex_w_immediate)
+{
+  const guint8 mov_rax_imm64[] = {
+    0x48, 0xb8, 0x88, 0x77, 0x66, 0x55, 0x44, 0x33, 0x22, 0x11
+  };
+  const guint8 add_rax_imm32[] = { 0x48, 0x81, 0xc0, 0x44, 0x33, 0x22, 0x11 };
+  const guint8 mov_mem_imm32[] = {
+    0x48, 0xc7, 0x00, 0x44, 0x33, 0x22, 0x11
+  };
+  GumX86InsnInfo info;
+
+  g_assert_true (gum_x86_decoder_decode_one (mov_rax_imm64, GUM_CPU_AMD64,
+      &info));
+  g_assert_cmpuint (info.length, ==, sizeof (mov_rax_imm64));
+
+  g_assert_true (gum_x86_decoder_decode_one (add_rax_imm32, GUM_CPU_AMD64,
+      &info));
+  g_assert_cmpuint (info.length, ==, sizeof (add_rax_imm32));
+
+  g_assert_true (gum_x86_decoder_decode_one (mov_mem_imm32, GUM_CPU_AMD64,
+      &info));
+  g_assert_cmpuint (info.length, ==, sizeof (mov_mem_imm32));
+}
+
+TESTCASE (decoder_operand_size_immediate)
+{
+  const guint8 mov_ax_imm16[] = { 0x66, 0xb8, 0x22, 0x11 };
+  const guint8 add_ax_imm16[] = { 0x66, 0x81, 0xc0, 0x22, 0x11 };
+  const guint8 test_ax_imm16[] = { 0x66, 0xf7, 0xc0, 0x22, 0x11 };
+  GumX86InsnInfo info;
+
+  g_assert_true (gum_x86_decoder_decode_one (mov_ax_imm16, GUM_CPU_AMD64,
+      &info));
+  g_assert_cmpuint (info.length, ==, sizeof (mov_ax_imm16));
+
+  g_assert_true (gum_x86_decoder_decode_one (add_ax_imm16, GUM_CPU_AMD64,
+      &info));
+  g_assert_cmpuint (info.length, ==, sizeof (add_ax_imm16));
+
+  g_assert_true (gum_x86_decoder_decode_one (test_ax_imm16, GUM_CPU_AMD64,
+      &info));
+  g_assert_cmpuint (info.length, ==, sizeof (test_ax_imm16));
+}
+
+TESTCASE (decoder_operand_size_with_rex_w_immediate)
+{
+  const guint8 add_rax_imm32[] = {
+    0x66, 0x48, 0x81, 0xc0, 0x44, 0x33, 0x22, 0x11
+  };
+  const guint8 test_rax_imm32[] = {
+    0x66, 0x48, 0xf7, 0xc0, 0x44, 0x33, 0x22, 0x11
+  };
+  GumX86InsnInfo info;
+
+  g_assert_true (gum_x86_decoder_decode_one (add_rax_imm32, GUM_CPU_AMD64,
+      &info));
+  g_assert_cmpuint (info.length, ==, sizeof (add_rax_imm32));
+
+  g_assert_true (gum_x86_decoder_decode_one (test_rax_imm32, GUM_CPU_AMD64,
+      &info));
+  g_assert_cmpuint (info.length, ==, sizeof (test_rax_imm32));
+}
+
+TESTCASE (decoder_sib_without_base)
+{
+  const guint8 mov_eax_abs[] = { 0x8b, 0x04, 0x25, 0x44, 0x33, 0x22, 0x11 };
+  const guint8 mov_eax_index[] = {
+    0x8b, 0x04, 0x8d, 0x44, 0x33, 0x22, 0x11
+  };
+  GumX86InsnInfo info;
+
+  g_assert_true (gum_x86_decoder_decode_one (mov_eax_abs, GUM_CPU_AMD64,
+      &info));
+  g_assert_cmpuint (info.length, ==, sizeof (mov_eax_abs));
+  g_assert_false (info.is_rip_relative);
+
+  g_assert_true (gum_x86_decoder_decode_one (mov_eax_index, GUM_CPU_AMD64,
+      &info));
+  g_assert_cmpuint (info.length, ==, sizeof (mov_eax_index));
+  g_assert_false (info.is_rip_relative);
+}
+
+TESTCASE (decoder_rip_relative)
+{
+  const guint8 mov_rax_rip[] = { 0x48, 0x8b, 0x05, 0x44, 0x33, 0x22, 0x11 };
+  const guint8 cmp_rip_imm8[] = {
+    0x83, 0x3d, 0x44, 0x33, 0x22, 0x11, 0x00
+  };
+  GumX86InsnInfo info;
+
+  g_assert_true (gum_x86_decoder_decode_one (mov_rax_rip, GUM_CPU_AMD64,
+      &info));
+  g_assert_cmpuint (info.length, ==, sizeof (mov_rax_rip));
+  g_assert_true (info.is_rip_relative);
+  g_assert_cmpuint (info.modrm_offset, ==, 2);
+
+  g_assert_true (gum_x86_decoder_decode_one (cmp_rip_imm8, GUM_CPU_AMD64,
+      &info));
+  g_assert_cmpuint (info.length, ==, sizeof (cmp_rip_imm8));
+  g_assert_true (info.is_rip_relative);
+
+  g_assert_true (gum_x86_decoder_decode_one (mov_rax_rip + 1, GUM_CPU_IA32,
+      &info));
+  g_assert_cmpuint (info.length, ==, sizeof (mov_rax_rip) - 1);
+  g_assert_false (info.is_rip_relative);
+}
+
 TESTCASE (skip_instruction)
 {
   guint8 input[] = {
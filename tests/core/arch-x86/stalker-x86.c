@@ -25,7 +25,17 @@ TESTLIST_BEGIN (stalker)
   TESTENTRY (exec)
   TESTENTRY (call_depth)
   TESTENTRY (call_probe)
+  TESTENTRY (call_probe_among_many_targets)
   TESTENTRY (custom_transformer)
+  TESTENTRY (light_callout)
+  TESTENTRY (edge_coverage_transformer)
+  TESTENTRY (block_counters)
+  TESTENTRY (hot_loop_should_be_traced)
+  TESTENTRY (trace_should_report_each_segment_as_a_block)
+  TESTENTRY (block_counters_should_include_trace_segments)
+  TESTENTRY (prefetching_should_not_affect_execution)
+  TESTENTRY (shadow_stack_should_track_calls)
+  TESTENTRY (dual_mapping_should_not_affect_execution)
   TESTENTRY (unfollow_should_be_allowed_before_first_transform)
   TESTENTRY (unfollow_should_be_allowed_mid_first_transform)
   TESTENTRY (unfollow_should_be_allowed_after_first_transform)
@@ -72,10 +82,12 @@ TESTLIST_BEGIN (stalker)
 #endif
   TESTENTRY (no_red_zone_clobber)
   TESTENTRY (big_block)
+  TESTENTRY (code_cache_budget_should_trigger_eviction)
 
   TESTENTRY (heap_api)
   TESTENTRY (follow_syscall)
   TESTENTRY (follow_thread)
+  TESTENTRY (follow_threads)
   TESTENTRY (unfollow_should_handle_terminated_thread)
   TESTENTRY (self_modifying_code_should_be_detected_with_threshold_minus_one)
   TESTENTRY (self_modifying_code_should_not_be_detected_with_threshold_zero)
@@ -110,6 +122,16 @@ static void pretend_workload (GumMemoryRange * runner_range);
 static void insert_extra_increment_after_xor (GumStalkerIterator * iterator,
     GumStalkerOutput * output, gpointer user_data);
 static void store_xax (GumCpuContext * cpu_context, gpointer user_data);
+static void insert_light_callout_before_ret (GumStalkerIterator * iterator,
+    GumStalkerOutput * output, gpointer user_data);
+static void replace_xax (gsize * registers, gpointer user_data);
+static void insert_call_stack_snapshot_before_ret (
+    GumStalkerIterator * iterator, GumStalkerOutput * output,
+    gpointer user_data);
+static void snapshot_call_stack (GumCpuContext * cpu_context,
+    gpointer user_data);
+static guint32 hash_and_count_block (GumAddress block_address,
+    gpointer user_data);
 static void unfollow_during_transform (GumStalkerIterator * iterator,
     GumStalkerOutput * output, gpointer user_data);
 static void modify_to_return_true_after_three_calls (
@@ -126,6 +148,7 @@ static void modify_to_return_true_on_subsequent_transform (
     gpointer user_data);
 static void add_n_return_value_increments (GumStalkerIterator * iterator,
     GumStalkerOutput * output, gpointer user_data);
+static void wait_for_prefetch (GumStalker * stalker);
 static void invoke_follow_return_code (TestStalkerFixture * fixture);
 static void invoke_unfollow_deep_code (TestStalkerFixture * fixture);
 
@@ -214,6 +237,42 @@ TESTCASE (follow_thread)
   sdc_finalize (&channel);
 }
 
+TESTCASE (follow_threads)
+{
+  StalkerDummyChannel channel;
+  GThread * thread;
+  GumThreadId thread_id;
+
+  sdc_init (&channel);
+
+  thread = g_thread_new ("stalker-test-target", run_stalked_briefly, &channel);
+  thread_id = sdc_await_thread_id (&channel);
+
+  fixture->sink->mask = GUM_EXEC | GUM_CALL | GUM_RET;
+  gum_stalker_follow_threads (fixture->stalker, &thread_id, 1, NULL,
+      GUM_EVENT_SINK (fixture->sink));
+  gum_stalker_follow_threads (fixture->stalker, &thread_id, 1, NULL,
+      GUM_EVENT_SINK (fixture->sink));
+  sdc_put_follow_confirmation (&channel);
+
+  sdc_await_run_confirmation (&channel);
+  g_assert_cmpuint (fixture->sink->events->len, >, 0);
+
+  gum_stalker_unfollow (fixture->stalker, thread_id);
+  sdc_put_unfollow_confirmation (&channel);
+
+  sdc_await_flush_confirmation (&channel);
+  gum_fake_event_sink_reset (fixture->sink);
+
+  sdc_put_finish_confirmation (&channel);
+
+  g_thread_join (thread);
+
+  g_assert_cmpuint (fixture->sink->events->len, ==, 0);
+
+  sdc_finalize (&channel);
+}
+
 static gpointer
 run_stalked_briefly (gpointer data)
 {
@@ -402,7 +461,7 @@ TESTCASE (performance)
 {
   GumMemoryRange runner_range;
   GTimer * timer;
-  gdouble duration_direct, duration_stalked;
+  gdouble duration_direct, duration_stalked, duration_traced;
 
   runner_range.base_address = 0;
   runner_range.size = 0;
@@ -436,10 +495,27 @@ TESTCASE (performance)
 
   gum_stalker_unfollow_me (fixture->stalker);
 
+  gum_stalker_set_trace_threshold (fixture->stalker, 2);
+  gum_stalker_follow_me (fixture->stalker, fixture->transformer,
+      GUM_EVENT_SINK (fixture->sink));
+
+  /* warm-up, long enough for the hot paths to turn into traces */
+  pretend_workload (&runner_range);
+  pretend_workload (&runner_range);
+
+  g_timer_reset (timer);
+  pretend_workload (&runner_range);
+  duration_traced = g_timer_elapsed (timer, NULL);
+
+  gum_stalker_unfollow_me (fixture->stalker);
+  gum_stalker_set_trace_threshold (fixture->stalker, 0);
+
   g_timer_destroy (timer);
 
-  g_print ("<duration_direct=%f duration_stalked=%f ratio=%f> ",
-      duration_direct, duration_stalked, duration_stalked / duration_direct);
+  g_print ("<duration_direct=%f duration_stalked=%f ratio=%f "
+      "duration_traced=%f traced_ratio=%f> ",
+      duration_direct, duration_stalked, duration_stalked / duration_direct,
+      duration_traced, duration_traced / duration_direct);
 
   gum_stalker_dump_counters ();
 }
@@ -636,40 +712,41 @@ struct _CallProbeContext
 static void probe_func_a_invocation (GumCallDetails * details,
     gpointer user_data);
 
-TESTCASE (call_probe)
+static const guint8 call_probe_code[] =
 {
-  const guint8 code_template[] =
-  {
-    0x68, 0x44, 0x44, 0xaa, 0xaa, /* push 0xaaaa4444     */
-    0x68, 0x33, 0x33, 0xaa, 0xaa, /* push 0xaaaa3333     */
-    0xba, 0x22, 0x22, 0xaa, 0xaa, /* mov edx, 0xaaaa2222 */
-    0xb9, 0x11, 0x11, 0xaa, 0xaa, /* mov ecx, 0xaaaa1111 */
-    0xe8, 0x1b, 0x00, 0x00, 0x00, /* call func_a         */
-    0x68, 0x44, 0x44, 0xaa, 0xaa, /* push 0xbbbb4444     */
-    0x68, 0x33, 0x33, 0xaa, 0xaa, /* push 0xbbbb3333     */
-    0xba, 0x22, 0x22, 0xaa, 0xaa, /* mov edx, 0xbbbb2222 */
-    0xb9, 0x11, 0x11, 0xaa, 0xaa, /* mov ecx, 0xbbbb1111 */
-    0xe8, 0x06, 0x00, 0x00, 0x00, /* call func_b         */
-    0xc3,                         /* ret                 */
+  0x68, 0x44, 0x44, 0xaa, 0xaa, /* push 0xaaaa4444     */
+  0x68, 0x33, 0x33, 0xaa, 0xaa, /* push 0xaaaa3333     */
+  0xba, 0x22, 0x22, 0xaa, 0xaa, /* mov edx, 0xaaaa2222 */
+  0xb9, 0x11, 0x11, 0xaa, 0xaa, /* mov ecx, 0xaaaa1111 */
+  0xe8, 0x1b, 0x00, 0x00, 0x00, /* call func_a         */
+  0x68, 0x44, 0x44, 0xaa, 0xaa, /* push 0xbbbb4444     */
+  0x68, 0x33, 0x33, 0xaa, 0xaa, /* push 0xbbbb3333     */
+  0xba, 0x22, 0x22, 0xaa, 0xaa, /* mov edx, 0xbbbb2222 */
+  0xb9, 0x11, 0x11, 0xaa, 0xaa, /* mov ecx, 0xbbbb1111 */
+  0xe8, 0x06, 0x00, 0x00, 0x00, /* call func_b         */
+  0xc3,                         /* ret                 */
 
-    0xcc,                         /* int 3               */
+  0xcc,                         /* int 3               */
 
-    /* func_a: */
-    0xc2, 2 * sizeof (gpointer), 0x00, /* ret x          */
+  /* func_a: */
+  0xc2, 2 * sizeof (gpointer), 0x00, /* ret x          */
 
-    0xcc,                         /* int 3               */
+  0xcc,                         /* int 3               */
 
-    /* func_b: */
-    0xc2, 2 * sizeof (gpointer), 0x00, /* ret x          */
-  };
+  /* func_b: */
+  0xc2, 2 * sizeof (gpointer), 0x00, /* ret x          */
+};
+
+TESTCASE (call_probe)
+{
   StalkerTestFunc func;
   guint8 * func_a;
   CallProbeContext probe_ctx, secondary_probe_ctx;
   GumProbeId probe_id;
 
   func = GUM_POINTER_TO_FUNCPTR (StalkerTestFunc,
-      test_stalker_fixture_dup_code (fixture, code_template,
-          sizeof (code_template)));
+      test_stalker_fixture_dup_code (fixture, call_probe_code,
+          sizeof (call_probe_code)));
 
   func_a = fixture->code + 52;
 
@@ -696,6 +773,42 @@ TESTCASE (call_probe)
   g_assert_cmpuint (secondary_probe_ctx.num_calls, ==, 2);
 }
 
+TESTCASE (call_probe_among_many_targets)
+{
+  StalkerTestFunc func;
+  guint8 * func_a;
+  CallProbeContext probe_ctx;
+  GumProbeId other_ids[500];
+  guint i;
+
+  func = GUM_POINTER_TO_FUNCPTR (StalkerTestFunc,
+      test_stalker_fixture_dup_code (fixture, call_probe_code,
+          sizeof (call_probe_code)));
+
+  func_a = fixture->code + 52;
+
+  for (i = 0; i != G_N_ELEMENTS (other_ids); i++)
+  {
+    other_ids[i] = gum_stalker_add_call_probe (fixture->stalker,
+        GSIZE_TO_POINTER (0x1000 + (i * 16)), probe_func_a_invocation, NULL,
+        NULL);
+  }
+
+  probe_ctx.num_calls = 0;
+  probe_ctx.target_address = func_a;
+  probe_ctx.return_address = fixture->code + 25;
+  gum_stalker_add_call_probe (fixture->stalker, func_a,
+      probe_func_a_invocation, &probe_ctx, NULL);
+  test_stalker_fixture_follow_and_invoke (fixture, func, 0);
+  g_assert_cmpuint (probe_ctx.num_calls, ==, 1);
+
+  for (i = 0; i != G_N_ELEMENTS (other_ids); i++)
+    gum_stalker_remove_call_probe (fixture->stalker, other_ids[i]);
+
+  test_stalker_fixture_follow_and_invoke (fixture, func, 0);
+  g_assert_cmpuint (probe_ctx.num_calls, ==, 2);
+}
+
 static void
 probe_func_a_invocation (GumCallDetails * details,
                          gpointer user_data)
@@ -811,6 +924,404 @@ store_xax (GumCpuContext * cpu_context,
   *last_xax = GUM_CPU_CONTEXT_XAX (cpu_context);
 }
 
+TESTCASE (light_callout)
+{
+  gsize last_xax = 0;
+
+  fixture->transformer = gum_stalker_transformer_make_from_callback (
+      insert_light_callout_before_ret, &last_xax, NULL);
+
+  invoke_flat_expecting_return_value (fixture, GUM_NOTHING, 1337);
+
+  g_assert_cmpuint (last_xax, ==, 2);
+}
+
+static void
+insert_light_callout_before_ret (GumStalkerIterator * iterator,
+                                 GumStalkerOutput * output,
+                                 gpointer user_data)
+{
+  static const guint registers[] = { GUM_REG_XBP, GUM_REG_XAX };
+  const cs_insn * insn;
+  gboolean in_leaf_func;
+
+  in_leaf_func = FALSE;
+
+  while (gum_stalker_iterator_next (iterator, &insn))
+  {
+    if (in_leaf_func && insn->id == X86_INS_RET)
+    {
+      gum_stalker_iterator_put_light_callout (iterator, registers,
+          G_N_ELEMENTS (registers), replace_xax, user_data, NULL);
+    }
+
+    gum_stalker_iterator_keep (iterator);
+
+    if (insn->id == X86_INS_XOR)
+      in_leaf_func = TRUE;
+  }
+}
+
+static void
+replace_xax (gsize * registers,
+             gpointer user_data)
+{
+  gsize * last_xax = user_data;
+
+  *last_xax = registers[1];
+  registers[1] = 1337;
+}
+
+TESTCASE (edge_coverage_transformer)
+{
+  guint8 bitmap[1024] = { 0, };
+  guint num_hashed_blocks = 0;
+  guint total_hits, i;
+
+  fixture->transformer = gum_stalker_transformer_make_edge_coverage (bitmap,
+      sizeof (bitmap), hash_and_count_block, &num_hashed_blocks);
+
+  invoke_jumpy (fixture, GUM_NOTHING);
+
+  g_assert_cmpuint (num_hashed_blocks, >=, 3);
+
+  total_hits = 0;
+  for (i = 0; i != G_N_ELEMENTS (bitmap); i++)
+    total_hits += bitmap[i];
+  g_assert_cmpuint (total_hits, >=, 3);
+}
+
+static guint32
+hash_and_count_block (GumAddress block_address,
+                      gpointer user_data)
+{
+  guint * num_hashed_blocks = user_data;
+
+  (*num_hashed_blocks)++;
+
+  return (guint32) (block_address ^ (block_address >> 12));
+}
+
+TESTCASE (block_counters)
+{
+  FlatFunc f;
+  GArray * counts;
+  guint i;
+  const GumStalkerBlockCount * flat_count = NULL;
+
+  f = GUM_POINTER_TO_FUNCPTR (FlatFunc,
+      test_stalker_fixture_dup_code (fixture, flat_code, sizeof (flat_code)));
+
+  gum_stalker_set_block_counters_enabled (fixture->stalker, TRUE);
+  g_assert_true (gum_stalker_get_block_counters_enabled (fixture->stalker));
+
+  gum_stalker_follow_me (fixture->stalker, fixture->transformer, NULL);
+  f ();
+  f ();
+  f ();
+  counts = gum_stalker_snapshot_block_counts (fixture->stalker);
+  gum_stalker_unfollow_me (fixture->stalker);
+
+  for (i = 0; i != counts->len; i++)
+  {
+    const GumStalkerBlockCount * count =
+        &g_array_index (counts, GumStalkerBlockCount, i);
+
+    if (count->start == f)
+      flat_count = count;
+  }
+
+  g_assert_nonnull (flat_count);
+  g_assert_true (flat_count->end == (guint8 *) f + sizeof (flat_code));
+  g_assert_cmpuint (flat_count->count, ==, 3);
+
+  g_array_free (counts, TRUE);
+}
+
+static const guint8 loop_code[] = {
+  0x31, 0xc0,                   /* xor eax, eax    */
+  0xb9, 0x64, 0x00, 0x00, 0x00, /* mov ecx, 100    */
+  0xff, 0xc0,                   /* loop: inc eax   */
+  0xff, 0xc9,                   /* dec ecx         */
+  0x75, 0xfa,                   /* jnz loop        */
+  0xc3                          /* ret             */
+};
+
+TESTCASE (hot_loop_should_be_traced)
+{
+  guint8 * code;
+  StalkerTestFunc func;
+  gint ret;
+  guint num_loop_compiles, i;
+
+  code = test_stalker_fixture_dup_code (fixture, loop_code, sizeof (loop_code));
+  func = GUM_POINTER_TO_FUNCPTR (StalkerTestFunc, code);
+
+  gum_stalker_set_trace_threshold (fixture->stalker, 2);
+  g_assert_cmpuint (gum_stalker_get_trace_threshold (fixture->stalker), ==, 2);
+
+  fixture->sink->mask = GUM_COMPILE;
+  ret = test_stalker_fixture_follow_and_invoke (fixture, func, -1);
+  g_assert_cmpint (ret, ==, 100);
+
+  num_loop_compiles = 0;
+  for (i = 0; i != fixture->sink->events->len; i++)
+  {
+    const GumCompileEvent * ev =
+        &g_array_index (fixture->sink->events, GumEvent, i).compile;
+
+    if (ev->type == GUM_COMPILE && ev->start == code + 7)
+      num_loop_compiles++;
+  }
+  g_assert_cmpuint (num_loop_compiles, ==, 2);
+}
+
+static const guint8 split_loop_code[] =
+{
+  0xb8, 0x00, 0x00, 0x00, 0x00, /* mov eax, 0      */
+  0xb9, 0x64, 0x00, 0x00, 0x00, /* mov ecx, 100    */
+  0xff, 0xc0,                   /* loop: inc eax   */
+  0xeb, 0x01,                   /* jmp next        */
+  0xcc,                         /* int3            */
+  0xff, 0xc9,                   /* next: dec ecx   */
+  0x75, 0xf7,                   /* jnz loop        */
+  0xc3                          /* ret             */
+};
+
+TESTCASE (trace_should_report_each_segment_as_a_block)
+{
+  guint8 * code;
+  StalkerTestFunc func;
+  gint ret;
+  guint num_head_blocks, num_tail_blocks, i;
+
+  code = test_stalker_fixture_dup_code (fixture, split_loop_code,
+      sizeof (split_loop_code));
+  func = GUM_POINTER_TO_FUNCPTR (StalkerTestFunc, code);
+
+  gum_stalker_set_trace_threshold (fixture->stalker, 2);
+
+  fixture->sink->mask = GUM_BLOCK;
+  ret = test_stalker_fixture_follow_and_invoke (fixture, func, -1);
+  g_assert_cmpint (ret, ==, 100);
+
+  num_head_blocks = 0;
+  num_tail_blocks = 0;
+  for (i = 0; i != fixture->sink->events->len; i++)
+  {
+    const GumBlockEvent * ev =
+        &g_array_index (fixture->sink->events, GumEvent, i).block;
+
+    if (ev->type != GUM_BLOCK)
+      continue;
+
+    if (ev->start == code + 10)
+    {
+      g_assert_true (ev->end == code + 14);
+      num_head_blocks++;
+    }
+    else if (ev->start == code + 15)
+    {
+      g_assert_true (ev->end == code + 19);
+      num_tail_blocks++;
+    }
+  }
+  g_assert_cmpuint (num_head_blocks, ==, 99);
+  g_assert_cmpuint (num_tail_blocks, ==, 100);
+}
+
+TESTCASE (block_counters_should_include_trace_segments)
+{
+  guint8 * code;
+  StalkerTestFunc func;
+  gint ret;
+  GArray * counts;
+  guint64 num_head_entries, num_tail_entries;
+  guint i;
+
+  code = test_stalker_fixture_dup_code (fixture, split_loop_code,
+      sizeof (split_loop_code));
+  func = GUM_POINTER_TO_FUNCPTR (StalkerTestFunc, code);
+
+  gum_stalker_set_trace_threshold (fixture->stalker, 2);
+  gum_stalker_set_block_counters_enabled (fixture->stalker, TRUE);
+
+  gum_stalker_follow_me (fixture->stalker, fixture->transformer, NULL);
+  ret = func (-1);
+  counts = gum_stalker_snapshot_block_counts (fixture->stalker);
+  gum_stalker_unfollow_me (fixture->stalker);
+
+  g_assert_cmpint (ret, ==, 100);
+
+  num_head_entries = 0;
+  num_tail_entries = 0;
+  for (i = 0; i != counts->len; i++)
+  {
+    const GumStalkerBlockCount * count =
+        &g_array_index (counts, GumStalkerBlockCount, i);
+
+    if (count->start == code + 10)
+    {
+      g_assert_true (count->end == code + 14);
+      num_head_entries = count->count;
+    }
+    else if (count->start == code + 15)
+    {
+      g_assert_true (count->end == code + 19);
+      num_tail_entries = count->count;
+    }
+  }
+  g_assert_cmpuint (num_head_entries, ==, 99);
+  g_assert_cmpuint (num_tail_entries, ==, 100);
+
+  g_array_free (counts, TRUE);
+}
+
+TESTCASE (prefetching_should_not_affect_execution)
+{
+  guint i;
+  GumStalkerCodeCacheStats stats;
+
+  gum_stalker_set_prefetch_enabled (fixture->stalker, TRUE);
+  g_assert_true (gum_stalker_get_prefetch_enabled (fixture->stalker));
+
+  for (i = 0; i != 10; i++)
+  {
+    invoke_jumpy (fixture, GUM_COMPILE);
+    invoke_flat (fixture, GUM_NOTHING);
+  }
+
+  if (gum_query_rwx_support () != GUM_RWX_NONE)
+  {
+    fixture->sink->mask = GUM_NOTHING;
+
+    gum_stalker_follow_me (fixture->stalker, fixture->transformer,
+        GUM_EVENT_SINK (fixture->sink));
+    wait_for_prefetch (fixture->stalker);
+    gum_stalker_unfollow_me (fixture->stalker);
+
+    gum_stalker_query_code_cache_stats (fixture->stalker, &stats);
+    g_assert_cmpuint (stats.prefetched_blocks, >, 0);
+  }
+
+  gum_stalker_set_prefetch_enabled (fixture->stalker, FALSE);
+  g_assert_false (gum_stalker_get_prefetch_enabled (fixture->stalker));
+}
+
+static void
+wait_for_prefetch (GumStalker * stalker)
+{
+  gint64 deadline;
+  GumStalkerCodeCacheStats stats;
+
+  deadline = g_get_monotonic_time () + G_USEC_PER_SEC;
+
+  do
+  {
+    g_thread_yield ();
+
+    gum_stalker_query_code_cache_stats (stalker, &stats);
+  }
+  while (stats.prefetched_blocks == 0 && g_get_monotonic_time () < deadline);
+}
+
+TESTCASE (dual_mapping_should_not_affect_execution)
+{
+  guint i;
+
+  if (!gum_memory_can_dual_map ())
+  {
+    g_print ("<skipping, not supported> ");
+    return;
+  }
+
+  gum_stalker_set_dual_mapping_enabled (fixture->stalker, TRUE);
+  g_assert_true (gum_stalker_get_dual_mapping_enabled (fixture->stalker));
+
+  for (i = 0; i != 10; i++)
+  {
+    invoke_jumpy (fixture, GUM_COMPILE);
+    invoke_flat (fixture, GUM_NOTHING);
+  }
+
+  gum_stalker_flush (fixture->stalker);
+  gum_stalker_stop (fixture->stalker);
+  while (gum_stalker_garbage_collect (fixture->stalker))
+    g_usleep (10000);
+
+  gum_stalker_set_dual_mapping_enabled (fixture->stalker, FALSE);
+  g_assert_false (gum_stalker_get_dual_mapping_enabled (fixture->stalker));
+}
+
+typedef struct _CallStackContext CallStackContext;
+
+struct _CallStackContext
+{
+  GumStalker * stalker;
+  GArray * call_stack;
+};
+
+TESTCASE (shadow_stack_should_track_calls)
+{
+  CallStackContext ctx;
+
+  ctx.stalker = fixture->stalker;
+  ctx.call_stack = NULL;
+
+  gum_stalker_set_shadow_stack_enabled (fixture->stalker, TRUE);
+  g_assert_true (gum_stalker_get_shadow_stack_enabled (fixture->stalker));
+
+  fixture->transformer = gum_stalker_transformer_make_from_callback (
+      insert_call_stack_snapshot_before_ret, &ctx, NULL);
+
+  invoke_flat (fixture, GUM_NOTHING);
+  invoke_flat (fixture, GUM_NOTHING);
+
+  g_assert_nonnull (ctx.call_stack);
+  g_assert_cmpuint (ctx.call_stack->len, >=, 1);
+  GUM_ASSERT_CMPADDR (g_array_index (ctx.call_stack, gpointer, 0), ==,
+      fixture->last_invoke_retaddr);
+  g_array_unref (ctx.call_stack);
+
+  gum_stalker_set_shadow_stack_enabled (fixture->stalker, FALSE);
+}
+
+static void
+insert_call_stack_snapshot_before_ret (GumStalkerIterator * iterator,
+                                       GumStalkerOutput * output,
+                                       gpointer user_data)
+{
+  const cs_insn * insn;
+  gboolean in_leaf_func;
+
+  in_leaf_func = FALSE;
+
+  while (gum_stalker_iterator_next (iterator, &insn))
+  {
+    if (in_leaf_func && insn->id == X86_INS_RET)
+    {
+      gum_stalker_iterator_put_callout (iterator, snapshot_call_stack,
+          user_data, NULL);
+    }
+
+    gum_stalker_iterator_keep (iterator);
+
+    if (insn->id == X86_INS_XOR)
+      in_leaf_func = TRUE;
+  }
+}
+
+static void
+snapshot_call_stack (GumCpuContext * cpu_context,
+                     gpointer user_data)
+{
+  CallStackContext * ctx = user_data;
+
+  if (ctx->call_stack != NULL)
+    g_array_unref (ctx->call_stack);
+  ctx->call_stack = gum_stalker_snapshot_call_stack (ctx->stalker);
+}
+
 TESTCASE (unfollow_should_be_allowed_before_first_transform)
 {
   UnfollowTransformContext ctx;
@@ -2390,6 +2901,51 @@ TESTCASE (big_block)
   test_stalker_fixture_follow_and_invoke (fixture, func, -1);
 }
 
+TESTCASE (code_cache_budget_should_trigger_eviction)
+{
+  const guint block_count = 65536;
+  const guint8 jmp_to_next[] = {
+    0xeb, 0x00 /* jmp short +0 */
+  };
+  guint8 * code;
+  GumX86Writer cw;
+  guint i;
+  StalkerTestFunc func;
+  GumStalkerCodeCacheStats stats;
+
+  code = gum_alloc_n_pages (
+      ((block_count * sizeof (jmp_to_next)) / gum_query_page_size ()) + 1,
+      GUM_PAGE_RW);
+  gum_x86_writer_init (&cw, code);
+
+  for (i = 0; i != block_count; i++)
+    gum_x86_writer_put_bytes (&cw, jmp_to_next, sizeof (jmp_to_next));
+  gum_x86_writer_put_mov_reg_u32 (&cw, GUM_REG_EAX, 1337);
+  gum_x86_writer_put_ret (&cw);
+
+  gum_x86_writer_flush (&cw);
+  gum_memory_mark_code (cw.base, gum_x86_writer_offset (&cw));
+
+  func = GUM_POINTER_TO_FUNCPTR (StalkerTestFunc,
+      test_stalker_fixture_dup_code (fixture, code,
+          gum_x86_writer_offset (&cw)));
+
+  gum_x86_writer_clear (&cw);
+  gum_free_pages (code);
+
+  gum_stalker_set_code_cache_budget (fixture->stalker, 1);
+  g_assert_cmpuint (gum_stalker_get_code_cache_budget (fixture->stalker), ==,
+      1);
+
+  g_assert_cmpint (test_stalker_fixture_follow_and_invoke (fixture, func, 0),
+      ==, 1337);
+
+  gum_stalker_query_code_cache_stats (fixture->stalker, &stats);
+  g_assert_cmpuint (stats.evictions, >=, 1);
+  g_assert_cmpuint (stats.evicted_blocks, >, 0);
+  g_assert_cmpuint (stats.evicted_bytes, >, 0);
+}
+
 #ifdef HAVE_WINDOWS
 
 typedef struct _TestWindow TestWindow;
@@ -6,6 +6,7 @@
 
 #include "guminterceptor.h"
 
+#include "gumcapstone.h"
 #include "interceptor-callbacklistener.h"
 #include "interceptor-functiondatalistener.h"
 #include "lowlevelhelpers.h"
@@ -28,6 +28,7 @@ TESTLIST_BEGIN (interceptor)
   TESTENTRY (attach_one)
   TESTENTRY (attach_two)
   TESTENTRY (attach_to_recursive_function)
+  TESTENTRY (attach_to_deeply_recursive_function)
   TESTENTRY (attach_to_special_function)
 #ifdef G_OS_UNIX
   TESTENTRY (attach_to_pthread_key_create)
@@ -36,6 +37,20 @@ TESTLIST_BEGIN (interceptor)
   TESTENTRY (attach_to_heap_api)
 #endif
   TESTENTRY (attach_to_own_api)
+#if defined (HAVE_LINUX) && !defined (HAVE_ANDROID)
+  TESTENTRY (attach_import)
+#endif
+  TESTENTRY (attach_many)
+  TESTENTRY (attach_many_performance)
+#ifdef HAVE_I386
+  TESTENTRY (attach_many_generated_functions_performance)
+#endif
+  TESTENTRY (attach_performance)
+  TESTENTRY (invocation_performance)
+  TESTENTRY (hook_stats)
+#ifdef HAVE_LINUX
+  TESTENTRY (attach_with_thread_suspension)
+#endif
 #ifdef HAVE_WINDOWS
   TESTENTRY (attach_detach_torture)
 #endif
@@ -66,6 +81,8 @@ TESTLIST_BEGIN (interceptor)
 # endif
 #endif
   TESTENTRY (replace_then_attach)
+  TESTENTRY (replace_fast)
+  TESTENTRY (replace_fast_then_attach)
 
 #ifdef HAVE_QNX
   TESTENTRY (intercept_malloc_and_create_thread)
@@ -79,8 +96,63 @@ static gpointer thread_calling_pthread_setspecific (gpointer data);
 #ifdef HAVE_WINDOWS
 static gpointer hit_target_function_repeatedly (gpointer data);
 #endif
+#ifdef HAVE_LINUX
+static gpointer hit_target_nop_function_repeatedly (gpointer data);
+#endif
+static void count_invocation (guint * count, GumInvocationContext * context);
+static gdouble measure_attach_and_detach (GumInterceptor * interceptor,
+    GumInvocationListener * listener, guint num_rounds);
+static gboolean find_hook_stats (const GumHookStats * stats,
+    GumHookStats * result);
 static gpointer replacement_malloc (gsize size);
 static gpointer replacement_target_function (GString * str);
+static gpointer replacement_target_function_fast (GString * str);
+
+static gpointer (* target_function_original) (GString * str) = NULL;
+
+/*
+ * Plain C library functions that neither the interceptor nor the test harness
+ * call while hooks are being applied, so hooking them is safe.
+ */
+static const gchar * attach_many_safe_function_names[] =
+{
+  "abs",
+  "labs",
+  "llabs",
+  "div",
+  "ldiv",
+  "atoi",
+  "atol",
+  "atof",
+  "strtod",
+  "strtof",
+  "strtoul",
+  "strtoull",
+  "strspn",
+  "strcspn",
+  "strpbrk",
+  "strtok",
+  "strncat",
+  "strcoll",
+  "strxfrm",
+  "toupper",
+  "tolower",
+  "isalnum",
+  "isalpha",
+  "isxdigit",
+  "ispunct",
+  "bsearch",
+  "rand",
+  "srand",
+  "difftime",
+  "mktime",
+  "asctime",
+  "wcslen",
+  "wcscmp",
+  "wcsncpy",
+  "mbstowcs",
+  "wcstombs",
+};
 
 TESTCASE (attach_one)
 {
@@ -114,6 +186,25 @@ TESTCASE (attach_to_recursive_function)
   g_assert_cmpstr (fixture->result->str, ==, ">>>>>0<1<2<3<4<");
 }
 
+TESTCASE (attach_to_deeply_recursive_function)
+{
+  const gint depth = 3 * GUM_MAX_CALL_DEPTH;
+  GString * expected;
+  gint i;
+
+  expected = g_string_new ("");
+  for (i = 0; i <= depth; i++)
+    g_string_append_c (expected, '>');
+  for (i = 0; i <= depth; i++)
+    g_string_append_printf (expected, "%d<", i);
+
+  interceptor_fixture_attach (fixture, 0, recursive_function, '>', '<');
+  recursive_function (fixture->result, depth);
+  g_assert_cmpstr (fixture->result->str, ==, expected->str);
+
+  g_string_free (expected, TRUE);
+}
+
 TESTCASE (attach_to_special_function)
 {
   interceptor_fixture_attach (fixture, 0, special_function, '>', '<');
@@ -169,6 +260,67 @@ TESTCASE (attach_to_heap_api)
   g_assert_cmpstr (fixture->result->str, ==, "><ab");
 }
 
+#if defined (HAVE_LINUX) && !defined (HAVE_ANDROID)
+
+TESTCASE (attach_import)
+{
+  GumInterceptor * interceptor = fixture->interceptor;
+  TestCallbackListener * listener;
+  guint count = 0;
+  volatile gpointer p;
+  gchar * (* strdup_impl) (const gchar * str);
+
+  if (RUNNING_ON_VALGRIND)
+  {
+    g_print ("<skipping, not compatible with Valgrind> ");
+    return;
+  }
+
+  strdup_impl = GSIZE_TO_POINTER (gum_module_find_export_by_name (
+      SYSTEM_MODULE_NAME, "strdup"));
+  g_assert_nonnull (strdup_impl);
+
+  listener = test_callback_listener_new ();
+  listener->on_enter = (TestCallbackListenerFunc) count_invocation;
+  listener->user_data = &count;
+
+  gum_interceptor_ignore_other_threads (interceptor);
+
+  g_assert_cmpint (gum_interceptor_attach_import (interceptor,
+      GUM_TESTS_MODULE_NAME, "nonexistent_import",
+      GUM_INVOCATION_LISTENER (listener), NULL), ==, GUM_ATTACH_NOT_FOUND);
+
+  g_assert_cmpint (gum_interceptor_attach_import (interceptor,
+      GUM_TESTS_MODULE_NAME, "malloc", GUM_INVOCATION_LISTENER (listener),
+      NULL), ==, GUM_ATTACH_OK);
+  g_assert_cmpint (gum_interceptor_attach_import (interceptor,
+      GUM_TESTS_MODULE_NAME, "malloc", GUM_INVOCATION_LISTENER (listener),
+      NULL), ==, GUM_ATTACH_ALREADY_ATTACHED);
+
+  p = malloc (1);
+  free (p);
+  g_assert_cmpuint (count, >=, 1);
+
+  /* The system library's own calls to malloc() go through its own slot. */
+  count = 0;
+  p = strdup_impl ("x");
+  free (p);
+  g_assert_cmpuint (count, ==, 0);
+
+  gum_interceptor_detach (interceptor, GUM_INVOCATION_LISTENER (listener));
+
+  count = 0;
+  p = malloc (1);
+  free (p);
+  g_assert_cmpuint (count, ==, 0);
+
+  gum_interceptor_unignore_other_threads (interceptor);
+
+  g_object_unref (listener);
+}
+
+#endif
+
 TESTCASE (attach_to_own_api)
 {
   TestCallbackListener * listener;
@@ -189,6 +341,405 @@ TESTCASE (attach_to_own_api)
   g_object_unref (listener);
 }
 
+TESTCASE (attach_many)
+{
+  TestCallbackListener * listener;
+  guint count = 0;
+  gpointer functions[4];
+  GumAttachReturn results[G_N_ELEMENTS (functions)];
+  guint num_attached;
+
+  listener = test_callback_listener_new ();
+  listener->on_enter = (TestCallbackListenerFunc) count_invocation;
+  listener->user_data = &count;
+
+  functions[0] = target_nop_function_c;
+  functions[1] = target_nop_function_a;
+  functions[2] = target_nop_function_b;
+  functions[3] = target_nop_function_a;
+
+  num_attached = gum_interceptor_attach_many (fixture->interceptor, functions,
+      G_N_ELEMENTS (functions), GUM_INVOCATION_LISTENER (listener), NULL,
+      results);
+  g_assert_cmpuint (num_attached, ==, 3);
+  g_assert_cmpint (results[0], ==, GUM_ATTACH_OK);
+  g_assert_cmpint (results[1], ==, GUM_ATTACH_OK);
+  g_assert_cmpint (results[2], ==, GUM_ATTACH_OK);
+  g_assert_cmpint (results[3], ==, GUM_ATTACH_ALREADY_ATTACHED);
+
+  target_nop_function_a (NULL);
+  target_nop_function_b (NULL);
+  target_nop_function_c (NULL);
+  g_assert_cmpuint (count, ==, 3);
+
+  gum_interceptor_detach (fixture->interceptor,
+      GUM_INVOCATION_LISTENER (listener));
+
+  target_nop_function_a (NULL);
+  g_assert_cmpuint (count, ==, 3);
+
+  g_object_unref (listener);
+}
+
+TESTCASE (attach_many_performance)
+{
+  const guint num_rounds = 100;
+  GArray * functions;
+  TestCallbackListener * listener;
+  GTimer * timer;
+  gdouble batch_elapsed, loop_elapsed;
+  guint num_attached = 0;
+  guint round, i;
+
+  if (!g_test_slow ())
+  {
+    g_print ("<skipping, run in slow mode> ");
+    return;
+  }
+
+  functions = g_array_new (FALSE, FALSE, sizeof (gpointer));
+  for (i = 0; i != G_N_ELEMENTS (attach_many_safe_function_names); i++)
+  {
+    gpointer address;
+
+    address = GSIZE_TO_POINTER (gum_module_find_export_by_name (NULL,
+        attach_many_safe_function_names[i]));
+    if (address != NULL)
+      g_array_append_val (functions, address);
+  }
+  if (functions->len == 0)
+  {
+    g_print ("<skipping, no functions found> ");
+    g_array_free (functions, TRUE);
+    return;
+  }
+
+  listener = test_callback_listener_new ();
+
+  timer = g_timer_new ();
+
+  batch_elapsed = 0.0;
+  for (round = 0; round != num_rounds; round++)
+  {
+    g_timer_start (timer);
+    num_attached = gum_interceptor_attach_many (fixture->interceptor,
+        (const gpointer *) functions->data, functions->len,
+        GUM_INVOCATION_LISTENER (listener), NULL, NULL);
+    batch_elapsed += g_timer_elapsed (timer, NULL);
+
+    g_assert_cmpuint (num_attached, >, 0);
+
+    gum_interceptor_detach (fixture->interceptor,
+        GUM_INVOCATION_LISTENER (listener));
+  }
+
+  loop_elapsed = 0.0;
+  for (round = 0; round != num_rounds; round++)
+  {
+    g_timer_start (timer);
+    for (i = 0; i != functions->len; i++)
+    {
+      gum_interceptor_attach (fixture->interceptor,
+          g_array_index (functions, gpointer, i),
+          GUM_INVOCATION_LISTENER (listener), NULL);
+    }
+    loop_elapsed += g_timer_elapsed (timer, NULL);
+
+    gum_interceptor_detach (fixture->interceptor,
+        GUM_INVOCATION_LISTENER (listener));
+  }
+
+  g_timer_destroy (timer);
+
+  g_print ("<%u of %u functions, per attach: attach_many %.2f us, "
+      "attach %.2f us> ", num_attached, functions->len,
+      (batch_elapsed * G_USEC_PER_SEC) / (num_rounds * functions->len),
+      (loop_elapsed * G_USEC_PER_SEC) / (num_rounds * functions->len));
+
+  g_object_unref (listener);
+  g_array_free (functions, TRUE);
+}
+
+#ifdef HAVE_I386
+
+TESTCASE (attach_many_generated_functions_performance)
+{
+  const guint num_functions = 5000;
+  const gsize function_size = 32;
+  guint num_pages;
+  guint8 * code;
+  gpointer * functions;
+  TestCallbackListener * listener;
+  GTimer * timer;
+  gdouble batch_elapsed, loop_elapsed;
+  guint num_attached, i;
+
+  if (!g_test_slow ())
+  {
+    g_print ("<skipping, run in slow mode> ");
+    return;
+  }
+
+  num_pages = (num_functions * function_size) / gum_query_page_size () + 1;
+  code = gum_alloc_n_pages (num_pages, GUM_PAGE_RWX);
+  functions = g_new (gpointer, num_functions);
+  for (i = 0; i != num_functions; i++)
+  {
+    guint8 * function = code + (i * function_size);
+
+    memset (function, 0x90, function_size - 1);
+    function[function_size - 1] = 0xc3;
+
+    functions[i] = function;
+  }
+
+  listener = test_callback_listener_new ();
+
+  timer = g_timer_new ();
+
+  /*
+   * This goes first so that it gets to allocate all of its trampolines,
+   * whereas the loop below reuses the slices freed by the detach.
+   */
+  g_timer_start (timer);
+  num_attached = gum_interceptor_attach_many (fixture->interceptor, functions,
+      num_functions, GUM_INVOCATION_LISTENER (listener), NULL, NULL);
+  batch_elapsed = g_timer_elapsed (timer, NULL);
+  g_assert_cmpuint (num_attached, ==, num_functions);
+
+  gum_interceptor_detach (fixture->interceptor,
+      GUM_INVOCATION_LISTENER (listener));
+
+  g_timer_start (timer);
+  for (i = 0; i != num_functions; i++)
+  {
+    g_assert_cmpint (gum_interceptor_attach (fixture->interceptor,
+        functions[i], GUM_INVOCATION_LISTENER (listener), NULL),
+        ==, GUM_ATTACH_OK);
+  }
+  loop_elapsed = g_timer_elapsed (timer, NULL);
+
+  gum_interceptor_detach (fixture->interceptor,
+      GUM_INVOCATION_LISTENER (listener));
+
+  g_timer_destroy (timer);
+
+  g_print ("<%u functions, attach_many %.2f ms, attach %.2f ms> ",
+      num_functions, batch_elapsed * 1000.0, loop_elapsed * 1000.0);
+
+  g_object_unref (listener);
+  g_free (functions);
+  gum_free_pages (code);
+}
+
+#endif
+
+TESTCASE (attach_performance)
+{
+  const guint num_rounds = 10000;
+  TestCallbackListener * listener;
+  gdouble uncached_elapsed, cached_elapsed;
+
+  if (!g_test_slow ())
+  {
+    g_print ("<skipping, run in slow mode> ");
+    return;
+  }
+
+  listener = test_callback_listener_new ();
+
+  _gum_capstone_set_cache_enabled (FALSE);
+  uncached_elapsed = measure_attach_and_detach (fixture->interceptor,
+      GUM_INVOCATION_LISTENER (listener), num_rounds);
+  _gum_capstone_set_cache_enabled (TRUE);
+
+  cached_elapsed = measure_attach_and_detach (fixture->interceptor,
+      GUM_INVOCATION_LISTENER (listener), num_rounds);
+
+  g_print ("<per attach+detach: %.2f us without capstone cache, "
+      "%.2f us with> ",
+      (uncached_elapsed * G_USEC_PER_SEC) / num_rounds,
+      (cached_elapsed * G_USEC_PER_SEC) / num_rounds);
+
+  g_object_unref (listener);
+}
+
+TESTCASE (invocation_performance)
+{
+  const guint num_calls = 1000000;
+  TestCallbackListener * listener;
+  guint count = 0;
+  GTimer * timer;
+  guint i;
+
+  if (!g_test_slow ())
+  {
+    g_print ("<skipping, run in slow mode> ");
+    return;
+  }
+
+  listener = test_callback_listener_new ();
+  listener->on_enter = (TestCallbackListenerFunc) count_invocation;
+  listener->on_leave = (TestCallbackListenerFunc) count_invocation;
+  listener->user_data = &count;
+
+  g_assert_cmpint (gum_interceptor_attach (fixture->interceptor,
+      target_nop_function_a, GUM_INVOCATION_LISTENER (listener), NULL),
+      ==, GUM_ATTACH_OK);
+
+  timer = g_timer_new ();
+
+  for (i = 0; i != num_calls; i++)
+    target_nop_function_a (NULL);
+
+  g_print ("<%u calls in %u ms> ", num_calls,
+      (guint) (g_timer_elapsed (timer, NULL) * 1000.0));
+  g_timer_destroy (timer);
+
+  g_assert_cmpuint (count, ==, 2 * num_calls);
+
+  gum_interceptor_detach (fixture->interceptor,
+      GUM_INVOCATION_LISTENER (listener));
+
+  g_object_unref (listener);
+}
+
+TESTCASE (hook_stats)
+{
+  GumInterceptor * interceptor = fixture->interceptor;
+  TestCallbackListener * listener;
+  guint count = 0;
+  GumHookStats stats;
+
+  listener = test_callback_listener_new ();
+  listener->on_enter = (TestCallbackListenerFunc) count_invocation;
+  listener->user_data = &count;
+
+  g_assert_false (gum_interceptor_get_stats_enabled (interceptor));
+  g_assert_cmpint (gum_interceptor_attach (interceptor, target_nop_function_a,
+      GUM_INVOCATION_LISTENER (listener), NULL), ==, GUM_ATTACH_OK);
+
+  target_nop_function_a (NULL);
+
+  gum_interceptor_set_stats_enabled (interceptor, TRUE);
+  g_assert_true (gum_interceptor_get_stats_enabled (interceptor));
+
+  target_nop_function_a (NULL);
+  target_nop_function_a (NULL);
+
+  gum_interceptor_ignore_current_thread (interceptor);
+  target_nop_function_a (NULL);
+  gum_interceptor_unignore_current_thread (interceptor);
+
+  g_assert_cmpuint (count, ==, 3);
+
+  stats.function_address = target_nop_function_a;
+  stats.enter_count = G_MAXUINT64;
+  gum_interceptor_enumerate_stats (interceptor,
+      (GumFoundHookStatsFunc) find_hook_stats, &stats);
+  g_assert_cmpuint (stats.enter_count, ==, 2);
+  g_assert_cmpuint (stats.leave_count, ==, 2);
+  g_assert_cmpuint (stats.bypass_count, ==, 1);
+
+  gum_interceptor_reset_stats (interceptor);
+  gum_interceptor_set_stats_enabled (interceptor, FALSE);
+
+  target_nop_function_a (NULL);
+
+  stats.enter_count = G_MAXUINT64;
+  gum_interceptor_enumerate_stats (interceptor,
+      (GumFoundHookStatsFunc) find_hook_stats, &stats);
+  g_assert_cmpuint (stats.enter_count, ==, 0);
+  g_assert_cmpuint (stats.bypass_count, ==, 0);
+
+  gum_interceptor_detach (interceptor, GUM_INVOCATION_LISTENER (listener));
+  g_object_unref (listener);
+}
+
+static gboolean
+find_hook_stats (const GumHookStats * stats,
+                 GumHookStats * result)
+{
+  if (stats->function_address != result->function_address)
+    return TRUE;
+
+  *result = *stats;
+
+  return FALSE;
+}
+
+static void
+count_invocation (guint * count,
+                  GumInvocationContext * context)
+{
+  (*count)++;
+}
+
+static gdouble
+measure_attach_and_detach (GumInterceptor * interceptor,
+                           GumInvocationListener * listener,
+                           guint num_rounds)
+{
+  GTimer * timer;
+  gdouble elapsed;
+  guint i;
+
+  timer = g_timer_new ();
+
+  for (i = 0; i != num_rounds; i++)
+  {
+    g_assert_cmpint (gum_interceptor_attach (interceptor,
+        target_nop_function_a, listener, NULL), ==, GUM_ATTACH_OK);
+    gum_interceptor_detach (interceptor, listener);
+  }
+
+  elapsed = g_timer_elapsed (timer, NULL);
+  g_timer_destroy (timer);
+
+  return elapsed;
+}
+
+#ifdef HAVE_LINUX
+
+TESTCASE (attach_with_thread_suspension)
+{
+  GumInterceptor * interceptor = fixture->interceptor;
+  TestCallbackListener * listener;
+  volatile guint count = 0;
+  volatile gboolean done = FALSE;
+  GThread * th;
+  guint i;
+
+  th = g_thread_new ("interceptor-test-suspension",
+      hit_target_nop_function_repeatedly, (gpointer) &done);
+
+  listener = test_callback_listener_new ();
+  listener->on_enter = (TestCallbackListenerFunc) count_invocation;
+  listener->user_data = (gpointer) &count;
+
+  gum_interceptor_set_thread_suspension_enabled (interceptor, TRUE);
+  g_assert_true (gum_interceptor_get_thread_suspension_enabled (interceptor));
+
+  g_assert_cmpint (gum_interceptor_attach (interceptor,
+      target_nop_function_b, GUM_INVOCATION_LISTENER (listener), NULL),
+      ==, GUM_ATTACH_OK);
+
+  for (i = 0; i != 500 && count == 0; i++)
+    g_usleep (G_USEC_PER_SEC / 100);
+  g_assert_cmpuint (count, >, 0);
+
+  gum_interceptor_detach (interceptor, GUM_INVOCATION_LISTENER (listener));
+
+  gum_interceptor_set_thread_suspension_enabled (interceptor, FALSE);
+
+  done = TRUE;
+  g_thread_join (th);
+
+  g_object_unref (listener);
+}
+
+#endif
+
 #ifdef HAVE_WINDOWS
 
 TESTCASE (attach_detach_torture)
@@ -708,6 +1259,63 @@ replacement_target_function (GString * str)
   return result;
 }
 
+TESTCASE (replace_fast)
+{
+  gpointer original = NULL;
+
+  g_assert_cmpint (gum_interceptor_replace_fast (fixture->interceptor,
+      target_function, replacement_target_function_fast, &original),
+      ==, GUM_REPLACE_OK);
+  g_assert_nonnull (original);
+  g_assert_cmpint (gum_interceptor_replace_fast (fixture->interceptor,
+      target_function, replacement_target_function_fast, NULL),
+      ==, GUM_REPLACE_ALREADY_REPLACED);
+  g_assert_cmpint (gum_interceptor_replace (fixture->interceptor,
+      target_function, replacement_target_function, NULL),
+      ==, GUM_REPLACE_WRONG_TYPE);
+
+  target_function_original = original;
+  target_function (fixture->result);
+  g_assert_cmpstr (fixture->result->str, ==, "/|\\");
+
+  gum_interceptor_revert (fixture->interceptor, target_function);
+  target_function_original = NULL;
+
+  g_string_truncate (fixture->result, 0);
+  target_function (fixture->result);
+  g_assert_cmpstr (fixture->result->str, ==, "|");
+}
+
+TESTCASE (replace_fast_then_attach)
+{
+  TestCallbackListener * listener;
+
+  g_assert_cmpint (gum_interceptor_replace_fast (fixture->interceptor,
+      target_function, replacement_target_function_fast,
+      (gpointer *) &target_function_original), ==, GUM_REPLACE_OK);
+
+  listener = test_callback_listener_new ();
+  g_assert_cmpint (gum_interceptor_attach (fixture->interceptor,
+      target_function, GUM_INVOCATION_LISTENER (listener), NULL),
+      ==, GUM_ATTACH_WRONG_TYPE);
+  g_object_unref (listener);
+
+  gum_interceptor_revert (fixture->interceptor, target_function);
+  target_function_original = NULL;
+}
+
+static gpointer
+replacement_target_function_fast (GString * str)
+{
+  gpointer result;
+
+  g_string_append_c (str, '/');
+  result = target_function_original (str);
+  g_string_append_c (str, '\\');
+
+  return result;
+}
+
 TESTCASE (i_can_has_replaceability)
 {
   UnsupportedFunction * unsupported_functions;
@@ -804,6 +1412,21 @@ hit_target_function_repeatedly (gpointer data)
 
 #endif
 
+#ifdef HAVE_LINUX
+
+static gpointer
+hit_target_nop_function_repeatedly (gpointer data)
+{
+  volatile gboolean * done = data;
+
+  while (!*done)
+    target_nop_function_b (NULL);
+
+  return NULL;
+}
+
+#endif
+
 typedef gpointer (* MallocFunc) (gsize size);
 
 static gpointer
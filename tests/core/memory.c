@@ -30,6 +30,7 @@ TESTLIST_BEGIN (memory)
   TESTENTRY (alloc_n_pages_near_returns_aligned_rw_address_within_range)
   TESTENTRY (allocate_handles_alignment)
   TESTENTRY (allocate_near_handles_alignment)
+  TESTENTRY (allocate_near_handles_many_allocations)
   TESTENTRY (mprotect_handles_page_boundaries)
 TESTLIST_END ()
 
@@ -496,6 +497,62 @@ TESTCASE (allocate_near_handles_alignment)
   gum_memory_free (page, size);
 }
 
+TESTCASE (allocate_near_handles_many_allocations)
+{
+  GumAddressSpec as;
+  guint variable_on_stack;
+  gsize page_size;
+  gpointer pages[256];
+  guint round, i;
+#if !defined (HAVE_WINDOWS) && !defined (HAVE_DARWIN)
+  guint scans_before;
+#endif
+
+  as.near_address = &variable_on_stack;
+  as.max_distance = G_MAXINT32;
+
+  page_size = gum_query_page_size ();
+
+#if !defined (HAVE_WINDOWS) && !defined (HAVE_DARWIN)
+  scans_before = _gum_memory_backend_query_near_range_scans ();
+#endif
+
+  for (round = 0; round != 2; round++)
+  {
+    for (i = 0; i != G_N_ELEMENTS (pages); i++)
+    {
+      guint8 * page;
+      gsize actual_distance;
+
+      page = gum_memory_allocate_near (&as, page_size, page_size,
+          GUM_PAGE_RW);
+      g_assert_nonnull (page);
+
+      actual_distance = ABS (page - (guint8 *) as.near_address);
+      g_assert_cmpuint (actual_distance, <=, as.max_distance);
+
+      g_assert_cmpuint (page[0], ==, 0);
+      page[0] = 0x42;
+
+      pages[i] = page;
+    }
+
+    for (i = 0; i != G_N_ELEMENTS (pages); i += 2)
+      gum_memory_free (pages[i], page_size);
+    for (i = 1; i < G_N_ELEMENTS (pages); i += 2)
+      gum_memory_free (pages[i], page_size);
+  }
+
+#if !defined (HAVE_WINDOWS) && !defined (HAVE_DARWIN)
+  /*
+   * Reserving an arena may take one scan of the address space, after which
+   * every allocation should be carved out of it.
+   */
+  g_assert_cmpuint (
+      _gum_memory_backend_query_near_range_scans () - scans_before, <=, 1);
+#endif
+}
+
 TESTCASE (mprotect_handles_page_boundaries)
 {
   guint8 * pages;
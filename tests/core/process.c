@@ -34,6 +34,8 @@
 TESTLIST_BEGIN (process)
   TESTENTRY (process_threads)
   TESTENTRY (process_threads_exclude_cloaked)
+  TESTENTRY (process_threads_can_be_enumerated_without_cpu_context)
+  TESTENTRY (process_threads_can_be_modified_in_batch)
   TESTENTRY (process_modules)
   TESTENTRY (process_ranges)
   TESTENTRY (process_ranges_exclude_cloaked)
@@ -147,6 +149,8 @@ static GThread * create_sleeping_dummy_thread_sync (volatile gboolean * done,
 static gpointer sleeping_dummy (gpointer data);
 static gboolean thread_found_cb (const GumThreadDetails * details,
     gpointer user_data);
+static void count_modified_thread (GumThreadId thread_id,
+    GumCpuContext * cpu_context, gpointer user_data);
 static gboolean thread_check_cb (const GumThreadDetails * details,
     gpointer user_data);
 static gboolean module_found_cb (const GumModuleDetails * details,
@@ -224,6 +228,59 @@ TESTCASE (process_threads_exclude_cloaked)
   g_thread_join (thread);
 }
 
+TESTCASE (process_threads_can_be_enumerated_without_cpu_context)
+{
+  volatile gboolean done = FALSE;
+  GThread * thread;
+  TestThreadContext ctx;
+
+  if (!check_thread_enumeration_testable ())
+    return;
+
+  thread = create_sleeping_dummy_thread_sync (&done, &ctx.needle);
+
+  ctx.found = FALSE;
+  gum_process_enumerate_threads_full (GUM_THREAD_FLAGS_NONE, thread_check_cb,
+      &ctx);
+  g_assert_true (ctx.found);
+
+  done = TRUE;
+  g_thread_join (thread);
+}
+
+TESTCASE (process_threads_can_be_modified_in_batch)
+{
+  volatile gboolean done = FALSE;
+  GThread * thread_a, * thread_b;
+  GumThreadId thread_ids[2];
+  guint num_modified;
+
+  if (!check_thread_enumeration_testable ())
+    return;
+
+  thread_a = create_sleeping_dummy_thread_sync (&done, &thread_ids[0]);
+  thread_b = create_sleeping_dummy_thread_sync (&done, &thread_ids[1]);
+
+  num_modified = 0;
+  g_assert_cmpuint (gum_process_modify_threads (thread_ids,
+      G_N_ELEMENTS (thread_ids), count_modified_thread, &num_modified), ==, 2);
+  g_assert_cmpuint (num_modified, ==, 2);
+
+  done = TRUE;
+  g_thread_join (thread_b);
+  g_thread_join (thread_a);
+}
+
+static void
+count_modified_thread (GumThreadId thread_id,
+                       GumCpuContext * cpu_context,
+                       gpointer user_data)
+{
+  guint * num_modified = user_data;
+
+  (*num_modified)++;
+}
+
 static gboolean
 check_thread_enumeration_testable (void)
 {
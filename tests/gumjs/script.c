@@ -66,6 +66,8 @@ TESTLIST_BEGIN (script)
     TESTENTRY (invocations_provide_context_for_backtrace)
 #endif
     TESTENTRY (invocations_provide_context_serializable_to_json)
+    TESTENTRY (listener_can_be_attached_to_many_functions)
+    TESTENTRY (listener_stats_can_be_enumerated)
     TESTENTRY (listener_can_be_detached)
     TESTENTRY (listener_can_be_detached_by_destruction_mid_call)
     TESTENTRY (all_listeners_can_be_detached)
@@ -77,11 +79,13 @@ TESTLIST_BEGIN (script)
     TESTENTRY (interceptor_should_support_native_pointer_values)
     TESTENTRY (interceptor_should_handle_bad_pointers)
     TESTENTRY (interceptor_should_refuse_to_attach_without_any_callbacks)
+    TESTENTRY (interceptor_callbacks_can_be_isolated)
   TESTGROUP_END ()
   TESTGROUP_BEGIN ("Interceptor/Performance")
     TESTENTRY (interceptor_on_enter_performance)
     TESTENTRY (interceptor_on_leave_performance)
     TESTENTRY (interceptor_on_enter_and_leave_performance)
+    TESTENTRY (interceptor_isolated_callbacks_scaling_performance)
   TESTGROUP_END ()
 
   TESTGROUP_BEGIN ("Memory")
@@ -367,8 +371,11 @@ TESTLIST_BEGIN (script)
 
   TESTENTRY (script_can_be_compiled_to_bytecode)
   TESTENTRY (script_can_be_reloaded)
+  TESTENTRY (script_messages_can_be_batched)
   TESTENTRY (script_should_not_leak_if_destroyed_before_load)
   TESTENTRY (script_memory_usage)
+  TESTENTRY (script_startup_performance)
+  TESTENTRY (script_scheduler_job_throughput)
   TESTENTRY (source_maps_should_be_supported_for_our_runtime)
   TESTENTRY (source_maps_should_be_supported_for_user_scripts)
   TESTENTRY (types_handle_invalid_construction)
@@ -416,6 +423,9 @@ static size_t gum_pass_ssize (ssize_t ssz);
 static gboolean ignore_thread (GumInterceptor * interceptor);
 static gboolean unignore_thread (GumInterceptor * interceptor);
 
+static void count_scheduler_job (volatile gint * count);
+static gboolean count_idle_source (volatile gint * count);
+
 static gint gum_assert_variadic_uint8_values_are_sane (gpointer a, gpointer b,
     gpointer c, gpointer d, ...);
 static gint gum_clobber_system_error (gint value);
@@ -461,6 +471,8 @@ static gboolean resume_all_threads (const GumThreadDetails * details,
 #endif
 
 static void measure_target_function_int_overhead (void);
+static gdouble measure_target_function_int_throughput (guint num_threads);
+static gpointer hammer_target_function_int (gpointer data);
 static int compare_measurements (gconstpointer element_a,
     gconstpointer element_b);
 
@@ -5507,6 +5519,63 @@ TESTCASE (invocations_provide_context_serializable_to_json)
   EXPECT_NO_MESSAGES ();
 }
 
+TESTCASE (listener_can_be_attached_to_many_functions)
+{
+  COMPILE_AND_LOAD_SCRIPT (
+      "const listener = Interceptor.attachMany(["
+      "  " GUM_PTR_CONST ","
+      "  " GUM_PTR_CONST
+      "], {"
+      "  onEnter(args) {"
+      "    send('enter');"
+      "  }"
+      "});"
+      ""
+      "recv('detach', () => {"
+      "  listener.detach();"
+      "});",
+      target_function_int, target_function_string);
+
+  EXPECT_NO_MESSAGES ();
+  target_function_int (42);
+  EXPECT_SEND_MESSAGE_WITH ("\"enter\"");
+  target_function_string ("badger");
+  EXPECT_SEND_MESSAGE_WITH ("\"enter\"");
+  EXPECT_NO_MESSAGES ();
+
+  POST_MESSAGE ("{\"type\":\"detach\"}");
+  target_function_int (42);
+  target_function_string ("badger");
+  EXPECT_NO_MESSAGES ();
+}
+
+TESTCASE (listener_stats_can_be_enumerated)
+{
+  COMPILE_AND_LOAD_SCRIPT (
+      "const target = " GUM_PTR_CONST ";"
+      "Interceptor.attach(target, {"
+      "  onEnter(args) {"
+      "  }"
+      "});"
+      "Interceptor.enableStats();"
+      ""
+      "recv('query', () => {"
+      "  const s = Interceptor.enumerateStats()"
+      "      .filter(s => s.target.equals(target))[0];"
+      "  send([s.enters, s.leaves, s.bypasses, s.listenerTime >= 0]);"
+      "  Interceptor.resetStats();"
+      "  Interceptor.disableStats();"
+      "});",
+      target_function_int);
+
+  target_function_int (1);
+  target_function_int (2);
+
+  POST_MESSAGE ("{\"type\":\"query\"}");
+  EXPECT_SEND_MESSAGE_WITH ("[2,2,0,true]");
+  EXPECT_NO_MESSAGES ();
+}
+
 TESTCASE (listener_can_be_detached)
 {
   COMPILE_AND_LOAD_SCRIPT (
@@ -5754,6 +5823,39 @@ TESTCASE (interceptor_should_refuse_to_attach_without_any_callbacks)
       "Error: expected at least one callback");
 }
 
+TESTCASE (interceptor_callbacks_can_be_isolated)
+{
+  if (!GUM_QUICK_IS_SCRIPT_BACKEND (fixture->backend))
+  {
+    g_print ("<skipped due to runtime> ");
+    return;
+  }
+
+  COMPILE_AND_LOAD_SCRIPT (
+      "recv(function onMessage(message) {"
+      "  send(message.value);"
+      "  recv(onMessage);"
+      "});"
+      ""
+      "Interceptor.attach(" GUM_PTR_CONST ", {"
+      "  isolated: true,"
+      "  onEnter(args) {"
+      "    this.value = args[0].toInt32();"
+      "    send(this.value);"
+      "  },"
+      "  onLeave(retval) {"
+      "    Isolate.post({ value: this.value + retval.toInt32() });"
+      "  }"
+      "});",
+      target_function_int);
+
+  EXPECT_NO_MESSAGES ();
+  target_function_int (7);
+  EXPECT_SEND_MESSAGE_WITH ("7");
+  EXPECT_SEND_MESSAGE_WITH ("322");
+  EXPECT_NO_MESSAGES ();
+}
+
 TESTCASE (interceptor_on_enter_performance)
 {
   COMPILE_AND_LOAD_SCRIPT (
@@ -5804,6 +5906,93 @@ TESTCASE (interceptor_on_enter_and_leave_performance)
 #endif
 }
 
+TESTCASE (interceptor_isolated_callbacks_scaling_performance)
+{
+  const guint max_threads = MIN (g_get_num_processors (), 8);
+  guint isolated;
+
+  if (!GUM_QUICK_IS_SCRIPT_BACKEND (fixture->backend))
+  {
+    g_print ("<skipped due to runtime> ");
+    return;
+  }
+
+  if (!g_test_slow ())
+  {
+    g_print ("<skipping, run in slow mode> ");
+    return;
+  }
+
+  for (isolated = 0; isolated != 2; isolated++)
+  {
+    guint num_threads;
+
+    COMPILE_AND_LOAD_SCRIPT (
+        "Interceptor.attach(" GUM_PTR_CONST ", {"
+        "  isolated: %s,"
+        "  onEnter(args) {"
+        "    this.value = args[0].toInt32();"
+        "  },"
+        "  onLeave(retval) {"
+        "    retval.replace(this.value);"
+        "  }"
+        "});",
+        target_function_int, isolated ? "true" : "false");
+
+    g_print ("<%s:", isolated ? "isolated" : "shared");
+    for (num_threads = 1; num_threads <= max_threads; num_threads *= 2)
+    {
+      g_print (" %u thread%s=%.0f calls/s", num_threads,
+          (num_threads == 1) ? "" : "s",
+          measure_target_function_int_throughput (num_threads));
+    }
+    g_print ("> ");
+
+    UNLOAD_SCRIPT ();
+  }
+}
+
+#define GUM_HAMMER_ITERATIONS 20000
+
+static gdouble
+measure_target_function_int_throughput (guint num_threads)
+{
+  GThread ** threads;
+  GTimer * timer;
+  gdouble elapsed;
+  guint i;
+
+  threads = g_newa (GThread *, num_threads);
+
+  timer = g_timer_new ();
+
+  for (i = 0; i != num_threads; i++)
+  {
+    threads[i] = g_thread_new ("script-test-hammer", hammer_target_function_int,
+        NULL);
+  }
+
+  for (i = 0; i != num_threads; i++)
+    g_thread_join (threads[i]);
+
+  elapsed = g_timer_elapsed (timer, NULL);
+
+  g_timer_destroy (timer);
+
+  return (gdouble) (num_threads * GUM_HAMMER_ITERATIONS) / elapsed;
+}
+
+static gpointer
+hammer_target_function_int (gpointer data)
+{
+  guint i;
+
+  for (i = 0; i != GUM_HAMMER_ITERATIONS; i++)
+    target_function_int (7);
+
+  return NULL;
+}
+
 static void
 measure_target_function_int_overhead (void)
 {
@@ -8126,68 +8315,45 @@ TESTCASE (script_can_be_compiled_to_bytecode)
   GError * error;
   GBytes * code;
   GumScript * script;
+  TestScriptMessageItem * item;
 
   error = NULL;
   code = gum_script_backend_compile_sync (fixture->backend, "testcase",
       "send(1337);\noops;", NULL, &error);
-  if (GUM_QUICK_IS_SCRIPT_BACKEND (fixture->backend))
-  {
-    g_assert_nonnull (code);
-    g_assert_null (error);
-
-    g_assert_null (gum_script_backend_compile_sync (fixture->backend,
-        "failcase1", "'", NULL, NULL));
-
-    g_assert_null (gum_script_backend_compile_sync (fixture->backend,
-        "failcase2", "'", NULL, &error));
-    g_assert_nonnull (error);
-    g_assert_true (g_str_has_prefix (error->message,
-        "Script(line 1): SyntaxError: "));
-    g_clear_error (&error);
-  }
-  else
-  {
-    g_assert_null (code);
-    g_assert_nonnull (error);
-    g_assert_cmpstr (error->message, ==, "not yet supported by the V8 runtime");
-    g_clear_error (&error);
+  g_assert_nonnull (code);
+  g_assert_null (error);
 
-    code = g_bytes_new (NULL, 0);
-  }
+  g_assert_null (gum_script_backend_compile_sync (fixture->backend,
+      "failcase1", "'", NULL, NULL));
+
+  g_assert_null (gum_script_backend_compile_sync (fixture->backend,
+      "failcase2", "'", NULL, &error));
+  g_assert_nonnull (error);
+  g_assert_true (g_str_has_prefix (error->message,
+      "Script(line 1): SyntaxError: "));
+  g_clear_error (&error);
 
   script = gum_script_backend_create_from_bytes_sync (fixture->backend, code,
       NULL, &error);
-  if (GUM_QUICK_IS_SCRIPT_BACKEND (fixture->backend))
-  {
-    TestScriptMessageItem * item;
-
-    g_assert_nonnull (script);
-    g_assert_null (error);
+  g_assert_nonnull (script);
+  g_assert_null (error);
 
-    gum_script_set_message_handler (script, test_script_fixture_store_message,
-        fixture, NULL);
+  gum_script_set_message_handler (script, test_script_fixture_store_message,
+      fixture, NULL);
 
-    gum_script_load_sync (script, NULL);
+  gum_script_load_sync (script, NULL);
 
-    EXPECT_SEND_MESSAGE_WITH ("1337");
+  EXPECT_SEND_MESSAGE_WITH ("1337");
 
-    item = test_script_fixture_pop_message (fixture);
-    g_assert_nonnull (strstr (item->message, "ReferenceError"));
-    g_assert_null (strstr (item->message, "agent.js"));
-    g_assert_nonnull (strstr (item->message, "testcase.js"));
-    test_script_message_item_free (item);
+  item = test_script_fixture_pop_message (fixture);
+  g_assert_nonnull (strstr (item->message, "ReferenceError"));
+  g_assert_null (strstr (item->message, "agent.js"));
+  g_assert_nonnull (strstr (item->message, "testcase.js"));
+  test_script_message_item_free (item);
 
-    EXPECT_NO_MESSAGES ();
+  EXPECT_NO_MESSAGES ();
 
-    g_object_unref (script);
-  }
-  else
-  {
-    g_assert_null (script);
-    g_assert_nonnull (error);
-    g_assert_cmpstr (error->message, ==, "not yet supported by the V8 runtime");
-    g_clear_error (&error);
-  }
+  g_object_unref (script);
 
   g_bytes_unref (code);
 }
@@ -8207,6 +8373,57 @@ TESTCASE (script_can_be_reloaded)
   EXPECT_SEND_MESSAGE_WITH ("\"undefined\"");
 }
 
+TESTCASE (script_messages_can_be_batched)
+{
+  const gchar * first_message = "{\"type\":\"send\",\"payload\":1}";
+  const gchar * second_message = "{\"type\":\"send\",\"payload\":2}";
+  GumScript * script;
+  TestScriptMessageItem * item;
+  const guint8 * frame;
+  gsize frame_size;
+  guint32 message_size, data_size;
+
+  script = gum_script_backend_create_sync (fixture->backend, "testcase",
+      "send(1);"
+      "send(2, new Uint8Array([0x13, 0x37]).buffer);",
+      NULL, NULL);
+  fixture->script = script;
+
+  gum_script_set_message_handler (script, test_script_fixture_store_message,
+      fixture, NULL);
+  gum_script_set_message_batching (script, 4096, 50);
+
+  gum_script_load_sync (script, NULL);
+
+  item = test_script_fixture_pop_message (fixture);
+  g_assert_cmpstr (item->message, ==, "{\"type\":\"batch\",\"count\":2}");
+  g_assert_nonnull (item->raw_data);
+
+  frame = g_bytes_get_data (item->raw_data, &frame_size);
+  g_assert_cmpuint (frame_size, ==, 8 + strlen (first_message) +
+      8 + strlen (second_message) + 2);
+
+  memcpy (&message_size, frame, sizeof (message_size));
+  memcpy (&data_size, frame + 4, sizeof (data_size));
+  g_assert_cmpuint (GUINT32_FROM_LE (message_size), ==, strlen (first_message));
+  g_assert_cmpuint (GUINT32_FROM_LE (data_size), ==, G_MAXUINT32);
+  g_assert_true (memcmp (frame + 8, first_message, message_size) == 0);
+  frame += 8 + message_size;
+
+  memcpy (&message_size, frame, sizeof (message_size));
+  memcpy (&data_size, frame + 4, sizeof (data_size));
+  g_assert_cmpuint (GUINT32_FROM_LE (message_size), ==,
+      strlen (second_message));
+  g_assert_cmpuint (GUINT32_FROM_LE (data_size), ==, 2);
+  g_assert_true (memcmp (frame + 8, second_message, message_size) == 0);
+  g_assert_cmphex (frame[8 + message_size], ==, 0x13);
+  g_assert_cmphex (frame[8 + message_size + 1], ==, 0x37);
+
+  test_script_message_item_free (item);
+
+  EXPECT_NO_MESSAGES ();
+}
+
 TESTCASE (script_should_not_leak_if_destroyed_before_load)
 {
   GumExceptor * held_instance;
@@ -8269,6 +8486,129 @@ TESTCASE (script_memory_usage)
   g_object_unref (script);
 }
 
+TESTCASE (script_startup_performance)
+{
+  const guint num_iterations = 100;
+  GumScript * script;
+  GTimer * timer;
+  gdouble create_time, load_time, unload_time;
+  guint i;
+
+  /* Warm up */
+  script = gum_script_backend_create_sync (fixture->backend, "testcase",
+      "const foo = 42;", NULL, NULL);
+  gum_script_load_sync (script, NULL);
+  gum_script_unload_sync (script, NULL);
+  g_object_unref (script);
+
+  timer = g_timer_new ();
+
+  create_time = 0;
+  load_time = 0;
+  unload_time = 0;
+
+  for (i = 0; i != num_iterations; i++)
+  {
+    g_timer_reset (timer);
+    script = gum_script_backend_create_sync (fixture->backend, "testcase",
+        "const foo = 42;", NULL, NULL);
+    create_time += g_timer_elapsed (timer, NULL);
+
+    g_timer_reset (timer);
+    gum_script_load_sync (script, NULL);
+    load_time += g_timer_elapsed (timer, NULL);
+
+    g_timer_reset (timer);
+    gum_script_unload_sync (script, NULL);
+    unload_time += g_timer_elapsed (timer, NULL);
+
+    g_object_unref (script);
+  }
+
+  g_print ("<create=%u us load=%u us unload=%u us> ",
+      (guint) (create_time * 1000000.0 / num_iterations),
+      (guint) (load_time * 1000000.0 / num_iterations),
+      (guint) (unload_time * 1000000.0 / num_iterations));
+
+  g_timer_destroy (timer);
+}
+
+TESTCASE (script_scheduler_job_throughput)
+{
+  const gint num_jobs = 100000;
+  GTimer * timer;
+  volatile gint count;
+  gint i;
+  GumScriptScheduler * scheduler;
+  gdouble scheduler_time, idle_time;
+  GMainContext * context;
+  GMainLoop * loop;
+  GThread * thread;
+
+  timer = g_timer_new ();
+
+  scheduler = gum_script_scheduler_new ();
+
+  count = 0;
+  g_timer_reset (timer);
+  for (i = 0; i != num_jobs; i++)
+  {
+    gum_script_scheduler_push_job_on_js_thread (scheduler, G_PRIORITY_DEFAULT,
+        (GumScriptJobFunc) count_scheduler_job, (gpointer) &count, NULL);
+  }
+  while (g_atomic_int_get (&count) != num_jobs)
+    g_thread_yield ();
+  scheduler_time = g_timer_elapsed (timer, NULL);
+
+  g_object_unref (scheduler);
+
+  context = g_main_context_new ();
+  loop = g_main_loop_new (context, FALSE);
+  thread = g_thread_new ("idle-source-loop", (GThreadFunc) g_main_loop_run,
+      loop);
+
+  count = 0;
+  g_timer_reset (timer);
+  for (i = 0; i != num_jobs; i++)
+  {
+    GSource * source;
+
+    source = g_idle_source_new ();
+    g_source_set_callback (source, (GSourceFunc) count_idle_source,
+        (gpointer) &count, NULL);
+    g_source_attach (source, context);
+    g_source_unref (source);
+  }
+  while (g_atomic_int_get (&count) != num_jobs)
+    g_thread_yield ();
+  idle_time = g_timer_elapsed (timer, NULL);
+
+  g_main_loop_quit (loop);
+  g_thread_join (thread);
+  g_main_loop_unref (loop);
+  g_main_context_unref (context);
+
+  g_print ("<scheduler=%u ms idle sources=%u ms> ",
+      (guint) (scheduler_time * 1000.0),
+      (guint) (idle_time * 1000.0));
+
+  g_timer_destroy (timer);
+}
+
+static void
+count_scheduler_job (volatile gint * count)
+{
+  g_atomic_int_inc (count);
+}
+
+static gboolean
+count_idle_source (volatile gint * count)
+{
+  g_atomic_int_inc (count);
+
+  return FALSE;
+}
+
 TESTCASE (source_maps_should_be_supported_for_our_runtime)
 {
   TestScriptMessageItem * item;